@@ -12,7 +12,7 @@
 /*!< note: u can use wifi and xbee at the same time, so both of these handles can be set */
 /*!< at the same time */
 #define MQTT 1                                 /*!< set this to 1 if using MQTT for telemetry transfer */
-#define XBEE 1                                 /*!< set to 1 if using XBEE for telemetry transfer */
+#define XBEE 0                                 /*!< set to 1 if using XBEE for telemetry transfer - confirm XBEE_RX_PIN and XBEE_TX_PIN against the board first */
 
 #define BAUDRATE        115200
 #define GPS_BAUD_RATE 9600                     /*!< baud rate for the GPS module. Change accordingly */
@@ -22,6 +22,8 @@
 #define DEBUGGING 1                           /*!< allow debugging to terminal. Set to 0 pre flight to disable serial terminal printing and improve speed  */
 #define LOG_TO_MEMORY 0                       /*!< allow data logging to memory. Set to 1 to log data to external flash memory. Must be set during flight */
 #define DEBUG_TO_TERMINAL 0                   /*!< allow create task that prints data to terminal. Set o 0 before flight  */
+#define TASK_PROFILING 1                      /*!< time the task loop bodies, see task_profiler.h. Set to 0 to compile the profiler out */
+#define LATENCY_TRACING 1                     /*!< trace sample latency from acquisition to flash and radio, see latency_trace.h */
 
 #if DEBUGGING
     #define debug(x) Serial.print(x)
@@ -40,6 +42,13 @@
 #define MPU_ACCEL_RANGE 16
 #define GYRO_RANGE 1000 /* 1000 deg/s */
 
+/* I2C bus shared by the MPU6050 and the BMP180 - see i2c_bus.h */
+#define I2C_CLOCK           400000          /*!< SCL frequency in Hz, fast mode is the fastest both sensors take */
+#define I2C_TRANSFER_TIMEOUT 5              /*!< time in ms after which the Wire driver abandons a transfer */
+#define I2C_MAX_RETRIES     2               /*!< attempts after a failed transfer, with a bus recovery if SDA is stuck */
+#define I2C_WAIT_TIMEOUT    10              /*!< time in ms a sensor task waits for its transaction before skipping the sample */
+#define BMP180_OVERSAMPLING 3               /*!< pressure oversampling setting 0 to 3, 3 takes 25.5 ms */
+
 /* other pins */
 #define RED_LED_PIN         15               
 #define GREEN_LED_PIN       4
@@ -47,20 +56,50 @@
 #define SET_DAQ_MODE_PIN    14     /*!< Pin to set the flight computer to TEST mode */
 #define SET_TEST_MODE_PIN   13      /*!< Pin to set the flight computer to RUN mode */
 #define SD_CS_PIN           26
+#define DROGUE_PYRO_PIN     25
+#define MAIN_PYRO_PIN       12
+#define DROGUE_SENSE_PIN    -1     /*!< drogue e-match continuity input, -1 as it is not wired on this board */
+#define MAIN_SENSE_PIN      -1     /*!< main e-match continuity input, -1 as it is not wired on this board */
 
 /* timing constant */
 #define SETUP_DELAY 300
+#define PYRO_PULSE_TIME 5000                /*!< time in ms the pyro channel stays HIGH - determine from pop tests */
 #define TASK_DELAY 10
 
-/*!< Flight data constants  */
-#define ALTITUDE 1525.0 // altitude of iPIC building, JKUAT, Juja. TODO: Change to launch site altitude
+/*!< Flight data constants - the defaults of flight_config_t, a config record in FLIGHT_CONFIG_FILE overrides them at boot */
+#define FLIGHT_CONFIG_FILE "/flight_config.bin"  /*!< SPIFFS path of the flight config record, see scripts/flight-config.py */
 #define LAUNCH_DETECTION_THRESHOLD 10         /*!< altitude in meters, above which we register that we have launched  */
 #define LAUNCH_DETECTION_ALTITUDE_WINDOW 20  /*!< Window in meters where we register a launch */
-#define APOGEE_DETECTION_THRESHOLD 5         /*!< value in meters for detecting apogee */
-#define MAIN_EJECTION_HEIGHT 1000            /*!< height to eject the main chute  */
+#define LAUNCH_ACCEL_THRESHOLD 2.5           /*!< axial acceleration in g above which we register thrust */
+#define LAUNCH_ACCEL_SUSTAIN_TIME 30         /*!< time in ms the acceleration must stay above LAUNCH_ACCEL_THRESHOLD to register a launch */
+#define LAUNCH_CONFIRM_TIME 2000             /*!< time in ms the altimeter has to climb LAUNCH_DETECTION_THRESHOLD after an accelerometer launch */
+#define LAUNCH_MIN_BURN_TIME 500             /*!< time in ms above LAUNCH_ACCEL_THRESHOLD after which a launch stands without the altimeter - far longer than a knock on the pad */
+#define APOGEE_VELOCITY_THRESHOLD 0          /*!< Kalman or integrated vertical velocity in m/s at or below which an apogee vote counts */
+#define APOGEE_SLOPE_THRESHOLD 0             /*!< altitude regression slope in m/s at or below which the baro apogee vote counts */
+#define APOGEE_CONFIDENCE 3                  /*!< consecutive samples an apogee estimator needs before it votes */
+#define APOGEE_TIMEOUT_TIME 30000            /*!< time in ms after launch at which apogee is declared without agreement - keep above the simulated time to apogee */
+#define APOGEE_ACCEL_SATURATION (MPU_ACCEL_RANGE * 0.98)    /*!< axial acceleration in g taken as clipped by the IMU */
+#define MAIN_EJECTION_HEIGHT 1000            /*!< height above ground level in m to eject the main chute  */
+#define MAIN_EJECTION_HYSTERESIS 10          /*!< m above MAIN_EJECTION_HEIGHT a sample must be to restart the main deploy count */
+#define MAIN_EJECTION_CONFIRM 3              /*!< altimeter samples at or below MAIN_EJECTION_HEIGHT needed to eject the main chute */
 #define DROGUE_EJECTION_HEIGHT               /*!< height to eject the drogue chute - ideally it should be at apogee  */
-#define SEA_LEVEL_PRESSURE 101325            /*!< sea level pressure to be used for altitude calculations */
-#define BASE_ALTITUDE 1417                   /*!< this value is the altitude at rocket launch site - adjust accordingly */
+#define SEA_LEVEL_PRESSURE 101325            /*!< sea level pressure in Pa to be used for altitude calculations */
+#define GROUND_CALIBRATION_TIME 5000         /*!< time in ms the pad pressure is averaged over to get the ground level */
+#define APOGEE_LOCKOUT_TIME 3000             /*!< time in ms after launch during which apogee is not accepted */
+#define COAST_APOGEE_LOCKOUT_TIME 1000       /*!< time in ms after burnout during which apogee is not accepted */
+#define BURNOUT_ACCEL_THRESHOLD 0            /*!< axial acceleration in g below which the motor is out - drag only */
+#define BURNOUT_JERK_THRESHOLD 4             /*!< thrust drop in g/s that marks burnout, low enough for a progressive tail-off */
+#define BURNOUT_SUSTAIN_TIME 20              /*!< time in ms the acceleration must stay below BURNOUT_ACCEL_THRESHOLD */
+#define BURNOUT_JERK_WINDOW 500              /*!< time in ms the thrust drop counts towards burnout detection */
+#define BURNOUT_FILTER_ALPHA 0.3             /*!< smoothing of the axial acceleration for burnout detection, 1 for none */
+#define LANDING_LOCKOUT_TIME 5000            /*!< time in ms after apogee during which landing is not accepted */
+#define LANDING_VELOCITY_THRESHOLD 1.0       /*!< vertical speed in m/s below which the rocket counts as still */
+#define LANDING_ALTITUDE_BAND 2.0            /*!< m the AGL altitude may wander while the rocket is still */
+#define LANDING_STABLE_TIME 5000             /*!< time in ms the rocket must stay still to register landing */
+#define KALMAN_ALTITUDE_SIGMA 1.0            /*!< barometer altitude noise in m */
+#define KALMAN_ACCEL_SIGMA 20.0              /*!< unmodelled vertical acceleration in m/s^2 */
+#define KALMAN_INNOVATION_GATE 5.0           /*!< altitude samples further than this many sigma from the estimate are treated as spikes */
+#define GPS_ALTITUDE_SIGMA 5.0               /*!< GPS altitude noise in m, for the altitude estimate used when the barometer fails */
 
 /*!<  tasks constants */
 #define STACK_SIZE 1024                     /*!< task stack size in words */
@@ -71,6 +110,30 @@
 #define FILTERED_DATA_QUEUE_LENGTH 10       /*!< length of the filtered data queue */
 #define FLIGHT_STATES_QUEUE_LENGTH 1        /*!< length of the flight states queue */
 #define CONSUME_TASK_DELAY    10
+#define PROFILE_SUMMARY_INTERVAL 10000      /*!< time in ms between task profile summaries in the system log and telemetry */
+#define QUEUE_STATS_INTERVAL 10000          /*!< time in ms between queue statistics in the system log and telemetry */
+#define RESOURCE_LOG_INTERVAL 10000         /*!< time in ms between heap and low stack lines in the system log */
+#define HEALTH_JITTER_MARGIN 2              /*!< time in ms a check-in may be later than one period and the check-in jitter of the task, for the 1 ms tick */
+#define HEALTH_MAX_RECOVERIES 2             /*!< recovery attempts on a stalled task before failing over */
+#define TASK_RESTART_TIMEOUT 50             /*!< time in ms the idle task of the core gets to release a deleted task, the task is failed over if it has not */
+#define SAMPLE_TIMER 0                      /*!< hardware timer that releases the accelerometer and altimeter tasks */
+#define SAMPLE_TIMER_PRESCALER 80           /*!< divides the 80MHz APB clock to a 1us timer tick */
+
+/* latency tracing - see latency_trace.h and scripts/latency-trace.py */
+#define LATENCY_TRACE_FILE "/latency_trace.bin" /*!< SPIFFS path of the latency trace, rewritten at every launch */
+#define TRACE_FLUSH_INTERVAL    1000        /*!< time in ms between writes of the trace ring to LATENCY_TRACE_FILE after launch */
+#define TRACE_FILE_MAX_SIZE     262144      /*!< the trace file stops growing at this size in bytes */
+
+/* flash logging interval per flight phase */
+#define LOG_INTERVAL_GROUND     100         /*!< time in ms between logged samples on the ground */
+#define LOG_INTERVAL_POWERED    10          /*!< time in ms between logged samples during powered flight */
+#define LOG_INTERVAL_COASTING   5           /*!< time in ms between logged samples while coasting to apogee */
+#define LOG_INTERVAL_DESCENT    50          /*!< time in ms between logged samples under parachute */
+
+/* post flight recovery mode */
+#define RECOVERY_BEACON_INTERVAL    5000    /*!< time in ms between GPS position beacons after landing */
+#define RECOVERY_SHUTDOWN_TIMEOUT   1000    /*!< time in ms to wait for each task to stop */
+#define RECOVERY_CPU_FREQUENCY      80      /*!< CPU clock in MHz after landing, the lowest that keeps WiFi running */
 
 /* MQTT constants */
 //const char MQTT_SERVER[30] = "192.168.1.101";
@@ -79,6 +142,39 @@ const char MQTT_SERVER[30] = "192.168.1.113";
 const char MQTT_TOPIC[30] = "n4/flight-computer-1";             /* make this topic unique to every rocket */
 #define MQTT_PORT 1883                               /*!< MQTT broker port */
 
+#define MQTT_BUFFER_SIZE            1152    /*!< PubSubClient packet buffer - one batch payload plus MQTT header and topic */
+#define MQTT_BATCH_SIZE             8       /*!< telemetry records per publish, minimum batch size in adaptive mode */
+#define MQTT_BATCH_MAX_SIZE         32      /*!< largest batch the adaptive mode may grow to */
+#define MQTT_BATCH_MAX_LATENCY      100     /*!< max time in ms a record waits in a batch before it is published */
+#define MQTT_BATCH_ADAPTIVE         1       /*!< set to 1 to grow the batch size when the link is congested */
+#define MQTT_CONGESTION_TIME        50      /*!< publish duration in ms above which the link is treated as congested */
+#define MQTT_OUTBOUND_SLOTS         4       /*!< batches kept while the broker is unreachable */
+#define MQTT_RECONNECT_MIN_DELAY    500     /*!< first delay in ms between reconnection attempts */
+#define MQTT_RECONNECT_MAX_DELAY    16000   /*!< longest delay in ms between reconnection attempts */
+#define MQTT_SOCKET_TIMEOUT         1       /*!< time in seconds to wait for the broker's answer to the MQTT CONNECT */
+#define MQTT_CONNECT_TIMEOUT        250     /*!< time in ms to wait for the TCP connection to the broker */
+#define MQTT_CLIENT_ID_PREFIX       "flight-computer-1"     /*!< MQTT client ID prefix, the chip MAC is appended */
+
+/* sensor fusion constants - see sensor_fusion.h, records come at the sensorFusion task rate */
+#define FUSION_OUTPUT_DELAY         100     /*!< time in ms a fused record is built after its time, the altimeter sample after it has arrived by then */
+#define FUSION_ACCEL_MAX_AGE        30      /*!< time in ms without an IMU sample before attitude is left out of the records */
+#define FUSION_ALTIMETER_MAX_AGE    150     /*!< time in ms without a barometer sample before altitude is left out of the records */
+#define FUSION_GPS_MAX_AGE          2000    /*!< time in ms without a GPS fix before the position is left out of the records */
+
+/* telemetry scheduling constants - see telemetry_scheduler.h */
+#define TELEMETRY_SCHEDULED_FRAMES  1       /*!< 1 to send link-scheduled frames, 0 to send every packet as a legacy CSV row */
+#define TELEMETRY_FRAME_INTERVAL    100     /*!< time in ms between scheduled frames */
+#define TELEMETRY_LINK_RATE         2000    /*!< initial link throughput estimate in bytes/s */
+#define TELEMETRY_MIN_LINK_RATE     200     /*!< lowest link throughput estimate in bytes/s */
+#define TELEMETRY_MAX_LINK_RATE     20000   /*!< highest link throughput estimate in bytes/s */
+#define TELEMETRY_POLL_INTERVAL     20      /*!< longest time in ms the telemetry task waits before servicing the links */
+
+/* XBee constants - the radio must be configured for API mode 2 (AP=2) */
+#define XBEE_RX_PIN                 35      /*!< ESP32 UART RX pin connected to XBee DOUT - not on the v1 pin sheet, confirm against the board */
+#define XBEE_TX_PIN                 2       /*!< ESP32 UART TX pin connected to XBee DIN - not on the v1 pin sheet, confirm against the board. GPIO2 is a boot strapping pin */
+#define XBEE_DESTINATION_ADDRESS    0xFFFFULL   /*!< 64 bit address of the ground station radio, 0xFFFF to broadcast */
+#define XBEE_STATUS_TIMEOUT         1000    /*!< time in ms to wait for a transmit status before counting a frame as lost */
+
 #define BROKER_IP_ADDRESS_LENGTH    20      /*!< length of broker ip address string */
 #define MQTT_TOPIC_LENGTH           10      /*!< length of mqtt topic string */
 
@@ -95,10 +191,16 @@ const char MQTT_TOPIC[30] = "n4/flight-computer-1";             /* make this top
 #define MB_SIZE_DIVISOR 1048576
 #define FORMAT_SPIFFS_IF_FAILED 1
 
+/* flight state notification bits - set in the flightStateCallback task notification when the state is entered */
 #define PREFLIGHT_BIT 0
 #define POWERED_FLIGHT_BIT 1
-#define APOGEE_BIT 2
+#define COASTING_BIT 2
+#define APOGEE_BIT 3
+#define DROGUE_DEPLOY_BIT 4
+#define DROGUE_DESCENT_BIT 5
+#define MAIN_DEPLOY_BIT 6
+#define MAIN_DESCENT_BIT 7
+#define POST_FLIGHT_BIT 8
 
-#define STATE_CHANGE_DELAY 20
 #endif // DEFS_H
 
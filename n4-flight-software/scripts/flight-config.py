@@ -0,0 +1,127 @@
+'''
+Generate, verify and dump the flight config record loaded from SPIFFS at boot
+See src/flight_config.h for the layout. The field list below must match flight_config_t
+
+usage:
+    python flight-config.py generate flight_config.bin [name=value ...]
+    python flight-config.py verify flight_config.bin
+    python flight-config.py dump flight_config.bin
+
+Upload the file to the SPIFFS root as /flight_config.bin, e.g. by placing it in data/
+and running "pio run -t uploadfs"
+'''
+
+import struct
+import sys
+import zlib
+
+MAGIC = 0x4346344E          # "N4CF"
+VERSION = 1
+HEADER = struct.Struct("<IHH")
+CRC = struct.Struct("<I")
+
+# (name, struct type, default) in flight_config_t order - defaults follow include/defs.h
+FIELDS = [
+    ("launch_detection_threshold",  "f", 10.0),
+    ("launch_accel_threshold",      "f", 2.5),
+    ("launch_accel_sustain_ms",     "I", 30),
+    ("launch_confirm_ms",           "I", 2000),
+    ("burnout_accel_threshold",     "f", 0.0),
+    ("burnout_jerk_threshold",      "f", 4.0),
+    ("burnout_sustain_ms",          "I", 20),
+    ("burnout_jerk_window_ms",      "I", 500),
+    ("burnout_filter_alpha",        "f", 0.3),
+    ("apogee_lockout_ms",           "I", 3000),
+    ("coast_apogee_lockout_ms",     "I", 1000),
+    ("apogee_velocity_threshold",   "f", 0.0),
+    ("apogee_slope_threshold",      "f", 0.0),
+    ("apogee_confidence",           "I", 3),
+    ("apogee_timeout_ms",           "I", 30000),
+    ("main_ejection_height",        "f", 1000.0),
+    ("main_ejection_hysteresis",    "f", 10.0),
+    ("main_ejection_confirm",       "I", 3),
+    ("landing_lockout_ms",          "I", 5000),
+    ("landing_velocity_threshold",  "f", 1.0),
+    ("landing_altitude_band",       "f", 2.0),
+    ("landing_stable_ms",           "I", 5000),
+    ("ground_calibration_ms",       "I", 5000),
+    ("kalman_altitude_sigma",       "f", 1.0),
+    ("kalman_accel_sigma",          "f", 20.0),
+    ("kalman_innovation_gate",      "f", 5.0),
+    ("log_interval_ground_ms",      "I", 100),
+    ("log_interval_powered_ms",     "I", 10),
+    ("log_interval_coasting_ms",    "I", 5),
+    ("log_interval_descent_ms",     "I", 50),
+    ("data_queue_length",           "I", 10),
+]
+
+PAYLOAD = struct.Struct("<" + "".join(t for _, t, _ in FIELDS))
+
+
+def build(values):
+    payload = PAYLOAD.pack(*[values[name] for name, _, _ in FIELDS])
+    body = HEADER.pack(MAGIC, VERSION, len(payload)) + payload
+    return body + CRC.pack(zlib.crc32(body) & 0xFFFFFFFF)
+
+
+def parse(record):
+    '''return the field values, raise ValueError if the record would be rejected at boot'''
+    if len(record) < HEADER.size + CRC.size:
+        raise ValueError("too short")
+
+    magic, version, length = HEADER.unpack_from(record)
+    if magic != MAGIC:
+        raise ValueError("bad magic 0x%08x" % magic)
+    if version != VERSION:
+        raise ValueError("version %d, this tool writes version %d" % (version, VERSION))
+    if length != PAYLOAD.size or len(record) < HEADER.size + length + CRC.size:
+        raise ValueError("bad length %d" % length)
+
+    end = HEADER.size + length
+    (crc,) = CRC.unpack_from(record, end)
+    if zlib.crc32(record[:end]) & 0xFFFFFFFF != crc:
+        raise ValueError("bad CRC")
+
+    return dict(zip([name for name, _, _ in FIELDS], PAYLOAD.unpack_from(record, HEADER.size)))
+
+
+def main(argv):
+    if len(argv) < 3 or argv[1] not in ("generate", "verify", "dump"):
+        print(__doc__)
+        return 2
+
+    command, path = argv[1], argv[2]
+
+    if command == "generate":
+        values = {name: default for name, _, default in FIELDS}
+        types = {name: t for name, t, _ in FIELDS}
+        for setting in argv[3:]:
+            name, _, value = setting.partition("=")
+            if name not in values:
+                print("unknown field: " + name)
+                return 2
+            values[name] = float(value) if types[name] == "f" else int(value, 0)
+
+        with open(path, "wb") as f:
+            f.write(build(values))
+        print("wrote %s (%d bytes)" % (path, HEADER.size + PAYLOAD.size + CRC.size))
+        return 0
+
+    with open(path, "rb") as f:
+        record = f.read()
+
+    try:
+        values = parse(record)
+    except ValueError as e:
+        print("INVALID: %s" % e)
+        return 1
+
+    if command == "dump":
+        for name, value in values.items():
+            print("%-28s %g" % (name, value))
+    print("OK")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,145 @@
+'''
+Latency breakdown of the sample trace written by the flight computer after launch
+See src/latency_trace.h for the file layout. Download /latency_trace.bin from SPIFFS first
+
+usage:
+    python latency-trace.py latency_trace.bin          text report
+    python latency-trace.py latency_trace.bin --plot   text report and histograms
+
+For every pipeline stage the time from acquisition is reported, and for stages a sample
+passes one after the other (dequeued -> state checked) the time between them, so the
+queue wait and detector time of the deploy path can be checked against its budget
+'''
+
+import math
+import struct
+import sys
+
+MAGIC = 0x544C344E          # "N4LT"
+VERSION = 1
+HEADER = struct.Struct("<IHH")
+RECORD = struct.Struct("<HBBI")
+
+# TRACE_STAGE order in src/latency_trace.h
+STAGES = ["filtered", "dequeued", "state_checked", "pyro_fired", "logged", "published"]
+
+# data flags in src/data_types.h
+SOURCES = {1: "accel", 2: "gyro", 4: "altimeter", 8: "gps"}
+
+# stage pairs on the same sample whose difference is reported
+STEPS = [
+    ("dequeued", "state_checked"),
+    ("state_checked", "pyro_fired"),
+]
+
+BUCKETS_US = [100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000]
+
+
+def read_trace(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if len(data) < HEADER.size:
+        raise ValueError("file too short")
+
+    magic, version, record_size = HEADER.unpack_from(data)
+    if magic != MAGIC:
+        raise ValueError("bad magic 0x%08x" % magic)
+    if version != VERSION or record_size != RECORD.size:
+        raise ValueError("version %d with %d byte records, this tool reads version %d" % (version, record_size, VERSION))
+
+    records = []
+    for offset in range(HEADER.size, len(data) - RECORD.size + 1, RECORD.size):
+        records.append(RECORD.unpack_from(data, offset))
+    return records
+
+
+def percentile(values, fraction):
+    '''nearest rank, the smallest value with at least fraction of the values at or below it'''
+    ordered = sorted(values)
+    # the tolerance keeps e.g. 0.99 * 300 = 297.00000000000006 at rank 297
+    rank = int(math.ceil(fraction * len(ordered) - 1e-9))
+    return ordered[min(len(ordered), max(1, rank)) - 1]
+
+
+def histogram(values):
+    counts = [0] * (len(BUCKETS_US) + 1)
+    for v in values:
+        i = 0
+        while i < len(BUCKETS_US) and v > BUCKETS_US[i]:
+            i += 1
+        counts[i] += 1
+    return counts
+
+
+def print_group(title, values):
+    print("%-34s n %6d  p50 %8d  p90 %8d  p99 %8d  max %8d us" % (
+        title, len(values), percentile(values, 0.5), percentile(values, 0.9), percentile(values, 0.99), max(values)))
+
+    counts = histogram(values)
+    peak = max(counts)
+    for i, count in enumerate(counts):
+        if count == 0:
+            continue
+        label = "<= %d" % BUCKETS_US[i] if i < len(BUCKETS_US) else "> %d" % BUCKETS_US[-1]
+        print("    %-10s %6d %s" % (label, count, "#" * max(1, count * 40 // peak)))
+
+
+def main(argv):
+    if len(argv) < 2:
+        print(__doc__)
+        return 2
+
+    try:
+        records = read_trace(argv[1])
+    except (OSError, ValueError) as e:
+        print("INVALID: %s" % e)
+        return 1
+
+    by_stage = {}
+    by_sample = {}
+    for trace_id, stage, source, latency in records:
+        if stage >= len(STAGES):
+            continue
+        by_stage.setdefault((source, STAGES[stage]), []).append(latency)
+        by_sample.setdefault((source, trace_id), {})[STAGES[stage]] = latency
+
+    print("%d records\n" % len(records))
+    print("time from acquisition")
+    for source in sorted(SOURCES):
+        for stage in STAGES:
+            values = by_stage.get((source, stage))
+            if values:
+                print_group("%s %s" % (SOURCES[source], stage), values)
+
+    print("\ntime between stages")
+    for source in sorted(SOURCES):
+        for first, second in STEPS:
+            values = [s[second] - s[first] for (src, _), s in by_sample.items()
+                      if src == source and first in s and second in s and s[second] >= s[first]]
+            if values:
+                print_group("%s %s -> %s" % (SOURCES[source], first, second), values)
+
+    pyro = [(src, tid, s["pyro_fired"]) for (src, tid), s in by_sample.items() if "pyro_fired" in s]
+    if pyro:
+        print("\npyro firings, acquisition of the deciding sample to fire command")
+        for src, tid, latency in pyro:
+            print("    %s sample %d: %d us" % (SOURCES.get(src, src), tid, latency))
+
+    if "--plot" in argv:
+        import matplotlib.pyplot as plt
+
+        groups = [(k, v) for k, v in sorted(by_stage.items()) if v]
+        fig, axes = plt.subplots(len(groups), 1, figsize=(8, 2 * len(groups)), squeeze=False)
+        for ax, ((source, stage), values) in zip(axes[:, 0], groups):
+            ax.hist([v / 1000.0 for v in values], bins=50)
+            ax.set_title("%s %s" % (SOURCES.get(source, source), stage))
+            ax.set_xlabel("latency (ms)")
+        fig.tight_layout()
+        plt.show()
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
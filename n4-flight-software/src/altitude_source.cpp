@@ -0,0 +1,65 @@
+/**
+ * @file altitude_source.cpp
+ * @brief implements the altitude source choice and the GPS altitude tracking
+ */
+
+#include "altitude_source.h"
+
+/**
+ * @brief reset the GPS altitude filter and the pad altitude
+ * @param gps_sigma GPS altitude noise standard deviation in m
+ * @param accel_sigma process noise standard deviation in m/s^2
+ * @param gate innovation gate in standard deviations, 0 disables it
+ */
+void altitude_source_init(altitude_source_t* s, float gps_sigma, float accel_sigma, float gate) {
+    vkf_init(&s->gps, gps_sigma, accel_sigma, gate);
+    s->gps_ground_altitude = 0;
+    s->last_fix_us = 0;
+}
+
+/**
+ * @brief update the GPS altitude estimate from a GPS packet
+ * The GPS task sends every period, the fix only changes with a new sentence
+ * @param acquired_us acquisition time of the packet
+ * @param gps_altitude altitude of the fix in m, 0 is an invalid altitude
+ * @param on_pad 1 before launch, the fix becomes the pad altitude
+ * @return 1 if the packet holds a new GPS altitude
+ */
+uint8_t altitude_gps_fix(altitude_source_t* s, uint32_t acquired_us, float gps_altitude, uint8_t on_pad) {
+    if(acquired_us == s->last_fix_us || gps_altitude == 0) {
+        return 0;
+    }
+
+    float dt = s->last_fix_us == 0 ? 0 : (acquired_us - s->last_fix_us) * 0.000001f;
+    s->last_fix_us = acquired_us;
+
+    vkf_update(&s->gps, gps_altitude, 0, dt);
+
+    if(on_pad) {
+        s->gps_ground_altitude = s->gps.altitude;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief the altitude source for one packet, see ALTITUDE_SOURCE
+ * A failed barometer is checked first, its readings are never used while it is failed
+ * @param baro_failed 1 if the health monitor failed the barometer over
+ * @param baro_sample 1 if the packet carries a barometer reading
+ * @param gps_fix 1 if the packet carried a new GPS altitude, see altitude_gps_fix()
+ */
+uint8_t altitude_select(uint8_t baro_failed, uint8_t baro_sample, uint8_t gps_fix) {
+    if(baro_failed) {
+        return gps_fix ? ALTITUDE_GPS : ALTITUDE_NONE;
+    }
+
+    return baro_sample ? ALTITUDE_BAROMETER : ALTITUDE_NONE;
+}
+
+/**
+ * @brief GPS altitude above the pad in m
+ */
+float altitude_gps_agl(const altitude_source_t* s) {
+    return s->gps.altitude - s->gps_ground_altitude;
+}
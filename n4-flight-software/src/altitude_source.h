@@ -0,0 +1,35 @@
+/**
+ * @file altitude_source.h
+ * @brief Choice of the altitude the flight detectors run on, the barometer or the GPS
+ *
+ * The barometer is the altitude source until the health monitor fails it over. From then
+ * on only the GPS altitude is used, whatever sensor a packet comes from: a reading from a
+ * failed barometer, queued before the failover or sent while it fails intermittently,
+ * is not trusted. The GPS altitude and vertical velocity are tracked by a Kalman filter
+ * on every new fix, and made above ground level with the last fix before launch
+ */
+
+#ifndef ALTITUDE_SOURCE_H
+#define ALTITUDE_SOURCE_H
+
+#include <stdint.h>
+#include "vertical_kalman.h"
+
+typedef enum {
+    ALTITUDE_NONE = 0,                  /*!< the packet carries no altitude to use */
+    ALTITUDE_BAROMETER,
+    ALTITUDE_GPS
+} ALTITUDE_SOURCE;
+
+typedef struct {
+    vertical_kalman_t gps;              /*!< GPS altitude and vertical velocity */
+    float gps_ground_altitude;          /*!< GPS altitude of the pad, the last fix before launch */
+    uint32_t last_fix_us;               /*!< acquisition time of the last fix, a new sentence changes it */
+} altitude_source_t;
+
+void altitude_source_init(altitude_source_t* s, float gps_sigma, float accel_sigma, float gate);
+uint8_t altitude_gps_fix(altitude_source_t* s, uint32_t acquired_us, float gps_altitude, uint8_t on_pad);
+uint8_t altitude_select(uint8_t baro_failed, uint8_t baro_sample, uint8_t gps_fix);
+float altitude_gps_agl(const altitude_source_t* s);
+
+#endif
@@ -0,0 +1,66 @@
+/**
+ * @file altitude_trigger.cpp
+ * @brief implements the AGL altitude trigger
+ */
+
+#include "altitude_trigger.h"
+
+/**
+ * @brief initialize the trigger, it stays idle until altitude_trigger_arm() is called
+ * @param threshold AGL in m to trigger at
+ * @param hysteresis m above the threshold that resets the count
+ * @param confirm samples at or below the threshold needed to fire
+ */
+void altitude_trigger_init(altitude_trigger_t* t, float threshold, float hysteresis, uint8_t confirm) {
+    t->threshold = threshold;
+    t->hysteresis = hysteresis > 0 ? hysteresis : 0;
+    t->confirm = confirm > 0 ? confirm : 1;
+    t->count = 0;
+    t->armed = 0;
+    t->fired = 0;
+}
+
+/**
+ * @brief start watching the altitude
+ */
+void altitude_trigger_arm(altitude_trigger_t* t) {
+    if(t->armed) {
+        return;
+    }
+
+    t->armed = 1;
+    t->fired = 0;
+    t->count = 0;
+}
+
+/**
+ * @brief stop watching and allow the trigger to fire again after the next arming
+ */
+void altitude_trigger_disarm(altitude_trigger_t* t) {
+    t->armed = 0;
+    t->fired = 0;
+    t->count = 0;
+}
+
+/**
+ * @brief feed one AGL sample
+ * @return 1 on the sample the trigger fires, 0 otherwise
+ */
+uint8_t altitude_trigger_update(altitude_trigger_t* t, float agl) {
+    if(!t->armed || t->fired) {
+        return 0;
+    }
+
+    if(agl <= t->threshold) {
+        t->count++;
+    } else if(agl > t->threshold + t->hysteresis) {
+        t->count = 0;
+    }
+
+    if(t->count >= t->confirm) {
+        t->fired = 1;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+/**
+ * @file altitude_trigger.h
+ * @brief One-shot trigger on descending through an AGL altitude, with hysteresis
+ *
+ * Samples at or below the threshold count towards the trigger, samples above
+ * threshold + hysteresis reset the count, samples inside the band keep it. The trigger
+ * fires once `confirm` samples have counted, so baro noise around the deploy altitude
+ * neither fires early nor keeps restarting the count
+ */
+
+#ifndef ALTITUDE_TRIGGER_H
+#define ALTITUDE_TRIGGER_H
+
+#include <stdint.h>
+
+typedef struct {
+    float threshold;                /*!< AGL in m at or below which samples count */
+    float hysteresis;               /*!< m above the threshold a sample must be to reset the count */
+    uint8_t confirm;                /*!< samples that must count before the trigger fires */
+    uint8_t count;
+    uint8_t armed;
+    uint8_t fired;
+} altitude_trigger_t;
+
+void altitude_trigger_init(altitude_trigger_t* t, float threshold, float hysteresis, uint8_t confirm);
+void altitude_trigger_arm(altitude_trigger_t* t);
+void altitude_trigger_disarm(altitude_trigger_t* t);
+uint8_t altitude_trigger_update(altitude_trigger_t* t, float agl);
+
+#endif
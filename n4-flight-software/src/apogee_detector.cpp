@@ -0,0 +1,345 @@
+/**
+ * @file apogee_detector.cpp
+ * @brief implements the apogee voter
+ */
+
+#include <string.h>
+#include "apogee_detector.h"
+
+#define STANDARD_GRAVITY    9.80665f
+
+static const char* const voter_names[NUM_APOGEE_VOTERS] = {
+    "BARO",
+    "KALMAN",
+    "ACCEL"
+};
+
+static void reset_votes(apogee_detector_t* d) {
+    for(uint8_t i = 0; i < NUM_APOGEE_VOTERS; i++) {
+        d->votes[i].count = 0;
+        d->votes[i].vote = 0;
+    }
+}
+
+/**
+ * @brief initialize the detector, it stays idle until apogee_arm() is called
+ * @param lockout_ms time after arming during which no estimator votes
+ * @param velocity_threshold Kalman and integrated velocity in m/s that counts as descending, normally 0
+ * @param slope_threshold regression slope in m/s that counts as descending, normally 0
+ * @param confidence consecutive samples an estimator needs to vote
+ * @param timeout_ms apogee is declared this long after launch if the estimators never agree
+ * @param saturation_g axial acceleration in g at which the IMU clips
+ */
+void apogee_init(apogee_detector_t* d, uint32_t lockout_ms, float velocity_threshold, float slope_threshold, uint8_t confidence, uint32_t timeout_ms, float saturation_g) {
+    memset(d, 0, sizeof(apogee_detector_t));
+    d->lockout_ms = lockout_ms;
+    d->velocity_threshold = velocity_threshold;
+    d->slope_threshold = slope_threshold;
+    d->confidence = confidence > 0 ? confidence : 1;
+    d->timeout_ms = timeout_ms;
+    d->saturation_g = saturation_g;
+    d->axis_sign = 1;
+}
+
+/**
+ * @brief integrate one IMU sample into the vertical velocity, drops ACCEL on a clipped reading
+ */
+static void integrate(apogee_detector_t* d, uint32_t now, float axial_g) {
+    if(axial_g >= d->saturation_g || axial_g <= -d->saturation_g) {
+        d->votes[APOGEE_VOTER_ACCEL].healthy = 0;
+    }
+
+    // the IMU measures thrust and drag but not gravity, for a near vertical flight
+    // the vertical acceleration is the axial reading less 1 g
+    if(d->last_accel_time != 0) {
+        float dt = (now - d->last_accel_time) * 0.001f;
+        if(dt <= APOGEE_MAX_ACCEL_DT) {
+            d->accel_velocity += (d->axis_sign * axial_g - 1.0f) * STANDARD_GRAVITY * dt;
+        }
+    }
+    d->last_accel_time = now;
+}
+
+/**
+ * @brief start the lockout, the timeout and the accelerometer integration, call at launch
+ * @param axis_sign sign of the IMU X axis reading under thrust, see launch_detector_t::axis_sign
+ * @param launch_time time in ms of the first sample of the burn, see launch_detector_t::launch_time.
+ * The IMU samples kept since then are integrated at once
+ */
+void apogee_arm(apogee_detector_t* d, uint32_t now, int8_t axis_sign, uint32_t launch_time) {
+    if(d->armed) {
+        return;
+    }
+
+    d->armed = 1;
+    d->arm_time = now;
+    d->launch_time = launch_time;
+    d->axis_sign = axis_sign < 0 ? -1 : 1;
+    d->accel_velocity = 0;
+    d->last_accel_time = 0;
+    d->max_altitude = 0;
+    d->detected = APOGEE_NONE;
+    d->detect_votes = 0;
+
+    for(uint8_t i = 0; i < NUM_APOGEE_VOTERS; i++) {
+        d->votes[i].count = 0;
+        d->votes[i].vote = 0;
+        d->votes[i].healthy = 1;
+        d->votes[i].voted = 0;
+        d->votes[i].vote_time = 0;
+    }
+
+    // the burn up to the launch detection, oldest sample first. The sample before the
+    // launch sample only starts the clock, so the launch sample covers its own period
+    uint8_t oldest = (d->history_index + APOGEE_ACCEL_HISTORY - d->history_count) % APOGEE_ACCEL_HISTORY;
+    for(uint8_t i = 0; i < d->history_count; i++) {
+        uint8_t k = (oldest + i) % APOGEE_ACCEL_HISTORY;
+        if((int32_t) (d->history_times[k] - launch_time) >= 0) {
+            integrate(d, d->history_times[k], d->history[k]);
+        } else {
+            d->last_accel_time = d->history_times[k];
+        }
+    }
+    d->history_count = 0;
+}
+
+/**
+ * @brief stop detecting until apogee_arm() is called again, e.g. after a rejected launch
+ */
+void apogee_disarm(apogee_detector_t* d) {
+    d->armed = 0;
+    d->max_altitude = 0;
+    d->detected = APOGEE_NONE;
+    reset_votes(d);
+}
+
+/**
+ * @brief replace the lockout with one starting now, e.g. a shorter one once burnout is known.
+ * The timeout still runs from launch
+ * @param lockout_ms new lockout measured from now
+ */
+void apogee_restart_lockout(apogee_detector_t* d, uint32_t now, uint32_t lockout_ms) {
+    d->arm_time = now;
+    d->lockout_ms = lockout_ms;
+    reset_votes(d);
+}
+
+/**
+ * @brief least squares slope of altitude over time in the window
+ * @return slope in m/s, 0 until the window is full
+ */
+float apogee_window_slope(const apogee_detector_t* d) {
+    if(d->count < APOGEE_WINDOW_SIZE) {
+        return 0;
+    }
+
+    // times relative to the oldest sample keep the sums small enough for float
+    uint32_t t0 = d->times[d->index];
+    float mean_t = 0;
+    float mean_h = 0;
+
+    for(uint8_t i = 0; i < APOGEE_WINDOW_SIZE; i++) {
+        mean_t += (d->times[i] - t0) * 0.001f;
+        mean_h += d->altitudes[i];
+    }
+    mean_t /= APOGEE_WINDOW_SIZE;
+    mean_h /= APOGEE_WINDOW_SIZE;
+
+    float sxy = 0;
+    float sxx = 0;
+    for(uint8_t i = 0; i < APOGEE_WINDOW_SIZE; i++) {
+        float dt = (d->times[i] - t0) * 0.001f - mean_t;
+        sxy += dt * (d->altitudes[i] - mean_h);
+        sxx += dt * dt;
+    }
+
+    return sxx > 0 ? sxy / sxx : 0;
+}
+
+/**
+ * @brief 1 if the full window shows no change at all - a live barometer always has some noise
+ */
+static uint8_t window_stuck(const apogee_detector_t* d) {
+    if(d->count < APOGEE_WINDOW_SIZE) {
+        return 0;
+    }
+
+    float min = d->altitudes[0];
+    float max = d->altitudes[0];
+    for(uint8_t i = 1; i < APOGEE_WINDOW_SIZE; i++) {
+        if(d->altitudes[i] < min) min = d->altitudes[i];
+        if(d->altitudes[i] > max) max = d->altitudes[i];
+    }
+
+    return (max - min) < APOGEE_STUCK_BAND;
+}
+
+/**
+ * @brief 1 while votes are not held
+ * The IMU and barometer samples reach the detector out of order by up to a conversion
+ * time, so a sample taken before the lockout started counts as in it
+ */
+static uint8_t in_lockout(const apogee_detector_t* d, uint32_t now) {
+    return (int32_t) (now - d->arm_time) < (int32_t) d->lockout_ms;
+}
+
+/**
+ * @brief count one sample of an estimator's criterion
+ */
+static void cast(apogee_detector_t* d, uint8_t voter, uint8_t descending, uint32_t now) {
+    apogee_vote_t* v = &d->votes[voter];
+
+    if(!v->healthy || !descending) {
+        v->count = 0;
+        v->vote = 0;
+        return;
+    }
+
+    if(v->count < d->confidence) {
+        v->count++;
+    }
+
+    v->vote = v->count >= d->confidence;
+    if(v->vote && !v->voted) {
+        v->voted = 1;
+        v->vote_time = now;
+    }
+}
+
+/**
+ * @brief count the votes of the healthy estimators and check the timeout
+ * @return see APOGEE_DECISION
+ */
+static uint8_t decide(apogee_detector_t* d, uint32_t now) {
+    uint8_t healthy = 0;
+    uint8_t votes = 0;
+
+    for(uint8_t i = 0; i < NUM_APOGEE_VOTERS; i++) {
+        if(d->votes[i].healthy) {
+            healthy++;
+            votes += d->votes[i].vote;
+        }
+    }
+
+    // two healthy estimators must agree, a single one left decides alone
+    uint8_t quorum = healthy >= 2 ? 2 : 1;
+
+    if(healthy > 0 && votes >= quorum) {
+        d->detected = APOGEE_VOTED;
+    } else if((int32_t) (now - d->launch_time) >= (int32_t) d->timeout_ms) {
+        d->detected = APOGEE_TIMEOUT;
+    } else {
+        return APOGEE_NONE;
+    }
+
+    d->detect_votes = apogee_vote_mask(d);
+    d->detect_time = now;
+    return d->detected;
+}
+
+/**
+ * @brief feed one altimeter sample, drives the BARO and KALMAN votes
+ * @param now sample time in ms
+ * @param altitude barometric altitude in m
+ * @param velocity Kalman vertical velocity in m/s
+ * @return see APOGEE_DECISION, not APOGEE_NONE only on the sample apogee is declared
+ */
+uint8_t apogee_update(apogee_detector_t* d, uint32_t now, float altitude, float velocity) {
+    d->times[d->index] = now;
+    d->altitudes[d->index] = altitude;
+    d->index = (d->index + 1) % APOGEE_WINDOW_SIZE;
+    if(d->count < APOGEE_WINDOW_SIZE) {
+        d->count++;
+    }
+
+    if(!d->armed || d->detected) {
+        return APOGEE_NONE;
+    }
+
+    if(altitude > d->max_altitude) {
+        d->max_altitude = altitude;
+    }
+
+    // both baro estimators lose their input together
+    if(window_stuck(d)) {
+        d->votes[APOGEE_VOTER_BARO].healthy = 0;
+        d->votes[APOGEE_VOTER_KALMAN].healthy = 0;
+    }
+
+    d->slope = apogee_window_slope(d);
+
+    if(in_lockout(d, now) || d->count < APOGEE_WINDOW_SIZE) {
+        // no votes are held in the lockout, only the timeout can decide
+        reset_votes(d);
+        return decide(d, now);
+    }
+
+    cast(d, APOGEE_VOTER_BARO, d->slope <= d->slope_threshold, now);
+    cast(d, APOGEE_VOTER_KALMAN, velocity <= d->velocity_threshold, now);
+
+    return decide(d, now);
+}
+
+/**
+ * @brief feed one IMU sample, drives the ACCEL vote
+ * @param now sample time in ms
+ * @param axial_g acceleration along the rocket axis in g as read from the IMU
+ * @return see APOGEE_DECISION, not APOGEE_NONE only on the sample apogee is declared
+ */
+uint8_t apogee_update_accel(apogee_detector_t* d, uint32_t now, float axial_g) {
+    if(!d->armed) {
+        // kept for apogee_arm(), launch is detected after the burn has started
+        d->history_times[d->history_index] = now;
+        d->history[d->history_index] = axial_g;
+        d->history_index = (d->history_index + 1) % APOGEE_ACCEL_HISTORY;
+        if(d->history_count < APOGEE_ACCEL_HISTORY) {
+            d->history_count++;
+        }
+        return APOGEE_NONE;
+    }
+
+    if(d->detected) {
+        return APOGEE_NONE;
+    }
+
+    integrate(d, now, axial_g);
+
+    if(in_lockout(d, now)) {
+        reset_votes(d);
+        return decide(d, now);
+    }
+
+    cast(d, APOGEE_VOTER_ACCEL, d->accel_velocity <= d->velocity_threshold, now);
+
+    return decide(d, now);
+}
+
+/**
+ * @return votes currently held, bit n for APOGEE_VOTER n
+ */
+uint8_t apogee_vote_mask(const apogee_detector_t* d) {
+    uint8_t mask = 0;
+    for(uint8_t i = 0; i < NUM_APOGEE_VOTERS; i++) {
+        if(d->votes[i].vote) {
+            mask |= (1 << i);
+        }
+    }
+    return mask;
+}
+
+/**
+ * @return healthy estimators, bit n for APOGEE_VOTER n
+ */
+uint8_t apogee_health_mask(const apogee_detector_t* d) {
+    uint8_t mask = 0;
+    for(uint8_t i = 0; i < NUM_APOGEE_VOTERS; i++) {
+        if(d->votes[i].healthy) {
+            mask |= (1 << i);
+        }
+    }
+    return mask;
+}
+
+const char* apogee_voter_name(uint8_t voter) {
+    return voter < NUM_APOGEE_VOTERS ? voter_names[voter] : "UNKNOWN";
+}
@@ -0,0 +1,106 @@
+/**
+ * @file apogee_detector.h
+ * @brief Apogee decision by voting across independent estimators
+ *
+ * Three estimators each cast a vote once their criterion has held for `confidence`
+ * consecutive samples after the lockout:
+ *  - BARO    least squares slope of the last APOGEE_WINDOW_SIZE altitude samples
+ *  - KALMAN  vertical velocity of the Kalman filter
+ *  - ACCEL   vertical velocity integrated from the axial acceleration since launch
+ * Apogee is declared when the healthy estimators agree: 2 of 3 (or 2 of 2) votes, or
+ * the single vote left if only one estimator is healthy. If no decision is reached
+ * timeout_ms after launch, apogee is declared anyway.
+ *
+ * An estimator is dropped for the rest of the flight when its sensor is seen to fail:
+ * a baro window with no noise at all is a stuck sensor and drops BARO and KALMAN, which
+ * both come from the barometer; an axial reading at the IMU range drops ACCEL, as the
+ * integration has lost the clipped part of the thrust.
+ * The lockout starts at burnout (or launch) and hides the transonic baro glitches.
+ * Launch is declared some samples into the burn, so the last IMU samples are kept while
+ * disarmed and the integration starts from the launch sample, not from apogee_arm().
+ * All times are sample times. The IMU and barometer samples may arrive out of order by a
+ * conversion time, so the lockout and the timeout compare them signed.
+ * Every step depends only on the samples fed in, so replays are deterministic
+ */
+
+#ifndef APOGEE_DETECTOR_H
+#define APOGEE_DETECTOR_H
+
+#include <stdint.h>
+
+#define APOGEE_WINDOW_SIZE      10          /*!< altitude samples in the regression window */
+#define APOGEE_STUCK_BAND       0.01f       /*!< m, a full window spanning less than this is a stuck barometer */
+#define APOGEE_MAX_ACCEL_DT     0.1f        /*!< s, longer gaps between IMU samples are not integrated */
+#define APOGEE_ACCEL_HISTORY    32          /*!< IMU samples kept before arming, covers the launch detection delay */
+
+typedef enum {
+    APOGEE_VOTER_BARO = 0,
+    APOGEE_VOTER_KALMAN,
+    APOGEE_VOTER_ACCEL,
+    NUM_APOGEE_VOTERS
+} APOGEE_VOTER;
+
+typedef enum {
+    APOGEE_NONE = 0,                        /*!< no decision yet */
+    APOGEE_VOTED,                           /*!< the healthy estimators agreed */
+    APOGEE_TIMEOUT                          /*!< no agreement before the timeout */
+} APOGEE_DECISION;
+
+/**
+ * State of one estimator's vote
+ */
+typedef struct {
+    uint8_t count;                          /*!< consecutive samples that met the criterion */
+    uint8_t vote;                           /*!< 1 while count has reached the confidence */
+    uint8_t healthy;                        /*!< 0 once the sensor behind the estimator failed */
+    uint8_t voted;                          /*!< 1 once the estimator has voted */
+    uint32_t vote_time;                     /*!< time in ms of the first vote */
+} apogee_vote_t;
+
+typedef struct {
+    /* configuration */
+    uint32_t lockout_ms;                    /*!< no votes until this long after apogee_arm() */
+    float velocity_threshold;               /*!< Kalman and integrated velocity in m/s at or below which the vote counts */
+    float slope_threshold;                  /*!< regression slope in m/s at or below which the vote counts */
+    uint8_t confidence;                     /*!< consecutive samples an estimator needs to vote */
+    uint32_t timeout_ms;                    /*!< apogee is declared this long after launch without agreement */
+    float saturation_g;                     /*!< axial readings at or beyond this are clipped by the IMU */
+
+    /* regression window */
+    uint32_t times[APOGEE_WINDOW_SIZE];     /*!< sample times in ms */
+    float altitudes[APOGEE_WINDOW_SIZE];
+    uint8_t index;
+    uint8_t count;
+
+    /* accelerometer integration */
+    int8_t axis_sign;                       /*!< sign of the IMU X axis reading under thrust */
+    float accel_velocity;                   /*!< integrated vertical velocity in m/s */
+    uint32_t last_accel_time;               /*!< 0 until the first IMU sample after arming */
+    uint32_t history_times[APOGEE_ACCEL_HISTORY];   /*!< IMU sample times in ms while disarmed */
+    float history[APOGEE_ACCEL_HISTORY];    /*!< axial readings in g while disarmed */
+    uint8_t history_index;
+    uint8_t history_count;
+
+    uint8_t armed;                          /*!< 1 once apogee_arm() was called */
+    uint32_t arm_time;                      /*!< start of the lockout */
+    uint32_t launch_time;                   /*!< start of the timeout and of the integration */
+    apogee_vote_t votes[NUM_APOGEE_VOTERS];
+    float slope;                            /*!< latest regression slope in m/s */
+    float max_altitude;                     /*!< highest altitude seen since arming */
+    uint8_t detected;                       /*!< see APOGEE_DECISION */
+    uint8_t detect_votes;                   /*!< votes held at the decision, bit n for APOGEE_VOTER n */
+    uint32_t detect_time;
+} apogee_detector_t;
+
+void apogee_init(apogee_detector_t* d, uint32_t lockout_ms, float velocity_threshold, float slope_threshold, uint8_t confidence, uint32_t timeout_ms, float saturation_g);
+void apogee_arm(apogee_detector_t* d, uint32_t now, int8_t axis_sign, uint32_t launch_time);
+void apogee_disarm(apogee_detector_t* d);
+void apogee_restart_lockout(apogee_detector_t* d, uint32_t now, uint32_t lockout_ms);
+uint8_t apogee_update(apogee_detector_t* d, uint32_t now, float altitude, float velocity);
+uint8_t apogee_update_accel(apogee_detector_t* d, uint32_t now, float axial_g);
+uint8_t apogee_vote_mask(const apogee_detector_t* d);
+uint8_t apogee_health_mask(const apogee_detector_t* d);
+float apogee_window_slope(const apogee_detector_t* d);
+const char* apogee_voter_name(uint8_t voter);
+
+#endif
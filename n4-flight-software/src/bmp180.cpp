@@ -0,0 +1,116 @@
+/**
+ * @file bmp180.cpp
+ * @brief implements the BMP180 datasheet compensation
+ */
+
+#include <math.h>
+#include "bmp180.h"
+
+static int16_t s16(const uint8_t* raw) {
+    return (int16_t) ((raw[0] << 8) | raw[1]);
+}
+
+static uint16_t u16(const uint8_t* raw) {
+    return (uint16_t) ((raw[0] << 8) | raw[1]);
+}
+
+/**
+ * @brief unpack the BMP180_CALIBRATION_LENGTH bytes read from BMP180_CALIBRATION
+ */
+void bmp180_parse_calibration(bmp180_calibration_t* cal, const uint8_t* raw) {
+    cal->ac1 = s16(raw + 0);
+    cal->ac2 = s16(raw + 2);
+    cal->ac3 = s16(raw + 4);
+    cal->ac4 = u16(raw + 6);
+    cal->ac5 = u16(raw + 8);
+    cal->ac6 = u16(raw + 10);
+    cal->b1 = s16(raw + 12);
+    cal->b2 = s16(raw + 14);
+    cal->mb = s16(raw + 16);
+    cal->mc = s16(raw + 18);
+    cal->md = s16(raw + 20);
+}
+
+/**
+ * @brief control register value starting a pressure conversion
+ * @param oss oversampling setting 0 to 3, more samples take longer and are less noisy
+ */
+uint8_t bmp180_pressure_command(uint8_t oss) {
+    return BMP180_READ_PRESSURE + ((oss & 3) << 6);
+}
+
+/**
+ * @brief pressure conversion time in ms, rounded up
+ */
+uint8_t bmp180_pressure_time(uint8_t oss) {
+    static const uint8_t times[] = { 5, 8, 14, 26 };
+    return times[oss & 3];
+}
+
+/**
+ * @brief uncompensated temperature from the 2 result bytes
+ */
+int32_t bmp180_raw_temperature(const uint8_t* raw) {
+    return u16(raw);
+}
+
+/**
+ * @brief uncompensated pressure from the 3 result bytes
+ */
+int32_t bmp180_raw_pressure(const uint8_t* raw, uint8_t oss) {
+    return (((int32_t) raw[0] << 16) | ((int32_t) raw[1] << 8) | raw[2]) >> (8 - (oss & 3));
+}
+
+/**
+ * @brief temperature term the pressure compensation needs
+ * @param ut uncompensated temperature
+ */
+int32_t bmp180_b5(const bmp180_calibration_t* cal, int32_t ut) {
+    int32_t x1 = ((ut - (int32_t) cal->ac6) * (int32_t) cal->ac5) >> 15;
+    int32_t x2 = ((int32_t) cal->mc << 11) / (x1 + cal->md);
+
+    return x1 + x2;
+}
+
+/**
+ * @brief temperature in C
+ */
+double bmp180_temperature(int32_t b5) {
+    return ((b5 + 8) >> 4) / 10.0;
+}
+
+/**
+ * @brief compensated pressure in Pa
+ * @param up uncompensated pressure read with oversampling setting oss
+ * @param b5 from the temperature read before the pressure
+ */
+int32_t bmp180_pressure_pa(const bmp180_calibration_t* cal, int32_t up, uint8_t oss, int32_t b5) {
+    oss &= 3;
+
+    int32_t b6 = b5 - 4000;
+    int32_t x1 = (cal->b2 * ((b6 * b6) >> 12)) >> 11;
+    int32_t x2 = (cal->ac2 * b6) >> 11;
+    int32_t x3 = x1 + x2;
+    int32_t b3 = ((((int32_t) cal->ac1 * 4 + x3) << oss) + 2) / 4;
+
+    x1 = (cal->ac3 * b6) >> 13;
+    x2 = (cal->b1 * ((b6 * b6) >> 12)) >> 16;
+    x3 = (x1 + x2 + 2) >> 2;
+
+    uint32_t b4 = ((uint32_t) cal->ac4 * (uint32_t) (x3 + 32768)) >> 15;
+    uint32_t b7 = ((uint32_t) up - b3) * (uint32_t) (50000 >> oss);
+    int32_t p = b7 < 0x80000000 ? (int32_t) ((b7 * 2) / b4) : (int32_t) ((b7 / b4) * 2);
+
+    x1 = (p >> 8) * (p >> 8);
+    x1 = (x1 * 3038) >> 16;
+    x2 = (-7357 * p) >> 16;
+
+    return p + ((x1 + x2 + 3791) >> 4);
+}
+
+/**
+ * @brief altitude in m of a pressure above the level of a reference pressure, both in the same unit
+ */
+double bmp180_altitude(double pressure, double reference) {
+    return 44330.0 * (1 - pow(pressure / reference, 1 / 5.255));
+}
@@ -0,0 +1,49 @@
+/**
+ * @file bmp180.h
+ * @brief BMP180 registers and compensation, independent of how the bus is accessed
+ *
+ * The readAltimeter task moves the register bytes through the I2C bus manager and turns
+ * them into temperature and pressure here. A reading takes a temperature conversion for
+ * B5, then a pressure conversion compensated with it:
+ * - write BMP180_READ_TEMPERATURE to BMP180_CONTROL, wait BMP180_TEMPERATURE_TIME, read 2
+ *   bytes from BMP180_RESULT
+ * - write bmp180_pressure_command(oss) to BMP180_CONTROL, wait bmp180_pressure_time(oss),
+ *   read 3 bytes from BMP180_RESULT
+ *
+ * The compensation is the integer algorithm of the BMP180 datasheet, pressure has a
+ * resolution of 1 Pa
+ */
+
+#ifndef BMP180_H
+#define BMP180_H
+
+#include <stdint.h>
+
+#define BMP180_ADDRESS              0x77
+#define BMP180_CHIP_ID              0xD0
+#define BMP180_ID                   0x55    /*!< content of BMP180_CHIP_ID */
+#define BMP180_CALIBRATION          0xAA    /*!< first of the calibration registers, AC1 MSB */
+#define BMP180_CALIBRATION_LENGTH   22
+#define BMP180_CONTROL              0xF4
+#define BMP180_RESULT               0xF6
+#define BMP180_READ_TEMPERATURE     0x2E
+#define BMP180_READ_PRESSURE        0x34
+#define BMP180_TEMPERATURE_TIME     5       /*!< temperature conversion time in ms, 4.5 rounded up */
+
+typedef struct {
+    int16_t ac1, ac2, ac3;
+    uint16_t ac4, ac5, ac6;
+    int16_t b1, b2, mb, mc, md;
+} bmp180_calibration_t;
+
+void bmp180_parse_calibration(bmp180_calibration_t* cal, const uint8_t* raw);
+uint8_t bmp180_pressure_command(uint8_t oss);
+uint8_t bmp180_pressure_time(uint8_t oss);
+int32_t bmp180_raw_temperature(const uint8_t* raw);
+int32_t bmp180_raw_pressure(const uint8_t* raw, uint8_t oss);
+int32_t bmp180_b5(const bmp180_calibration_t* cal, int32_t ut);
+double bmp180_temperature(int32_t b5);
+int32_t bmp180_pressure_pa(const bmp180_calibration_t* cal, int32_t up, uint8_t oss, int32_t b5);
+double bmp180_altitude(double pressure, double reference);
+
+#endif
@@ -0,0 +1,104 @@
+/**
+ * @file burnout_detector.cpp
+ * @brief implements the burnout detector
+ */
+
+#include <string.h>
+#include "burnout_detector.h"
+
+/**
+ * @brief initialize the detector, it stays idle until burnout_arm() is called
+ * @param accel_threshold axial acceleration in g below which thrust is gone, normally 0
+ * @param jerk_threshold magnitude of the negative jerk in g/s that marks the thrust drop
+ * @param sustain_ms time the acceleration must stay below accel_threshold
+ * @param jerk_window_ms how long a jerk spike counts towards a detection
+ * @param filter_alpha weight of a new sample in the acceleration filter
+ */
+void burnout_init(burnout_detector_t* d, float accel_threshold, float jerk_threshold, uint32_t sustain_ms, uint32_t jerk_window_ms, float filter_alpha) {
+    memset(d, 0, sizeof(burnout_detector_t));
+    d->accel_threshold = accel_threshold;
+    d->jerk_threshold = jerk_threshold;
+    d->sustain_ms = sustain_ms;
+    d->jerk_window_ms = jerk_window_ms;
+    d->filter_alpha = filter_alpha;
+    d->axis_sign = 1;
+}
+
+/**
+ * @brief start detecting, call at launch
+ * @param axis_sign sign of the axial reading under thrust, see launch_detector_t::axis_sign
+ */
+void burnout_arm(burnout_detector_t* d, int8_t axis_sign) {
+    d->armed = 1;
+    d->axis_sign = axis_sign < 0 ? -1 : 1;
+    d->initialized = 0;
+    d->jerk_seen = 0;
+    d->below = 0;
+    d->detected = 0;
+}
+
+/**
+ * @brief stop detecting, e.g. after a rejected launch
+ */
+void burnout_disarm(burnout_detector_t* d) {
+    d->armed = 0;
+    d->detected = 0;
+}
+
+/**
+ * @brief feed one accelerometer sample
+ * @param now sample time in ms
+ * @param axial_accel acceleration along the rocket axis in g as read from the IMU
+ * @return 1 on the sample burnout is detected, 0 otherwise
+ */
+uint8_t burnout_update(burnout_detector_t* d, uint32_t now, float axial_accel) {
+    if(!d->armed || d->detected) {
+        return 0;
+    }
+
+    float a = axial_accel * d->axis_sign;
+
+    if(!d->initialized) {
+        d->accel = a;
+        d->last_time = now;
+        d->initialized = 1;
+        return 0;
+    }
+
+    uint32_t dt_ms = now - d->last_time;
+    if(dt_ms == 0) {
+        return 0;
+    }
+
+    float previous = d->accel;
+    d->accel += d->filter_alpha * (a - d->accel);
+    d->jerk = (d->accel - previous) * 1000.0f / dt_ms;
+    d->last_time = now;
+
+    if(d->jerk <= -d->jerk_threshold) {
+        d->jerk_seen = 1;
+        d->jerk_time = now;
+    }
+
+    if(d->jerk_seen && (now - d->jerk_time) > d->jerk_window_ms) {
+        d->jerk_seen = 0;
+    }
+
+    if(d->accel >= d->accel_threshold) {
+        d->below = 0;
+        return 0;
+    }
+
+    if(!d->below) {
+        d->below = 1;
+        d->below_since = now;
+    }
+
+    if(d->jerk_seen && (now - d->below_since) >= d->sustain_ms) {
+        d->detected = 1;
+        d->detect_time = now;
+        return 1;
+    }
+
+    return 0;
+}
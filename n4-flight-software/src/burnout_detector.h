@@ -0,0 +1,46 @@
+/**
+ * @file burnout_detector.h
+ * @brief Motor burnout detection from axial acceleration and jerk
+ *
+ * While the motor burns the accelerometer reads thrust minus drag along the rocket
+ * axis, a positive specific force. At burnout thrust collapses within tens of ms,
+ * or over a progressive tail-off of several hundred ms at a few g/s, giving a negative
+ * jerk, and the reading turns negative as only drag remains.
+ * Burnout is declared when the filtered axial acceleration has stayed below the
+ * threshold for sustain_ms and a jerk spike was seen within jerk_window_ms before
+ */
+
+#ifndef BURNOUT_DETECTOR_H
+#define BURNOUT_DETECTOR_H
+
+#include <stdint.h>
+
+typedef struct {
+    /* configuration */
+    float accel_threshold;      /*!< axial acceleration in g below which the motor is considered out, normally 0 */
+    float jerk_threshold;       /*!< jerk in g/s the thrust drop must exceed, positive number */
+    uint32_t sustain_ms;        /*!< time the acceleration must stay below the threshold */
+    uint32_t jerk_window_ms;    /*!< the jerk spike must have happened within this time */
+    float filter_alpha;         /*!< smoothing of the acceleration, 0..1, 1 means no smoothing */
+
+    uint8_t armed;
+    int8_t axis_sign;           /*!< +1 or -1, so that thrust reads positive */
+    uint8_t initialized;        /*!< 1 once the first sample seeded the filter */
+    float accel;                /*!< filtered axial acceleration in g */
+    float jerk;                 /*!< latest jerk in g/s */
+    uint32_t last_time;         /*!< time in ms of the previous sample */
+    uint32_t jerk_time;         /*!< time in ms of the last jerk spike */
+    uint8_t jerk_seen;
+    uint8_t below;
+    uint32_t below_since;       /*!< time in ms the acceleration went below the threshold */
+
+    uint8_t detected;
+    uint32_t detect_time;
+} burnout_detector_t;
+
+void burnout_init(burnout_detector_t* d, float accel_threshold, float jerk_threshold, uint32_t sustain_ms, uint32_t jerk_window_ms, float filter_alpha);
+void burnout_arm(burnout_detector_t* d, int8_t axis_sign);
+void burnout_disarm(burnout_detector_t* d);
+uint8_t burnout_update(burnout_detector_t* d, uint32_t now, float axial_accel);
+
+#endif
@@ -49,6 +49,16 @@ typedef struct Altimeter_Data{
     double AGL;                  /*!< altitude above ground level */
 } altimeter_type_t;
 
+/**
+ * Bits of telemetry_type_t::data_flags - which sensor groups of a packet hold valid data.
+ * Each producer task fills only its own group of the packet, the fusion stage fills every
+ * group that has recent data
+ */
+#define ACCEL_DATA_FLAG         (1 << 0)
+#define GYRO_DATA_FLAG          (1 << 1)
+#define ALTIMETER_DATA_FLAG     (1 << 2)
+#define GPS_DATA_FLAG           (1 << 3)
+
 /**
  * A structure to represent telemetry data. This is the data transmitted to ground
  */
@@ -56,6 +66,10 @@ typedef struct Telemetry_Data {
     uint32_t record_number;     /*!< current row number for flight data logging  */
     uint8_t operation_mode;     /*!< operation mode to tell whether we are in SAFE or FLIGHT mode */
     uint8_t state;              /*!< current flight state. See states.h */
+    uint8_t data_flags;         /*!< sensor groups filled in this packet, see *_DATA_FLAG */
+    uint8_t fresh_flags;        /*!< groups of data_flags holding a new sample, see sensor_fusion.h */
+    uint32_t trace_id;          /*!< sample number of the producing sensor, see latency_trace.h */
+    uint32_t acquired_us;       /*!< micros() when the sample was taken, the sample timer tick for the accelerometer and altimeter, the record time for fused records */
     altimeter_type_t alt_data;  /*!< altimeter data */
     accel_type_t acc_data;      /*!< accelerometer data */
     gyro_type_t gyro_data;      /*!< gyroscope data */
@@ -0,0 +1,188 @@
+/**
+ * @file flight_config.cpp
+ * @brief implements parsing and validation of the flight config record
+ */
+
+#include <string.h>
+#include "flight_config.h"
+
+// every field is 4 bytes with no padding, so the struct maps word for word onto the payload
+static_assert(sizeof(flight_config_t) == FLIGHT_CONFIG_PAYLOAD_SIZE, "flight_config_t must hold FLIGHT_CONFIG_NUM_FIELDS 4 byte fields");
+
+static const char* const status_names[] = {
+    "OK",
+    "TOO_SHORT",
+    "BAD_MAGIC",
+    "OLD_VERSION",
+    "NEW_VERSION",
+    "BAD_LENGTH",
+    "BAD_CRC",
+    "OUT_OF_RANGE"
+};
+
+static uint32_t read_u32(const uint8_t* p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint16_t read_u16(const uint8_t* p) {
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static void write_u32(uint8_t* p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+/**
+ * @brief standard CRC-32, reflected polynomial 0xEDB88320, same as zlib.crc32()
+ */
+uint32_t flight_config_crc32(const uint8_t* data, size_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+
+    for(size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for(uint8_t b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+/**
+ * @brief check that every value can be used by the detectors
+ * @return FLIGHT_CONFIG_OK or FLIGHT_CONFIG_OUT_OF_RANGE
+ */
+uint8_t flight_config_validate(const flight_config_t* cfg) {
+    // written so that NaN fails every check
+    if(!(cfg->launch_detection_threshold > 0) || !(cfg->launch_accel_threshold > 1.0f)) {
+        return FLIGHT_CONFIG_OUT_OF_RANGE;
+    }
+
+    if(!(cfg->burnout_filter_alpha > 0 && cfg->burnout_filter_alpha <= 1.0f) || !(cfg->burnout_jerk_threshold >= 0)) {
+        return FLIGHT_CONFIG_OUT_OF_RANGE;
+    }
+
+    if(cfg->apogee_confidence < 1 || cfg->apogee_confidence > 255 || cfg->apogee_timeout_ms <= cfg->apogee_lockout_ms) {
+        return FLIGHT_CONFIG_OUT_OF_RANGE;
+    }
+
+    if(!(cfg->apogee_velocity_threshold == cfg->apogee_velocity_threshold) || !(cfg->apogee_slope_threshold == cfg->apogee_slope_threshold)) {
+        return FLIGHT_CONFIG_OUT_OF_RANGE;
+    }
+
+    if(!(cfg->main_ejection_height > 0) || !(cfg->main_ejection_hysteresis >= 0) || cfg->main_ejection_confirm < 1 || cfg->main_ejection_confirm > 255) {
+        return FLIGHT_CONFIG_OUT_OF_RANGE;
+    }
+
+    if(!(cfg->landing_velocity_threshold > 0) || !(cfg->landing_altitude_band > 0) || cfg->landing_stable_ms == 0) {
+        return FLIGHT_CONFIG_OUT_OF_RANGE;
+    }
+
+    if(!(cfg->kalman_altitude_sigma > 0) || !(cfg->kalman_accel_sigma > 0) || !(cfg->kalman_innovation_gate > 0)) {
+        return FLIGHT_CONFIG_OUT_OF_RANGE;
+    }
+
+    if(cfg->log_interval_ground_ms == 0 || cfg->log_interval_powered_ms == 0 || cfg->log_interval_coasting_ms == 0 || cfg->log_interval_descent_ms == 0) {
+        return FLIGHT_CONFIG_OUT_OF_RANGE;
+    }
+
+    if(cfg->log_interval_ground_ms > 0xFFFF || cfg->log_interval_powered_ms > 0xFFFF || cfg->log_interval_coasting_ms > 0xFFFF || cfg->log_interval_descent_ms > 0xFFFF) {
+        return FLIGHT_CONFIG_OUT_OF_RANGE;
+    }
+
+    if(cfg->data_queue_length < 1 || cfg->data_queue_length > FLIGHT_CONFIG_MAX_QUEUE_LENGTH) {
+        return FLIGHT_CONFIG_OUT_OF_RANGE;
+    }
+
+    return FLIGHT_CONFIG_OK;
+}
+
+/**
+ * @brief check and decode a record
+ * @param cfg written only if the whole record is valid
+ * @param record record bytes as read from storage
+ * @param length number of bytes in record
+ * @return see FLIGHT_CONFIG_STATUS
+ */
+uint8_t flight_config_parse(flight_config_t* cfg, const uint8_t* record, size_t length) {
+    if(record == NULL || length < FLIGHT_CONFIG_HEADER_SIZE + FLIGHT_CONFIG_CRC_SIZE) {
+        return FLIGHT_CONFIG_TOO_SHORT;
+    }
+
+    if(read_u32(record) != FLIGHT_CONFIG_MAGIC) {
+        return FLIGHT_CONFIG_BAD_MAGIC;
+    }
+
+    uint16_t version = read_u16(record + 4);
+    uint16_t payload_length = read_u16(record + 6);
+
+    if(version < FLIGHT_CONFIG_VERSION) {
+        return FLIGHT_CONFIG_OLD_VERSION;
+    }
+
+    if(version > FLIGHT_CONFIG_VERSION) {
+        return FLIGHT_CONFIG_NEW_VERSION;
+    }
+
+    if(payload_length != FLIGHT_CONFIG_PAYLOAD_SIZE || length < FLIGHT_CONFIG_RECORD_SIZE) {
+        return FLIGHT_CONFIG_BAD_LENGTH;
+    }
+
+    size_t crc_offset = FLIGHT_CONFIG_HEADER_SIZE + FLIGHT_CONFIG_PAYLOAD_SIZE;
+    if(flight_config_crc32(record, crc_offset) != read_u32(record + crc_offset)) {
+        return FLIGHT_CONFIG_BAD_CRC;
+    }
+
+    flight_config_t parsed;
+    uint8_t* fields = (uint8_t*) &parsed;
+    const uint8_t* payload = record + FLIGHT_CONFIG_HEADER_SIZE;
+
+    for(uint8_t i = 0; i < FLIGHT_CONFIG_NUM_FIELDS; i++) {
+        uint32_t word = read_u32(payload + 4 * i);
+        memcpy(fields + 4 * i, &word, 4);
+    }
+
+    uint8_t status = flight_config_validate(&parsed);
+    if(status != FLIGHT_CONFIG_OK) {
+        return status;
+    }
+
+    *cfg = parsed;
+    return FLIGHT_CONFIG_OK;
+}
+
+/**
+ * @brief encode a config as a record
+ * @param out output buffer, FLIGHT_CONFIG_RECORD_SIZE bytes
+ * @return bytes written, 0 if out is too small
+ */
+size_t flight_config_serialize(const flight_config_t* cfg, uint8_t* out, size_t size) {
+    if(out == NULL || size < FLIGHT_CONFIG_RECORD_SIZE) {
+        return 0;
+    }
+
+    write_u32(out, FLIGHT_CONFIG_MAGIC);
+    out[4] = FLIGHT_CONFIG_VERSION & 0xFF;
+    out[5] = FLIGHT_CONFIG_VERSION >> 8;
+    out[6] = FLIGHT_CONFIG_PAYLOAD_SIZE & 0xFF;
+    out[7] = FLIGHT_CONFIG_PAYLOAD_SIZE >> 8;
+
+    const uint8_t* fields = (const uint8_t*) cfg;
+    for(uint8_t i = 0; i < FLIGHT_CONFIG_NUM_FIELDS; i++) {
+        uint32_t word;
+        memcpy(&word, fields + 4 * i, 4);
+        write_u32(out + FLIGHT_CONFIG_HEADER_SIZE + 4 * i, word);
+    }
+
+    size_t crc_offset = FLIGHT_CONFIG_HEADER_SIZE + FLIGHT_CONFIG_PAYLOAD_SIZE;
+    write_u32(out + crc_offset, flight_config_crc32(out, crc_offset));
+
+    return FLIGHT_CONFIG_RECORD_SIZE;
+}
+
+const char* flight_config_status_name(uint8_t status) {
+    return status < sizeof(status_names) / sizeof(status_names[0]) ? status_names[status] : "UNKNOWN";
+}
@@ -0,0 +1,98 @@
+/**
+ * @file flight_config.h
+ * @brief Versioned binary record of the site and flight parameters, loaded once at boot
+ *
+ * Record layout, all values little endian:
+ * magic (u32) | version (u16) | payload length (u16) | payload | CRC-32 (u32)
+ * The payload is the fields of flight_config_t in declaration order, each 4 bytes,
+ * u32 or IEEE 754 float. The CRC is the standard CRC-32 (zlib/Ethernet) of every byte
+ * before it. scripts/flight-config.py generates and verifies records.
+ *
+ * A record is only accepted whole: bad magic, other versions, a wrong length, a CRC
+ * mismatch or a value out of range leave the caller with its defaults
+ */
+
+#ifndef FLIGHT_CONFIG_H
+#define FLIGHT_CONFIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLIGHT_CONFIG_MAGIC         0x4346344E      /*!< "N4CF" */
+#define FLIGHT_CONFIG_VERSION       1
+#define FLIGHT_CONFIG_HEADER_SIZE   8
+#define FLIGHT_CONFIG_CRC_SIZE      4
+#define FLIGHT_CONFIG_NUM_FIELDS    31
+#define FLIGHT_CONFIG_PAYLOAD_SIZE  (FLIGHT_CONFIG_NUM_FIELDS * 4)
+#define FLIGHT_CONFIG_RECORD_SIZE   (FLIGHT_CONFIG_HEADER_SIZE + FLIGHT_CONFIG_PAYLOAD_SIZE + FLIGHT_CONFIG_CRC_SIZE)
+#define FLIGHT_CONFIG_MAX_QUEUE_LENGTH  24  /*!< longest data queue, the queue storage is reserved statically for it */
+
+typedef enum {
+    FLIGHT_CONFIG_OK = 0,
+    FLIGHT_CONFIG_TOO_SHORT,            /*!< fewer bytes than a header and CRC */
+    FLIGHT_CONFIG_BAD_MAGIC,            /*!< not a config record */
+    FLIGHT_CONFIG_OLD_VERSION,          /*!< written for older firmware, regenerate it */
+    FLIGHT_CONFIG_NEW_VERSION,          /*!< written for newer firmware */
+    FLIGHT_CONFIG_BAD_LENGTH,           /*!< payload length does not match the version */
+    FLIGHT_CONFIG_BAD_CRC,              /*!< corrupted */
+    FLIGHT_CONFIG_OUT_OF_RANGE          /*!< intact, but a value is not usable */
+} FLIGHT_CONFIG_STATUS;
+
+/**
+ * Flight parameters. The field order is the record payload order - append new fields
+ * at the end and bump FLIGHT_CONFIG_VERSION
+ */
+typedef struct {
+    /* launch */
+    float launch_detection_threshold;       /*!< m AGL the barometer must climb to register or confirm launch */
+    float launch_accel_threshold;           /*!< axial g above which thrust is registered */
+    uint32_t launch_accel_sustain_ms;
+    uint32_t launch_confirm_ms;
+
+    /* burnout */
+    float burnout_accel_threshold;
+    float burnout_jerk_threshold;
+    uint32_t burnout_sustain_ms;
+    uint32_t burnout_jerk_window_ms;
+    float burnout_filter_alpha;
+
+    /* apogee */
+    uint32_t apogee_lockout_ms;
+    uint32_t coast_apogee_lockout_ms;
+    float apogee_velocity_threshold;
+    float apogee_slope_threshold;
+    uint32_t apogee_confidence;
+    uint32_t apogee_timeout_ms;
+
+    /* main chute */
+    float main_ejection_height;             /*!< m AGL */
+    float main_ejection_hysteresis;
+    uint32_t main_ejection_confirm;
+
+    /* landing */
+    uint32_t landing_lockout_ms;
+    float landing_velocity_threshold;
+    float landing_altitude_band;
+    uint32_t landing_stable_ms;
+
+    /* altimeter */
+    uint32_t ground_calibration_ms;
+    float kalman_altitude_sigma;
+    float kalman_accel_sigma;
+    float kalman_innovation_gate;
+
+    /* logging and tasks */
+    uint32_t log_interval_ground_ms;
+    uint32_t log_interval_powered_ms;
+    uint32_t log_interval_coasting_ms;
+    uint32_t log_interval_descent_ms;
+    uint32_t data_queue_length;             /*!< length of each sensor data queue */
+} flight_config_t;
+
+uint8_t flight_config_parse(flight_config_t* cfg, const uint8_t* record, size_t length);
+size_t flight_config_serialize(const flight_config_t* cfg, uint8_t* out, size_t size);
+uint8_t flight_config_validate(const flight_config_t* cfg);
+uint32_t flight_config_crc32(const uint8_t* data, size_t length);
+const char* flight_config_status_name(uint8_t status);
+
+#endif
@@ -0,0 +1,286 @@
+/**
+ * @file flight_fsm.cpp
+ * @brief implements the table driven flight state machine
+ */
+
+#include <string.h>
+#include "flight_fsm.h"
+
+/* guards */
+static uint8_t apogee_allowed(const flight_fsm_t* fsm) {
+    return (fsm->now - fsm->launch_time) >= fsm->apogee_lockout_ms;
+}
+
+static uint8_t coast_apogee_allowed(const flight_fsm_t* fsm) {
+    return (fsm->now - fsm->burnout_time) >= fsm->coast_lockout_ms;
+}
+
+static uint8_t landing_allowed(const flight_fsm_t* fsm) {
+    return (fsm->now - fsm->apogee_time) >= fsm->landing_lockout_ms;
+}
+
+/* actions */
+static void record_launch(flight_fsm_t* fsm) {
+    fsm->launch_time = fsm->now;
+}
+
+static void record_burnout(flight_fsm_t* fsm) {
+    fsm->burnout_time = fsm->now;
+}
+
+static void record_apogee(flight_fsm_t* fsm) {
+    fsm->apogee_time = fsm->now;
+}
+
+#define IGNORE                      { FSM_NO_TRANSITION, NULL, NULL }
+#define GO(state)                   { ARMED_FLIGHT_STATE::state, NULL, NULL }
+#define GO_IF(state, guard, action) { ARMED_FLIGHT_STATE::state, guard, action }
+
+/**
+ * Transition table indexed by [current state][event]
+ */
+static const fsm_transition_t transition_table[NUM_FLIGHT_STATES][NUM_FLIGHT_EVENTS] = {
+    /* PRE_FLIGHT_GROUND */ {
+        /* LAUNCH */            GO_IF(POWERED_FLIGHT, NULL, record_launch),
+        /* BURNOUT */           IGNORE,
+        /* APOGEE */            IGNORE,
+        /* MAIN_ALTITUDE */     IGNORE,
+        /* LANDED */            IGNORE,
+        /* LAUNCH_REJECTED */   IGNORE,
+        /* DONE */              IGNORE
+    },
+    /* POWERED_FLIGHT */ {
+        /* LAUNCH */            IGNORE,
+        /* BURNOUT */           GO_IF(COASTING, NULL, record_burnout),
+        /* APOGEE */            GO_IF(APOGEE, apogee_allowed, record_apogee),
+        /* MAIN_ALTITUDE */     IGNORE,
+        /* LANDED */            IGNORE,
+        /* LAUNCH_REJECTED */   GO(PRE_FLIGHT_GROUND),
+        /* DONE */              IGNORE
+    },
+    /* COASTING */ {
+        /* LAUNCH */            IGNORE,
+        /* BURNOUT */           IGNORE,
+        /* APOGEE */            GO_IF(APOGEE, coast_apogee_allowed, record_apogee),
+        /* MAIN_ALTITUDE */     IGNORE,
+        /* LANDED */            IGNORE,
+        /* LAUNCH_REJECTED */   IGNORE,     /* burnout was seen, the rocket has flown */
+        /* DONE */              IGNORE
+    },
+    /* APOGEE */ {
+        /* LAUNCH */            IGNORE,
+        /* BURNOUT */           IGNORE,
+        /* APOGEE */            IGNORE,
+        /* MAIN_ALTITUDE */     IGNORE,
+        /* LANDED */            IGNORE,
+        /* LAUNCH_REJECTED */   IGNORE,
+        /* DONE */              GO(DROGUE_DEPLOY)
+    },
+    /* DROGUE_DEPLOY */ {
+        /* LAUNCH */            IGNORE,
+        /* BURNOUT */           IGNORE,
+        /* APOGEE */            IGNORE,
+        /* MAIN_ALTITUDE */     IGNORE,
+        /* LANDED */            IGNORE,
+        /* LAUNCH_REJECTED */   IGNORE,
+        /* DONE */              GO(DROGUE_DESCENT)
+    },
+    /* DROGUE_DESCENT */ {
+        /* LAUNCH */            IGNORE,
+        /* BURNOUT */           IGNORE,
+        /* APOGEE */            IGNORE,
+        /* MAIN_ALTITUDE */     GO(MAIN_DEPLOY),
+        /* LANDED */            GO_IF(POST_FLIGHT_GROUND, landing_allowed, NULL),
+        /* LAUNCH_REJECTED */   IGNORE,
+        /* DONE */              IGNORE
+    },
+    /* MAIN_DEPLOY */ {
+        /* LAUNCH */            IGNORE,
+        /* BURNOUT */           IGNORE,
+        /* APOGEE */            IGNORE,
+        /* MAIN_ALTITUDE */     IGNORE,
+        /* LANDED */            IGNORE,
+        /* LAUNCH_REJECTED */   IGNORE,
+        /* DONE */              GO(MAIN_DESCENT)
+    },
+    /* MAIN_DESCENT */ {
+        /* LAUNCH */            IGNORE,
+        /* BURNOUT */           IGNORE,
+        /* APOGEE */            IGNORE,
+        /* MAIN_ALTITUDE */     IGNORE,
+        /* LANDED */            GO_IF(POST_FLIGHT_GROUND, landing_allowed, NULL),
+        /* LAUNCH_REJECTED */   IGNORE,
+        /* DONE */              IGNORE
+    },
+    /* POST_FLIGHT_GROUND */ {
+        /* LAUNCH */            IGNORE,
+        /* BURNOUT */           IGNORE,
+        /* APOGEE */            IGNORE,
+        /* MAIN_ALTITUDE */     IGNORE,
+        /* LANDED */            IGNORE,
+        /* LAUNCH_REJECTED */   IGNORE,
+        /* DONE */              IGNORE
+    }
+};
+
+/**
+ * States left as soon as their entry hook has run
+ */
+static const uint8_t transient_state[NUM_FLIGHT_STATES] = {
+    0,  /* PRE_FLIGHT_GROUND */
+    0,  /* POWERED_FLIGHT */
+    0,  /* COASTING */
+    1,  /* APOGEE */
+    1,  /* DROGUE_DEPLOY */
+    0,  /* DROGUE_DESCENT */
+    1,  /* MAIN_DEPLOY */
+    0,  /* MAIN_DESCENT */
+    0   /* POST_FLIGHT_GROUND */
+};
+
+static const char* const state_names[NUM_FLIGHT_STATES] = {
+    "PRE_FLIGHT_GROUND",
+    "POWERED_FLIGHT",
+    "COASTING",
+    "APOGEE",
+    "DROGUE_DEPLOY",
+    "DROGUE_DESCENT",
+    "MAIN_DEPLOY",
+    "MAIN_DESCENT",
+    "POST_FLIGHT_GROUND"
+};
+
+static const char* const event_names[NUM_FLIGHT_EVENTS] = {
+    "LAUNCH",
+    "BURNOUT",
+    "APOGEE",
+    "MAIN_ALTITUDE",
+    "LANDED",
+    "LAUNCH_REJECTED",
+    "DONE"
+};
+
+/**
+ * @brief start the state machine in PRE_FLIGHT_GROUND with no hooks
+ * @param apogee_lockout_ms apogee events are ignored until this long after launch
+ * @param coast_lockout_ms in COASTING, apogee events are ignored until this long after burnout
+ * @param landing_lockout_ms landing events are ignored until this long after apogee
+ * @param now current time in ms
+ */
+void fsm_init(flight_fsm_t* fsm, uint32_t apogee_lockout_ms, uint32_t coast_lockout_ms, uint32_t landing_lockout_ms, uint32_t now) {
+    memset(fsm, 0, sizeof(flight_fsm_t));
+    fsm->state = ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND;
+    fsm->now = now;
+    fsm->state_entry_time = now;
+    fsm->apogee_lockout_ms = apogee_lockout_ms;
+    fsm->coast_lockout_ms = coast_lockout_ms;
+    fsm->landing_lockout_ms = landing_lockout_ms;
+}
+
+/**
+ * @brief set the functions called when a state is entered and left
+ * @param entry called after the state is entered, may be NULL
+ * @param exit called before the state is left, may be NULL
+ */
+void fsm_set_hooks(flight_fsm_t* fsm, uint8_t state, fsm_hook_t entry, fsm_hook_t exit) {
+    if(state >= NUM_FLIGHT_STATES) {
+        return;
+    }
+
+    fsm->entry[state] = entry;
+    fsm->exit[state] = exit;
+}
+
+/**
+ * @brief queue an event without processing it. Use from hooks, the event is handled
+ * once the current transition completes
+ * @return 1 if the event was queued, 0 if the queue is full or the event is invalid
+ */
+uint8_t fsm_post(flight_fsm_t* fsm, uint8_t event) {
+    if(event >= NUM_FLIGHT_EVENTS || fsm->event_count >= FSM_EVENT_QUEUE_LENGTH) {
+        fsm->dropped++;
+        return 0;
+    }
+
+    fsm->events[(fsm->event_head + fsm->event_count) % FSM_EVENT_QUEUE_LENGTH] = event;
+    fsm->event_count++;
+    return 1;
+}
+
+/**
+ * @brief transition for an event in a given state
+ * @return table entry, NULL if state or event are out of range
+ */
+const fsm_transition_t* fsm_lookup(uint8_t state, uint8_t event) {
+    if(state >= NUM_FLIGHT_STATES || event >= NUM_FLIGHT_EVENTS) {
+        return NULL;
+    }
+
+    return &transition_table[state][event];
+}
+
+/**
+ * @brief handle one event: guard, exit hook, action, state change, entry hook
+ */
+static void process(flight_fsm_t* fsm, uint8_t event) {
+    const fsm_transition_t* t = &transition_table[fsm->state][event];
+
+    if(t->next_state == FSM_NO_TRANSITION) {
+        return;
+    }
+
+    if(t->guard != NULL && !t->guard(fsm)) {
+        fsm->rejected++;
+        return;
+    }
+
+    uint8_t previous = fsm->state;
+    if(fsm->exit[previous] != NULL) {
+        fsm->exit[previous](fsm, previous);
+    }
+
+    if(t->action != NULL) {
+        t->action(fsm);
+    }
+
+    fsm->state = t->next_state;
+    fsm->state_entry_time = fsm->now;
+    fsm->transitions++;
+
+    if(fsm->entry[fsm->state] != NULL) {
+        fsm->entry[fsm->state](fsm, fsm->state);
+    }
+
+    if(transient_state[fsm->state]) {
+        fsm_post(fsm, EVENT_DONE);
+    }
+}
+
+/**
+ * @brief process an event and every event posted while handling it
+ * @param event event from the detectors
+ * @param now current time in ms
+ * @return the state after all pending events were handled
+ */
+uint8_t fsm_dispatch(flight_fsm_t* fsm, uint8_t event, uint32_t now) {
+    fsm->now = now;
+    fsm_post(fsm, event);
+
+    while(fsm->event_count > 0) {
+        uint8_t e = fsm->events[fsm->event_head];
+        fsm->event_head = (fsm->event_head + 1) % FSM_EVENT_QUEUE_LENGTH;
+        fsm->event_count--;
+
+        process(fsm, e);
+    }
+
+    return fsm->state;
+}
+
+const char* fsm_state_name(uint8_t state) {
+    return state < NUM_FLIGHT_STATES ? state_names[state] : "UNKNOWN";
+}
+
+const char* fsm_event_name(uint8_t event) {
+    return event < NUM_FLIGHT_EVENTS ? event_names[event] : "UNKNOWN";
+}
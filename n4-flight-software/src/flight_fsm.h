@@ -0,0 +1,91 @@
+/**
+ * @file flight_fsm.h
+ * @brief Table driven, event based flight state machine over ARMED_FLIGHT_STATE
+ *
+ * The detectors turn sensor data into flight events. Every (state, event) pair maps to
+ * one entry of a constant transition table holding the next state, an optional guard
+ * and an optional action, so dispatching an event is a single table lookup.
+ *
+ * Events are processed run to completion: entry and exit hooks may post further events,
+ * these are queued and handled after the current transition has finished. Transient
+ * states (APOGEE, DROGUE_DEPLOY, MAIN_DEPLOY) post EVENT_DONE once their entry hook
+ * returns, so the machine moves straight on without blocking delays.
+ *
+ * PRE_FLIGHT_GROUND  --LAUNCH-->   POWERED_FLIGHT  --BURNOUT-->  COASTING
+ * POWERED_FLIGHT  --LAUNCH_REJECTED-->  PRE_FLIGHT_GROUND
+ * POWERED_FLIGHT / COASTING  --APOGEE-->  APOGEE  --DONE-->  DROGUE_DEPLOY  --DONE-->  DROGUE_DESCENT
+ * DROGUE_DESCENT  --MAIN_ALTITUDE-->  MAIN_DEPLOY  --DONE-->  MAIN_DESCENT
+ * DROGUE_DESCENT / MAIN_DESCENT  --LANDED-->  POST_FLIGHT_GROUND
+ */
+
+#ifndef FLIGHT_FSM_H
+#define FLIGHT_FSM_H
+
+#include <stdint.h>
+#include "states.h"
+
+#define NUM_FLIGHT_STATES           (ARMED_FLIGHT_STATE::POST_FLIGHT_GROUND + 1)
+#define FSM_EVENT_QUEUE_LENGTH      8       /*!< events that can be pending during one dispatch */
+#define FSM_NO_TRANSITION           0xFF    /*!< next state of table entries that ignore the event */
+
+typedef enum {
+    EVENT_LAUNCH = 0,       /*!< liftoff detected */
+    EVENT_BURNOUT,          /*!< motor burnout detected */
+    EVENT_APOGEE,           /*!< apogee detected */
+    EVENT_MAIN_ALTITUDE,    /*!< descended through the main chute deploy altitude */
+    EVENT_LANDED,           /*!< back on the ground */
+    EVENT_LAUNCH_REJECTED,  /*!< the barometer did not confirm the launch */
+    EVENT_DONE,             /*!< a transient state finished its entry action */
+    NUM_FLIGHT_EVENTS
+} FLIGHT_EVENT;
+
+struct flight_fsm_t;
+
+typedef uint8_t (*fsm_guard_t)(const struct flight_fsm_t* fsm);
+typedef void (*fsm_action_t)(struct flight_fsm_t* fsm);
+typedef void (*fsm_hook_t)(struct flight_fsm_t* fsm, uint8_t state);
+
+/**
+ * One entry of the transition table
+ */
+typedef struct {
+    uint8_t next_state;             /*!< FSM_NO_TRANSITION if the event is ignored in this state */
+    fsm_guard_t guard;              /*!< the transition is only taken if this returns 1, NULL to always take it */
+    fsm_action_t action;            /*!< run between the exit and entry hooks, may be NULL */
+} fsm_transition_t;
+
+typedef struct flight_fsm_t {
+    uint8_t state;
+    uint32_t now;                   /*!< time in ms of the event being dispatched */
+    uint32_t state_entry_time;      /*!< time in ms the current state was entered */
+    uint32_t launch_time;           /*!< time in ms of liftoff */
+    uint32_t burnout_time;          /*!< time in ms of motor burnout */
+    uint32_t apogee_time;           /*!< time in ms of apogee */
+
+    uint32_t apogee_lockout_ms;     /*!< apogee is ignored until this long after launch */
+    uint32_t coast_lockout_ms;      /*!< in COASTING apogee is ignored until this long after burnout */
+    uint32_t landing_lockout_ms;    /*!< landing is ignored until this long after apogee */
+
+    fsm_hook_t entry[NUM_FLIGHT_STATES];
+    fsm_hook_t exit[NUM_FLIGHT_STATES];
+
+    uint8_t events[FSM_EVENT_QUEUE_LENGTH];     /*!< events waiting to be processed */
+    uint8_t event_head;
+    uint8_t event_count;
+
+    uint32_t transitions;           /*!< transitions taken */
+    uint32_t rejected;              /*!< events whose guard refused the transition */
+    uint32_t dropped;               /*!< events lost because the queue was full */
+
+    void* context;                  /*!< free for the hooks to use */
+} flight_fsm_t;
+
+void fsm_init(flight_fsm_t* fsm, uint32_t apogee_lockout_ms, uint32_t coast_lockout_ms, uint32_t landing_lockout_ms, uint32_t now);
+void fsm_set_hooks(flight_fsm_t* fsm, uint8_t state, fsm_hook_t entry, fsm_hook_t exit);
+uint8_t fsm_post(flight_fsm_t* fsm, uint8_t event);
+uint8_t fsm_dispatch(flight_fsm_t* fsm, uint8_t event, uint32_t now);
+const fsm_transition_t* fsm_lookup(uint8_t state, uint8_t event);
+const char* fsm_state_name(uint8_t state);
+const char* fsm_event_name(uint8_t event);
+
+#endif
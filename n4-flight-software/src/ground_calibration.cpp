@@ -0,0 +1,58 @@
+/**
+ * @file ground_calibration.cpp
+ * @brief implements the ground pressure calibration
+ */
+
+#include <string.h>
+#include "ground_calibration.h"
+
+/**
+ * @brief restart the calibration
+ * @param duration_ms time in ms to average the pressure over
+ */
+void ground_cal_init(ground_calibration_t* g, uint32_t duration_ms) {
+    memset(g, 0, sizeof(ground_calibration_t));
+    g->duration_ms = duration_ms;
+}
+
+/**
+ * @brief add a pressure sample, samples after the calibration finished are ignored
+ * @param now current time in ms
+ * @param pressure barometer pressure in mb
+ * @return 1 once the ground pressure is known
+ */
+uint8_t ground_cal_update(ground_calibration_t* g, uint32_t now, double pressure) {
+    if(g->calibrated) {
+        return 1;
+    }
+
+    if(g->samples == 0) {
+        g->start_time = now;
+    } else {
+        double mean = g->pressure_sum / g->samples;
+        double deviation = pressure > mean ? pressure - mean : mean - pressure;
+        if(deviation > GROUND_CAL_MAX_DEVIATION) {
+            g->skipped++;
+
+            // more outliers than samples means the first samples were the bad ones, start over
+            if(g->skipped <= g->samples) {
+                return 0;
+            }
+
+            g->pressure_sum = 0;
+            g->samples = 0;
+            g->skipped = 0;
+            g->start_time = now;
+        }
+    }
+
+    g->pressure_sum += pressure;
+    g->samples++;
+
+    if((now - g->start_time) >= g->duration_ms && g->samples >= GROUND_CAL_MIN_SAMPLES) {
+        g->ground_pressure = g->pressure_sum / g->samples;
+        g->calibrated = 1;
+    }
+
+    return g->calibrated;
+}
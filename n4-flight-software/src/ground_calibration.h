@@ -0,0 +1,34 @@
+/**
+ * @file ground_calibration.h
+ * @brief Pad calibration of the ground level pressure
+ *
+ * The barometer is averaged over a fixed time on the pad to get the ground pressure
+ * that AGL altitude is measured from. Averaging over seconds rather than latching one
+ * reading removes the sensor noise from the reference every later altitude depends on.
+ * Samples further than GROUND_CAL_MAX_DEVIATION from the running mean are skipped so
+ * one bad reading does not shift the reference. If the outliers outnumber the samples
+ * the calibration starts over from the latest sample
+ */
+
+#ifndef GROUND_CALIBRATION_H
+#define GROUND_CALIBRATION_H
+
+#include <stdint.h>
+
+#define GROUND_CAL_MIN_SAMPLES      10      /*!< calibration is not finished with fewer samples than this */
+#define GROUND_CAL_MAX_DEVIATION    1.0     /*!< mb from the running mean above which a sample is skipped, about 8 m */
+
+typedef struct {
+    uint32_t duration_ms;           /*!< time to average over */
+    uint32_t start_time;            /*!< time in ms of the first sample */
+    double pressure_sum;
+    uint32_t samples;               /*!< samples averaged */
+    uint32_t skipped;               /*!< samples rejected as outliers */
+    double ground_pressure;         /*!< mean pressure in mb, valid once calibrated */
+    uint8_t calibrated;
+} ground_calibration_t;
+
+void ground_cal_init(ground_calibration_t* g, uint32_t duration_ms);
+uint8_t ground_cal_update(ground_calibration_t* g, uint32_t now, double pressure);
+
+#endif
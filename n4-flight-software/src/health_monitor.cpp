@@ -0,0 +1,105 @@
+/**
+ * @file health_monitor.cpp
+ * @brief implements task stall detection and recovery escalation
+ */
+
+#include <string.h>
+#include "health_monitor.h"
+
+void health_init(health_monitor_t* m) {
+    memset(m, 0, sizeof(health_monitor_t));
+}
+
+/**
+ * @brief start watching a task, it counts as checked in now
+ * @param timeout_ms time without a check-in that counts as a stall
+ * @param restart_ms time for the first check-in after the watch or a recovery attempt, at least timeout_ms
+ * @param max_recoveries recovery attempts before failing over, 0 to fail over at once
+ */
+void health_watch(health_monitor_t* m, uint8_t task, uint32_t timeout_ms, uint32_t restart_ms, uint8_t max_recoveries, uint32_t now) {
+    health_entry_t* e = &m->tasks[task];
+
+    memset(e, 0, sizeof(health_entry_t));
+    e->timeout_ms = timeout_ms;
+    e->restart_ms = restart_ms > timeout_ms ? restart_ms : timeout_ms;
+    e->max_recoveries = max_recoveries;
+    e->last_checkin = now;
+
+    __atomic_or_fetch(&m->watched, 1UL << task, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief called by a watched task once per loop
+ */
+void health_checkin(health_monitor_t* m, uint8_t task, uint32_t now) {
+    health_entry_t* e = &m->tasks[task];
+
+    __atomic_store_n(&e->last_checkin, now, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&e->checkins, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief check one task for a stall
+ * @return HEALTH_ACTION the caller has to take
+ */
+uint8_t health_check(health_monitor_t* m, uint8_t task, uint32_t now) {
+    if(!(__atomic_load_n(&m->watched, __ATOMIC_ACQUIRE) & (1UL << task))) {
+        return HEALTH_NONE;
+    }
+
+    health_entry_t* e = &m->tasks[task];
+    uint32_t last = __atomic_load_n(&e->last_checkin, __ATOMIC_RELAXED);
+
+    if(e->status != HEALTH_OK) {
+        // checked in since the stall started
+        if(last != e->stall_start) {
+            uint32_t gap = last - e->stall_start;
+            if(gap > e->longest_stall_ms) {
+                e->longest_stall_ms = gap;
+            }
+
+            e->status = HEALTH_OK;
+            e->recoveries = 0;
+            m->failed &= ~(1UL << task);
+            return HEALTH_RESTORED;
+        }
+
+        if(e->status == HEALTH_FAILED || now - e->last_attempt < e->restart_ms) {
+            return HEALTH_NONE;
+        }
+
+        e->last_attempt = now;
+
+        if(e->recoveries < e->max_recoveries) {
+            e->recoveries++;
+            return HEALTH_RECOVER;
+        }
+
+        e->status = HEALTH_FAILED;
+        e->failovers++;
+        m->failed |= 1UL << task;
+        return HEALTH_FAILOVER;
+    }
+
+    // no check-in since the watch started, the first one may take a whole response time
+    uint32_t timeout = __atomic_load_n(&e->checkins, __ATOMIC_ACQUIRE) == 0 ? e->restart_ms : e->timeout_ms;
+
+    if(now - last <= timeout) {
+        return HEALTH_NONE;
+    }
+
+    e->status = HEALTH_STALLED;
+    e->stall_start = last;
+    e->last_attempt = now;
+    e->stalls++;
+
+    if(e->max_recoveries == 0) {
+        e->status = HEALTH_FAILED;
+        e->failovers++;
+        m->failed |= 1UL << task;
+        return HEALTH_FAILOVER;
+    }
+
+    e->recoveries = 1;
+    return HEALTH_RECOVER;
+}
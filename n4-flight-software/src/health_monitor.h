@@ -0,0 +1,71 @@
+/**
+ * @file health_monitor.h
+ * @brief Task stall detection with escalating recovery
+ *
+ * Each watched task checks in with health_checkin() when it made progress, once per loop
+ * or per good sample. The monitor task calls health_check() for every watched task each
+ * period. A task that has not checked in for its timeout, one of its periods and a margin
+ * for its check-in jitter, is stalled and the check asks the caller for a recovery attempt.
+ * A task that was just watched or recovered has its restart time for the first check-in,
+ * which may follow a whole response time including a sleep on hardware. While it stays
+ * stalled another attempt is asked for every restart time, up to max_recoveries, then the
+ * check asks the caller to fail over to another data source. A check-in after a stall or
+ * failover restores the task.
+ *
+ * What a recovery attempt does is up to the caller, the attempt number is in recoveries,
+ * e.g. reset the bus first and restart the task next.
+ *
+ * Check-ins come from tasks on both cores and use atomic stores, the rest of the monitor
+ * is used from the monitor task only
+ */
+
+#ifndef HEALTH_MONITOR_H
+#define HEALTH_MONITOR_H
+
+#include <stdint.h>
+#include "task_schedule.h"
+
+typedef enum {
+    HEALTH_OK = 0,
+    HEALTH_STALLED,                     /*!< recovery attempts in progress */
+    HEALTH_FAILED                       /*!< recovery gave up, the caller failed over */
+} HEALTH_STATUS;
+
+typedef enum {
+    HEALTH_NONE = 0,                    /*!< nothing to do */
+    HEALTH_RECOVER,                     /*!< stalled, make recovery attempt number recoveries */
+    HEALTH_FAILOVER,                    /*!< recovery failed, switch to another data source */
+    HEALTH_RESTORED                     /*!< the task checked in again after a stall or failover */
+} HEALTH_ACTION;
+
+typedef struct {
+    uint32_t timeout_ms;                /*!< time without a check-in that counts as a stall */
+    uint32_t restart_ms;                /*!< time a newly watched or recovered task gets for its first check-in */
+    uint8_t max_recoveries;             /*!< attempts before failing over */
+
+    /* written by the watched task */
+    uint32_t last_checkin;              /*!< time in ms of the latest check-in */
+    uint32_t checkins;
+
+    /* written by the monitor */
+    uint8_t status;                     /*!< HEALTH_STATUS */
+    uint8_t recoveries;                 /*!< attempts made in the current stall */
+    uint32_t last_attempt;              /*!< time in ms of the stall detection or latest attempt */
+    uint32_t stall_start;               /*!< last check-in before the current stall */
+    uint32_t stalls;                    /*!< stalls detected */
+    uint32_t failovers;
+    uint32_t longest_stall_ms;          /*!< longest time without a check-in of a restored stall */
+} health_entry_t;
+
+typedef struct {
+    health_entry_t tasks[NUM_FLIGHT_TASKS];
+    uint32_t watched;                   /*!< bit i set if flight_tasks[i] is watched */
+    uint32_t failed;                    /*!< bit i set while flight_tasks[i] is failed over */
+} health_monitor_t;
+
+void health_init(health_monitor_t* m);
+void health_watch(health_monitor_t* m, uint8_t task, uint32_t timeout_ms, uint32_t restart_ms, uint8_t max_recoveries, uint32_t now);
+void health_checkin(health_monitor_t* m, uint8_t task, uint32_t now);
+uint8_t health_check(health_monitor_t* m, uint8_t task, uint32_t now);
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * @file heap_guard.cpp
+ * @brief implements the post arming heap growth check
+ */
+
+#include <string.h>
+#include "heap_guard.h"
+
+void heap_guard_init(heap_guard_t* g, uint32_t tolerance) {
+    memset(g, 0, sizeof(heap_guard_t));
+    g->tolerance = tolerance;
+}
+
+/**
+ * @brief take the reference the later samples are compared against
+ */
+void heap_guard_arm(heap_guard_t* g, uint32_t allocated_blocks, uint32_t free_bytes) {
+    g->armed = 1;
+    g->arm_blocks = allocated_blocks;
+    g->arm_free = free_bytes;
+    g->peak_blocks = allocated_blocks;
+    g->min_free = free_bytes;
+}
+
+void heap_guard_disarm(heap_guard_t* g) {
+    g->armed = 0;
+}
+
+/**
+ * @brief compare a sample of the allocator statistics against the arming reference
+ * @return see HEAP_GUARD_RESULT, HEAP_GUARD_GROWTH is the one to log
+ */
+uint8_t heap_guard_check(heap_guard_t* g, uint32_t allocated_blocks, uint32_t free_bytes) {
+    if(!g->armed) {
+        return HEAP_GUARD_OK;
+    }
+
+    if(free_bytes < g->min_free) {
+        g->min_free = free_bytes;
+    }
+
+    if(allocated_blocks <= g->arm_blocks + g->tolerance) {
+        return HEAP_GUARD_OK;
+    }
+
+    g->violations++;
+
+    if(allocated_blocks > g->peak_blocks) {
+        g->peak_blocks = allocated_blocks;
+        return HEAP_GUARD_GROWTH;
+    }
+
+    return HEAP_GUARD_OVER;
+}
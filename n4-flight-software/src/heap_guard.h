@@ -0,0 +1,44 @@
+/**
+ * @file heap_guard.h
+ * @brief Detects heap growth after the pyros are armed
+ *
+ * Tasks, queues and buffers are allocated before launch, in flight nothing of the flight
+ * software should allocate. The guard takes the allocator's count of allocated blocks
+ * when the pyros arm and compares every later sample against it. The WiFi stack and
+ * SPIFFS allocate and free transient buffers of their own, HEAP_GUARD_BLOCK_TOLERANCE
+ * blocks of growth are accepted for those. Anything above is a leak or an allocation in
+ * the flight path and is reported.
+ *
+ * The guard reports, it does not stop the flight computer - a reset in flight would
+ * lose the flight state. The host test in test/heap-guard runs with no tolerance
+ */
+
+#ifndef HEAP_GUARD_H
+#define HEAP_GUARD_H
+
+#include <stdint.h>
+
+#define HEAP_GUARD_BLOCK_TOLERANCE  16      /*!< blocks above the arming count taken as transient network and file buffers */
+
+typedef enum {
+    HEAP_GUARD_OK = 0,              /*!< disarmed or within the tolerance */
+    HEAP_GUARD_GROWTH,              /*!< above the tolerance and higher than any earlier sample */
+    HEAP_GUARD_OVER                 /*!< still above the tolerance, no new peak */
+} HEAP_GUARD_RESULT;
+
+typedef struct {
+    uint8_t armed;
+    uint32_t tolerance;             /*!< allocated blocks above the arming count that are accepted */
+    uint32_t arm_blocks;            /*!< allocated blocks when armed */
+    uint32_t arm_free;              /*!< free heap in bytes when armed */
+    uint32_t peak_blocks;           /*!< most allocated blocks seen since arming */
+    uint32_t min_free;              /*!< least free heap seen since arming */
+    uint32_t violations;            /*!< samples above the tolerance */
+} heap_guard_t;
+
+void heap_guard_init(heap_guard_t* g, uint32_t tolerance);
+void heap_guard_arm(heap_guard_t* g, uint32_t allocated_blocks, uint32_t free_bytes);
+void heap_guard_disarm(heap_guard_t* g);
+uint8_t heap_guard_check(heap_guard_t* g, uint32_t allocated_blocks, uint32_t free_bytes);
+
+#endif
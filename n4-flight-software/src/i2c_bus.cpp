@@ -0,0 +1,156 @@
+/**
+ * @file i2c_bus.cpp
+ * @brief implements the prioritised I2C transaction queue of the bus manager
+ */
+
+#include <string.h>
+#include "i2c_bus.h"
+
+static_assert((I2C_QUEUE_LENGTH & (I2C_QUEUE_LENGTH - 1)) == 0, "I2C_QUEUE_LENGTH must be a power of two");
+
+void i2c_bus_init(i2c_bus_t* bus, I2CBusHardware* hw, uint8_t max_retries) {
+    memset(bus, 0, sizeof(i2c_bus_t));
+    bus->hw = hw;
+    bus->max_retries = max_retries;
+}
+
+/**
+ * @brief set up a register read, priority, done and context are left as they are
+ */
+void i2c_txn_read(i2c_txn_t* txn, uint8_t address, uint8_t reg, uint8_t* rx, uint8_t rx_len) {
+    txn->address = address;
+    txn->tx[0] = reg;
+    txn->tx_len = 1;
+    txn->rx = rx;
+    txn->rx_len = rx_len;
+}
+
+/**
+ * @brief set up a one byte register write, priority, done and context are left as they are
+ */
+void i2c_txn_write(i2c_txn_t* txn, uint8_t address, uint8_t reg, uint8_t value) {
+    txn->address = address;
+    txn->tx[0] = reg;
+    txn->tx[1] = value;
+    txn->tx_len = 2;
+    txn->rx = NULL;
+    txn->rx_len = 0;
+}
+
+/**
+ * @brief queue a transaction for the bus manager
+ * @return 1 if queued. 0 if the transaction is still pending from an earlier submission,
+ * or if its pending list is full, then its status is I2C_REJECTED
+ */
+uint8_t i2c_bus_submit(i2c_bus_t* bus, i2c_txn_t* txn, uint32_t now_us) {
+    if(__atomic_load_n(&txn->status, __ATOMIC_ACQUIRE) == I2C_PENDING) {
+        return 0;
+    }
+
+    uint8_t p = txn->priority < NUM_I2C_PRIORITIES ? txn->priority : (uint8_t) I2C_PRIORITY_LOW;
+
+    if(bus->tail[p] - bus->head[p] >= I2C_QUEUE_LENGTH) {
+        bus->rejected++;
+        __atomic_store_n(&txn->status, I2C_REJECTED, __ATOMIC_RELEASE);
+        return 0;
+    }
+
+    txn->submitted_us = now_us;
+    __atomic_store_n(&txn->status, I2C_PENDING, __ATOMIC_RELEASE);
+
+    bus->pending[p][bus->tail[p] & (I2C_QUEUE_LENGTH - 1)] = txn;
+    bus->tail[p]++;
+
+    return 1;
+}
+
+/**
+ * @brief take the next transaction to run
+ * @return the oldest transaction of the highest priority, NULL if none is pending
+ */
+i2c_txn_t* i2c_bus_next(i2c_bus_t* bus) {
+    for(uint8_t p = 0; p < NUM_I2C_PRIORITIES; p++) {
+        if(bus->head[p] != bus->tail[p]) {
+            return bus->pending[p][bus->head[p]++ & (I2C_QUEUE_LENGTH - 1)];
+        }
+    }
+
+    return NULL;
+}
+
+static void recover(i2c_bus_t* bus) {
+    bus->hw->recover();
+    bus->recoveries++;
+}
+
+/**
+ * @brief ask the bus manager to recover the bus before its next transfer, from any task
+ */
+void i2c_bus_request_recovery(i2c_bus_t* bus) {
+    __atomic_store_n(&bus->recover_requested, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief recover the bus if a recovery was requested
+ * @return 1 if the bus was recovered
+ */
+uint8_t i2c_bus_check_recovery(i2c_bus_t* bus) {
+    if(!__atomic_exchange_n(&bus->recover_requested, 0, __ATOMIC_ACQ_REL)) {
+        return 0;
+    }
+
+    uint32_t start = bus->hw->timeUs();
+    recover(bus);
+    bus->busy_us += bus->hw->timeUs() - start;
+
+    return 1;
+}
+
+/**
+ * @brief run a transaction, retrying a failed transfer, then call its done callback
+ * A transaction run without i2c_bus_submit() needs submitted_us set for the wait statistics
+ * @return the final I2C_STATUS of the transaction
+ */
+uint8_t i2c_bus_run(i2c_bus_t* bus, i2c_txn_t* txn) {
+    i2c_bus_check_recovery(bus);
+
+    uint32_t start = bus->hw->timeUs();
+    uint32_t wait = start - txn->submitted_us;
+    uint8_t p = txn->priority < NUM_I2C_PRIORITIES ? txn->priority : (uint8_t) I2C_PRIORITY_LOW;
+
+    if(wait > bus->max_wait_us[p]) {
+        bus->max_wait_us[p] = wait;
+    }
+
+    uint8_t status = bus->hw->transfer(txn);
+
+    for(uint8_t attempt = 0; status != I2C_DONE && attempt < bus->max_retries; attempt++) {
+        bus->retries++;
+
+        // a device stopped in the middle of a byte holds SDA low until it is clocked out
+        if(bus->hw->sdaStuck()) {
+            recover(bus);
+        }
+
+        status = bus->hw->transfer(txn);
+    }
+
+    txn->started_us = start;
+    txn->completed_us = bus->hw->timeUs();
+    bus->busy_us += txn->completed_us - start;
+
+    if(status == I2C_DONE) {
+        bus->completed++;
+        bus->bytes += txn->tx_len + txn->rx_len;
+    } else {
+        bus->failed++;
+    }
+
+    __atomic_store_n(&txn->status, status, __ATOMIC_RELEASE);
+
+    if(txn->done != NULL) {
+        txn->done(txn);
+    }
+
+    return status;
+}
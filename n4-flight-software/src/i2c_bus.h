@@ -0,0 +1,121 @@
+/**
+ * @file i2c_bus.h
+ * @brief I2C bus shared by several tasks through prioritised transactions
+ *
+ * Only the bus manager task drives the I2C controller. A sensor task describes a transfer
+ * in an i2c_txn_t, submits it and is told by the done callback when it completed, so two
+ * tasks can no longer interleave their transfers on the Wire driver or read each other's
+ * receive buffer. A transaction writes tx_len bytes, a register address and maybe data,
+ * and if rx_len is not 0 reads rx_len bytes after a repeated start.
+ *
+ * Pending transactions are served highest priority first and in submission order within
+ * a priority. A transfer on the bus is never preempted, so a transaction waits at most for
+ * the one on the bus and those of higher priority. A failed transfer is retried up to
+ * max_retries times, and before a retry a bus whose SDA is held low is recovered, see
+ * I2CBusHardware::recover(). Any task may ask for a recovery before the next transfer with
+ * i2c_bus_request_recovery().
+ *
+ * i2c_bus_submit() and i2c_bus_next() share the pending lists, the caller keeps them from
+ * running at the same time. i2c_bus_run() and i2c_bus_check_recovery() are called from the
+ * bus manager only
+ */
+
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <stdint.h>
+
+#define I2C_QUEUE_LENGTH    8               /*!< pending transactions per priority, a power of two */
+#define I2C_TX_MAX          4               /*!< bytes a transaction writes at most */
+
+typedef enum {
+    I2C_IDLE = 0,                           /*!< not submitted yet */
+    I2C_PENDING,                            /*!< waiting for the bus or on it */
+    I2C_DONE,
+    I2C_NACK,                               /*!< the device did not acknowledge, after the retries */
+    I2C_BUS_ERROR,                          /*!< timeout or lost arbitration, after the retries */
+    I2C_REJECTED                            /*!< the pending list of its priority was full */
+} I2C_STATUS;
+
+typedef enum {
+    I2C_PRIORITY_HIGH = 0,
+    I2C_PRIORITY_LOW,
+    NUM_I2C_PRIORITIES
+} I2C_PRIORITY;
+
+struct i2c_txn;
+typedef void (*i2c_done_t)(struct i2c_txn* txn);
+
+typedef struct i2c_txn {
+    uint8_t address;                        /*!< 7 bit device address */
+    uint8_t priority;                       /*!< I2C_PRIORITY */
+    uint8_t tx[I2C_TX_MAX];
+    uint8_t tx_len;
+    uint8_t* rx;                            /*!< filled by the bus manager, must outlive the transaction */
+    uint8_t rx_len;
+    i2c_done_t done;                        /*!< called by the bus manager once the transaction completed or failed */
+    void* context;                          /*!< for the done callback */
+    uint8_t status;                         /*!< I2C_STATUS, read it with an acquire load from another task */
+    uint32_t submitted_us;
+    uint32_t started_us;
+    uint32_t completed_us;
+} i2c_txn_t;
+
+/**
+ * The I2C controller as seen by the bus manager, the Wire driver on the flight computer
+ * and a simulated bus on the host
+ */
+class I2CBusHardware {
+    public:
+        virtual ~I2CBusHardware() {}
+
+        /**
+         * @brief run one transaction on the bus
+         * @return I2C_DONE, I2C_NACK or I2C_BUS_ERROR
+         */
+        virtual uint8_t transfer(i2c_txn_t* txn) = 0;
+
+        /**
+         * @brief check whether a device holds SDA low while the bus should be idle
+         */
+        virtual bool sdaStuck() = 0;
+
+        /**
+         * @brief clock out a device holding SDA low, send a STOP and restart the controller
+         */
+        virtual void recover() = 0;
+
+        /**
+         * @brief time in us for the transaction times
+         */
+        virtual uint32_t timeUs() = 0;
+};
+
+typedef struct {
+    I2CBusHardware* hw;
+    uint8_t max_retries;                    /*!< attempts after the first failed transfer */
+    i2c_txn_t* pending[NUM_I2C_PRIORITIES][I2C_QUEUE_LENGTH];
+    uint32_t head[NUM_I2C_PRIORITIES];      /*!< transactions taken from each pending list */
+    uint32_t tail[NUM_I2C_PRIORITIES];      /*!< transactions added to each pending list */
+    uint8_t recover_requested;
+
+    uint32_t completed;                     /*!< transactions that succeeded */
+    uint32_t failed;                        /*!< transactions that failed after their retries */
+    uint32_t rejected;                      /*!< submissions to a full pending list */
+    uint32_t retries;
+    uint32_t recoveries;                    /*!< bus recoveries, on a stuck SDA or requested */
+    uint32_t bytes;                         /*!< bytes moved by the successful transactions */
+    uint32_t busy_us;                       /*!< time spent on transfers and recoveries */
+    uint32_t max_wait_us[NUM_I2C_PRIORITIES];   /*!< longest time from submission to the start of a transfer */
+} i2c_bus_t;
+
+void i2c_bus_init(i2c_bus_t* bus, I2CBusHardware* hw, uint8_t max_retries);
+void i2c_txn_read(i2c_txn_t* txn, uint8_t address, uint8_t reg, uint8_t* rx, uint8_t rx_len);
+void i2c_txn_write(i2c_txn_t* txn, uint8_t address, uint8_t reg, uint8_t value);
+uint8_t i2c_bus_submit(i2c_bus_t* bus, i2c_txn_t* txn, uint32_t now_us);
+i2c_txn_t* i2c_bus_next(i2c_bus_t* bus);
+uint8_t i2c_bus_run(i2c_bus_t* bus, i2c_txn_t* txn);
+void i2c_bus_request_recovery(i2c_bus_t* bus);
+uint8_t i2c_bus_check_recovery(i2c_bus_t* bus);
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * @file landing_detector.cpp
+ * @brief implements the landing detector
+ */
+
+#include <string.h>
+#include "landing_detector.h"
+
+/**
+ * @brief initialize the detector, it stays idle until landing_arm() is called
+ * @param velocity_threshold vertical speed in m/s below which the rocket counts as still
+ * @param altitude_band m the AGL altitude may wander during the quiet period
+ * @param stable_ms time in ms the rocket must stay still
+ */
+void landing_init(landing_detector_t* d, float velocity_threshold, float altitude_band, uint32_t stable_ms) {
+    memset(d, 0, sizeof(landing_detector_t));
+    d->velocity_threshold = velocity_threshold;
+    d->altitude_band = altitude_band;
+    d->stable_ms = stable_ms;
+}
+
+/**
+ * @brief start watching for landing, call once the descent has begun
+ */
+void landing_arm(landing_detector_t* d) {
+    if(d->armed) {
+        return;
+    }
+
+    d->armed = 1;
+    d->primed = 0;
+    d->quiet = 0;
+    d->landed = 0;
+}
+
+/**
+ * @brief stop watching and clear any detection
+ */
+void landing_disarm(landing_detector_t* d) {
+    d->armed = 0;
+    d->quiet = 0;
+    d->landed = 0;
+}
+
+/**
+ * @brief feed one altimeter sample
+ * @param now current time in ms
+ * @param agl altitude above ground level in m
+ * @param velocity Kalman vertical velocity in m/s
+ * @return 1 on the sample landing is detected, 0 otherwise
+ */
+uint8_t landing_update(landing_detector_t* d, uint32_t now, float agl, float velocity) {
+    if(!d->armed || d->landed) {
+        return 0;
+    }
+
+    if(!d->primed) {
+        d->velocity = velocity;
+        d->altitude = agl;
+        d->primed = 1;
+    } else {
+        d->velocity += LANDING_FILTER_ALPHA * (velocity - d->velocity);
+        d->altitude += LANDING_FILTER_ALPHA * (agl - d->altitude);
+    }
+
+    if(d->velocity > d->velocity_threshold || d->velocity < -d->velocity_threshold) {
+        d->quiet = 0;
+        return 0;
+    }
+
+    float drift = d->altitude - d->reference;
+    if(!d->quiet || drift > d->altitude_band || drift < -d->altitude_band) {
+        d->quiet = 1;
+        d->reference = d->altitude;
+        d->quiet_since = now;
+        return 0;
+    }
+
+    if((now - d->quiet_since) >= d->stable_ms) {
+        d->landed = 1;
+        d->landed_time = now;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file landing_detector.h
+ * @brief Landing detection from near zero vertical velocity and a stable barometer
+ *
+ * Landing is declared once the Kalman vertical velocity has stayed within
+ * +-velocity_threshold and the AGL altitude within +-altitude_band of where the quiet
+ * period started, for stable_ms. No absolute altitude is assumed, so a landing site
+ * above or below the pad is detected the same way.
+ * Both inputs are smoothed with LANDING_FILTER_ALPHA first, the Kalman velocity alone
+ * is too noisy at rest to hold a tight threshold for seconds
+ */
+
+#ifndef LANDING_DETECTOR_H
+#define LANDING_DETECTOR_H
+
+#include <stdint.h>
+
+#define LANDING_FILTER_ALPHA    0.05f       /*!< smoothing of velocity and altitude, about 0.5 s at 40 Hz */
+
+typedef struct {
+    /* configuration */
+    float velocity_threshold;       /*!< m/s, faster than this in either direction restarts the quiet period */
+    float altitude_band;            /*!< m around the reference altitude the barometer must stay within */
+    uint32_t stable_ms;             /*!< time in ms the velocity and altitude must stay quiet */
+
+    uint8_t armed;
+    uint8_t primed;                 /*!< 1 once the filters hold a sample */
+    float velocity;                 /*!< smoothed vertical velocity */
+    float altitude;                 /*!< smoothed AGL */
+    uint8_t quiet;                  /*!< 1 while a quiet period is running */
+    float reference;                /*!< AGL at the start of the quiet period */
+    uint32_t quiet_since;           /*!< time in ms the quiet period started */
+    uint8_t landed;
+    uint32_t landed_time;
+} landing_detector_t;
+
+void landing_init(landing_detector_t* d, float velocity_threshold, float altitude_band, uint32_t stable_ms);
+void landing_arm(landing_detector_t* d);
+void landing_disarm(landing_detector_t* d);
+uint8_t landing_update(landing_detector_t* d, uint32_t now, float agl, float velocity);
+
+#endif
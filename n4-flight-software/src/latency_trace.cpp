@@ -0,0 +1,85 @@
+/**
+ * @file latency_trace.cpp
+ * @brief implements the sample latency trace ring
+ */
+
+#include <string.h>
+#include "latency_trace.h"
+
+static_assert(sizeof(trace_record_t) == 8, "trace records are written to file as is");
+static_assert((TRACE_BUFFER_LENGTH & (TRACE_BUFFER_LENGTH - 1)) == 0, "TRACE_BUFFER_LENGTH must be a power of two");
+
+void trace_init(trace_buffer_t* b) {
+    memset(b, 0, sizeof(trace_buffer_t));
+}
+
+/**
+ * @brief whether a sample is traced at a stage
+ * Pyro firing is always traced, every other stage one sample in TRACE_SAMPLE_DIVIDER
+ */
+uint8_t trace_sampled(uint32_t trace_id, uint8_t stage) {
+    return stage == TRACE_PYRO_FIRED || (trace_id % TRACE_SAMPLE_DIVIDER) == 0;
+}
+
+/**
+ * @brief add a record, safe to call from any task on either core
+ * @param source data flag of the sensor that produced the sample
+ * @param latency_us time from acquisition to this stage
+ */
+void trace_record(trace_buffer_t* b, uint32_t trace_id, uint8_t source, uint8_t stage, uint32_t latency_us) {
+    uint32_t index = __atomic_fetch_add(&b->write_index, 1, __ATOMIC_RELAXED);
+    trace_slot_t* slot = &b->slots[index & (TRACE_BUFFER_LENGTH - 1)];
+
+    // invalidate first, so a reader never mixes an old sequence with new data
+    __atomic_store_n(&slot->sequence, 0, __ATOMIC_RELAXED);
+
+    slot->record.trace_id = (uint16_t) trace_id;
+    slot->record.stage = stage;
+    slot->record.source = source;
+    slot->record.latency_us = latency_us;
+
+    __atomic_store_n(&slot->sequence, index + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief copy out the records written since the previous call, oldest first
+ * Only one task may read. Stops at a record that is claimed but not written yet
+ * @return number of records copied to out
+ */
+size_t trace_read(trace_buffer_t* b, trace_record_t* out, size_t max_records) {
+    size_t copied = 0;
+    uint32_t written = __atomic_load_n(&b->write_index, __ATOMIC_ACQUIRE);
+
+    // the writers lapped the reader, the oldest records are gone
+    if(written - b->read_index > TRACE_BUFFER_LENGTH) {
+        b->lost += written - b->read_index - TRACE_BUFFER_LENGTH;
+        b->read_index = written - TRACE_BUFFER_LENGTH;
+    }
+
+    while(b->read_index != written && copied < max_records) {
+        const trace_slot_t* slot = &b->slots[b->read_index & (TRACE_BUFFER_LENGTH - 1)];
+
+        if(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != b->read_index + 1) {
+            break;
+        }
+
+        out[copied] = slot->record;
+
+        // overwritten while it was copied
+        if(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != b->read_index + 1) {
+            b->lost++;
+        } else {
+            copied++;
+        }
+
+        b->read_index++;
+    }
+
+    return copied;
+}
+
+void trace_file_header(trace_file_header_t* header) {
+    header->magic = TRACE_FILE_MAGIC;
+    header->version = TRACE_FILE_VERSION;
+    header->record_size = sizeof(trace_record_t);
+}
@@ -0,0 +1,99 @@
+/**
+ * @file latency_trace.h
+ * @brief Sample latency tracing from acquisition to flash and radio
+ *
+ * Every telemetry packet carries a trace id and the micros() time it was acquired at.
+ * Each pipeline stage the packet passes records how long after acquisition it got there
+ * into a fixed size ring of compact records. Only every TRACE_SAMPLE_DIVIDER-th sample of
+ * a sensor is traced, except for pyro firing which is always recorded.
+ *
+ * Records are claimed with an atomic counter so tasks on both cores can write. Each slot
+ * is stamped with its sequence number once written, the single reader skips slots that
+ * are not complete yet or were overwritten while it was behind.
+ *
+ * Trace file layout (little endian), read by scripts/latency-trace.py:
+ * header  magic "N4LT" (uint32), version (uint16), record size (uint16)
+ * record  trace id (uint16), stage (uint8), source data flag (uint8), latency in us (uint32)
+ *
+ * A fused record carries several sensor groups, it is traced as the sample of its lowest
+ * data flag, see sensor_fusion.h
+ *
+ * With LATENCY_TRACING 0 (see defs.h) TRACE_STAGE expands to nothing
+ */
+
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef LATENCY_TRACING
+    #define LATENCY_TRACING 0
+#endif
+
+#define TRACE_BUFFER_LENGTH     512         /*!< records kept, a power of two - about 10 s of flight */
+#define TRACE_SAMPLE_DIVIDER    10          /*!< trace one sample in this many */
+#define TRACE_FILE_MAGIC        0x544C344E  /*!< "N4LT" */
+#define TRACE_FILE_VERSION      1
+
+typedef enum {
+    TRACE_FILTERED = 0,                     /*!< vertical Kalman filter updated with the sample */
+    TRACE_DEQUEUED,                         /*!< taken off the queue by checkFlightState */
+    TRACE_STATE_CHECKED,                    /*!< run through the flight detectors */
+    TRACE_PYRO_FIRED,                       /*!< a pyro channel fired because of the sample */
+    TRACE_LOGGED,                           /*!< written to flash */
+    TRACE_PUBLISHED,                        /*!< sent to ground in a telemetry batch */
+    NUM_TRACE_STAGES
+} TRACE_STAGE;
+
+typedef struct {
+    uint16_t trace_id;                      /*!< low 16 bits of the packet trace id */
+    uint8_t stage;
+    uint8_t source;                         /*!< data flag of the sensor that produced the sample */
+    uint32_t latency_us;                    /*!< time from acquisition to this stage */
+} trace_record_t;
+
+typedef struct {
+    uint32_t sequence;                      /*!< index + 1 once the record is complete */
+    trace_record_t record;
+} trace_slot_t;
+
+typedef struct {
+    trace_slot_t slots[TRACE_BUFFER_LENGTH];
+    uint32_t write_index;                   /*!< records claimed since init */
+    uint32_t read_index;                    /*!< records consumed by trace_read() */
+    uint32_t lost;                          /*!< records overwritten before they were read */
+} trace_buffer_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+} trace_file_header_t;
+
+void trace_init(trace_buffer_t* b);
+uint8_t trace_sampled(uint32_t trace_id, uint8_t stage);
+void trace_record(trace_buffer_t* b, uint32_t trace_id, uint8_t source, uint8_t stage, uint32_t latency_us);
+size_t trace_read(trace_buffer_t* b, trace_record_t* out, size_t max_records);
+void trace_file_header(trace_file_header_t* header);
+
+/**
+ * @brief data flag of the sensor a packet is traced as, the lowest one it carries
+ */
+static inline uint8_t trace_source(uint8_t data_flags) {
+    return data_flags & -data_flags;
+}
+
+#if LATENCY_TRACING
+    extern trace_buffer_t latency_trace;
+    #define TRACE_STAGE(packet, stage) \
+        do { \
+            if(trace_sampled((packet).trace_id, stage)) { \
+                trace_record(&latency_trace, (packet).trace_id, trace_source((packet).data_flags), stage, micros() - (packet).acquired_us); \
+            } \
+        } while(0)
+#else
+    #define TRACE_STAGE(packet, stage)
+#endif
+
+#endif
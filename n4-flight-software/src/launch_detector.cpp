@@ -0,0 +1,150 @@
+/**
+ * @file launch_detector.cpp
+ * @brief implements the accelerometer launch detector
+ */
+
+#include <string.h>
+#include "launch_detector.h"
+
+/**
+ * @brief initialize the detector
+ * @param accel_threshold axial acceleration in g, compared against the magnitude so the IMU mounting direction does not matter
+ * @param sustain_ms time the acceleration must stay above the threshold
+ * @param baro_threshold altitude in m above the pad that confirms a launch
+ * @param confirm_ms time after an accelerometer launch within which the barometer must confirm it
+ * @param min_burn_ms time above accel_threshold after which the launch stands without the barometer
+ */
+void launch_init(launch_detector_t* d, float accel_threshold, uint32_t sustain_ms, float baro_threshold, uint32_t confirm_ms, uint32_t min_burn_ms) {
+    memset(d, 0, sizeof(launch_detector_t));
+    d->accel_threshold = accel_threshold;
+    d->sustain_ms = sustain_ms;
+    d->baro_threshold = baro_threshold;
+    d->confirm_ms = confirm_ms;
+    d->min_burn_ms = min_burn_ms;
+    d->axis_sign = 1;
+}
+
+/**
+ * @brief forget a detected launch, keeps the configuration and the rejected count
+ */
+void launch_reset(launch_detector_t* d) {
+    d->above = 0;
+    d->launched = 0;
+    d->confirmed = 0;
+    d->source = LAUNCH_SOURCE_NONE;
+}
+
+/**
+ * @brief mark the altimeter failed or recovered, see health_monitor.h
+ * While it is failed an accelerometer launch is never rejected
+ */
+void launch_set_baro_failed(launch_detector_t* d, uint8_t failed) {
+    d->baro_failed = failed ? 1 : 0;
+}
+
+/**
+ * @brief feed one accelerometer sample
+ * @param now sample time in ms
+ * @param axial_accel acceleration along the rocket axis in g
+ * @return LAUNCH_DETECTED on the sample launch is declared, LAUNCH_CONFIRMED on the sample
+ * the thrust of an unconfirmed launch has lasted min_burn_ms, LAUNCH_NONE otherwise
+ */
+uint8_t launch_update_accel(launch_detector_t* d, uint32_t now, float axial_accel) {
+    if(d->confirmed) {
+        return LAUNCH_NONE;
+    }
+
+    float magnitude = axial_accel < 0 ? -axial_accel : axial_accel;
+
+    if(magnitude < d->accel_threshold) {
+        d->above = 0;
+        return LAUNCH_NONE;
+    }
+
+    if(!d->above) {
+        d->above = 1;
+        d->above_since = now;
+    }
+
+    if(d->launched) {
+        // no knock or drop holds the acceleration this long, the motor is burning
+        if((now - d->launch_time) >= d->min_burn_ms && d->above_since == d->launch_time) {
+            d->confirmed = 1;
+            return LAUNCH_CONFIRMED;
+        }
+        return LAUNCH_NONE;
+    }
+
+    if((now - d->above_since) < d->sustain_ms) {
+        return LAUNCH_NONE;
+    }
+
+    d->launched = 1;
+    d->source = LAUNCH_SOURCE_ACCEL;
+    d->axis_sign = axial_accel < 0 ? -1 : 1;
+    d->launch_time = d->above_since;
+    d->detect_time = now;
+    d->confirm_start = now;
+    d->confirm_samples = 0;
+    return LAUNCH_DETECTED;
+}
+
+/**
+ * @brief feed one altimeter sample
+ * @param now sample time in ms
+ * @param altitude height above the pad in m
+ * @return LAUNCH_DETECTED if the barometer alone detected launch, LAUNCH_CONFIRMED or
+ * LAUNCH_REJECTED once an accelerometer launch is decided, LAUNCH_NONE otherwise
+ */
+uint8_t launch_update_baro(launch_detector_t* d, uint32_t now, float altitude) {
+    if(!d->launched) {
+        if(altitude > d->baro_threshold) {
+            d->launched = 1;
+            d->confirmed = 1;
+            d->source = LAUNCH_SOURCE_BARO;
+            d->axis_sign = 1;
+            d->launch_time = now;
+            d->detect_time = now;
+            return LAUNCH_DETECTED;
+        }
+        return LAUNCH_NONE;
+    }
+
+    if(d->confirmed) {
+        return LAUNCH_NONE;
+    }
+
+    if(altitude > d->baro_threshold) {
+        d->confirmed = 1;
+        return LAUNCH_CONFIRMED;
+    }
+
+    if(d->baro_failed) {
+        // the altitude comes from the GPS, the window starts again once the barometer is back
+        d->confirm_start = now;
+        d->confirm_samples = 0;
+        return LAUNCH_NONE;
+    }
+
+    // a barometer sample taken before an accelerometer launch was declared can arrive after it
+    int32_t elapsed = (int32_t) (now - d->confirm_start);
+    if(elapsed < 0) {
+        return LAUNCH_NONE;
+    }
+
+    if(elapsed < (int32_t) d->confirm_ms) {
+        d->confirm_samples++;
+        return LAUNCH_NONE;
+    }
+
+    if(d->confirm_samples == 0) {
+        // the barometer was silent for the whole window, that is no evidence against the launch
+        d->confirm_start = now;
+        d->confirm_samples = 1;
+        return LAUNCH_NONE;
+    }
+
+    d->rejected++;
+    launch_reset(d);
+    return LAUNCH_REJECTED;
+}
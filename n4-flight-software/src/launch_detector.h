@@ -0,0 +1,65 @@
+/**
+ * @file launch_detector.h
+ * @brief Liftoff detection from axial acceleration, cross-checked against the barometer
+ *
+ * Launch is declared as soon as the axial acceleration magnitude stays above the
+ * threshold for sustain_ms, which takes tens of milliseconds instead of the hundreds
+ * the barometer needs to climb LAUNCH_DETECTION_THRESHOLD. The barometer must then
+ * confirm the climb within confirm_ms, otherwise the launch is rejected (a knock or a
+ * drop on the pad). If the accelerometer misses the launch, the barometer alone
+ * still detects it
+ *
+ * A rejection disarms the pyros, so it is only made on evidence: thrust held for
+ * min_burn_ms confirms the launch without the barometer, a confirm window without a
+ * barometer sample in it is started again, and no launch is rejected while the
+ * altimeter is marked failed
+ */
+
+#ifndef LAUNCH_DETECTOR_H
+#define LAUNCH_DETECTOR_H
+
+#include <stdint.h>
+
+typedef enum {
+    LAUNCH_NONE = 0,
+    LAUNCH_DETECTED,            /*!< liftoff detected, not yet confirmed by the barometer */
+    LAUNCH_CONFIRMED,           /*!< the barometer confirmed an accelerometer launch */
+    LAUNCH_REJECTED             /*!< the barometer did not confirm the launch in time */
+} LAUNCH_EVENT;
+
+typedef enum {
+    LAUNCH_SOURCE_NONE = 0,
+    LAUNCH_SOURCE_ACCEL,
+    LAUNCH_SOURCE_BARO
+} LAUNCH_SOURCE;
+
+typedef struct {
+    /* configuration */
+    float accel_threshold;      /*!< axial acceleration in g above which thrust is assumed */
+    uint32_t sustain_ms;        /*!< time the acceleration must stay above the threshold */
+    float baro_threshold;       /*!< altitude in m that confirms or, alone, detects launch */
+    uint32_t confirm_ms;        /*!< time the barometer has to confirm an accelerometer launch */
+    uint32_t min_burn_ms;       /*!< acceleration above the threshold this long is a motor burn, not a knock */
+
+    uint8_t above;              /*!< 1 while the acceleration is above the threshold */
+    uint32_t above_since;       /*!< time in ms the acceleration went above the threshold */
+
+    uint8_t launched;
+    uint8_t confirmed;
+    uint8_t source;             /*!< see LAUNCH_SOURCE */
+    int8_t axis_sign;           /*!< sign of the axial reading under thrust, +1 if the barometer detected launch */
+    uint32_t launch_time;       /*!< time in ms the acceleration first crossed the threshold */
+    uint32_t detect_time;       /*!< time in ms launch was declared */
+    uint32_t confirm_start;     /*!< time in ms the current confirm window started */
+    uint32_t confirm_samples;   /*!< barometer samples taken in the current confirm window */
+    uint8_t baro_failed;        /*!< 1 while the altimeter is marked failed, launches are not rejected */
+    uint32_t rejected;          /*!< launches the barometer did not confirm */
+} launch_detector_t;
+
+void launch_init(launch_detector_t* d, float accel_threshold, uint32_t sustain_ms, float baro_threshold, uint32_t confirm_ms, uint32_t min_burn_ms);
+void launch_reset(launch_detector_t* d);
+void launch_set_baro_failed(launch_detector_t* d, uint8_t failed);
+uint8_t launch_update_accel(launch_detector_t* d, uint32_t now, float axial_accel);
+uint8_t launch_update_baro(launch_detector_t* d, uint32_t now, float altitude);
+
+#endif
@@ -7,9 +7,9 @@
 #include "logger.h"
 #include "data_types.h"
 #include "defs.h"
+#include "telemetry_csv.h"
 
 telemetry_type_t t;
-char pckt_buff[50];
 
 /**
  * @brief class constructor 
@@ -163,48 +163,13 @@ void DataLogger::loggerWrite(telemetry_type_t packet){
     // Serial.print("FROM LOGGER: ");
     // Serial.println(t->alt_data.altitude);
 
-    // write the record to the flash chip
-    
-    sprintf(pckt_buff, "%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
-            packet.acc_data.ax,
-            packet.acc_data.ay,
-            packet.acc_data.az,
-            packet.acc_data.pitch,
-            packet.acc_data.roll,
-            packet.alt_data.pressure);
-
     // write the packet to memory
     this->_file.write((uint8_t*)&packet, sizeof(packet));
 
-    Serial.print( packet.record_number );
-    Serial.print( "," );
-    Serial.print( packet.operation_mode );
-    Serial.print( "," );
-    Serial.print( packet.state );
-    Serial.print( "," );
-    Serial.print( packet.acc_data.ax );
-    Serial.print( "," );
-    Serial.print( packet.acc_data.ay );
-    Serial.print( "," );
-    Serial.print( packet.acc_data. az );
-    Serial.print( "," );
-    Serial.print( packet.acc_data.pitch );
-    Serial.print( "," );
-    Serial.print( packet.acc_data.roll );
-    Serial.print( "," );
-    Serial.print( packet.gyro_data.gx );
-    Serial.print( "," );
-    Serial.print( packet.gyro_data.gy );
-    Serial.print( "," );
-    Serial.print( packet.gyro_data.gz );
-    Serial.print( "," );
-    Serial.print( packet.alt_data.altitude );
-    Serial.print( "," );
-    Serial.print( packet.alt_data.velocity );
-    Serial.print( "," );
-    Serial.print( packet.alt_data.pressure );
-    Serial.print( "," );
-    Serial.println( packet.alt_data.temperature );
+    // echo the record as a CSV row, see telemetry_csv.cpp for the column order
+    if(telemetry_to_csv(this->_row, sizeof(this->_row), &packet) > 0) {
+        Serial.print(this->_row);
+    }
 
     // Serial.println(F("logged"));
     
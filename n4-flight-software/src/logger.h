@@ -16,6 +16,7 @@
 #include <Arduino.h>
 #include <SerialFlash.h>
 #include "data_types.h"
+#include "telemetry_csv.h"
 
 class DataLogger {
     private:
@@ -26,6 +27,7 @@ class DataLogger {
         uint32_t _file_size;            /*!< how large do you want the file */
         uint8_t  _flash_delay = 100;    /*!< 100ms delay gives a frequency of 20Hz */
         uint8_t _file_pointer = 0;      /*!< pointer to the start of the file- to be used when reading the file */
+        char _row[TELEMETRY_CSV_ROW_LENGTH]; /*!< CSV echo of the last record, kept off the small logToMemory stack */
 
 
     public:
@@ -12,16 +12,15 @@
 */
 
 #include <Arduino.h>
-#include <Wire.h>
 #include <WiFi.h>
 #include <PubSubClient.h> // TODO: ADD A MQTT SWITCH - TO USE MQTT OR NOT
 #include <TinyGPSPlus.h>  // handle GPS
-#include <SFE_BMP180.h>     // For BMP180
 #include <FS.h>             // File system functions
 #include <SD.h>             // SD card logging function
 #include <SPIFFS.h>         // SPIFFS file system function
 #include "defs.h"           // misc defines
 #include "mpu.h"            // for reading MPU6050
+#include "bmp180.h"         // BMP180 registers and compensation
 #include "SerialFlash.h"    // Handling external SPI flash memory
 #include "logger.h"         // system logging
 #include "data_types.h"     // definitions of data types used
@@ -30,20 +29,53 @@
 #include "system_log_levels.h"  // system logging log levels
 #include "wifi-config.h"    // handle wifi connection
 #include "kalman_filter.h"  // handle kalman filter functions
-#include "ring_buffer.h"    // for apogee detection
+#include "telemetry_csv.h"  // telemetry packet to CSV row formatting
+#include "telemetry_batch.h" // batching of telemetry records per MQTT publish
+#include "telemetry_scheduler.h" // link aware telemetry decimation
+#include "mqtt_transport.h"   // telemetry over MQTT
+#include "xbee_transport.h"   // telemetry over the XBee radio
+#include "flight_fsm.h"       // flight state machine
+#include "vertical_kalman.h"  // altitude and vertical velocity estimation
+#include "altitude_source.h"  // barometer or GPS altitude for the flight detectors
+#include "apogee_detector.h"  // apogee detection
+#include "launch_detector.h"  // liftoff detection
+#include "burnout_detector.h" // motor burnout detection
+#include "ground_calibration.h" // pad pressure calibration
+#include "altitude_trigger.h" // main chute deploy altitude
+#include "landing_detector.h" // touchdown detection
+#include "flight_config.h"    // flight parameters record
+#include "pyro.h"             // pyro channel driver
+#include "task_schedule.h"    // task table and schedulability analysis
+#include "task_profiler.h"    // task loop timing
+#include "latency_trace.h"    // sample latency tracing
+#include "queue_monitor.h"    // queue drop and high water accounting
+#include "task_shutdown.h"    // ordered task shutdown after landing
+#include "resource_monitor.h" // stack and heap watermarks
+#include "static_arena.h"     // boot time allocation of stacks and queue storage
+#include "heap_guard.h"       // heap growth check after arming
+#include "esp_heap_caps.h"
+#include "sample_clock.h"     // sample timer ticks and jitter
+#include "sensor_fusion.h"    // multi-rate sensor fusion
+#include "health_monitor.h"   // task stall detection and recovery
+#include "esp_task_wdt.h"
+#include "i2c_bus.h"          // I2C transactions shared by the sensor tasks
+#include "wire_bus.h"         // the I2C bus on the Wire driver
 
 /* non-task function prototypes definition */
 void initDynamicWIFI();
 void drogueChuteDeploy();
 void mainChuteDeploy();
-float kalmanFilter(float z);
+void enterRecoveryMode();
+void logApogeeVotes();
 void checkRunTestToggle();
 void buzz(uint16_t interval);
 
 /* state machine variables*/
 uint8_t operation_mode = 0;                                     /*!< Tells whether software is in safe or flight mode - FLIGHT_MODE=1, SAFE_MODE=0 */
-uint8_t current_state = ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND;	    /*!< The starting state - we start at PRE_FLIGHT_GROUND state */
+volatile uint8_t current_state = ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND;	    /*!< The starting state - we start at PRE_FLIGHT_GROUND state. Written only by the state machine hooks */
 uint8_t STATE_BIT_MASK = 0;
+volatile uint8_t recovery_mode = 0;                             /*!< set after landing - the sensor tasks stop and only the GPS beacon runs */
+uint8_t apogee_votes_pending = 0;                               /*!< set on APOGEE, the resource monitor logs the votes on the network core */
 
 /* GPS object */
 TinyGPSPlus gps;
@@ -93,13 +125,35 @@ uint8_t SUBSYSTEM_INIT_MASK = 0b00000000;
 
 WiFiClient wifi_client;
 PubSubClient client(wifi_client);
-uint8_t MQTTInit(const char* broker_IP, uint16_t broker_port);
+
+/**
+ * Telemetry links - each enabled link gets its own batch and frames sized to its own
+ * throughput estimate, so a slow or failing link does not hold back the others. Enable at least one
+ */
+#if MQTT
+    MQTTTransport mqtt_transport(client, wifi_client, MQTT_SERVER, MQTT_PORT, MQTT_TOPIC);
+#endif
+#if XBEE
+    XBeeTransport xbee_transport(Serial1, XBEE_RX_PIN, XBEE_TX_PIN, XBEE_DESTINATION_ADDRESS, XBEE_STATUS_TIMEOUT);
+#endif
+
+TelemetryTransport* telemetry_transports[] = {
+    #if MQTT
+        &mqtt_transport,
+    #endif
+    #if XBEE
+        &xbee_transport,
+    #endif
+};
+const uint8_t NUM_TELEMETRY_TRANSPORTS = sizeof(telemetry_transports) / sizeof(telemetry_transports[0]);
+telemetry_batch_t telemetry_batches[NUM_TELEMETRY_TRANSPORTS];          /*!< records waiting to be sent as one message, indexed like telemetry_transports */
+telemetry_scheduler_t telemetry_schedulers[NUM_TELEMETRY_TRANSPORTS];   /*!< decides which telemetry channels go into each frame of a link */
 
 /* WIFI configuration class object */
 WIFIConfig wifi_config;
 
-uint8_t drogue_pyro = 25;
-uint8_t main_pyro = 12;
+PyroChannel drogue_pyro("drogue", DROGUE_PYRO_PIN, DROGUE_SENSE_PIN, PYRO_PULSE_TIME);
+PyroChannel main_pyro("main", MAIN_PYRO_PIN, MAIN_SENSE_PIN, PYRO_PULSE_TIME);
 uint8_t flash_cs_pin = 5;           /*!< External flash memory chip select pin */
 uint8_t remote_switch = 27;
 
@@ -112,7 +166,59 @@ uint32_t FILE_SIZE_4M  = 4194304L;          /*!< 4MB */
 SerialFlashFile file;                       /*!< object representing file object for flash memory */
 unsigned long long previous_log_time = 0;   /*!< The last time we logged data to memory */
 unsigned long long current_log_time = 0;    /*!< What is the processor time right now? */
-uint16_t log_sample_interval = 10;          /*!< After how long should we sample and log data to flash memory? */
+uint16_t log_sample_interval = LOG_INTERVAL_GROUND;    /*!< After how long should we sample and log data to flash memory? Set per flight state */
+
+/* flight parameters - the defaults below are replaced by FLIGHT_CONFIG_FILE in setup(), see loadFlightConfig() */
+flight_config_t loaded_flight_config = {
+    LAUNCH_DETECTION_THRESHOLD,
+    LAUNCH_ACCEL_THRESHOLD,
+    LAUNCH_ACCEL_SUSTAIN_TIME,
+    LAUNCH_CONFIRM_TIME,
+    BURNOUT_ACCEL_THRESHOLD,
+    BURNOUT_JERK_THRESHOLD,
+    BURNOUT_SUSTAIN_TIME,
+    BURNOUT_JERK_WINDOW,
+    BURNOUT_FILTER_ALPHA,
+    APOGEE_LOCKOUT_TIME,
+    COAST_APOGEE_LOCKOUT_TIME,
+    APOGEE_VELOCITY_THRESHOLD,
+    APOGEE_SLOPE_THRESHOLD,
+    APOGEE_CONFIDENCE,
+    APOGEE_TIMEOUT_TIME,
+    MAIN_EJECTION_HEIGHT,
+    MAIN_EJECTION_HYSTERESIS,
+    MAIN_EJECTION_CONFIRM,
+    LANDING_LOCKOUT_TIME,
+    LANDING_VELOCITY_THRESHOLD,
+    LANDING_ALTITUDE_BAND,
+    LANDING_STABLE_TIME,
+    GROUND_CALIBRATION_TIME,
+    KALMAN_ALTITUDE_SIGMA,
+    KALMAN_ACCEL_SIGMA,
+    KALMAN_INNOVATION_GATE,
+    LOG_INTERVAL_GROUND,
+    LOG_INTERVAL_POWERED,
+    LOG_INTERVAL_COASTING,
+    LOG_INTERVAL_DESCENT,
+    TELEMETRY_DATA_QUEUE_LENGTH
+};
+const flight_config_t& flight_config = loaded_flight_config;   /*!< read only view for the tasks, fixed after setup() */
+
+/* log interval in ms for each flight state, indexed by ARMED_FLIGHT_STATE - filled from the config in flightStateMachineInit() */
+uint16_t state_log_interval[NUM_FLIGHT_STATES];
+
+/* task notification bit set when each flight state is entered */
+const uint8_t state_notify_bit[NUM_FLIGHT_STATES] = {
+    PREFLIGHT_BIT,          /* PRE_FLIGHT_GROUND */
+    POWERED_FLIGHT_BIT,     /* POWERED_FLIGHT */
+    COASTING_BIT,           /* COASTING */
+    APOGEE_BIT,             /* APOGEE */
+    DROGUE_DEPLOY_BIT,      /* DROGUE_DEPLOY */
+    DROGUE_DESCENT_BIT,     /* DROGUE_DESCENT */
+    MAIN_DEPLOY_BIT,        /* MAIN_DEPLOY */
+    MAIN_DESCENT_BIT,       /* MAIN_DESCENT */
+    POST_FLIGHT_BIT         /* POST_FLIGHT_GROUND */
+};
 
 DataLogger data_logger(flash_cs_pin, flash_led_pin, filename, file,  FILE_SIZE_4M);
 
@@ -120,14 +226,17 @@ DataLogger data_logger(flash_cs_pin, flash_led_pin, filename, file,  FILE_SIZE_4
 long long current_time = 0;
 long long previous_time = 0;
 
-/* To store the main telemetry packet being sent over MQTT */
-char telemetry_packet_buffer[256];
-ring_buffer altitude_ring_buffer;
-float curr_val;
-float oldest_val;
-uint8_t apogee_flag =0; // to signal that we have detected apogee
-static int apogee_val = 0; // apogee altitude aproximmation
-uint8_t main_eject_flag = 0;
+vertical_kalman_t vertical_kalman;  /*!< altitude and vertical velocity estimate, updated by the altimeter task */
+altitude_source_t altitude_source;  /*!< GPS altitude for a failed barometer, used only from the checkFlightState task */
+health_monitor_t health_monitor;
+volatile uint8_t failed_sensors = 0;    /*!< *_DATA_FLAG of the sensors the health monitor failed over */
+apogee_detector_t apogee_detector;  /*!< used only from the checkFlightState task */
+uint32_t dispatch_sample_time = 0;  /*!< sample time in ms of the packet checkFlightState is handling, the clock of the detectors */
+launch_detector_t launch_detector;  /*!< used only from the checkFlightState task */
+burnout_detector_t burnout_detector;    /*!< used only from the checkFlightState task */
+altitude_trigger_t main_deploy_trigger; /*!< used only from the checkFlightState task */
+landing_detector_t landing_detector;    /*!< used only from the checkFlightState task */
+flight_fsm_t flight_fsm;            /*!< flight state machine, driven only from the checkFlightState task */
 
 /**
 * @brief create dynamic WIFI
@@ -160,9 +269,46 @@ void checkRunTestToggle() {
  TaskHandle_t checkFlightStateTaskHandle;
  TaskHandle_t flightStateCallbackTaskHandle;
  TaskHandle_t MQTT_TransmitTelemetryTaskHandle;
- TaskHandle_t kalmanFilterTaskHandle;
+ TaskHandle_t sensorFusionTaskHandle;
  TaskHandle_t debugToTerminalTaskHandle;
  TaskHandle_t logToMemoryTaskHandle;
+ TaskHandle_t resourceMonitorTaskHandle;
+ TaskHandle_t healthMonitorTaskHandle;
+ TaskHandle_t i2cBusTaskHandle;
+
+#if TASK_PROFILING
+/**
+ * Loop body timing of the tasks, see task_profiler.h
+ */
+profiler_t task_profiler;
+
+uint32_t readCycleCount() {
+    return ESP.getCycleCount();
+}
+
+/**
+ * @brief name the profiled sections, the periodic ones are checked against their task period
+ */
+void taskProfilerInit() {
+    profiler_init(&task_profiler, readCycleCount, getCpuFrequencyMhz());
+
+    profiler_set_section(&task_profiler, PROFILE_ACQUISITION, "acquisition", flight_tasks[TASK_READ_ACCELERATION].period_ms * 1000);
+    profiler_set_section(&task_profiler, PROFILE_ALTIMETER,   "altimeter",   flight_tasks[TASK_READ_ALTIMETER].period_ms * 1000);
+    profiler_set_section(&task_profiler, PROFILE_FILTER,      "filter",      0);
+    profiler_set_section(&task_profiler, PROFILE_STATE_CHECK, "state_check", 0);
+    profiler_set_section(&task_profiler, PROFILE_LOG_WRITE,   "log_write",   0);
+    profiler_set_section(&task_profiler, PROFILE_PUBLISH,     "publish",     0);
+}
+#endif // TASK_PROFILING
+
+#if LATENCY_TRACING
+/**
+ * Sample latency trace, written by every pipeline stage and flushed to LATENCY_TRACE_FILE
+ * by the telemetry task
+ */
+trace_buffer_t latency_trace;
+const telemetry_type_t* dispatch_sample = NULL;    /*!< sample checkFlightState is handling, the cause of a pyro firing */
+#endif // LATENCY_TRACING
 
 /**
  * ///////////////////////// DATA TYPES /////////////////////////
@@ -189,10 +335,221 @@ telemetry_type_t telemetry_packet;
 */
 MPU6050 imu(MPU_ADDRESS, MPU_ACCEL_RANGE, GYRO_RANGE); // TODO: remove magic numbers 
 
-/* create BMP object */
-SFE_BMP180 altimeter;
-char status;
-double T, PRESSURE, p0, a;
+/* BMP180 calibration, read at boot */
+bmp180_calibration_t bmp180_calibration;
+double T, PRESSURE, a, agl;
+ground_calibration_t ground_calibration;   /*!< used only from the readAltimeter task */
+uint32_t last_altimeter_sample_us = 0;      /*!< sample timer tick of the previous good altimeter sample */
+
+/**
+ * I2C bus of the IMU and the barometer. Once the i2cBus task runs it is the only task on
+ * the Wire driver, the sensor tasks hand it transactions, see i2c_bus.h
+ */
+WireBus wire_bus(SDA, SCL, I2C_CLOCK, I2C_TRANSFER_TIMEOUT);
+i2c_bus_t i2c_bus;
+portMUX_TYPE i2c_bus_lock = portMUX_INITIALIZER_UNLOCKED;   /*!< guards the pending lists of i2c_bus */
+
+/**
+ * Transaction of one sensor task and the semaphore its done callback gives. The bytes are
+ * read into rx, which outlives a transaction the task stopped waiting for
+ */
+typedef struct {
+    i2c_txn_t txn;
+    uint8_t rx[BMP180_CALIBRATION_LENGTH];
+    SemaphoreHandle_t done;
+    StaticSemaphore_t done_buffer;
+} i2c_client_t;
+
+i2c_client_t imu_bus_client;
+i2c_client_t baro_bus_client;
+
+void i2cTransactionDone(i2c_txn_t* txn) {
+    xSemaphoreGive((SemaphoreHandle_t) txn->context);
+}
+
+void i2cClientInit(i2c_client_t* client, uint8_t priority) {
+    client->done = xSemaphoreCreateBinaryStatic(&client->done_buffer);
+    client->txn.priority = priority;
+    client->txn.done = i2cTransactionDone;
+    client->txn.context = client->done;
+}
+
+/*!****************************************************************************
+ * @brief start the I2C bus at I2C_CLOCK, the IMU is on the high priority
+ *
+ *******************************************************************************/
+void i2cBusInit() {
+    if(!wire_bus.begin()) {
+        debugln("[-]I2C bus init failed");
+    }
+
+    i2c_bus_init(&i2c_bus, &wire_bus, I2C_MAX_RETRIES);
+    i2cClientInit(&imu_bus_client, I2C_PRIORITY_HIGH);
+    i2cClientInit(&baro_bus_client, I2C_PRIORITY_LOW);
+}
+
+/*!****************************************************************************
+ * @brief run the transaction of a client and wait up to I2C_WAIT_TIMEOUT for it
+ * Before the i2cBus task runs, setup() is alone on the bus and runs it directly
+ * @return 1 if the transaction succeeded
+ *
+ *******************************************************************************/
+uint8_t i2cTransfer(i2c_client_t* client) {
+    if(i2cBusTaskHandle == NULL) {
+        client->txn.submitted_us = micros();
+        return i2c_bus_run(&i2c_bus, &client->txn) == I2C_DONE;
+    }
+
+    // a completion left from a transaction waited for too long
+    xSemaphoreTake(client->done, 0);
+
+    portENTER_CRITICAL(&i2c_bus_lock);
+    uint8_t queued = i2c_bus_submit(&i2c_bus, &client->txn, micros());
+    portEXIT_CRITICAL(&i2c_bus_lock);
+
+    if(!queued) {
+        return 0;
+    }
+
+    xTaskNotifyGive(i2cBusTaskHandle);
+
+    if(xSemaphoreTake(client->done, pdMS_TO_TICKS(I2C_WAIT_TIMEOUT)) != pdTRUE) {
+        return 0;
+    }
+
+    return __atomic_load_n(&client->txn.status, __ATOMIC_ACQUIRE) == I2C_DONE;
+}
+
+/*!****************************************************************************
+ * @brief read rx_len bytes from a device register
+ * @return 1 if the bytes were copied to rx
+ *
+ *******************************************************************************/
+uint8_t i2cRead(i2c_client_t* client, uint8_t address, uint8_t reg, uint8_t* rx, uint8_t rx_len) {
+    // the bus manager may still hold the previous transaction
+    if(__atomic_load_n(&client->txn.status, __ATOMIC_ACQUIRE) == I2C_PENDING || rx_len > sizeof(client->rx)) {
+        return 0;
+    }
+
+    i2c_txn_read(&client->txn, address, reg, client->rx, rx_len);
+    if(!i2cTransfer(client)) {
+        return 0;
+    }
+
+    memcpy(rx, client->rx, rx_len);
+    return 1;
+}
+
+/*!****************************************************************************
+ * @brief write one byte to a device register
+ * @return 1 if the device took it
+ *
+ *******************************************************************************/
+uint8_t i2cWrite(i2c_client_t* client, uint8_t address, uint8_t reg, uint8_t value) {
+    if(__atomic_load_n(&client->txn.status, __ATOMIC_ACQUIRE) == I2C_PENDING) {
+        return 0;
+    }
+
+    i2c_txn_write(&client->txn, address, reg, value);
+    return i2cTransfer(client);
+}
+
+/*!****************************************************************************
+ * @brief I2C bus manager, runs the submitted transactions highest priority first
+ * Released by the notification of a submission or a recovery request. Completions go to
+ * the done callback of each transaction
+ *
+ *******************************************************************************/
+void i2cBusTask(void* pvParameters) {
+    while(1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while(1) {
+            portENTER_CRITICAL(&i2c_bus_lock);
+            i2c_txn_t* txn = i2c_bus_next(&i2c_bus);
+            portEXIT_CRITICAL(&i2c_bus_lock);
+
+            if(txn == NULL) {
+                break;
+            }
+
+            i2c_bus_run(&i2c_bus, txn);
+        }
+
+        // a recovery asked for while no transaction was pending
+        i2c_bus_check_recovery(&i2c_bus);
+    }
+}
+
+/**
+ * The sample timer releases the accelerometer task every tick and the altimeter task
+ * every altimeter_tick_divider ticks. The tick time is the sample time, see sample_clock.h
+ */
+hw_timer_t* sample_timer = NULL;
+sample_clock_t accel_clock;
+sample_clock_t altimeter_clock;
+uint32_t altimeter_tick_divider = 1;
+uint32_t altimeter_tick_count = 0;          /*!< used only from onSampleTimer */
+
+/*!****************************************************************************
+ * @brief sample timer interrupt, stamps the tick and notifies the sensor tasks
+ *
+ *******************************************************************************/
+void IRAM_ATTR onSampleTimer() {
+    uint32_t now = micros();
+    BaseType_t task_woken = pdFALSE;
+
+    sample_clock_tick(&accel_clock, now);
+    if(readAccelerationTaskHandle != NULL) {
+        vTaskNotifyGiveFromISR(readAccelerationTaskHandle, &task_woken);
+    }
+
+    if(++altimeter_tick_count >= altimeter_tick_divider) {
+        altimeter_tick_count = 0;
+        sample_clock_tick(&altimeter_clock, now);
+        if(readAltimeterTaskHandle != NULL) {
+            vTaskNotifyGiveFromISR(readAltimeterTaskHandle, &task_woken);
+        }
+    }
+
+    if(task_woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/*!****************************************************************************
+ * @brief start the sample timer at the accelerometer period
+ * The altimeter period is rounded down to a multiple of the accelerometer period
+ *
+ *******************************************************************************/
+void sampleTimerInit() {
+    char message[80];
+    uint32_t period_us = flight_tasks[TASK_READ_ACCELERATION].period_ms * 1000;
+
+    altimeter_tick_divider = flight_tasks[TASK_READ_ALTIMETER].period_ms / flight_tasks[TASK_READ_ACCELERATION].period_ms;
+    if(altimeter_tick_divider == 0) {
+        altimeter_tick_divider = 1;
+    }
+
+    sample_clock_init(&accel_clock, period_us);
+    sample_clock_init(&altimeter_clock, period_us * altimeter_tick_divider);
+
+    sample_timer = timerBegin(SAMPLE_TIMER, SAMPLE_TIMER_PRESCALER, true);
+    if(sample_timer == NULL) {
+        debugln("[-]Sample timer init failed");
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]Sample timer init failed\r\n");
+        return;
+    }
+
+    timerAttachInterrupt(sample_timer, &onSampleTimer, true);
+    timerAlarmWrite(sample_timer, period_us, true);
+    timerAlarmEnable(sample_timer);
+
+    snprintf(message, sizeof(message), "[+]Sample timer OK, %lu us, altimeter every %lu ticks\r\n",
+             (unsigned long) period_us, (unsigned long) altimeter_tick_divider);
+    debug(message);
+    SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, message);
+}
 
 /**
 * @brief initialize Buzzer
@@ -214,6 +571,38 @@ uint8_t InitSPIFFS() {
     }
 }
 
+/**
+* @brief load the flight parameters from FLIGHT_CONFIG_FILE on SPIFFS. Call once in setup, after SPIFFS
+* is mounted and before anything reads flight_config. A missing or invalid record keeps the defaults from defs.h
+* @return FLIGHT_CONFIG_OK if the record was loaded, see FLIGHT_CONFIG_STATUS
+*/
+uint8_t loadFlightConfig() {
+    uint8_t record[FLIGHT_CONFIG_RECORD_SIZE];
+    char message[64];
+
+    File config_file = SPIFFS.open(FLIGHT_CONFIG_FILE, "r");
+    if(!config_file) {
+        debugln("[-]No flight config, using defaults");
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]No flight config, using defaults\r\n");
+        return FLIGHT_CONFIG_TOO_SHORT;
+    }
+
+    size_t length = config_file.read(record, sizeof(record));
+    config_file.close();
+
+    uint8_t status = flight_config_parse(&loaded_flight_config, record, length);
+
+    if(status == FLIGHT_CONFIG_OK) {
+        snprintf(message, sizeof(message), "[+]Flight config v%d loaded\r\n", FLIGHT_CONFIG_VERSION);
+    } else {
+        snprintf(message, sizeof(message), "[-]Flight config rejected: %s, using defaults\r\n", flight_config_status_name(status));
+    }
+
+    debugln(message);
+    SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, message);
+
+    return status;
+}
 
 /**
 * @brief initilize SD card 
@@ -259,12 +648,17 @@ uint8_t initSD() {
 }
 
 /*!****************************************************************************
- * @brief Initialize BMP180 barometric sensor
- * @return TODO: 1 if init OK, 0 otherwise
+ * @brief Initialize BMP180 barometric sensor, check its ID and read its calibration
+ * @return 1 if init OK, 0 otherwise
  * 
  *******************************************************************************/
 uint8_t BMPInit() {
-    if(altimeter.begin()) {
+    uint8_t id = 0;
+    uint8_t raw[BMP180_CALIBRATION_LENGTH];
+
+    if(i2cRead(&baro_bus_client, BMP180_ADDRESS, BMP180_CHIP_ID, &id, 1) && id == BMP180_ID
+       && i2cRead(&baro_bus_client, BMP180_ADDRESS, BMP180_CALIBRATION, raw, BMP180_CALIBRATION_LENGTH)) {
+        bmp180_parse_calibration(&bmp180_calibration, raw);
         debugln("[+]BMP init OK.");
         // TODO: update system table
         return 1;
@@ -274,6 +668,49 @@ uint8_t BMPInit() {
     }
 }
 
+/*!****************************************************************************
+ * @brief read the temperature and pressure from the BMP180
+ * The bus is free for the IMU during both conversions
+ * @param temperature set to the temperature in C
+ * @param pressure set to the pressure in mb
+ * @return 1 if both were read
+ * 
+ *******************************************************************************/
+uint8_t readBarometer(double* temperature, double* pressure) {
+    uint8_t raw[3];
+
+    if(!i2cWrite(&baro_bus_client, BMP180_ADDRESS, BMP180_CONTROL, BMP180_READ_TEMPERATURE)) {
+        debugln("error starting temperature measurement\n");
+        return 0;
+    }
+
+    delay(BMP180_TEMPERATURE_TIME);
+
+    if(!i2cRead(&baro_bus_client, BMP180_ADDRESS, BMP180_RESULT, raw, 2)) {
+        debugln("error retrieving temperature measurement\n");
+        return 0;
+    }
+
+    int32_t b5 = bmp180_b5(&bmp180_calibration, bmp180_raw_temperature(raw));
+
+    if(!i2cWrite(&baro_bus_client, BMP180_ADDRESS, BMP180_CONTROL, bmp180_pressure_command(BMP180_OVERSAMPLING))) {
+        debugln("error starting pressure measurement\n");
+        return 0;
+    }
+
+    delay(bmp180_pressure_time(BMP180_OVERSAMPLING));
+
+    if(!i2cRead(&baro_bus_client, BMP180_ADDRESS, BMP180_RESULT, raw, 3)) {
+        debugln("error retrieving pressure measurement\n");
+        return 0;
+    }
+
+    *temperature = bmp180_temperature(b5);
+    *pressure = bmp180_pressure_pa(&bmp180_calibration, bmp180_raw_pressure(raw, BMP180_OVERSAMPLING), BMP180_OVERSAMPLING, b5) / 100.0;
+
+    return 1;
+}
+
 /*!****************************************************************************
  * @brief Initialize the GPS connected on Serial2
  * @return 1 if init OK, 0 otherwise
@@ -313,11 +750,20 @@ void buzz(uint16_t interval) {
 /**
  * ///////////////////////// END OF PERIPHERALS INIT /////////////////////////
  */
-QueueHandle_t telemetry_data_queue_handle;
-QueueHandle_t log_to_mem_queue_handle;
-QueueHandle_t check_state_queue_handle;
-QueueHandle_t debug_to_term_queue_handle;
-QueueHandle_t kalman_filter_queue_handle;
+monitored_queue_t telemetry_data_queue;
+monitored_queue_t log_to_mem_queue;
+monitored_queue_t check_state_queue;
+monitored_queue_t debug_to_term_queue;
+monitored_queue_t fusion_queue;
+
+sensor_fusion_t sensor_fusion;      /*!< used only from the sensorFusion task */
+
+/**
+ * Item storage of the data queues above, reserved for the longest queue the config allows
+ */
+#define NUM_DATA_QUEUES 5
+uint8_t queue_storage[NUM_DATA_QUEUES * FLIGHT_CONFIG_MAX_QUEUE_LENGTH * sizeof(telemetry_type_t)] __attribute__((aligned(ARENA_ALIGNMENT)));
+static_arena_t queue_arena;
 
 //////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////// ACCELERATION AND ROCKET ATTITUDE DETERMINATION /////////////////
@@ -332,26 +778,53 @@ QueueHandle_t kalman_filter_queue_handle;
  * 
  *******************************************************************************/
 void readAccelerationTask(void* pvParameter) {
-    telemetry_type_t acc_data_lcl;
+    telemetry_type_t acc_data_lcl = {};
+    acc_data_lcl.data_flags = ACCEL_DATA_FLAG;
+    acc_data_lcl.fresh_flags = ACCEL_DATA_FLAG;
+    uint8_t accel_raw[ACCEL_BURST_LENGTH];
+    uint32_t tick_us;
 
     while(1) {
-        acc_data_lcl.operation_mode = operation_mode; // TODO: move these to check state function
-        acc_data_lcl.record_number++;
-        acc_data_lcl.state = 0;
+        // released by the sample timer, see onSampleTimer()
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // stop here, between two readings, once the flight is over - see enterRecoveryMode()
+        if(recovery_mode) {
+            vTaskSuspend(NULL);
+        }
+
+        if(!sample_clock_take(&accel_clock, micros(), &tick_us)) {
+            continue;
+        }
 
-        acc_data_lcl.acc_data.ax = imu.readXAcceleration();
-        acc_data_lcl.acc_data.ay = imu.readYAcceleration();
-        acc_data_lcl.acc_data.az = 0;
+        PROFILE_BEGIN(PROFILE_ACQUISITION);
 
-        // get pitch and roll
-        acc_data_lcl.acc_data.pitch = imu.getPitch();
-        acc_data_lcl.acc_data.roll = imu.getRoll();
-        
+        // the three axes in one transfer, served before any barometer transfer waiting for the bus
+        if(i2cRead(&imu_bus_client, MPU_ADDRESS, ACCEL_XOUT_H, accel_raw, ACCEL_BURST_LENGTH)) {
+            // only a sample counts as a check-in, so a hung bus is seen as a stall
+            health_checkin(&health_monitor, TASK_READ_ACCELERATION, millis());
+
+            acc_data_lcl.operation_mode = operation_mode; // TODO: move these to check state function
+            acc_data_lcl.record_number++;
+            acc_data_lcl.state = 0;
+
+            imu.decodeAcceleration(accel_raw);
+            acc_data_lcl.acc_data.ax = imu.acc_x_real;
+            acc_data_lcl.acc_data.ay = imu.acc_y_real;
+            acc_data_lcl.acc_data.az = 0;
+
+            // get pitch and roll
+            acc_data_lcl.acc_data.pitch = imu.pitch_angle * TO_DEG_FACTOR;
+            acc_data_lcl.acc_data.roll = imu.roll_angle * TO_DEG_FACTOR;
+            acc_data_lcl.trace_id++;
+            acc_data_lcl.acquired_us = tick_us;
+
+            // the flight detectors take every sample, the logger and telemetry the fused records
+            queue_send(&check_state_queue, &acc_data_lcl, 0);
+            queue_send(&fusion_queue, &acc_data_lcl, 0);
+        }
 
-        xQueueSend(telemetry_data_queue_handle, &acc_data_lcl, 0);
-        xQueueSend(log_to_mem_queue_handle, &acc_data_lcl, 0);
-        xQueueSend(check_state_queue_handle, &acc_data_lcl, 0);
-        xQueueSend(debug_to_term_queue_handle, &acc_data_lcl, 0);
+        PROFILE_END(PROFILE_ACQUISITION);
     }
 
 }
@@ -364,109 +837,76 @@ void readAccelerationTask(void* pvParameter) {
  * @brief Read atm pressure data from the barometric sensor onboard
  *******************************************************************************/
 void readAltimeterTask(void* pvParameters) {
-    telemetry_type_t alt_data_lcl;
+    telemetry_type_t alt_data_lcl = {};
+    alt_data_lcl.data_flags = ALTIMETER_DATA_FLAG;
+    alt_data_lcl.fresh_flags = ALTIMETER_DATA_FLAG;
+    uint32_t tick_us;
 
     while(1) {
-        // If you want to measure altitude, and not pressure, you will instead need
-        // to provide a known baseline pressure. This is shown at the end of the sketch.
-
-        // You must first get a temperature measurement to perform a pressure reading.
-        
-        // Start a temperature measurement:
-        // If request is successful, the number of ms to wait is returned.
-        // If request is unsuccessful, 0 is returned.
-        status = altimeter.startTemperature();
-        if(status !=0 ) {
-            // wait for measurement to complete
-            delay(status);
-
-            // retrieve the completed temperature measurement 
-            // temperature is stored in variable T
-
-            status = altimeter.getTemperature(T);
-            if(status != 0) {
-                // print out the measurement 
-                // debug("temperature: ");
-                // debug(T, 2);
-                // debug(" \xB0 C, ");
-
-                // start pressure measurement 
-                // The parameter is the oversampling setting, from 0 to 3 (highest res, longest wait).
-                // If request is successful, the number of ms to wait is returned.
-                // If request is unsuccessful, 0 is returned.
-                status = altimeter.startPressure(3);
-                if(status != 0) {
-                    // wait for the measurement to complete
-                    delay(status);
-
-                    // Retrieve the completed pressure measurement:
-                    // Note that the measurement is stored in the variable P.
-                    // Note also that the function requires the previous temperature measurement (T).
-                    // (If temperature is stable, you can do one temperature measurement for a number of pressure measurements.)
-                    // Function returns 1 if successful, 0 if failure.
-
-                    status = altimeter.getPressure(PRESSURE, T);
-                    if(status != 0) {
-                        // print out the measurement
-                        // debug("absolute pressure: ");
-                        // debug(P, 2);
-                        // debug(" mb, "); // in millibars
-
-                        p0 = altimeter.sealevel(PRESSURE,ALTITUDE);
-                        // If you want to determine your altitude from the pressure reading,
-                        // use the altitude function along with a baseline pressure (sea-level or other).
-                        // Parameters: P = absolute pressure in mb, p0 = baseline pressure in mb.
-                        // Result: a = altitude in m.
-
-                        a = altimeter.altitude(PRESSURE, p0);
-                        //debug(a);
-
-                        // feed the altitude into the kalman filter
-                        estimated_altitude = kalmanFilter(a);
-                        //debug(",");
-                        //debugln(estimated_altitude);
-
-                    } else {
-                        debugln("error retrieving pressure measurement\n");
-                    } 
-                
-                } else {
-                    debugln("error starting pressure measurement\n");
-                }
+        // released by the sample timer, the conversion delays below are part of the period, not added to it
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-            } else {
-                debugln("error retrieving temperature measurement\n");
-            }
+        // stop here, between two readings, once the flight is over - see enterRecoveryMode()
+        if(recovery_mode) {
+            vTaskSuspend(NULL);
+        }
 
-        } else {
-            debugln("error starting temperature measurement\n");
+        if(!sample_clock_take(&altimeter_clock, micros(), &tick_us)) {
+            continue;
         }
 
-        // delay(2000);
+        PROFILE_BEGIN(PROFILE_ALTIMETER);
+
+        // the conversions run with the bus free, see readBarometer(). A failed reading sends
+        // nothing, so the detectors never see the previous sample again as a new one
+        if(readBarometer(&T, &PRESSURE)) {
+            // only a sample counts as a check-in, so a hung bus is seen as a stall
+            health_checkin(&health_monitor, TASK_READ_ALTIMETER, millis());
+
+            // the pad pressure is averaged over the configured calibration time before AGL is measured from it
+            uint32_t sample_time = millis();
+            alt_data_lcl.trace_id++;
+            alt_data_lcl.acquired_us = tick_us;
+            ground_cal_update(&ground_calibration, sample_time, PRESSURE);
+
+            // altitude above sea level and above the pad, pressures in mb
+            a = bmp180_altitude(PRESSURE, SEA_LEVEL_PRESSURE / 100.0);
+
+            if(ground_calibration.calibrated) {
+                // the difference of the two altitudes, the ground pressure taken as the reference
+                // reads high by the pad altitude over 44 km, the main chute 36 m low from a 1600 m pad
+                agl = a - bmp180_altitude(ground_calibration.ground_pressure, SEA_LEVEL_PRESSURE / 100.0);
+
+                // feed the altitude into the kalman filter to estimate the vertical velocity
+                PROFILE_BEGIN(PROFILE_FILTER);
+                vkf_update(&vertical_kalman, agl, 0, (tick_us - last_altimeter_sample_us) * 0.000001f);
+                PROFILE_END(PROFILE_FILTER);
+                TRACE_STAGE(alt_data_lcl, TRACE_FILTERED);
+            }
 
-        // TODO: compute the velocity from the altimeter data
+            last_altimeter_sample_us = tick_us;
 
-        // assign data to queue
-        alt_data_lcl.alt_data.pressure = PRESSURE;
-        alt_data_lcl.alt_data.altitude = a;
-        alt_data_lcl.alt_data.velocity = 0;
-        alt_data_lcl.alt_data.temperature = T;
+            // assign data to queue
+            alt_data_lcl.alt_data.pressure = PRESSURE;
+            alt_data_lcl.alt_data.altitude = a;
+            alt_data_lcl.alt_data.AGL = agl;
+            alt_data_lcl.alt_data.velocity = vertical_kalman.velocity;
+            alt_data_lcl.alt_data.temperature = T;
 
-        alt_data_lcl.alt_data.pressure = 0;
-        alt_data_lcl.alt_data.altitude = 0;
-        alt_data_lcl.alt_data.velocity = 0;
-        alt_data_lcl.alt_data.temperature = 0;
+            // send this pressure data to queue
+            // do not wait for the queue if it is full because the data rate is so high, 
+            // we might lose some data as we wait for the queue to get space
+            queue_send(&fusion_queue, &alt_data_lcl, 0);
 
-        // send this pressure data to queue
-        // do not wait for the queue if it is full because the data rate is so high, 
-        // we might lose some data as we wait for the queue to get space
+            // the flight detectors work on AGL, which is meaningless until the pad is calibrated
+            if(ground_calibration.calibrated) {
+                queue_send(&check_state_queue, &alt_data_lcl, 0);
+            }
+        }
 
-        xQueueSend(telemetry_data_queue_handle, &alt_data_lcl, 0);
-        xQueueSend(log_to_mem_queue_handle, &alt_data_lcl, 0);
-        xQueueSend(check_state_queue_handle, &alt_data_lcl, 0);
-        xQueueSend(debug_to_term_queue_handle, &alt_data_lcl, 0);
+        // delay(2000);
 
-        vTaskDelay(CONSUME_TASK_DELAY / portTICK_PERIOD_MS);
+        PROFILE_END(PROFILE_ALTIMETER);
     }
 
 }
@@ -480,9 +920,18 @@ void readAltimeterTask(void* pvParameters) {
  *******************************************************************************/
 void readGPSTask(void* pvParameters){
 
-    telemetry_type_t gps_data_lcl;
+    telemetry_type_t gps_data_lcl = {};
+    gps_data_lcl.data_flags = GPS_DATA_FLAG;
+    gps_data_lcl.fresh_flags = GPS_DATA_FLAG;
+    uint32_t last_beacon_time = 0;
+    uint32_t fused_trace_id = 0;
+    const TickType_t period = pdMS_TO_TICKS(flight_tasks[TASK_READ_GPS].period_ms);
+    TickType_t last_wake_time = xTaskGetTickCount();
 
     while(true){
+        vTaskDelayUntil(&last_wake_time, period);
+        health_checkin(&health_monitor, TASK_READ_GPS, millis());
+
         // if(Serial2.available()) {
         //     char c = Serial2.read();
 
@@ -495,9 +944,13 @@ void readGPSTask(void* pvParameters){
         //     } 
         // }
 
-        if (Serial2.available()) {
+        // parse everything received since the last period, the UART buffer holds well over one period of NMEA data
+        while (Serial2.available()) {
             char c = Serial2.read();
             if(gps.encode(c)){
+                gps_data_lcl.trace_id++;
+                gps_data_lcl.acquired_us = micros();
+
                 // get location, latitude and longitude 
                 if(gps.location.isValid()) {
                     gps_data_lcl.gps_data.latitude = gps.location.lat();
@@ -523,245 +976,393 @@ void readGPSTask(void* pvParameters){
             }
         }
 
-        xQueueSend(telemetry_data_queue_handle, &gps_data_lcl, portMAX_DELAY);
-        xQueueSend(log_to_mem_queue_handle, &gps_data_lcl, portMAX_DELAY);
-        xQueueSend(check_state_queue_handle, &gps_data_lcl, portMAX_DELAY);
-        xQueueSend(debug_to_term_queue_handle, &gps_data_lcl, portMAX_DELAY);
-
-    }
-
-}
+        // RECOVERY - the flight consumers are stopped, send a low rate position beacon
+        if(recovery_mode) {
+            if(millis() - last_beacon_time >= RECOVERY_BEACON_INTERVAL) {
+                last_beacon_time = millis();
+                queue_send(&telemetry_data_queue, &gps_data_lcl, 0);
+            }
+            continue;
+        }
 
-/**
- * @brief Kalman filter estimated value calculation
- * 
- */
-float kalmanFilter(float z) {
-    float estimated_altitude_pred = estimated_altitude;
-    float error_covariance_pred = error_covariance_bmp + process_variance_bmp;
-    kalman_gain_bmp = error_covariance_pred / (error_covariance_pred + measurement_variance_bmp);
-    estimated_altitude = estimated_altitude_pred + kalman_gain_bmp * (z - estimated_altitude_pred);
-    error_covariance_bmp = (1 - kalman_gain_bmp) * error_covariance_pred;
+        // like the other sensors, drop the fix if a consumer is behind instead of
+        // stalling the UART drain until it catches up
+        queue_send(&check_state_queue, &gps_data_lcl, 0);
 
-    return estimated_altitude;
-}
+        // only new fixes are fused, the fusion stage holds the position in between
+        if(gps_data_lcl.trace_id != fused_trace_id) {
+            fused_trace_id = gps_data_lcl.trace_id;
+            queue_send(&fusion_queue, &gps_data_lcl, 0);
+        }
 
-/*!***************************************************************************
- * @brief Filter data using the Kalman Filter 
- * 
- */
-void kalmanFilterTask(void* pvParameters) {
-    
-    while (1) {
-        vTaskDelay(CONSUME_TASK_DELAY/portTICK_PERIOD_MS);
     }
 
 }
 
 /*!****************************************************************************
- * @brief check various condition from flight data to change the flight state
- * - -see states.h for more info --
+ * @brief configure the fusion stage, one record per sensorFusion period
+ * The IMU and barometer are interpolated to the record time, the GPS is held
  *
  *******************************************************************************/
-void checkFlightState(void* pvParameters) {
-    // get the flight state from the telemetry task
-    telemetry_type_t flight_data; 
-    
-    while (1) {
-        xQueueReceive(check_state_queue_handle, &flight_data, portMAX_DELAY);
-
-        if(apogee_flag != 1) {
-            // states before apogee
-            //debug("altitude value:"); debugln(flight_data.alt_data.altitude);
-            if(flight_data.alt_data.altitude < LAUNCH_DETECTION_THRESHOLD) {
-                current_state = ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND;
-                debugln("PREFLIGHT");
-                delay(STATE_CHANGE_DELAY);
-            } else if(LAUNCH_DETECTION_THRESHOLD < flight_data.alt_data.altitude < (LAUNCH_DETECTION_THRESHOLD+LAUNCH_DETECTION_ALTITUDE_WINDOW) ) {
-                current_state = ARMED_FLIGHT_STATE::POWERED_FLIGHT;
-                debugln("POWERED");
-                delay(STATE_CHANGE_DELAY);
-            } 
-
-            // COASTING
-
-            // APOGEE and APOGEE DETECTION
-            ring_buffer_put(&altitude_ring_buffer, flight_data.alt_data.altitude);
-            if(ring_buffer_full(&altitude_ring_buffer) == 1) {
-                oldest_val = ring_buffer_get(&altitude_ring_buffer);
-            }
+void sensorFusionInit() {
+    fusion_init(&sensor_fusion, flight_tasks[TASK_SENSOR_FUSION].period_ms * 1000, FUSION_OUTPUT_DELAY * 1000);
+    fusion_set_stream(&sensor_fusion, FUSION_ACCEL, FUSION_INTERPOLATE, FUSION_ACCEL_MAX_AGE * 1000);
+    fusion_set_stream(&sensor_fusion, FUSION_GYRO, FUSION_INTERPOLATE, FUSION_ACCEL_MAX_AGE * 1000);
+    fusion_set_stream(&sensor_fusion, FUSION_ALTIMETER, FUSION_INTERPOLATE, FUSION_ALTIMETER_MAX_AGE * 1000);
+    fusion_set_stream(&sensor_fusion, FUSION_GPS, FUSION_HOLD, FUSION_GPS_MAX_AGE * 1000);
+}
 
-            //debug("Curr val:");debug(flight_data.alt_data.altitude); debug("    "); debugln(oldest_val);
-            if((oldest_val - flight_data.alt_data.altitude) >= APOGEE_DETECTION_THRESHOLD) {
-
-                if(apogee_flag == 0) {
-                    apogee_val = ( (oldest_val - flight_data.alt_data.altitude) / 2 ) + oldest_val;
-
-                    current_state = ARMED_FLIGHT_STATE::APOGEE;
-                    delay(STATE_CHANGE_DELAY);
-                    debugln("APOGEE");
-                    delay(STATE_CHANGE_DELAY);
-                    current_state = ARMED_FLIGHT_STATE::DROGUE_DEPLOY;
-                    debugln("DROGUE");
-                    delay(STATE_CHANGE_DELAY);
-                    current_state =  ARMED_FLIGHT_STATE::DROGUE_DESCENT;
-                    debugln("DROGUE_DESCENT");
-                    delay(STATE_CHANGE_DELAY);
-                    apogee_flag = 1;
-                }
+/*!***************************************************************************
+ * @brief merge the IMU, barometer and GPS samples into one record per period
+ * The records go to the logger, telemetry and debug consumers, see sensor_fusion.h
+ * 
+ */
+void sensorFusionTask(void* pvParameters) {
+    telemetry_type_t packet;
+    telemetry_type_t record;
+    const TickType_t period = pdMS_TO_TICKS(flight_tasks[TASK_SENSOR_FUSION].period_ms);
+    TickType_t last_wake_time = xTaskGetTickCount();
 
-            }
+    while (1) {
+        vTaskDelayUntil(&last_wake_time, period);
 
-        } else if(apogee_flag == 1) {
-
-            if(LAUNCH_DETECTION_THRESHOLD <= flight_data.alt_data.altitude <= apogee_val) {
-                if(main_eject_flag == 0) {
-                    current_state = ARMED_FLIGHT_STATE::MAIN_DEPLOY;
-                    debugln("MAIN");
-                    delay(STATE_CHANGE_DELAY);
-                    main_eject_flag = 1;
-                } else if (main_eject_flag == 1) { // todo: confirm check_done_flag
-                    current_state = ARMED_FLIGHT_STATE::MAIN_DESCENT;
-                    debugln("MAIN_DESC");
-                    delay(STATE_CHANGE_DELAY);
-                }
-            }
+        while(queue_receive(&fusion_queue, &packet, 0)) {
+            fusion_push(&sensor_fusion, &packet);
+        }
 
-            if(flight_data.alt_data.altitude < LAUNCH_DETECTION_THRESHOLD) {
-                current_state = ARMED_FLIGHT_STATE::POST_FLIGHT_GROUND;
-                debugln("POST_FLIGHT");
-            }
+        while(fusion_output(&sensor_fusion, micros(), &record)) {
+            record.operation_mode = operation_mode;
+            record.state = current_state;
 
+            queue_send(&telemetry_data_queue, &record, 0);
+            queue_send(&log_to_mem_queue, &record, 0);
+            #if DEBUG_TO_TERMINAL
+            // without debugToTerminalTask nothing drains it and every record would count as a drop
+            queue_send(&debug_to_term_queue, &record, 0);
+            #endif
         }
     }
 
 }
 
 /*!****************************************************************************
- * @brief performs flight actions based on the current flight state
-
- * If the flight state requires an action, we perform it here
- * For example if the flight state is apogee, we perform MAIN_CHUTE ejection
- * 
+ * @brief runs on entry to every flight state, publishes the new state and wakes flightStateCallback
  *******************************************************************************/
-void flightStateCallback(void* pvParameters) {
-
-    while(1) {
-        switch (current_state) {
-            // PRE_FLIGHT_GROUND
-            case ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND:
-                //debugln("PRE-FLIGHT STATE");
-                break;
+void flightStateEntry(flight_fsm_t* fsm, uint8_t state) {
+    current_state = state;
+    log_sample_interval = state_log_interval[state];
 
-            // POWERED_FLIGHT
-            case ARMED_FLIGHT_STATE::POWERED_FLIGHT:
-                //debugln("POWERED FLIGHT STATE");
-                break;
+    // the bits accumulate until the callback task wakes up, so back to back states are all delivered
+    if(flightStateCallbackTaskHandle != NULL) {
+        xTaskNotify(flightStateCallbackTaskHandle, 1UL << state_notify_bit[state], eSetBits);
+    }
 
-            // COASTING
-            case ARMED_FLIGHT_STATE::COASTING:
-            //    debugln("COASTING");
-                break;
+    debugln(fsm_state_name(state));
+}
 
-            // APOGEE
-            case ARMED_FLIGHT_STATE::APOGEE:
-                //debugln("APOGEE");
-                break;
+/*!****************************************************************************
+ * @brief runs on entry to PRE_FLIGHT_GROUND, also after a rejected launch
+ *******************************************************************************/
+void preFlightEntry(flight_fsm_t* fsm, uint8_t state) {
+    flightStateEntry(fsm, state);
+    launch_reset(&launch_detector);
+    burnout_disarm(&burnout_detector);
+    apogee_disarm(&apogee_detector);
+    altitude_trigger_disarm(&main_deploy_trigger);
+    landing_disarm(&landing_detector);
+    drogue_pyro.disarm();
+    main_pyro.disarm();
+}
 
-            // DROGUE_DEPLOY
-            case ARMED_FLIGHT_STATE::DROGUE_DEPLOY:
-                //debugln("DROGUE DEPLOY");
-                drogueChuteDeploy();
-                break;
+/*!****************************************************************************
+ * @brief runs on entry to POWERED_FLIGHT, arms the pyro channels, starts burnout detection
+ * and the apogee detection lockout. The pyros stay safe on the pad. The lockout starts at the
+ * time of the sample that detected the launch, the apogee detector runs on the sample clock
+ *******************************************************************************/
+void poweredFlightEntry(flight_fsm_t* fsm, uint8_t state) {
+    flightStateEntry(fsm, state);
+    drogue_pyro.arm();
+    main_pyro.arm();
+    burnout_arm(&burnout_detector, launch_detector.axis_sign);
+    apogee_arm(&apogee_detector, dispatch_sample_time, launch_detector.axis_sign, launch_detector.launch_time);
+}
 
-            // DROGUE_DESCENT
-            case ARMED_FLIGHT_STATE::DROGUE_DESCENT:
-            //    debugln("DROGUE DESCENT");
-                break;
+/*!****************************************************************************
+ * @brief runs on entry to COASTING, the apogee lockout now only needs to cover the coast after burnout
+ *******************************************************************************/
+void coastingEntry(flight_fsm_t* fsm, uint8_t state) {
+    flightStateEntry(fsm, state);
+    apogee_restart_lockout(&apogee_detector, dispatch_sample_time, flight_config.coast_apogee_lockout_ms);
+}
 
-            // MAIN_DEPLOY
-            case ARMED_FLIGHT_STATE::MAIN_DEPLOY:
-            //    debugln("MAIN CHUTE DEPLOY");
-                mainChuteDeploy();
-                break;
+/*!****************************************************************************
+ * @brief runs on entry to DROGUE_DEPLOY
+ *******************************************************************************/
+void drogueDeployEntry(flight_fsm_t* fsm, uint8_t state) {
+    flightStateEntry(fsm, state);
+    drogueChuteDeploy();
+}
 
-            // MAIN_DESCENT
-            case ARMED_FLIGHT_STATE::MAIN_DESCENT:
-            //    debugln("MAIN CHUTE DESCENT");
-                break;
+/*!****************************************************************************
+ * @brief runs on entry to DROGUE_DESCENT, starts watching for the main deploy altitude and landing
+ *******************************************************************************/
+void drogueDescentEntry(flight_fsm_t* fsm, uint8_t state) {
+    flightStateEntry(fsm, state);
+    altitude_trigger_arm(&main_deploy_trigger);
+    landing_arm(&landing_detector);
+}
 
-            // POST_FLIGHT_GROUND
-            case ARMED_FLIGHT_STATE::POST_FLIGHT_GROUND:
-            //    debugln("POST FLIGHT GROUND");
-                break;
-            
-            // MAINTAIN AT PRE_FLIGHT_GROUND IF NO STATE IS SPECIFIED - NOT GONNA HAPPEN BUT BETTER SAFE THAN SORRY
-            default:
-                debugln(current_state);
-                break;
+/*!****************************************************************************
+ * @brief runs on entry to MAIN_DEPLOY
+ *******************************************************************************/
+void mainDeployEntry(flight_fsm_t* fsm, uint8_t state) {
+    flightStateEntry(fsm, state);
+    mainChuteDeploy();
+}
 
-        }
-        
-        vTaskDelay(CONSUME_TASK_DELAY / portTICK_PERIOD_MS);
+/*!****************************************************************************
+ * @brief initialize the flight state machine and attach the state entry hooks
+ *******************************************************************************/
+void flightStateMachineInit() {
+    const flight_config_t& c = flight_config;
+
+    fsm_init(&flight_fsm, c.apogee_lockout_ms, c.coast_apogee_lockout_ms, c.landing_lockout_ms, millis());
+    launch_init(&launch_detector, c.launch_accel_threshold, c.launch_accel_sustain_ms, c.launch_detection_threshold, c.launch_confirm_ms, LAUNCH_MIN_BURN_TIME);
+    burnout_init(&burnout_detector, c.burnout_accel_threshold, c.burnout_jerk_threshold, c.burnout_sustain_ms, c.burnout_jerk_window_ms, c.burnout_filter_alpha);
+    apogee_init(&apogee_detector, c.apogee_lockout_ms, c.apogee_velocity_threshold, c.apogee_slope_threshold, c.apogee_confidence, c.apogee_timeout_ms, APOGEE_ACCEL_SATURATION);
+    altitude_trigger_init(&main_deploy_trigger, c.main_ejection_height, c.main_ejection_hysteresis, c.main_ejection_confirm);
+    landing_init(&landing_detector, c.landing_velocity_threshold, c.landing_altitude_band, c.landing_stable_ms);
+
+    state_log_interval[ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND] = c.log_interval_ground_ms;
+    state_log_interval[ARMED_FLIGHT_STATE::POWERED_FLIGHT] = c.log_interval_powered_ms;
+    state_log_interval[ARMED_FLIGHT_STATE::COASTING] = c.log_interval_coasting_ms;
+    state_log_interval[ARMED_FLIGHT_STATE::APOGEE] = c.log_interval_coasting_ms;
+    state_log_interval[ARMED_FLIGHT_STATE::DROGUE_DEPLOY] = c.log_interval_coasting_ms;
+    state_log_interval[ARMED_FLIGHT_STATE::DROGUE_DESCENT] = c.log_interval_descent_ms;
+    state_log_interval[ARMED_FLIGHT_STATE::MAIN_DEPLOY] = c.log_interval_descent_ms;
+    state_log_interval[ARMED_FLIGHT_STATE::MAIN_DESCENT] = c.log_interval_descent_ms;
+    state_log_interval[ARMED_FLIGHT_STATE::POST_FLIGHT_GROUND] = c.log_interval_ground_ms;
+    log_sample_interval = state_log_interval[ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND];
+
+    for(uint8_t state = 0; state < NUM_FLIGHT_STATES; state++) {
+        fsm_set_hooks(&flight_fsm, state, flightStateEntry, NULL);
     }
+
+    fsm_set_hooks(&flight_fsm, ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND, preFlightEntry, NULL);
+    fsm_set_hooks(&flight_fsm, ARMED_FLIGHT_STATE::POWERED_FLIGHT, poweredFlightEntry, NULL);
+    fsm_set_hooks(&flight_fsm, ARMED_FLIGHT_STATE::COASTING, coastingEntry, NULL);
+    fsm_set_hooks(&flight_fsm, ARMED_FLIGHT_STATE::DROGUE_DEPLOY, drogueDeployEntry, NULL);
+    fsm_set_hooks(&flight_fsm, ARMED_FLIGHT_STATE::DROGUE_DESCENT, drogueDescentEntry, NULL);
+    fsm_set_hooks(&flight_fsm, ARMED_FLIGHT_STATE::MAIN_DEPLOY, mainDeployEntry, NULL);
 }
 
 /*!****************************************************************************
- * @brief debug flight/test data to terminal, this task is called if the DEBUG_TO_TERMINAL is set to 1 (see defs.h)
- * @param pvParameter - A value that is passed as the parameter to the created task.
- * If pvParameter is set to the address of a variable then the variable must still exist when the created task executes - 
+ * @brief move to COASTING once burnout was detected and the launch is confirmed
+ * A swing on the pad looks like a short burn and its end, and COASTING ignores a
+ * rejected launch, so burnout waits for the barometer or the burn time to confirm the launch
+ *
+ *******************************************************************************/
+void checkBurnout(uint32_t now) {
+    if(burnout_detector.detected && launch_detector.confirmed && flight_fsm.state == ARMED_FLIGHT_STATE::POWERED_FLIGHT) {
+        fsm_dispatch(&flight_fsm, EVENT_BURNOUT, now);
+    }
+}
+
+/*!****************************************************************************
+ * @brief detect flight events from the IMU and altimeter data and feed them to the state machine
+ * - -see states.h and flight_fsm.h for more info --
+ * Events that do not apply to the current state are ignored by the state machine
+ *
+ *******************************************************************************/
+void checkFlightState(void* pvParameters) {
+    // get the flight state from the telemetry task
+    telemetry_type_t flight_data;
+
+    while (1) {
+        queue_receive(&check_state_queue, &flight_data, portMAX_DELAY);
+        PROFILE_BEGIN(PROFILE_STATE_CHECK);
+        TRACE_STAGE(flight_data, TRACE_DEQUEUED);
+        #if LATENCY_TRACING
+            dispatch_sample = &flight_data;
+        #endif
+        uint32_t now = millis();
+
+        // the launch, burnout and apogee windows are timed on when the sample was taken, so the time it waited in the queue does not stretch or shrink them
+        uint32_t sample_time = now - (micros() - flight_data.acquired_us) / 1000;
+        dispatch_sample_time = sample_time;
+
+        // LAUNCH AND BURNOUT DETECTION - the X axis is the rocket axis
+        if(flight_data.data_flags & ACCEL_DATA_FLAG) {
+            if(launch_update_accel(&launch_detector, sample_time, flight_data.acc_data.ax) == LAUNCH_DETECTED) {
+                fsm_dispatch(&flight_fsm, EVENT_LAUNCH, now);
+            }
+
+            burnout_update(&burnout_detector, sample_time, flight_data.acc_data.ax);
+            checkBurnout(now);
+
+            // the integrated acceleration is one of the apogee votes
+            if(apogee_update_accel(&apogee_detector, sample_time, flight_data.acc_data.ax)) {
+                fsm_dispatch(&flight_fsm, EVENT_APOGEE, now);
+            }
+        }
+
+        uint8_t gps_fix = (flight_data.data_flags & GPS_DATA_FLAG) &&
+                          altitude_gps_fix(&altitude_source, flight_data.acquired_us, flight_data.gps_data.gps_altitude,
+                                           current_state == ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND);
+        uint8_t baro_failed = (failed_sensors & ALTIMETER_DATA_FLAG) != 0;
+
+        // all altitude detection is above ground level, from the barometer or the GPS once the barometer failed
+        float agl;
+        float velocity;
+        uint8_t source = altitude_select(baro_failed, (flight_data.data_flags & ALTIMETER_DATA_FLAG) != 0, gps_fix);
+        if(source == ALTITUDE_BAROMETER) {
+            agl = flight_data.alt_data.AGL;
+            velocity = flight_data.alt_data.velocity;
+        } else if(source == ALTITUDE_GPS) {
+            agl = altitude_gps_agl(&altitude_source);
+            velocity = altitude_source.gps.velocity;
+        } else {
+            // the other packets carry no altitude, their altitude fields are zero
+            TRACE_STAGE(flight_data, TRACE_STATE_CHECKED);
+            PROFILE_END(PROFILE_STATE_CHECK);
+            continue;
+        }
+
+        // the barometer confirms an accelerometer launch, or detects launch alone if the IMU missed it.
+        // A rejection disarms the pyros, it is never made on GPS altitude
+        launch_set_baro_failed(&launch_detector, baro_failed);
+        switch (launch_update_baro(&launch_detector, sample_time, agl)) {
+            case LAUNCH_DETECTED:
+                fsm_dispatch(&flight_fsm, EVENT_LAUNCH, now);
+                break;
+
+            case LAUNCH_REJECTED:
+                debugln("LAUNCH REJECTED");
+                fsm_dispatch(&flight_fsm, EVENT_LAUNCH_REJECTED, now);
+                break;
+
+            default:
+                break;
+        }
+        checkBurnout(now);
+
+        // APOGEE DETECTION - baro trend, Kalman velocity and integrated acceleration vote, 2 must agree
+        if(apogee_update(&apogee_detector, sample_time, agl, velocity)) {
+            fsm_dispatch(&flight_fsm, EVENT_APOGEE, now);
+        }
+
+        // MAIN CHUTE - armed in DROGUE_DESCENT, fires once through MAIN_EJECTION_HEIGHT
+        if(altitude_trigger_update(&main_deploy_trigger, agl)) {
+            fsm_dispatch(&flight_fsm, EVENT_MAIN_ALTITUDE, now);
+        }
+
+        // LANDING - still and at a steady altitude for LANDING_STABLE_TIME, wherever the rocket came down
+        if(landing_update(&landing_detector, now, agl, velocity)) {
+            fsm_dispatch(&flight_fsm, EVENT_LANDED, now);
+        }
+
+        TRACE_STAGE(flight_data, TRACE_STATE_CHECKED);
+        PROFILE_END(PROFILE_STATE_CHECK);
+    }
+
+}
+
+/*!****************************************************************************
+ * @brief performs flight actions based on the current flight state
+
+ * If the flight state requires an action, we perform it here
+ * For example if the flight state is apogee, we perform MAIN_CHUTE ejection
+ * The task sleeps until flightStateEntry() notifies it of a state change. Every
+ * state entered since the last wake up is handled, in flight order, so the
+ * transient states are not missed
+ * 
+ *******************************************************************************/
+void flightStateCallback(void* pvParameters) {
+    uint32_t state_bits = 0;
+
+    while(1) {
+        xTaskNotifyWait(0, ULONG_MAX, &state_bits, portMAX_DELAY);
+
+        for(uint8_t state = 0; state < NUM_FLIGHT_STATES; state++) {
+            if(!(state_bits & (1UL << state_notify_bit[state]))) {
+                continue;
+            }
+
+            switch (state) {
+                // PRE_FLIGHT_GROUND
+                case ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND:
+                    //debugln("PRE-FLIGHT STATE");
+                    break;
+
+                // POWERED_FLIGHT
+                case ARMED_FLIGHT_STATE::POWERED_FLIGHT:
+                    //debugln("POWERED FLIGHT STATE");
+                    break;
+
+                // COASTING
+                case ARMED_FLIGHT_STATE::COASTING:
+                //    debugln("COASTING");
+                    break;
+
+                // APOGEE - the votes are logged by resourceMonitorTask, a flash write here would delay the drogue
+                case ARMED_FLIGHT_STATE::APOGEE:
+                    //debugln("APOGEE");
+                    __atomic_store_n(&apogee_votes_pending, 1, __ATOMIC_RELEASE);
+                    break;
+
+                // DROGUE_DEPLOY - the charge is fired once on entry, see drogueDeployEntry()
+                case ARMED_FLIGHT_STATE::DROGUE_DEPLOY:
+                    //debugln("DROGUE DEPLOY");
+                    break;
+
+                // DROGUE_DESCENT
+                case ARMED_FLIGHT_STATE::DROGUE_DESCENT:
+                //    debugln("DROGUE DESCENT");
+                    break;
+
+                // MAIN_DEPLOY - the charge is fired once on entry, see mainDeployEntry()
+                case ARMED_FLIGHT_STATE::MAIN_DEPLOY:
+                //    debugln("MAIN CHUTE DEPLOY");
+                    break;
+
+                // MAIN_DESCENT
+                case ARMED_FLIGHT_STATE::MAIN_DESCENT:
+                //    debugln("MAIN CHUTE DESCENT");
+                    break;
+
+                // POST_FLIGHT_GROUND - stop acquisition and fall back to the GPS beacon
+                case ARMED_FLIGHT_STATE::POST_FLIGHT_GROUND:
+                //    debugln("POST FLIGHT GROUND");
+                    enterRecoveryMode();
+                    break;
+        
+                // MAINTAIN AT PRE_FLIGHT_GROUND IF NO STATE IS SPECIFIED - NOT GONNA HAPPEN BUT BETTER SAFE THAN SORRY
+                default:
+                    debugln(state);
+                    break;
+
+            }
+        }
+    }
+}
+
+/*!****************************************************************************
+ * @brief debug flight/test data to terminal, this task is called if the DEBUG_TO_TERMINAL is set to 1 (see defs.h)
+ * @param pvParameter - A value that is passed as the parameter to the created task.
+ * If pvParameter is set to the address of a variable then the variable must still exist when the created task executes - 
  * so it is not valid to pass the address of a stack variable.
  * 
  *******************************************************************************/
 void debugToTerminalTask(void* pvParameters){
     telemetry_type_t telemetry_received_packet; // acceleration received from acceleration_queue
+    char telemetry_packet_buffer[TELEMETRY_CSV_ROW_LENGTH];
 
     while(true){
-        // get telemetry data
-        xQueueReceive(log_to_mem_queue_handle, &telemetry_received_packet, portMAX_DELAY);
+        // get telemetry data, log_to_mem_queue belongs to logToMemory
+        queue_receive(&debug_to_term_queue, &telemetry_received_packet, portMAX_DELAY);
         
-        /**
-         * record number
-         * operation_mode
-         * state
-         * ax
-         * ay
-         * az
-         * pitch
-         * roll
-         * gx
-         * gy
-         * gz
-         * latitude
-         * longitude
-         * gps_altitude
-         * pressure
-         * temperature
-         * altitude_agl
-         * velocity
-         *
-         */
-        sprintf(telemetry_packet_buffer,
-                "%d,%d,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
-
-                telemetry_received_packet.record_number,
-                telemetry_received_packet.operation_mode,
-                telemetry_received_packet.state,
-                telemetry_received_packet.acc_data.ax,
-                telemetry_received_packet.acc_data.ay,
-                telemetry_received_packet.acc_data.az,
-                telemetry_received_packet.acc_data.pitch,
-                telemetry_received_packet.acc_data.roll,
-                telemetry_received_packet.gyro_data.gx,
-                telemetry_received_packet.gyro_data.gy,
-                telemetry_received_packet.gps_data.latitude,
-                telemetry_received_packet.gps_data.longitude,
-                telemetry_received_packet.gps_data.gps_altitude,
-                telemetry_received_packet.alt_data.pressure,
-                telemetry_received_packet.alt_data.temperature,
-                telemetry_received_packet.alt_data.AGL,
-                telemetry_received_packet.alt_data.velocity
-                );
+        /* see telemetry_csv.cpp for the column order */
+        telemetry_to_csv(telemetry_packet_buffer, sizeof(telemetry_packet_buffer), &telemetry_received_packet);
         
         debugln(telemetry_packet_buffer);
         vTaskDelay(CONSUME_TASK_DELAY/portTICK_PERIOD_MS);
@@ -780,7 +1381,7 @@ void logToMemory(void* pvParameter) {
     telemetry_type_t received_packet;
 
     while(1) {
-        xQueueReceive(log_to_mem_queue_handle, &received_packet, portMAX_DELAY);
+        queue_receive(&log_to_mem_queue, &received_packet, portMAX_DELAY);
 
         // received_packet.record_number++; 
 
@@ -789,15 +1390,293 @@ void logToMemory(void* pvParameter) {
 
         if(current_log_time - previous_log_time > log_sample_interval) {
             previous_log_time = current_log_time;
+            PROFILE_BEGIN(PROFILE_LOG_WRITE);
             data_logger.loggerWrite(received_packet);
+            PROFILE_END(PROFILE_LOG_WRITE);
+            TRACE_STAGE(received_packet, TRACE_LOGGED);
         }
         
     }
 
 }
 
+#if LATENCY_TRACING
+/**
+ * Traced samples on their way to ground, indexed by data flag bit. The telemetry task
+ * keeps the latest traced sample of each sensor, and the oldest one in the pending batches
+ */
+typedef struct {
+    uint32_t trace_id;
+    uint32_t acquired_us;
+    uint8_t valid;
+} traced_sample_t;
+
+traced_sample_t telemetry_traced[4];
+traced_sample_t batch_traced[4];
+uint8_t batch_traced_links = 0;         /*!< links whose pending batch still holds the batch_traced samples */
+
+/*!****************************************************************************
+ * @brief trace the sample that made checkFlightState fire a pyro channel
+ *
+ *******************************************************************************/
+void tracePyroFired() {
+    if(dispatch_sample != NULL) {
+        TRACE_STAGE(*dispatch_sample, TRACE_PYRO_FIRED);
+    }
+}
+
+/*!****************************************************************************
+ * @brief remember a traced packet received by the telemetry task
+ * A fused record is remembered as the sample of its trace source, see trace_source()
+ *
+ *******************************************************************************/
+void traceTelemetryReceived(const telemetry_type_t* packet) {
+    if(!trace_sampled(packet->trace_id, TRACE_PUBLISHED)) {
+        return;
+    }
+
+    for(uint8_t bit = 0; bit < 4; bit++) {
+        if(trace_source(packet->data_flags) == (1 << bit)) {
+            telemetry_traced[bit].trace_id = packet->trace_id;
+            telemetry_traced[bit].acquired_us = packet->acquired_us;
+            telemetry_traced[bit].valid = 1;
+        }
+    }
+}
+
+/*!****************************************************************************
+ * @brief the samples received so far are now in the pending batches of every link
+ *
+ *******************************************************************************/
+void traceBatchAppended() {
+    for(uint8_t bit = 0; bit < 4; bit++) {
+        if(telemetry_traced[bit].valid && !batch_traced[bit].valid) {
+            batch_traced[bit] = telemetry_traced[bit];
+            batch_traced_links = (1 << NUM_TELEMETRY_TRANSPORTS) - 1;
+        }
+        telemetry_traced[bit].valid = 0;
+    }
+}
+
+/*!****************************************************************************
+ * @brief trace the samples when the first link delivers a batch holding them
+ * They are dropped once every link has sent its batch without delivering them
+ * @param link index of the link in telemetry_transports
+ * @param published 1 if the link took the batch
+ *
+ *******************************************************************************/
+void traceBatchPublished(uint8_t link, uint8_t published) {
+    if(!(batch_traced_links & (1 << link))) {
+        return;
+    }
+
+    batch_traced_links &= ~(1 << link);
+    uint32_t now = micros();
+
+    for(uint8_t bit = 0; bit < 4; bit++) {
+        if(batch_traced[bit].valid && published) {
+            trace_record(&latency_trace, batch_traced[bit].trace_id, 1 << bit, TRACE_PUBLISHED, now - batch_traced[bit].acquired_us);
+        }
+        if(published || batch_traced_links == 0) {
+            batch_traced[bit].valid = 0;
+        }
+    }
+
+    if(published) {
+        batch_traced_links = 0;
+    }
+}
+
+/*!****************************************************************************
+ * @brief append the trace records written since the last call to LATENCY_TRACE_FILE
+ * The file is started over with the first flush after boot, so the trace of the last
+ * flight survives resets on the pad and after landing
+ *
+ *******************************************************************************/
+void flushLatencyTrace() {
+    static trace_record_t records[64];
+    static uint8_t file_started = 0;
+    static uint32_t file_size = 0;
+    size_t count;
+
+    if(!file_started) {
+        trace_file_header_t header;
+        trace_file_header(&header);
+
+        File file = SPIFFS.open(LATENCY_TRACE_FILE, FILE_WRITE);
+        if(!file) {
+            return;
+        }
+        file_size = file.write((const uint8_t*) &header, sizeof(header));
+        file.close();
+        file_started = 1;
+    }
+
+    File file = SPIFFS.open(LATENCY_TRACE_FILE, FILE_APPEND);
+    if(!file) {
+        return;
+    }
+
+    while(file_size < TRACE_FILE_MAX_SIZE && (count = trace_read(&latency_trace, records, 64)) > 0) {
+        file_size += file.write((const uint8_t*) records, count * sizeof(trace_record_t));
+    }
+
+    file.close();
+}
+#endif // LATENCY_TRACING
+
+/*!****************************************************************************
+ * @brief send the pending telemetry batch of one link
+ * The send time and result are fed back to the batch and the telemetry scheduler of that
+ * link only, so each adapts to its own link
+ * @param link index of the link in telemetry_transports
+ *
+ *******************************************************************************/
+void publishTelemetryBatch(uint8_t link) {
+    telemetry_batch_t* batch = &telemetry_batches[link];
+
+    if(batch->samples == 0) {
+        return;
+    }
+
+    PROFILE_BEGIN(PROFILE_PUBLISH);
+
+    size_t length = batch->length;
+    unsigned long send_start = millis();
+    uint8_t status = telemetry_transports[link]->send((const uint8_t*) batch->payload, length);
+    uint32_t send_time = millis() - send_start;
+
+    // a batch the link only queued has not reached the ground yet, both count it as congestion
+    uint8_t congested = status == TELEMETRY_QUEUED || send_time > MQTT_CONGESTION_TIME;
+    scheduler_report_link(&telemetry_schedulers[link], length, send_time, status != TELEMETRY_REFUSED, congested);
+    batch_report_publish(batch, status == TELEMETRY_SENT, send_time);
+
+    PROFILE_END(PROFILE_PUBLISH);
+
+    #if LATENCY_TRACING
+        traceBatchPublished(link, status == TELEMETRY_SENT);
+    #endif
+}
+
+/*!****************************************************************************
+ * @brief add a telemetry record to the pending batch of one link
+ * If the record does not fit, the batch is published first
+ * @param link index of the link in telemetry_transports
+ *
+ *******************************************************************************/
+void appendLinkRecord(uint8_t link, const char* record, size_t length) {
+    if(!batch_append(&telemetry_batches[link], record, length, millis())) {
+        publishTelemetryBatch(link);
+        batch_append(&telemetry_batches[link], record, length, millis());
+    }
+}
+
+/*!****************************************************************************
+ * @brief add a telemetry record to the pending batch of every link
+ *
+ *******************************************************************************/
+void appendTelemetryRecord(const char* record, size_t length) {
+    for(uint8_t i = 0; i < NUM_TELEMETRY_TRANSPORTS; i++) {
+        appendLinkRecord(i, record, length);
+    }
+
+    #if LATENCY_TRACING
+        traceBatchAppended();
+    #endif
+}
+
+/*!****************************************************************************
+ * @brief write the statistics of every data queue to the system log and the telemetry batch
+ * Runs from the telemetry task every QUEUE_STATS_INTERVAL ms. Drops mean a consumer
+ * fell behind its producers, a high water mark at the queue length that it nearly did
+ *
+ *******************************************************************************/
+void logQueueStats() {
+    monitored_queue_t* const queues[] = {
+        &telemetry_data_queue,
+        &log_to_mem_queue,
+        &check_state_queue,
+        &debug_to_term_queue,
+        &fusion_queue
+    };
+    char record[QUEUE_RECORD_LENGTH];
+    char line[160];
+    monitored_queue_t stats;
+    uint32_t now = millis();
+
+    for(uint8_t i = 0; i < sizeof(queues) / sizeof(queues[0]); i++) {
+        queue_snapshot(queues[i], &stats);
+
+        snprintf(line, sizeof(line), "[%c]Queue %s sent %lu dropped %lu received %lu high water %lu/%lu blocked %lu us\r\n",
+                 stats.dropped > 0 ? '-' : '+', stats.name, (unsigned long) stats.enqueued, (unsigned long) stats.dropped,
+                 (unsigned long) stats.received, (unsigned long) stats.high_water, (unsigned long) stats.length,
+                 (unsigned long) stats.blocked_us);
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+
+        size_t length = queue_format(queues[i], record, sizeof(record), now);
+        if(length > 0) {
+            appendTelemetryRecord(record, length);
+        }
+    }
+}
+
+#if TASK_PROFILING
+/*!****************************************************************************
+ * @brief write the task profile summary to the system log and the telemetry batch
+ * Runs from the telemetry task every PROFILE_SUMMARY_INTERVAL ms
+ *
+ *******************************************************************************/
+void logTaskProfile() {
+    char record[PROFILER_RECORD_LENGTH];
+    char line[100];
+    profile_summary_t summary;
+    uint32_t now = millis();
+
+    for(uint8_t i = 0; i < NUM_PROFILE_SECTIONS; i++) {
+        profiler_summary(&task_profiler, i, &summary);
+
+        snprintf(line, sizeof(line), "[+]Profile %s n %lu min %lu mean %lu max %lu p99 %lu us late %lu\r\n",
+                 task_profiler.sections[i].name, (unsigned long) summary.count, (unsigned long) summary.min_us,
+                 (unsigned long) summary.mean_us, (unsigned long) summary.max_us, (unsigned long) summary.p99_us,
+                 (unsigned long) summary.late);
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+
+        size_t length = profiler_format(&task_profiler, i, record, sizeof(record), now);
+        if(length > 0) {
+            appendTelemetryRecord(record, length);
+        }
+    }
+}
+#endif // TASK_PROFILING
+
+/*!****************************************************************************
+ * @brief set the priority and target rate of each telemetry channel on every link
+ * Lower priority value is more important. Flight state and altitude must reach the
+ * ground even on a poor link, GPS and health can wait
+ *
+ *******************************************************************************/
+void telemetrySchedulerInit() {
+    for(uint8_t i = 0; i < NUM_TELEMETRY_TRANSPORTS; i++) {
+        telemetry_scheduler_t* scheduler = &telemetry_schedulers[i];
+
+        scheduler_init(scheduler, TELEMETRY_FRAME_INTERVAL, TELEMETRY_LINK_RATE, TELEMETRY_MIN_LINK_RATE, TELEMETRY_MAX_LINK_RATE);
+
+        scheduler_set_channel(scheduler, CHANNEL_STATE,      0, 500);
+        scheduler_set_channel(scheduler, CHANNEL_ALTITUDE,   1, 100);
+        scheduler_set_channel(scheduler, CHANNEL_VELOCITY,   2, 100);
+        scheduler_set_channel(scheduler, CHANNEL_GPS,        3, 1000);
+        scheduler_set_channel(scheduler, CHANNEL_ATTITUDE,   4, 200);
+        scheduler_set_channel(scheduler, CHANNEL_HEALTH,     5, 2000);
+    }
+}
+
 /*!****************************************************************************
  * @brief send flight data to ground
+ * This is the only task that touches the telemetry links. It polls them (MQTT reconnect
+ * and keep-alive, XBee transmit status) between packets.
+ * With TELEMETRY_SCHEDULED_FRAMES set, every received packet only updates the telemetry
+ * schedulers, so the queue is drained at the sensor rate, and one frame sized to each link
+ * is built for it every TELEMETRY_FRAME_INTERVAL ms. Otherwise every packet is sent as a CSV row
  * @param pvParameter - A value that is passed as the paramater to the created task.
  * If pvParameter is set to the address of a variable then the variable must still exist when the created task executes -
  * so it is not valid to pass the address of a stack variable.
@@ -806,152 +1685,766 @@ void logToMemory(void* pvParameter) {
 void MQTT_TransmitTelemetry(void* pvParameters) {
     // variable to store the received packet to transmit
     telemetry_type_t telemetry_received_packet;
+    char telemetry_packet_buffer[TELEMETRY_CSV_ROW_LENGTH];
+    unsigned long last_frame_time = millis();
+    unsigned long last_queue_stats_time = millis();
+    #if TASK_PROFILING
+        unsigned long last_profile_time = millis();
+    #endif
+    #if LATENCY_TRACING
+        unsigned long last_trace_flush_time = millis();
+    #endif
+
+    for(uint8_t i = 0; i < NUM_TELEMETRY_TRANSPORTS; i++) {
+        batch_init(&telemetry_batches[i], MQTT_BATCH_SIZE, MQTT_BATCH_MAX_SIZE, MQTT_BATCH_MAX_LATENCY, MQTT_CONGESTION_TIME, MQTT_BATCH_ADAPTIVE);
+    }
+    telemetrySchedulerInit();
 
     while(1) {
+        // service the links, e.g. XBee transmit status frames
+        for(uint8_t i = 0; i < NUM_TELEMETRY_TRANSPORTS; i++) {
+            telemetry_transports[i]->poll();
+        }
+
+        // wait for the next record, but not past the latency cap of a pending batch
+        // or so long that the links are not serviced
+        uint32_t wait_ms = TELEMETRY_POLL_INTERVAL;
+        for(uint8_t i = 0; i < NUM_TELEMETRY_TRANSPORTS; i++) {
+            if(telemetry_batches[i].samples > 0) {
+                uint32_t to_deadline = batch_time_to_deadline(&telemetry_batches[i], millis());
+                if(to_deadline < wait_ms) {
+                    wait_ms = to_deadline;
+                }
+            }
+        }
+
+        #if TELEMETRY_SCHEDULED_FRAMES
+            uint32_t since_frame = millis() - last_frame_time;
+            uint32_t frame_interval = recovery_mode ? RECOVERY_BEACON_INTERVAL : TELEMETRY_FRAME_INTERVAL;
+            uint32_t to_frame = since_frame >= frame_interval ? 0 : frame_interval - since_frame;
+            if(to_frame < wait_ms) {
+                wait_ms = to_frame;
+            }
+        #endif
+
+        TickType_t wait = wait_ms / portTICK_PERIOD_MS;
 
         // receive from telemetry queue
-        xQueueReceive(telemetry_data_queue_handle, &telemetry_received_packet, portMAX_DELAY);
-
-        /**
-         * PACKAGE TELEMETRY PACKET
-         */
-
-        /**
-         * record number
-         * operation_mode
-         * state
-         * ax
-         * ay
-         * az
-         * pitch
-         * roll
-         * gx
-         * gy
-         * gz
-         * latitude
-         * longitude
-         * gps_altitude
-         * gps_time
-         * pressure
-         * temperature
-         * altitude_agl
-         * velocity
-         * pyro1_state // not used
-         * pyro2_state // not used
-         * battery_voltage // not used
-         *
-         */
-        sprintf(telemetry_packet_buffer,
-            "%d,%d,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
-
-            telemetry_received_packet.record_number,
-            telemetry_received_packet.operation_mode,
-            telemetry_received_packet.state,
-            telemetry_received_packet.acc_data.ax,
-            telemetry_received_packet.acc_data.ay,
-            telemetry_received_packet.acc_data.az,
-            telemetry_received_packet.acc_data.pitch,
-            telemetry_received_packet.acc_data.roll,
-            telemetry_received_packet.gyro_data.gx,
-            telemetry_received_packet.gyro_data.gy,
-            telemetry_received_packet.gps_data.latitude,
-            telemetry_received_packet.gps_data.longitude,
-            telemetry_received_packet.gps_data.gps_altitude,
-            telemetry_received_packet.alt_data.pressure,
-            telemetry_received_packet.alt_data.temperature,
-            telemetry_received_packet.alt_data.AGL,
-            telemetry_received_packet.alt_data.velocity
-            );
-
-        /* Send to MQTT topic  */
-        // if(client.publish(MQTT_TOPIC, telemetry_packet_buffer) ) {
-        //     debugln("[+]Data sent");
-        // } else {
-        //     debugln("[-]Data not sent");
-        // }
+        if(queue_receive(&telemetry_data_queue, &telemetry_received_packet, wait)) {
+            #if LATENCY_TRACING
+                traceTelemetryReceived(&telemetry_received_packet);
+            #endif
+
+            #if TELEMETRY_SCHEDULED_FRAMES
+                for(uint8_t i = 0; i < NUM_TELEMETRY_TRANSPORTS; i++) {
+                    scheduler_update(&telemetry_schedulers[i], &telemetry_received_packet, millis());
+                }
+            #else
+                /**
+                 * PACKAGE TELEMETRY PACKET
+                 * see telemetry_csv.cpp for the column order
+                 */
+                size_t row_length = telemetry_to_csv(telemetry_packet_buffer, sizeof(telemetry_packet_buffer), &telemetry_received_packet);
+                appendTelemetryRecord(telemetry_packet_buffer, row_length);
+            #endif
+        }
+
+        #if TELEMETRY_SCHEDULED_FRAMES
+            unsigned long now = millis();
+            if(now - last_frame_time >= frame_interval) {
+                last_frame_time = now;
+
+                // health word: subsystem init mask in bits 0-7, drogue pyro status in 8-11, main pyro status in 12-15,
+                // data flags of the failed over sensors in 16-19
+                uint32_t health = SUBSYSTEM_INIT_MASK | (drogue_pyro.status() << 8) | (main_pyro.status() << 12) | ((uint32_t) failed_sensors << 16);
+
+                for(uint8_t i = 0; i < NUM_TELEMETRY_TRANSPORTS; i++) {
+                    scheduler_update_state(&telemetry_schedulers[i], current_state, operation_mode, now);
+                    scheduler_update_health(&telemetry_schedulers[i], health, now);
+
+                    size_t frame_length = scheduler_build_frame(&telemetry_schedulers[i], telemetry_packet_buffer, sizeof(telemetry_packet_buffer), now);
+                    if(frame_length > 0) {
+                        appendLinkRecord(i, telemetry_packet_buffer, frame_length);
+                    }
+                }
+
+                #if LATENCY_TRACING
+                    traceBatchAppended();
+                #endif
+            }
+        #endif
+
+        if(millis() - last_queue_stats_time >= QUEUE_STATS_INTERVAL) {
+            last_queue_stats_time = millis();
+            logQueueStats();
+        }
+
+        #if TASK_PROFILING
+            if(millis() - last_profile_time >= PROFILE_SUMMARY_INTERVAL) {
+                last_profile_time = millis();
+                logTaskProfile();
+            }
+        #endif
+
+        // the trace is only kept from launch on, on the pad the ring just holds the latest records
+        #if LATENCY_TRACING
+            if(current_state != ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND && millis() - last_trace_flush_time >= TRACE_FLUSH_INTERVAL) {
+                last_trace_flush_time = millis();
+                flushLatencyTrace();
+            }
+        #endif
+
+        for(uint8_t i = 0; i < NUM_TELEMETRY_TRANSPORTS; i++) {
+            if(batch_ready(&telemetry_batches[i], millis())) {
+                publishTelemetryBatch(i);
+            }
+        }
+    }
+}
+
+/*!****************************************************************************
+ * @brief fires the pyro-charge to deploy the drogue chute
+ * Starts a PYRO_PULSE_TIME pulse on the drogue channel and returns immediately,
+ * the pulse is ended by a timer. The channel fires only once per arming
+ * 
+ *******************************************************************************/
+void drogueChuteDeploy() {
+    uint8_t result = drogue_pyro.fire();
+
+    if(result == PYRO_FIRE_OK) {
+        debugln("DROGUE CHUTE DEPLOYED");
+        #if LATENCY_TRACING
+            tracePyroFired();
+        #endif
+    } else {
+        debug("DROGUE CHUTE NOT DEPLOYED: "); debugln(result);
+    }
+}
+
+/*!****************************************************************************
+ * @brief fires the pyro-charge to deploy the main chute
+ * Starts a PYRO_PULSE_TIME pulse on the main channel and returns immediately,
+ * the pulse is ended by a timer. The channel fires only once per arming
+ * 
+ *******************************************************************************/
+void mainChuteDeploy() {
+    uint8_t result = main_pyro.fire();
+
+    if(result == PYRO_FIRE_OK) {
+        debugln("MAIN CHUTE DEPLOYED");
+        #if LATENCY_TRACING
+            tracePyroFired();
+        #endif
+    } else {
+        debug("MAIN CHUTE NOT DEPLOYED: "); debugln(result);
+    }
+}
+
+/*!****************************************************************************
+ * @brief record how apogee was decided and each estimator's vote to the system log
+ * Called from resourceMonitorTask on the network core once apogee_votes_pending is set. The
+ * detector no longer changes once apogee is declared, so it is safe to read from there
+ * 
+ *******************************************************************************/
+void logApogeeVotes() {
+    char line[96];
+
+    snprintf(line, sizeof(line), "[+]Apogee %s at %lu ms, votes 0x%x, healthy 0x%x\r\n",
+        apogee_detector.detected == APOGEE_TIMEOUT ? "by timeout" : "by vote",
+        (unsigned long) apogee_detector.detect_time, apogee_detector.detect_votes, apogee_health_mask(&apogee_detector));
+    debugln(line);
+    SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+
+    for(uint8_t i = 0; i < NUM_APOGEE_VOTERS; i++) {
+        const apogee_vote_t* v = &apogee_detector.votes[i];
+
+        if(v->voted) {
+            snprintf(line, sizeof(line), "[+]Apogee vote %s at %lu ms%s\r\n", apogee_voter_name(i),
+                (unsigned long) v->vote_time, v->healthy ? "" : ", unhealthy");
+        } else {
+            snprintf(line, sizeof(line), "[+]Apogee vote %s none%s\r\n", apogee_voter_name(i), v->healthy ? "" : ", unhealthy");
+        }
+        debugln(line);
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+    }
+}
+
+/*!****************************************************************************
+ * @brief stop the timer that wakes the sensor tasks, once both have suspended themselves
+ *******************************************************************************/
+void stopSampleTimer() {
+    if(sample_timer != NULL) {
+        timerAlarmDisable(sample_timer);
+    }
+}
+
+/**
+ * Recovery mode shutdown, in order, see task_shutdown.h
+ * 1. the IMU and altimeter tasks suspend themselves between readings, then the sample timer
+ *    and the fusion stage are stopped
+ * 2. the logger writes what is still queued, then the flight consumers are suspended
+ */
+const shutdown_step_t recovery_shutdown[] = {
+    { SHUTDOWN_AWAIT_SUSPEND,   "readAcceleration",     &readAccelerationTaskHandle,    NULL,               NULL },
+    { SHUTDOWN_AWAIT_SUSPEND,   "readAltimeter",        &readAltimeterTaskHandle,       NULL,               NULL },
+    { SHUTDOWN_CALL,            "sample timer",         NULL,                           NULL,               stopSampleTimer },
+    // the fusion stage would keep holding the last samples, stop it with the sensors
+    { SHUTDOWN_SUSPEND,         "sensorFusion",         &sensorFusionTaskHandle,        NULL,               NULL },
+    // nothing new reaches the log queue now, let the logger drain it
+    { SHUTDOWN_DRAIN,           "log_to_mem_queue",     NULL,                           &log_to_mem_queue,  NULL },
+    { SHUTDOWN_SUSPEND,         "logToMemory",          &logToMemoryTaskHandle,         NULL,               NULL },
+    { SHUTDOWN_SUSPEND,         "debugToTerminal",      &debugToTerminalTaskHandle,     NULL,               NULL },
+    { SHUTDOWN_SUSPEND,         "checkFlightState",     &checkFlightStateTaskHandle,    NULL,               NULL }
+};
 
-        client.publish(MQTT_TOPIC, telemetry_packet_buffer);
+const uint8_t NUM_RECOVERY_SHUTDOWN_STEPS = sizeof(recovery_shutdown) / sizeof(recovery_shutdown[0]);
+
+/*!****************************************************************************
+ * @brief switch to the post flight recovery mode, runs once from flightStateCallback
+ * Stops the flight tasks with the recovery_shutdown steps, then slows the CPU down. Only
+ * the GPS beacon and telemetry keep running
+ * 
+ *******************************************************************************/
+void enterRecoveryMode() {
+    if(recovery_mode) {
+        return;
     }
 
-    vTaskDelay(CONSUME_TASK_DELAY/ portTICK_PERIOD_MS);
+    recovery_mode = 1;
+    debugln("ENTERING RECOVERY MODE");
+
+    shutdown_result_t results[NUM_RECOVERY_SHUTDOWN_STEPS];
+    shutdown_run(recovery_shutdown, NUM_RECOVERY_SHUTDOWN_STEPS, RECOVERY_SHUTDOWN_TIMEOUT, results);
+
+    for(uint8_t i = 0; i < NUM_RECOVERY_SHUTDOWN_STEPS; i++) {
+        if(results[i].outcome == SHUTDOWN_TIMED_OUT) {
+            char line[64];
+            snprintf(line, sizeof(line), "[-]Shutdown %s timed out after %lu ms\r\n", recovery_shutdown[i].name,
+                (unsigned long) results[i].elapsed_ms);
+            debugln(line);
+            SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+        }
+    }
+
+    SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]Landed, flight log closed. Recovery mode.\r\n");
+
+    // WiFi needs at least 80MHz
+    setCpuFrequencyMhz(RECOVERY_CPU_FREQUENCY);
+
+    #if TASK_PROFILING
+        task_profiler.cycles_per_us = RECOVERY_CPU_FREQUENCY;
+    #endif
+}
+
+void resourceMonitorTask(void* pvParameters);
+void healthMonitorTask(void* pvParameters);
+void i2cBusTask(void* pvParameters);
+
+/**
+ * Entry function and handle of every task in flight_tasks, indexed by FLIGHT_TASK
+ */
+typedef struct {
+    TaskFunction_t entry;
+    TaskHandle_t* handle;
+    uint8_t enabled;
+} task_entry_t;
+
+const task_entry_t task_entries[NUM_FLIGHT_TASKS] = {
+    /* READ_ACCELERATION */     { readAccelerationTask,     &readAccelerationTaskHandle,        1 },
+    /* READ_ALTIMETER */        { readAltimeterTask,        &readAltimeterTaskHandle,           1 },
+    /* READ_GPS */              { readGPSTask,              &readGPSTaskHandle,                 1 },
+    /* CHECK_FLIGHT_STATE */    { checkFlightState,         &checkFlightStateTaskHandle,        1 },
+    /* FLIGHT_STATE_CALLBACK */ { flightStateCallback,      &flightStateCallbackTaskHandle,     1 },
+    /* SENSOR_FUSION */         { sensorFusionTask,         &sensorFusionTaskHandle,            1 },
+    /* TRANSMIT_TELEMETRY */    { MQTT_TransmitTelemetry,   &MQTT_TransmitTelemetryTaskHandle,  1 },
+    /* DEBUG_TO_TERMINAL */     { debugToTerminalTask,      &debugToTerminalTaskHandle,         DEBUG_TO_TERMINAL },
+    /* LOG_TO_MEMORY */         { logToMemory,              &logToMemoryTaskHandle,             LOG_TO_MEMORY },
+    /* RESOURCE_MONITOR */      { resourceMonitorTask,      &resourceMonitorTaskHandle,         1 },
+    /* HEALTH_MONITOR */        { healthMonitorTask,        &healthMonitorTaskHandle,           1 },
+    /* I2C_BUS */               { i2cBusTask,               &i2cBusTaskHandle,                  1 }
+};
+
+uint32_t created_task_mask = 0;     /*!< bit i set if flight_tasks[i] is running */
+
+/**
+ * Stacks and control blocks of the tasks, the stacks are carved from task_stacks by stack_depth
+ */
+uint8_t task_stacks[TASK_STACK_ARENA_SIZE] __attribute__((aligned(ARENA_ALIGNMENT)));
+StaticTask_t task_control_blocks[NUM_FLIGHT_TASKS];
+StackType_t* task_stack_base[NUM_FLIGHT_TASKS];     /*!< stack of each task in task_stacks, kept for restarts */
+static_arena_t task_stack_arena;
+
+/*!****************************************************************************
+ * @brief create one data queue of flight_config.data_queue_length telemetry packets
+ * The items are stored in queue_storage, the queue does not use the heap
+ *
+ *******************************************************************************/
+uint8_t createDataQueue(monitored_queue_t* q, const char* name) {
+    uint32_t length = flight_config.data_queue_length;
+    uint8_t* storage = (uint8_t*) arena_alloc(&queue_arena, length * sizeof(telemetry_type_t));
+
+    return queue_create(q, name, length, sizeof(telemetry_type_t), storage);
+}
+
+/*!****************************************************************************
+ * @brief create flight_tasks[i] on its stack in task_stacks
+ * @return 1 if the task is running
+ *
+ *******************************************************************************/
+uint8_t startTask(uint8_t i) {
+    const task_spec_t* t = &flight_tasks[i];
+
+    if(task_stack_base[i] == NULL) {
+        return 0;
+    }
+
+    *task_entries[i].handle = xTaskCreateStaticPinnedToCore(task_entries[i].entry, t->name, t->stack_depth, NULL, t->priority,
+                                                            task_stack_base[i], &task_control_blocks[i], t->core);
+
+    return *task_entries[i].handle != NULL;
+}
+
+/*!****************************************************************************
+ * @brief delete a stalled task and start it again on the same stack
+ * Its loop starts over, the state it keeps in globals is kept.
+ * A task deleted while it runs on the other core stays on the termination list until the
+ * idle task of that core runs, and creating a task on a control block still on that list
+ * corrupts the kernel lists. The task is created again only once the task count shows it
+ * was released. Only the health monitor creates or deletes tasks in flight, so the count
+ * drops for this task alone
+ * @return 1 if the task is running again, 0 if it was not released within
+ * TASK_RESTART_TIMEOUT ms. Its control block is then never reused and the task stays down
+ *
+ *******************************************************************************/
+uint8_t restartTask(uint8_t i) {
+    TaskHandle_t task = *task_entries[i].handle;
+
+    if(task == NULL) {
+        return 0;
+    }
+
+    UBaseType_t tasks_before = uxTaskGetNumberOfTasks();
+
+    // the sample timer and the monitors skip the task from here on
+    *task_entries[i].handle = NULL;
+    vTaskDelete(task);
+
+    for(uint32_t waited = 0; uxTaskGetNumberOfTasks() >= tasks_before; waited++) {
+        if(waited >= TASK_RESTART_TIMEOUT) {
+            task_stack_base[i] = NULL;
+            created_task_mask &= ~(1UL << i);
+            return 0;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    if(!startTask(i)) {
+        created_task_mask &= ~(1UL << i);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*!****************************************************************************
+ * @brief create every enabled task of the task table on its core
+ * Stacks come from task_stacks, so no task is allocated on the heap. Set DEBUG_TO_TERMINAL
+ * and LOG_TO_MEMORY in defs.h to enable the optional tasks
+ *
+ *******************************************************************************/
+void createTasks() {
+    char message[80];
+
+    arena_init(&task_stack_arena, task_stacks, sizeof(task_stacks));
+
+    for(uint8_t i = 0; i < NUM_FLIGHT_TASKS; i++) {
+        const task_spec_t* t = &flight_tasks[i];
+
+        if(!task_entries[i].enabled) {
+            continue;
+        }
+
+        task_stack_base[i] = (StackType_t*) arena_alloc(&task_stack_arena, t->stack_depth);
+
+        if(startTask(i)) {
+            created_task_mask |= 1UL << i;
+            snprintf(message, sizeof(message), "[+]%s task created OK on core %d.\r\n", t->name, t->core);
+        } else {
+            snprintf(message, sizeof(message), "[-]%s task creation failed\r\n", t->name);
+        }
+
+        debug(message);
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, message);
+    }
 }
 
-/*!
- * @brief Try reconnecting to MQTT if connection is lost
+/*!****************************************************************************
+ * @brief log the response time analysis of the created tasks
+ * A task whose worst case response time exceeds its deadline is reported, the flight
+ * software still starts
  *
+ *******************************************************************************/
+void taskScheduleReport() {
+    task_result_t results[NUM_FLIGHT_TASKS];
+    char line[100];
+
+    uint8_t schedulable = task_analyze(flight_tasks, NUM_FLIGHT_TASKS, created_task_mask, results);
+
+    for(uint8_t i = 0; i < NUM_FLIGHT_TASKS; i++) {
+        const task_spec_t* t = &flight_tasks[i];
+
+        if(!(created_task_mask & (1UL << i))) {
+            continue;
+        }
+
+        snprintf(line, sizeof(line), "[%c]%s core %d prio %d T %lu ms C %lu us R %lu us D %lu ms\r\n",
+                 results[i].schedulable ? '+' : '-', t->name, t->core, t->priority, (unsigned long) t->period_ms,
+                 (unsigned long) t->wcet_us, (unsigned long) results[i].response_us, (unsigned long) t->deadline_ms);
+        debug(line);
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+    }
+
+    for(uint8_t core = 0; core < NUM_TASK_CORES; core++) {
+        snprintf(line, sizeof(line), "[+]core %d utilization %.3f, rate monotonic bound %.3f\r\n", core,
+                 task_core_utilization(flight_tasks, NUM_FLIGHT_TASKS, created_task_mask, core),
+                 task_rm_bound(task_core_count(flight_tasks, NUM_FLIGHT_TASKS, created_task_mask, core)));
+        debug(line);
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+    }
+
+    if(schedulable) {
+        debugln("[+]Task schedule OK, all deadlines met");
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]Task schedule OK, all deadlines met\r\n");
+    } else {
+        debugln("[-]Task schedule can miss deadlines");
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]Task schedule can miss deadlines\r\n");
+    }
+}
+
+/**
+ * Stack and heap watermarks of the flight tasks, see resource_monitor.h
+ */
+resource_monitor_t resource_monitor;
+
+/**
+ * Heap growth check from arming to landing, see heap_guard.h
  */
-void MQTT_Reconnect() {
-     if(!client.connected()){
-         debug("[..]Attempting MQTT connection..."); // TODO: SYS LOGGER
-         String client_id = "[+]Flight-computer-1 client: ";
-         client_id += String(random(0XFFFF), HEX);
+heap_guard_t heap_guard;
 
-         if(client.connect(client_id.c_str())){
-             debugln("[+]MQTT reconnected");
-         }
+/*!****************************************************************************
+ * @brief sample the stack high water mark of every created task and the heap statistics
+ *
+ *******************************************************************************/
+void sampleResources() {
+    for(uint8_t i = 0; i < NUM_FLIGHT_TASKS; i++) {
+        // the handle is NULL while the health monitor restarts the task
+        TaskHandle_t task = *task_entries[i].handle;
+        if((created_task_mask & (1UL << i)) && task != NULL) {
+            monitor_sample_stack(&resource_monitor, i, uxTaskGetStackHighWaterMark(task));
+        }
     }
+
+    monitor_sample_heap(&resource_monitor, ESP.getFreeHeap(), ESP.getMinFreeHeap(), ESP.getMaxAllocHeap());
 }
 
+/*!****************************************************************************
+ * @brief compare the heap against the reference taken when the pyros armed
+ * The guard arms once the flight leaves the pad and disarms in recovery mode, where WiFi
+ * is reconfigured and allocations are expected
+ *
+ *******************************************************************************/
+void checkHeapGuard() {
+    multi_heap_info_t info;
+    char line[100];
+
+    if(recovery_mode) {
+        heap_guard_disarm(&heap_guard);
+        return;
+    }
+
+    heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+
+    if(!heap_guard.armed) {
+        if(current_state != ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND) {
+            heap_guard_arm(&heap_guard, info.allocated_blocks, info.total_free_bytes);
+        }
+        return;
+    }
+
+    if(heap_guard_check(&heap_guard, info.allocated_blocks, info.total_free_bytes) == HEAP_GUARD_GROWTH) {
+        snprintf(line, sizeof(line), "[-]Heap grew after arming, %lu blocks allocated, %lu at arming\r\n",
+                 (unsigned long) info.allocated_blocks, (unsigned long) heap_guard.arm_blocks);
+        debug(line);
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+    }
+}
 
 /*!****************************************************************************
- * @brief Initialize MQTT
+ * @brief log the tick interval jitter, missed ticks and wake latency of a sensor task
  *
  *******************************************************************************/
-void MQTTInit(const char* broker_IP, int broker_port) {
-    // client.setBufferSize(MQTT_BUFFER_SIZE);
-    debugln("[+]Initializing MQTT\n");
-    client.setServer(broker_IP, broker_port);
-    delay(2000);
+void logSampleClock(const char* name, const sample_clock_t* clock) {
+    char line[100];
+
+    if(clock->intervals == 0) {
+        return;
+    }
+
+    snprintf(line, sizeof(line), "[%c]%s jitter mean %lu min %ld max %ld us, %lu missed, latency max %lu us\r\n",
+             clock->missed > 0 ? '-' : '+', name, (unsigned long) sample_clock_mean_jitter(clock),
+             (long) clock->min_jitter_us, (long) clock->max_jitter_us, (unsigned long) clock->missed,
+             (unsigned long) clock->max_latency_us);
+    SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
 }
 
 /*!****************************************************************************
- * @brief fires the pyro-charge to deploy the drogue chute
- * Turn on the drogue chute ejection circuit by running the GPIO 
- * HIGH for a preset No. of seconds.  
- * Default no. of seconds to remain HIGH is 5 
- * 
+ * @brief log the fused record count and the samples the fusion stage could not use
+ * Rejected samples repeat the previous one of their sensor, stale counts the records a
+ * sensor was left out of because its last sample was too old
+ *
  *******************************************************************************/
-void drogueChuteDeploy() {
+void logFusionStats() {
+    const fusion_stream_t* s = sensor_fusion.streams;
+    char line[160];
+
+    snprintf(line, sizeof(line), "[%c]Fusion records %lu skipped %lu, rejected/stale accel %lu/%lu altimeter %lu/%lu gps %lu/%lu\r\n",
+             sensor_fusion.skipped > 0 ? '-' : '+', (unsigned long) sensor_fusion.records, (unsigned long) sensor_fusion.skipped,
+             (unsigned long) s[FUSION_ACCEL].rejected, (unsigned long) s[FUSION_ACCEL].stale,
+             (unsigned long) s[FUSION_ALTIMETER].rejected, (unsigned long) s[FUSION_ALTIMETER].stale,
+             (unsigned long) s[FUSION_GPS].rejected, (unsigned long) s[FUSION_GPS].stale);
+    SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+}
 
-    // // check for drogue chute deploy conditions 
+/*!****************************************************************************
+ * @brief log the I2C transactions, their failures and the longest wait for the bus
+ *
+ *******************************************************************************/
+void logI2CBus() {
+    char line[160];
+
+    snprintf(line, sizeof(line), "[%c]I2C transactions %lu failed %lu rejected %lu retries %lu recoveries %lu, busy %lu us, wait max imu %lu baro %lu us\r\n",
+             i2c_bus.failed > 0 ? '-' : '+', (unsigned long) i2c_bus.completed, (unsigned long) i2c_bus.failed,
+             (unsigned long) i2c_bus.rejected, (unsigned long) i2c_bus.retries, (unsigned long) i2c_bus.recoveries,
+             (unsigned long) i2c_bus.busy_us, (unsigned long) i2c_bus.max_wait_us[I2C_PRIORITY_HIGH],
+             (unsigned long) i2c_bus.max_wait_us[I2C_PRIORITY_LOW]);
+    SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+}
 
-    // //if the drogue deploy pin is HIGH, there is an error
-    // if(digitalRead(DROGUE_PIN)) {
-    //     // error
-    // } else {
-    //     // pulse the drogue pin for a number ofseceonds - determined from pop tests
-    //     digitalWrite(DROGUE_PIN, HIGH);
-    //     delay(PYRO_CHARGE_TIME); // TODO- Make this delay non-blocking
+/*!****************************************************************************
+ * @brief log the heap statistics and every task running short of stack
+ *
+ *******************************************************************************/
+void logResources() {
+    stack_report_t report;
+    char line[100];
+
+    logSampleClock(flight_tasks[TASK_READ_ACCELERATION].name, &accel_clock);
+    logSampleClock(flight_tasks[TASK_READ_ALTIMETER].name, &altimeter_clock);
+    logFusionStats();
+    logI2CBus();
+
+    snprintf(line, sizeof(line), "[+]Heap free %lu min %lu largest block %lu min %lu\r\n",
+             (unsigned long) resource_monitor.free_heap, (unsigned long) resource_monitor.min_free_heap,
+             (unsigned long) resource_monitor.largest_free_block, (unsigned long) resource_monitor.min_largest_free_block);
+    SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+
+    if(heap_guard.armed) {
+        snprintf(line, sizeof(line), "[%c]Heap guard blocks at arming %lu peak %lu, %lu samples over\r\n",
+                 heap_guard.violations > 0 ? '-' : '+', (unsigned long) heap_guard.arm_blocks,
+                 (unsigned long) heap_guard.peak_blocks, (unsigned long) heap_guard.violations);
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+    }
 
-    //     // update the drogue deployed telemetry variable
-    //     DROGUE_DEPLOY_FLAG = 1;
-    //     debugln("DROGUE CHUTE DEPLOYED");
-    // }
+    for(uint8_t i = 0; i < NUM_FLIGHT_TASKS; i++) {
+        if(monitor_stack_report(&resource_monitor, i, &report) && report.low) {
+            snprintf(line, sizeof(line), "[-]%s stack low, peak %lu of %lu bytes\r\n", flight_tasks[i].name,
+                     (unsigned long) report.used_bytes, (unsigned long) report.stack_bytes);
+            debug(line);
+            SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+        }
+    }
+}
 
+/*!****************************************************************************
+ * @brief log the peak stack use and recommended stack size of every task
+ * Written once after landing, when every flight path has run. Copy the recommended
+ * sizes into flight_tasks in task_schedule.cpp
+ *
+ *******************************************************************************/
+void logStackSizingReport() {
+    stack_report_t report;
+    char line[100];
+
+    for(uint8_t i = 0; i < NUM_FLIGHT_TASKS; i++) {
+        if(!monitor_stack_report(&resource_monitor, i, &report)) {
+            continue;
+        }
+
+        snprintf(line, sizeof(line), "[+]Stack %s size %lu peak %lu recommended %lu (%+ld)\r\n", flight_tasks[i].name,
+                 (unsigned long) report.stack_bytes, (unsigned long) report.used_bytes,
+                 (unsigned long) report.recommended_bytes, (long) report.change_bytes);
+        debug(line);
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+    }
+
+    snprintf(line, sizeof(line), "[+]Stack sizing total change %+ld bytes\r\n", (long) monitor_total_change(&resource_monitor, created_task_mask));
+    debug(line);
+    SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
 }
 
 /*!****************************************************************************
- * @brief fires the pyro-charge to deploy the main chute
- * Turn on the main chute ejection circuit by running the GPIO
- * HIGH for a preset No. of seconds
- * Default no. of seconds to remain HIGH is 5
- * 
+ * @brief samples the stack and heap watermarks
+ * Logs the heap every RESOURCE_LOG_INTERVAL ms, the apogee votes once apogee is declared
+ * and the stack sizing report once recovery mode is entered
+ *
  *******************************************************************************/
-void mainChuteDeploy() {
-    // // check for drogue chute deploy conditions 
+void resourceMonitorTask(void* pvParameters) {
+    TickType_t last_wake_time = xTaskGetTickCount();
+    unsigned long last_log_time = millis();
+    uint8_t sizing_reported = 0;
+
+    while(1) {
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(flight_tasks[TASK_RESOURCE_MONITOR].period_ms));
+
+        sampleResources();
+        checkHeapGuard();
+
+        if(millis() - last_log_time >= RESOURCE_LOG_INTERVAL) {
+            last_log_time = millis();
+            logResources();
+        }
+
+        if(recovery_mode && !sizing_reported) {
+            sizing_reported = 1;
+            logStackSizingReport();
+        }
+
+        if(__atomic_exchange_n(&apogee_votes_pending, 0, __ATOMIC_ACQUIRE)) {
+            logApogeeVotes();
+        }
+    }
+}
+
+/**
+ * Tasks watched by the health monitor, the sensor tasks check in with every good sample.
+ * The sensors on the I2C bus get a bus reset as the first recovery attempt, a restart of
+ * the task next
+ */
+typedef struct {
+    uint8_t task;               /*!< FLIGHT_TASK */
+    uint8_t on_i2c;             /*!< 1 if the task talks to the I2C bus */
+    uint8_t data_flag;          /*!< *_DATA_FLAG of the sensor, set in failed_sensors on failover */
+    const char* failover;       /*!< what takes over, for the log */
+} watched_task_t;
+
+const watched_task_t watched_tasks[] = {
+    { TASK_READ_ACCELERATION,   1, ACCEL_DATA_FLAG,     "launch detection from the barometer alone" },
+    { TASK_READ_ALTIMETER,      1, ALTIMETER_DATA_FLAG, "altitude from the GPS" },
+    { TASK_READ_GPS,            0, GPS_DATA_FLAG,       "no position" }
+};
+
+/*!****************************************************************************
+ * @brief watch the sensor tasks, once the sample timer runs so the first samples count
+ * A task is stalled when a check-in is more than one period, its check-in jitter and
+ * HEALTH_JITTER_MARGIN late. The jitter is the worst case response time of the task less
+ * the time it always sleeps on hardware. After the watch starts or a recovery attempt the
+ * first check-in may take a period and the whole response time. A task the analysis cannot
+ * bound gets a period for its response time
+ *
+ *******************************************************************************/
+void healthMonitorInit() {
+    task_result_t results[NUM_FLIGHT_TASKS];
+
+    task_analyze(flight_tasks, NUM_FLIGHT_TASKS, created_task_mask, results);
+
+    for(uint8_t i = 0; i < sizeof(watched_tasks) / sizeof(watched_tasks[0]); i++) {
+        uint8_t task = watched_tasks[i].task;
+        const task_spec_t* t = &flight_tasks[task];
+
+        if(created_task_mask & (1UL << task)) {
+            uint32_t response_ms = t->period_ms + t->suspend_us / 1000;
+            if(results[task].schedulable) {
+                response_ms = (results[task].response_us + 999) / 1000;
+            }
+            uint32_t jitter_ms = response_ms - t->suspend_us / 1000;
+
+            health_watch(&health_monitor, task, t->period_ms + jitter_ms + HEALTH_JITTER_MARGIN,
+                         t->period_ms + response_ms + HEALTH_JITTER_MARGIN, HEALTH_MAX_RECOVERIES, millis());
+        }
+    }
+}
+
+/*!****************************************************************************
+ * @brief take the action the health monitor asks for on a watched task and log it
+ *
+ *******************************************************************************/
+void handleHealthAction(const watched_task_t* w, uint8_t action) {
+    const health_entry_t* e = &health_monitor.tasks[w->task];
+    const char* name = flight_tasks[w->task].name;
+    char line[120];
+
+    switch (action) {
+        case HEALTH_RECOVER:
+            if(w->on_i2c && e->recoveries == 1) {
+                // the bus manager is the only task on the bus, it resets it before its next transfer
+                i2c_bus_request_recovery(&i2c_bus);
+                if(i2cBusTaskHandle != NULL) {
+                    xTaskNotifyGive(i2cBusTaskHandle);
+                }
+                snprintf(line, sizeof(line), "[-]%s stalled, I2C bus reset\r\n", name);
+            } else if(restartTask(w->task)) {
+                snprintf(line, sizeof(line), "[-]%s stalled, task restart OK\r\n", name);
+            } else {
+                // the task cannot run again, fail over now rather than after another timeout
+                failed_sensors |= w->data_flag;
+                snprintf(line, sizeof(line), "[-]%s stalled, task restart failed, %s\r\n", name, w->failover);
+            }
+            break;
+
+        case HEALTH_FAILOVER:
+            failed_sensors |= w->data_flag;
+            snprintf(line, sizeof(line), "[-]%s failed after %d recoveries, %s\r\n", name, e->recoveries, w->failover);
+            break;
 
-    // //if the drogue deploy pin is HIGH, there is an error
-    // if(digitalRead(MAIN_CHUTE_EJECT_PIN)) { // NOT NECESSARY - TEST WITHOUT
-    //     // error 
-    // } else {
-    //     // pulse the drogue pin for a number of seconds - determined from pop tests
-    //     digitalWrite(MAIN_CHUTE_EJECT_PIN, HIGH);
-    //     delay(MAIN_DESCENT_PYRO_CHARGE_TIME); // TODO- Make this delay non-blocking
+        case HEALTH_RESTORED:
+            failed_sensors &= ~w->data_flag;
+            snprintf(line, sizeof(line), "[+]%s restored after %lu ms\r\n", name, (unsigned long) e->longest_stall_ms);
+            break;
+
+        default:
+            return;
+    }
 
-    //     // update the drogue deployed telemetry variable
-    //     MAIN_CHUTE_EJECT_FLAG = 1;
-    //     debugln("MAIN CHUTE DEPLOYED");
-    // }
+    debug(line);
+    SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, line);
+}
+
+/*!****************************************************************************
+ * @brief checks the sensor tasks for stalls every period and recovers them
+ * Runs on the network core, so a task spinning on the acquisition core does not keep it
+ * from running. The task watchdog in turn resets the chip if the monitor itself hangs
+ *
+ *******************************************************************************/
+void healthMonitorTask(void* pvParameters) {
+    TickType_t last_wake_time = xTaskGetTickCount();
+
+    if(esp_task_wdt_add(NULL) != ESP_OK) {
+        debugln("[-]Health monitor not on the task watchdog");
+    }
+
+    while(1) {
+        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(flight_tasks[TASK_HEALTH_MONITOR].period_ms));
+        esp_task_wdt_reset();
+
+        // the sensor tasks are stopped on purpose in recovery mode
+        if(recovery_mode) {
+            continue;
+        }
+
+        for(uint8_t i = 0; i < sizeof(watched_tasks) / sizeof(watched_tasks[0]); i++) {
+            handleHealthAction(&watched_tasks[i], health_check(&health_monitor, watched_tasks[i].task, millis()));
+        }
+    }
 }
 
 /*!****************************************************************************
@@ -960,6 +2453,10 @@ void mainChuteDeploy() {
  * 
  *******************************************************************************/
 void setup() {
+    /* hold the pyro MOSFETs off before anything else */
+    drogue_pyro.begin();
+    main_pyro.begin();
+
     buzzerInit();
 
     /* buzz to indicate start of setup */
@@ -978,6 +2475,9 @@ void setup() {
     // SYSTEM LOG FILE
     SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::WRITE, "FC1", LOG_LEVEL::INFO, system_log_file, "Flight computer Event log\r\n");
 
+    // site and flight parameters, everything below reads them
+    loadFlightConfig();
+
     debugln();
     debugln(F("=============================================="));
     debugln(F("========= CREATING DYNAMIC WIFI ==========="));
@@ -993,6 +2493,8 @@ void setup() {
     debugln(F("=============================================="));
     SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "==Initializing peripherals==\r\n");
 
+    // the IMU and barometer init run on the bus before the i2cBus task takes it over
+    i2cBusInit();
     uint8_t bmp_init_state = BMPInit();
     uint8_t imu_init_state = imu.init();
     uint8_t gps_init_state = GPSInit();
@@ -1000,8 +2502,12 @@ void setup() {
     uint8_t flash_init_state = data_logger.loggerInit();
     
 
-    /* initialize mqtt */
-    MQTTInit(MQTT_SERVER, MQTT_PORT);
+    /* initialize the telemetry links - MQTT connects later from the telemetry task */
+    for(uint8_t i = 0; i < NUM_TELEMETRY_TRANSPORTS; i++) {
+        if(!telemetry_transports[i]->begin()) {
+            debug("[-]Telemetry link init failed: "); debugln(telemetry_transports[i]->name());
+        }
+    }
 
     /* update the sub-systems init state table */
     // check if BMP init OK
@@ -1035,8 +2541,13 @@ void setup() {
     }
 
 
-    /* initialize the ring buffer - used for apogee detection */
-    ring_buffer_init(&altitude_ring_buffer);
+    /* initialize the altitude and vertical velocity filters, the GPS one stands in for a failed barometer */
+    vkf_init(&vertical_kalman, flight_config.kalman_altitude_sigma, flight_config.kalman_accel_sigma, flight_config.kalman_innovation_gate);
+    altitude_source_init(&altitude_source, GPS_ALTITUDE_SIGMA, flight_config.kalman_accel_sigma, flight_config.kalman_innovation_gate);
+    ground_cal_init(&ground_calibration, flight_config.ground_calibration_ms);
+
+    /* start the flight state machine in PRE_FLIGHT_GROUND */
+    flightStateMachineInit();
 
     /* check whether we are in TEST or RUN mode */
     checkRunTestToggle();
@@ -1061,13 +2572,14 @@ void setup() {
     SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "==CREATING QUEUES==\r\n");
 
     /* Every producer task sends queue to a different queue to avoid data popping issue */
-    telemetry_data_queue_handle = xQueueCreate(TELEMETRY_DATA_QUEUE_LENGTH, sizeof(telemetry_type_t));
-    log_to_mem_queue_handle = xQueueCreate(TELEMETRY_DATA_QUEUE_LENGTH, sizeof(telemetry_type_t));
-    check_state_queue_handle = xQueueCreate(TELEMETRY_DATA_QUEUE_LENGTH, sizeof(telemetry_type_t));
-    debug_to_term_queue_handle = xQueueCreate(TELEMETRY_DATA_QUEUE_LENGTH, sizeof(telemetry_type_t));
-    kalman_filter_queue_handle = xQueueCreate(TELEMETRY_DATA_QUEUE_LENGTH, sizeof(telemetry_type_t));
-
-    if(telemetry_data_queue_handle == NULL) {
+    arena_init(&queue_arena, queue_storage, sizeof(queue_storage));
+    createDataQueue(&telemetry_data_queue, "telemetry");
+    createDataQueue(&log_to_mem_queue, "log");
+    createDataQueue(&check_state_queue, "state");
+    createDataQueue(&debug_to_term_queue, "debug");
+    createDataQueue(&fusion_queue, "fusion");
+
+    if(telemetry_data_queue.handle == NULL) {
         debugln("[-]telemetry_data_queue_handle creation failed");
         SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]telemetry_data_queue_handle creation failed\r\n");
     } else {
@@ -1075,7 +2587,7 @@ void setup() {
         SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]telemetry_data_queue_handle creation OK.\r\n");
     }
 
-    if(log_to_mem_queue_handle == NULL) {
+    if(log_to_mem_queue.handle == NULL) {
         debugln("[-]telemetry_data_queue_handle creation failed");
         SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]telemetry_data_queue_handle creation failed\r\n");
     } else {
@@ -1083,7 +2595,7 @@ void setup() {
         SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]telemetry_data_queue_handle creation OK.\r\n");
     }
 
-    if(check_state_queue_handle == NULL) {
+    if(check_state_queue.handle == NULL) {
         debugln("[-]check_state_queue_handle creation failed");
         SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]check_state_queue_handle creation failed\r\n");
     } else {
@@ -1091,7 +2603,7 @@ void setup() {
         SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]check_state_queue_handle creation OK.\r\n");
     }
 
-    if(debug_to_term_queue_handle == NULL) {
+    if(debug_to_term_queue.handle == NULL) {
         debugln("[-]debug_to_term_queue_handle creation failed");
         SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]debug_to_term_queue_handle creation failed\r\n");
     } else {
@@ -1099,12 +2611,12 @@ void setup() {
         SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]debug_to_term_queue_handle creation OK.\r\n");
     }
 
-    if(kalman_filter_queue_handle == NULL) {
-        debugln("[-]kalman_filter_queue_handle creation failed");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]kalman_filter_queue_handle creation failed\r\n");
+    if(fusion_queue.handle == NULL) {
+        debugln("[-]fusion_queue_handle creation failed");
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]fusion_queue_handle creation failed\r\n");
     } else {
-        debugln("[+]kalman_filter_queue_handle creation OK.");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]kalman_filter_queue_handle creation OK.\r\n");
+        debugln("[+]fusion_queue_handle creation OK.");
+        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]fusion_queue_handle creation OK.\r\n");
     }
 
     debugln();
@@ -1113,130 +2625,27 @@ void setup() {
     debugln(F("==============================================\n"));
     SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "==CREATING TASKS==\r\n");
 
-    /* Create tasks
-    * All tasks have a stack size of 1024 words - not bytes!
-    * ESP32 is 32 bit, therefore 32bits x 1024 = 4096 bytes
-    * So the stack size is 4096 bytes
-    * 
-    * TASK CREATION PARAMETERS
-    * function that executes this task
-    * Function name - for debugging 
-    * Stack depth in words 
-    * parameter to be passed to the task 
-    * Task priority 
-    * task handle that can be passed to other tasks to reference the task 
-    *
-    * /
-
-    /* TASK 1: READ ACCELERATION DATA */
-    BaseType_t gr = xTaskCreate(readAccelerationTask, "readGyroscope", STACK_SIZE*2, NULL, 2, &readAccelerationTaskHandle);
-    if(gr == pdPASS) {
-        debugln("[+]Read acceleration task created OK.");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]Read acceleration task created OK.\r\n");
-    } else {
-        debugln("[-]Read acceleration task creation failed");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]Read acceleration task creation failed\r\n");
-    }
-
-    /* TASK 2: READ ALTIMETER DATA */
-    BaseType_t ra = xTaskCreate(readAltimeterTask,"readAltimeter",STACK_SIZE*3,NULL,2, &readAltimeterTaskHandle);
-    if(ra == pdPASS) {
-        debugln("[+]readAltimeterTask created OK.");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]readAltimeterTask created OK.\r\n");
-    } else {
-        debugln("[-]Failed to create readAltimeterTask");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]Failed to create readAltimeterTask\r\n");
-    }
-
-    /* TASK 3: READ GPS DATA */
-    BaseType_t rg = xTaskCreate(readGPSTask, "readGPS", STACK_SIZE*2, NULL,2, &readGPSTaskHandle);
-    if(rg == pdPASS) {
-        debugln("[+]Read GPS task created OK.");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]Read GPS task created OK.\r\n");
-    } else {
-        debugln("[-]Failed to create GPS task");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]Failed to create GPS task\r\n");
-    }
-
-    /* TASK 5: CHECK FLIGHT STATE TASK */
-    BaseType_t cf = xTaskCreate(checkFlightState,"checkFlightState",STACK_SIZE*2,NULL,2, &checkFlightStateTaskHandle);
-
-    if(cf == pdPASS) {
-        debugln("[+]checkFlightState task created OK.");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]checkFlightState task created OK.\r\n");
-    } else {
-        debugln("[-]Failed to create checkFlightState task");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]Failed to create checkFlightState task\r\n");
-    }
-
-    /* TASK 6: FLIGHT STATE CALLBACK TASK */
-    BaseType_t fs = xTaskCreate(flightStateCallback, "flightStateCallback", STACK_SIZE*2, NULL, 2, &flightStateCallbackTaskHandle);
-
-    if(fs == pdPASS) {
-        debugln("[+]flightStateCallback task created OK.");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]flightStateCallback task created OK.\r\n");
-    } else {
-        debugln("[-]Failed to create flightStateCallback task");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]Failed to create flightStateCallback task\r\n");
-    }
-
-    /* TASK 8: TRANSMIT TELEMETRY DATA */
-    BaseType_t th = xTaskCreate(MQTT_TransmitTelemetry, "transmit_telemetry", STACK_SIZE*4, NULL, 2, &MQTT_TransmitTelemetryTaskHandle);
-
-    if(th == pdPASS){
-        debugln("[+]MQTT transmit task created OK");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]kalman_filter_queue_handle creation OK.\r\n");
-        
-    } else {
-        debugln("[-]MQTT transmit task failed to create");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]MQTT transmit task failed to create\r\n");
-    }
-
-    BaseType_t kf = xTaskCreate(kalmanFilterTask, "kalman filter", STACK_SIZE*2, NULL, 2, &kalmanFilterTaskHandle);
-
-    if(kf == pdPASS) {
-        debugln("[+]kalmanFilter task created OK.");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]kalman_filter_queue_handle creation OK.\r\n");
-    } else {
-        debugln("[-]kalmanFilter task failed to create");
-        SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]kalmanFilter task failed to create\r\n");
-    }
-
-    #if DEBUG_TO_TERMINAL   // set DEBUG_TO_TERMINAL to 0 to prevent serial debug data to serial monitor
-
-        /* TASK 7: DISPLAY DATA ON SERIAL MONITOR - FOR DEBUGGING */
-        BaseType_t dt = xTaskCreate(debugToTerminalTask,"debugToTerminalTask",STACK_SIZE*4, NULL,2,&debugToTerminalTaskHandle);
-    
-        if(dt == pdPASS) {
-            debugln("[+]debugToTerminal task created OK");
-            SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]debugToTerminal task created OK\r\n");
-        } else {
-            debugln("[-]debugToTerminal task not created");
-            SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]debugToTerminal task not created\r\n");
-        }
-    
-    #endif // DEBUG_TO_TERMINAL_TASK
-
-    #if LOG_TO_MEMORY   // set LOG_TO_MEMORY to 1 to allow logging to memory 
-        /* TASK 9: LOG DATA TO MEMORY */
-        if(xTaskCreate(
-                logToMemory,
-                "logToMemory",
-                STACK_SIZE,
-                NULL,
-                2,
-                &logToMemoryTaskHandle
-        ) != pdPASS){
-            debugln("[-]logToMemory task failed to create");
-            SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[-]logToMemory task failed to create\r\n");
-            vTaskSuspend(logToMemoryTaskHandle);
-
-        }else{
-            debugln("[+]logToMemory task created OK.");
-            SYSTEM_LOGGER.logToFile(SPIFFS, LOG_MODE::APPEND, "FC1", LOG_LEVEL::INFO, system_log_file, "[+]logToMemory task created OK.\r\n");
-
-        }
-    #endif // LOG_TO_MEMORY
+    /* Create tasks from the task table, see task_schedule.cpp
+    * ESP-IDF takes the stack depth in bytes, not words as vanilla FreeRTOS does
+    * Acquisition and estimation are pinned to ACQUISITION_CORE, telemetry and logging
+    * to NETWORK_CORE where the WiFi stack runs
+    */
+    #if TASK_PROFILING
+        taskProfilerInit();
+    #endif
+
+    #if LATENCY_TRACING
+        trace_init(&latency_trace);
+    #endif
+
+    sensorFusionInit();
+    health_init(&health_monitor);
+    monitor_init(&resource_monitor, flight_tasks);
+    heap_guard_init(&heap_guard, HEAP_GUARD_BLOCK_TOLERANCE);
+    createTasks();
+    sampleTimerInit();
+    healthMonitorInit();
+    taskScheduleReport();
 
     debugln();
     debugln(F("=============================================="));
@@ -1257,7 +2666,7 @@ void setup() {
  * @brief Main loop
  *******************************************************************************/
 void loop() {
-    /* enable MQTT transmit loop */
-    MQTT_Reconnect();
-    client.loop();
+    /* all work runs in the FreeRTOS tasks. The MQTT client is serviced by MQTT_TransmitTelemetry,
+     * so the loop task is not needed - delete it and free its stack */
+    vTaskDelete(NULL);
 } /* Enf of main loop*/
@@ -130,6 +130,45 @@ float MPU6050::readZAcceleration() {
     
 }
 
+/**
+ * divisor from raw counts to g of the configured full scale range
+*/
+float MPU6050::accelFactor() {
+    if(this->_accel_fs_range == 2) {
+        return ACCEL_FACTOR_2G;
+    } else if(this->_accel_fs_range == 4) {
+        return ACCEL_FACTOR_4G;
+    } else if(this->_accel_fs_range == 8) {
+        return ACCEL_FACTOR_8G;
+    }
+
+    return ACCEL_FACTOR_16G;
+}
+
+/**
+ * convert the ACCEL_BURST_LENGTH bytes read from ACCEL_XOUT_H
+ * sets the acceleration in g and m/s^2 and the pitch and roll angles in radians, the same
+ * as the read functions and getPitch() and getRoll() do with one transfer per axis
+*/
+void MPU6050::decodeAcceleration(const uint8_t* raw) {
+    float factor = this->accelFactor();
+
+    this->acc_x = raw[0] << 8 | raw[1];
+    this->acc_y = raw[2] << 8 | raw[3];
+    this->acc_z = raw[4] << 8 | raw[5];
+
+    this->acc_x_real = (float) this->acc_x / factor;
+    this->acc_y_real = (float) this->acc_y / factor;
+    this->acc_z_real = (float) this->acc_z / factor;
+
+    this->acc_x_ms = this->acc_x_real * ONE_G;
+    this->acc_y_ms = this->acc_y_real * ONE_G;
+    this->acc_z_ms = this->acc_z_real * ONE_G;
+
+    this->pitch_angle = asin(this->acc_x_ms/ONE_G);
+    this->roll_angle = atan2(this->acc_y_ms, this->acc_z_ms);
+}
+
 /**
  * compute the pitch angle
  * angle along the transverse axis 
@@ -46,6 +46,7 @@
 #define GYRO_ZOUT_L             0x48
 #define TEMP_OUT_H              0x41
 #define TEMP_OUT_L              0x42
+#define ACCEL_BURST_LENGTH      6          // ACCEL_XOUT_H to ACCEL_ZOUT_L in one read
 #define ONE_G                   9.80665
 #define TO_DEG_FACTOR           57.32
 
@@ -55,6 +56,8 @@ class MPU6050 {
         uint32_t _accel_fs_range;
         uint32_t _gyro_fs_range;
 
+        float accelFactor();
+
     public:
         // sensor data
         int16_t acc_x, acc_y, acc_z; // raw acceleration values
@@ -80,6 +83,7 @@ class MPU6050 {
         void filterImu();
         float getRoll();
         float getPitch();
+        void decodeAcceleration(const uint8_t* raw);
 
 };
 
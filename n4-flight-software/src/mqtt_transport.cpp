@@ -0,0 +1,156 @@
+/**
+ * @file mqtt_transport.cpp
+ * @brief implements the MQTT telemetry transport
+ */
+
+#include <WiFi.h>
+#include "mqtt_transport.h"
+
+/**
+ * @brief class constructor
+ * @param client MQTT client, used only through this transport
+ * @param net the network client of the MQTT client
+ * @param server broker address
+ * @param port broker port
+ * @param topic topic to publish telemetry to
+ */
+MQTTTransport::MQTTTransport(PubSubClient& client, WiFiClient& net, const char* server, uint16_t port, const char* topic) : _client(client), _net(net) {
+    this->_server = server;
+    this->_port = port;
+    this->_topic = topic;
+    this->_backoff = MQTT_RECONNECT_MIN_DELAY;
+    this->_next_attempt = 0;
+    this->_client_id[0] = '\0';
+
+    memset(&this->stats, 0, sizeof(this->stats));
+}
+
+/**
+ * @brief configure the client. The connection itself is made from poll()
+ */
+bool MQTTTransport::begin() {
+    debugln("[+]Initializing MQTT");
+
+    this->_client.setServer(this->_server, this->_port);
+    this->_client.setBufferSize(MQTT_BUFFER_SIZE);
+
+    // bound the time the MQTT CONNECT can wait for the broker's answer
+    this->_client.setSocketTimeout(MQTT_SOCKET_TIMEOUT);
+
+    // the client ID is built once from the chip MAC so no heap is used on reconnect
+    uint64_t mac = ESP.getEfuseMac();
+    snprintf(this->_client_id, sizeof(this->_client_id), "%s-%04x", MQTT_CLIENT_ID_PREFIX, (unsigned int) ((mac >> 32) & 0xFFFF));
+
+    return true;
+}
+
+/**
+ * @brief try to connect if the backoff delay has passed
+ * The TCP connection is opened first with a MQTT_CONNECT_TIMEOUT bound, PubSubClient then
+ * finds it connected and only sends the MQTT CONNECT. The delay doubles after every
+ * failure up to MQTT_RECONNECT_MAX_DELAY
+ */
+void MQTTTransport::reconnect(uint32_t now) {
+    if((int32_t) (now - this->_next_attempt) < 0) {
+        return;
+    }
+
+    if(WiFi.status() == WL_CONNECTED) {
+        uint32_t start = millis();
+
+        bool connected = this->_net.connect(this->_server, this->_port, MQTT_CONNECT_TIMEOUT) == 1 && this->_client.connect(this->_client_id);
+
+        uint32_t connect_time = millis() - start;
+        if(connect_time > this->stats.connect_time_max) {
+            this->stats.connect_time_max = connect_time;
+        }
+
+        if(connected) {
+            debugln("[+]MQTT connected");
+            this->stats.connects++;
+            this->_backoff = MQTT_RECONNECT_MIN_DELAY;
+            return;
+        }
+
+        // a socket left open by a refused MQTT CONNECT is closed before the next attempt
+        this->_net.stop();
+    }
+
+    this->stats.connect_failures++;
+    this->_next_attempt = now + this->_backoff;
+
+    this->_backoff *= 2;
+    if(this->_backoff > MQTT_RECONNECT_MAX_DELAY) {
+        this->_backoff = MQTT_RECONNECT_MAX_DELAY;
+    }
+}
+
+/**
+ * @brief publish queued messages, oldest first, until the queue is empty or a publish fails
+ */
+void MQTTTransport::drain() {
+    while(this->_outbound_count > 0) {
+        uint8_t slot = this->_outbound_head;
+
+        if(!this->_client.publish(this->_topic, this->_outbound[slot], this->_outbound_length[slot], false)) {
+            return;
+        }
+
+        this->stats.published++;
+        this->_outbound_head = (this->_outbound_head + 1) % MQTT_OUTBOUND_SLOTS;
+        this->_outbound_count--;
+    }
+}
+
+/**
+ * @brief keep the connection alive, reconnect when it drops and flush the queue
+ */
+void MQTTTransport::poll() {
+    if(!this->_client.connected()) {
+        this->reconnect(millis());
+        if(!this->_client.connected()) {
+            return;
+        }
+    }
+
+    this->_client.loop();
+    this->drain();
+}
+
+bool MQTTTransport::ready() {
+    return this->_client.connected() && this->_outbound_count < MQTT_OUTBOUND_SLOTS;
+}
+
+/**
+ * @brief queue the payload and publish it right away if connected
+ * When the queue is full the oldest message is dropped to make room
+ * @return TELEMETRY_SENT if the queue was published, TELEMETRY_QUEUED if the message waits
+ * for the broker, TELEMETRY_REFUSED if it is too large
+ */
+uint8_t MQTTTransport::send(const uint8_t* payload, size_t length) {
+    if(length > MQTT_OUTBOUND_SLOT_SIZE) {
+        return TELEMETRY_REFUSED;
+    }
+
+    if(this->_outbound_count == MQTT_OUTBOUND_SLOTS) {
+        // drop the oldest message
+        this->_outbound_head = (this->_outbound_head + 1) % MQTT_OUTBOUND_SLOTS;
+        this->_outbound_count--;
+        this->stats.dropped++;
+    }
+
+    uint8_t slot = (this->_outbound_head + this->_outbound_count) % MQTT_OUTBOUND_SLOTS;
+    memcpy(this->_outbound[slot], payload, length);
+    this->_outbound_length[slot] = length;
+    this->_outbound_count++;
+
+    if(this->_client.connected()) {
+        this->drain();
+    }
+
+    return this->_outbound_count == 0 ? TELEMETRY_SENT : TELEMETRY_QUEUED;
+}
+
+const char* MQTTTransport::name() {
+    return "MQTT";
+}
@@ -0,0 +1,69 @@
+/**
+ * @file mqtt_transport.h
+ * @brief Telemetry transport over MQTT using PubSubClient
+ *
+ * The transport owns the MQTT client. Only the telemetry task calls into it, so the client
+ * is never used from two tasks. Reconnection is attempted from poll() with exponential backoff
+ * and outgoing messages wait in a bounded queue that survives reconnects. When the queue is
+ * full the oldest message is dropped - fresh data is worth more to the ground station.
+ * The TCP connection is opened with a MQTT_CONNECT_TIMEOUT bound before the MQTT CONNECT,
+ * so an unreachable broker holds the telemetry task for that long and not for the seconds
+ * of the WiFiClient default
+ */
+
+#ifndef MQTT_TRANSPORT_H
+#define MQTT_TRANSPORT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include "telemetry_transport.h"
+#include "telemetry_batch.h"
+#include "defs.h"
+
+#define MQTT_OUTBOUND_SLOT_SIZE     TELEMETRY_BATCH_PAYLOAD_SIZE    /*!< largest message that can be queued */
+#define MQTT_CLIENT_ID_LENGTH       32
+
+/**
+ * Connection and delivery statistics of the MQTT link
+ */
+typedef struct {
+    uint32_t connects;              /*!< successful connections */
+    uint32_t connect_failures;      /*!< failed connection attempts */
+    uint32_t connect_time_max;      /*!< longest connection attempt in ms */
+    uint32_t published;             /*!< messages handed to the broker */
+    uint32_t dropped;               /*!< queued messages dropped because the queue was full */
+} mqtt_stats_t;
+
+class MQTTTransport : public TelemetryTransport {
+    private:
+        PubSubClient& _client;
+        WiFiClient& _net;
+        const char* _server;
+        uint16_t _port;
+        const char* _topic;
+        char _client_id[MQTT_CLIENT_ID_LENGTH];
+
+        uint32_t _backoff;              /*!< current delay between connection attempts in ms */
+        uint32_t _next_attempt;         /*!< time in ms of the next connection attempt */
+
+        uint8_t _outbound[MQTT_OUTBOUND_SLOTS][MQTT_OUTBOUND_SLOT_SIZE];
+        uint16_t _outbound_length[MQTT_OUTBOUND_SLOTS];
+        uint8_t _outbound_head = 0;     /*!< oldest queued message */
+        uint8_t _outbound_count = 0;
+
+        void reconnect(uint32_t now);
+        void drain();
+
+    public:
+        mqtt_stats_t stats;
+
+        MQTTTransport(PubSubClient& client, WiFiClient& net, const char* server, uint16_t port, const char* topic);
+        bool begin();
+        void poll();
+        bool ready();
+        uint8_t send(const uint8_t* payload, size_t length);
+        const char* name();
+};
+
+#endif
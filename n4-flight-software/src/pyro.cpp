@@ -0,0 +1,128 @@
+/**
+ * @file pyro.cpp
+ * @brief implements the pyro channel driver
+ */
+
+#include "pyro.h"
+
+/**
+ * @param name channel name for the logs
+ * @param fire_pin GPIO driving the channel MOSFET
+ * @param sense_pin GPIO reading the e-match continuity, PYRO_NO_SENSE_PIN if not wired
+ * @param pulse_ms time the fire pin stays HIGH
+ */
+PyroChannel::PyroChannel(const char* name, uint8_t fire_pin, int8_t sense_pin, uint32_t pulse_ms) {
+    _name = name;
+    _fire_pin = fire_pin;
+    _sense_pin = sense_pin;
+    _pulse_ms = pulse_ms;
+}
+
+/**
+ * @brief end of the pulse, runs in the esp_timer task
+ * A disarm() can make the channel safe while this callback is already dispatched,
+ * esp_timer_stop() does not wait for it, so the state only moves on from PYRO_FIRING
+ */
+void PyroChannel::pulseEnd(void* arg) {
+    PyroChannel* channel = (PyroChannel*) arg;
+    digitalWrite(channel->_fire_pin, LOW);
+
+    uint8_t firing = PYRO_FIRING;
+    __atomic_compare_exchange_n(&channel->_state, &firing, (uint8_t) PYRO_FIRED, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief drive the fire pin LOW and create the pulse timer. Call early in setup so the pin does not float
+ * @return true if the timer was created
+ */
+bool PyroChannel::begin() {
+    digitalWrite(_fire_pin, LOW);
+    pinMode(_fire_pin, OUTPUT);
+
+    if(_sense_pin != PYRO_NO_SENSE_PIN) {
+        pinMode(_sense_pin, INPUT);
+    }
+
+    esp_timer_create_args_t args = {};
+    args.callback = &PyroChannel::pulseEnd;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = _name;
+
+    return esp_timer_create(&args, &_timer) == ESP_OK;
+}
+
+/**
+ * @brief allow the channel to fire once
+ */
+void PyroChannel::arm() {
+    if(_state == PYRO_SAFE) {
+        _state = PYRO_ARMED;
+    }
+}
+
+/**
+ * @brief cut the pulse if one is running and make the channel safe, clears the latch
+ */
+void PyroChannel::disarm() {
+    if(_timer != NULL) {
+        esp_timer_stop(_timer);
+    }
+    digitalWrite(_fire_pin, LOW);
+    _latched = 0;
+    _state = PYRO_SAFE;
+}
+
+/**
+ * @brief start the pulse and return immediately
+ * @return PYRO_FIRE_OK if the pulse started, see PYRO_FIRE_RESULT otherwise
+ */
+uint8_t PyroChannel::fire() {
+    if(_latched) {
+        return PYRO_FIRE_ALREADY_FIRED;
+    }
+
+    if(_state != PYRO_ARMED) {
+        return PYRO_FIRE_NOT_ARMED;
+    }
+
+    if(_timer == NULL) {
+        return PYRO_FIRE_TIMER_ERROR;
+    }
+
+    _latched = 1;
+    _state = PYRO_FIRING;
+    _fire_time = millis();
+    _fire_count++;
+
+    digitalWrite(_fire_pin, HIGH);
+
+    if(esp_timer_start_once(_timer, (uint64_t) _pulse_ms * 1000) != ESP_OK) {
+        // never leave the MOSFET on without a timer to turn it off
+        digitalWrite(_fire_pin, LOW);
+        _state = PYRO_FIRED;
+        return PYRO_FIRE_TIMER_ERROR;
+    }
+
+    return PYRO_FIRE_OK;
+}
+
+/**
+ * @brief read the e-match continuity
+ * @return see PYRO_CONTINUITY
+ */
+uint8_t PyroChannel::continuity() {
+    if(_sense_pin == PYRO_NO_SENSE_PIN) {
+        return PYRO_CONTINUITY_UNKNOWN;
+    }
+
+    return digitalRead(_sense_pin) == HIGH ? PYRO_CONTINUITY_OK : PYRO_CONTINUITY_OPEN;
+}
+
+/**
+ * @brief channel state and continuity packed into 4 bits for telemetry
+ * @return state in bits 0-1, continuity in bits 2-3
+ */
+uint8_t PyroChannel::status() {
+    return (_state & 0x03) | ((continuity() & 0x03) << 2);
+}
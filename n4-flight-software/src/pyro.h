@@ -0,0 +1,67 @@
+/**
+ * @file pyro.h
+ * @brief Non-blocking pyro channel driver
+ *
+ * Each channel drives one e-match through a MOSFET. fire() latches the channel, raises
+ * the pin and starts a one-shot esp_timer that lowers it after the pulse time, so the
+ * caller returns in microseconds and the pulse length does not depend on task scheduling.
+ * A channel fires at most once per arming and only while armed
+ */
+
+#ifndef PYRO_H
+#define PYRO_H
+
+#include <Arduino.h>
+#include "esp_timer.h"
+
+#define PYRO_NO_SENSE_PIN   -1      /*!< the channel has no continuity sense input */
+
+typedef enum {
+    PYRO_SAFE = 0,          /*!< disarmed, fire() is refused */
+    PYRO_ARMED,             /*!< ready to fire */
+    PYRO_FIRING,            /*!< pulse in progress */
+    PYRO_FIRED              /*!< pulse finished, latched until disarmed */
+} PYRO_STATE;
+
+typedef enum {
+    PYRO_CONTINUITY_UNKNOWN = 0,    /*!< no sense pin on this channel */
+    PYRO_CONTINUITY_OPEN,           /*!< no e-match or a broken one */
+    PYRO_CONTINUITY_OK
+} PYRO_CONTINUITY;
+
+typedef enum {
+    PYRO_FIRE_OK = 0,
+    PYRO_FIRE_NOT_ARMED,
+    PYRO_FIRE_ALREADY_FIRED,
+    PYRO_FIRE_TIMER_ERROR
+} PYRO_FIRE_RESULT;
+
+class PyroChannel {
+    private:
+        const char* _name;
+        uint8_t _fire_pin;
+        int8_t _sense_pin;                  /*!< reads HIGH through an intact e-match, PYRO_NO_SENSE_PIN if not wired */
+        uint32_t _pulse_ms;                 /*!< time the fire pin stays HIGH */
+        esp_timer_handle_t _timer = NULL;
+        volatile uint8_t _state = PYRO_SAFE;
+        volatile uint8_t _latched = 0;      /*!< set on the first fire(), cleared only by disarm() */
+        uint32_t _fire_time = 0;            /*!< time in ms of the last fire() */
+        uint32_t _fire_count = 0;
+
+        static void pulseEnd(void* arg);
+
+    public:
+        PyroChannel(const char* name, uint8_t fire_pin, int8_t sense_pin, uint32_t pulse_ms);
+        bool begin();
+        void arm();
+        void disarm();
+        uint8_t fire();
+        uint8_t continuity();
+        uint8_t state() const { return _state; }
+        uint32_t fireTime() const { return _fire_time; }
+        uint32_t fireCount() const { return _fire_count; }
+        uint8_t status();
+        const char* name() const { return _name; }
+};
+
+#endif
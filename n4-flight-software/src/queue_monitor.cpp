@@ -0,0 +1,131 @@
+/**
+ * @file queue_monitor.cpp
+ * @brief implements the monitored queue wrapper
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "queue_monitor.h"
+
+/**
+ * @brief raise a counter to value if it is below, safe against concurrent senders
+ */
+static void atomic_max(uint32_t* counter, uint32_t value) {
+    uint32_t current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while(value > current) {
+        if(__atomic_compare_exchange_n(counter, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief create the underlying queue and clear the statistics
+ * @param name short name used in the log and telemetry, must stay valid
+ * @param storage length * item_size bytes that hold the queued items, must stay valid
+ * @return 1 if the queue was created
+ */
+uint8_t queue_create(monitored_queue_t* q, const char* name, uint32_t length, uint32_t item_size, uint8_t* storage) {
+    memset(q, 0, sizeof(monitored_queue_t));
+    q->name = name;
+    q->length = length;
+
+    if(storage == NULL) {
+        return 0;
+    }
+
+    q->handle = xQueueCreateStatic(length, item_size, storage, &q->control);
+
+    return q->handle != NULL;
+}
+
+/**
+ * @brief copy an item to the back of the queue
+ * Only a send with a timeout can block, so the clock is read only in that case
+ * @param timeout ticks to wait for space, 0 to drop the item at once if the queue is full
+ * @return 1 if the item was enqueued, 0 if it was dropped
+ */
+uint8_t queue_send(monitored_queue_t* q, const void* item, TickType_t timeout) {
+    int64_t start = timeout > 0 ? esp_timer_get_time() : 0;
+
+    BaseType_t sent = xQueueSend(q->handle, item, timeout);
+
+    if(timeout > 0) {
+        uint32_t waited = (uint32_t) (esp_timer_get_time() - start);
+        __atomic_fetch_add(&q->blocked_us, waited, __ATOMIC_RELAXED);
+        atomic_max(&q->max_blocked_us, waited);
+    }
+
+    if(sent != pdPASS) {
+        __atomic_fetch_add(&q->dropped, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    __atomic_fetch_add(&q->enqueued, 1, __ATOMIC_RELAXED);
+    atomic_max(&q->high_water, uxQueueMessagesWaiting(q->handle));
+
+    return 1;
+}
+
+/**
+ * @brief take an item off the front of the queue
+ * Time a consumer waits for data is not counted, consumers block on their queue by design
+ * @return 1 if an item was copied to item
+ */
+uint8_t queue_receive(monitored_queue_t* q, void* item, TickType_t timeout) {
+    if(xQueueReceive(q->handle, item, timeout) != pdPASS) {
+        return 0;
+    }
+
+    __atomic_fetch_add(&q->received, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+uint32_t queue_waiting(const monitored_queue_t* q) {
+    return uxQueueMessagesWaiting(q->handle);
+}
+
+/**
+ * @brief copy the statistics, each counter is read atomically
+ */
+void queue_snapshot(const monitored_queue_t* q, monitored_queue_t* snapshot) {
+    memset(snapshot, 0, sizeof(monitored_queue_t));
+    snapshot->handle = q->handle;
+    snapshot->name = q->name;
+    snapshot->length = q->length;
+    snapshot->enqueued = __atomic_load_n(&q->enqueued, __ATOMIC_RELAXED);
+    snapshot->dropped = __atomic_load_n(&q->dropped, __ATOMIC_RELAXED);
+    snapshot->received = __atomic_load_n(&q->received, __ATOMIC_RELAXED);
+    snapshot->high_water = __atomic_load_n(&q->high_water, __ATOMIC_RELAXED);
+    snapshot->blocked_us = __atomic_load_n(&q->blocked_us, __ATOMIC_RELAXED);
+    snapshot->max_blocked_us = __atomic_load_n(&q->max_blocked_us, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief format the statistics record of one queue, see queue_monitor.h
+ * @param buffer output buffer, QUEUE_RECORD_LENGTH is always enough
+ * @param now current time in ms
+ * @return length of the record excluding the terminating NUL, 0 if it does not fit
+ */
+size_t queue_format(const monitored_queue_t* q, char* buffer, size_t size, uint32_t now) {
+    monitored_queue_t s;
+
+    if(buffer == NULL || size == 0) {
+        return 0;
+    }
+
+    queue_snapshot(q, &s);
+
+    int length = snprintf(buffer, size, "Q,%lu,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n", (unsigned long) now, s.name,
+                          (unsigned long) s.enqueued, (unsigned long) s.dropped, (unsigned long) s.received,
+                          (unsigned long) s.high_water, (unsigned long) s.length, (unsigned long) s.blocked_us,
+                          (unsigned long) s.max_blocked_us);
+
+    if(length < 0 || (size_t) length >= size) {
+        buffer[0] = '\0';
+        return 0;
+    }
+
+    return length;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file queue_monitor.h
+ * @brief FreeRTOS queues with enqueue, drop and blocking accounting
+ *
+ * Wraps a QueueHandle_t and counts what goes through it: items enqueued, items dropped
+ * because the queue stayed full for the whole timeout, items received, the highest fill
+ * level seen and the time senders spent blocked waiting for space. Producers send with
+ * a timeout of 0, so a slow consumer costs samples that show up as drops instead of
+ * stalling the sensor task.
+ *
+ * Queues are created statically, the caller provides the item storage and the control
+ * block lives in monitored_queue_t, so creating a queue does not touch the heap.
+ *
+ * Counters are updated with atomics, several producers on either core may send to the
+ * same queue. Only the FreeRTOS queue API and esp_timer are used, so the module also
+ * builds against the host shim in test/queue-stress.
+ *
+ * Telemetry record written by queue_format():
+ * Q,<time ms>,<name>,<enqueued>,<dropped>,<received>,<high water>,<length>,<blocked us>,<max blocked us>
+ */
+
+#ifndef QUEUE_MONITOR_H
+#define QUEUE_MONITOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#define QUEUE_RECORD_LENGTH     112     /*!< longest record queue_format() writes */
+
+typedef struct {
+    QueueHandle_t handle;
+    StaticQueue_t control;              /*!< FreeRTOS queue control block */
+    const char* name;                   /*!< short name used in the log and telemetry */
+    uint32_t length;                    /*!< capacity in items */
+    uint32_t enqueued;
+    uint32_t dropped;                   /*!< sends that timed out on a full queue */
+    uint32_t received;
+    uint32_t high_water;                /*!< most items waiting at once */
+    uint32_t blocked_us;                /*!< total time senders waited for space */
+    uint32_t max_blocked_us;            /*!< longest single wait for space */
+} monitored_queue_t;
+
+uint8_t queue_create(monitored_queue_t* q, const char* name, uint32_t length, uint32_t item_size, uint8_t* storage);
+uint8_t queue_send(monitored_queue_t* q, const void* item, TickType_t timeout);
+uint8_t queue_receive(monitored_queue_t* q, void* item, TickType_t timeout);
+uint32_t queue_waiting(const monitored_queue_t* q);
+void queue_snapshot(const monitored_queue_t* q, monitored_queue_t* snapshot);
+size_t queue_format(const monitored_queue_t* q, char* buffer, size_t size, uint32_t now);
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * @file resource_monitor.cpp
+ * @brief implements the stack and heap watermark bookkeeping
+ */
+
+#include <string.h>
+#include "resource_monitor.h"
+
+/**
+ * @brief clear all samples
+ * @param tasks task table the stacks were created from, indexed by FLIGHT_TASK
+ */
+void monitor_init(resource_monitor_t* m, const task_spec_t* tasks) {
+    memset(m, 0, sizeof(resource_monitor_t));
+
+    for(uint8_t i = 0; i < NUM_FLIGHT_TASKS; i++) {
+        m->stacks[i].stack_bytes = tasks[i].stack_depth;
+        m->stacks[i].min_free_bytes = UINT32_MAX;
+    }
+
+    m->min_free_heap = UINT32_MAX;
+    m->min_largest_free_block = UINT32_MAX;
+}
+
+/**
+ * @param free_bytes uxTaskGetStackHighWaterMark() of the task, bytes on ESP-IDF
+ */
+void monitor_sample_stack(resource_monitor_t* m, uint8_t task, uint32_t free_bytes) {
+    if(task >= NUM_FLIGHT_TASKS) {
+        return;
+    }
+
+    stack_usage_t* s = &m->stacks[task];
+    if(free_bytes < s->min_free_bytes) {
+        s->min_free_bytes = free_bytes;
+    }
+    s->samples++;
+}
+
+/**
+ * @param min_free_heap the allocator's own minimum since boot, it also sees dips between samples
+ */
+void monitor_sample_heap(resource_monitor_t* m, uint32_t free_heap, uint32_t min_free_heap, uint32_t largest_free_block) {
+    m->free_heap = free_heap;
+    m->largest_free_block = largest_free_block;
+
+    if(min_free_heap < m->min_free_heap) {
+        m->min_free_heap = min_free_heap;
+    }
+    if(free_heap < m->min_free_heap) {
+        m->min_free_heap = free_heap;
+    }
+    if(largest_free_block < m->min_largest_free_block) {
+        m->min_largest_free_block = largest_free_block;
+    }
+
+    m->heap_samples++;
+}
+
+/**
+ * @brief stack size for a task given its allocated size and lowest free stack
+ * peak use plus STACK_MARGIN_PERCENT plus STACK_MARGIN_BYTES, rounded up to STACK_ROUNDING
+ * and at least STACK_MIN_BYTES
+ */
+uint32_t monitor_recommend_stack(uint32_t stack_bytes, uint32_t min_free_bytes) {
+    uint32_t used = min_free_bytes < stack_bytes ? stack_bytes - min_free_bytes : 0;
+    uint32_t size = used + used * STACK_MARGIN_PERCENT / 100 + STACK_MARGIN_BYTES;
+
+    size = (size + STACK_ROUNDING - 1) / STACK_ROUNDING * STACK_ROUNDING;
+
+    return size > STACK_MIN_BYTES ? size : STACK_MIN_BYTES;
+}
+
+/**
+ * @brief peak use and recommended size of one task stack
+ * @return 0 if the task was never sampled, report is left untouched
+ */
+uint8_t monitor_stack_report(const resource_monitor_t* m, uint8_t task, stack_report_t* report) {
+    if(task >= NUM_FLIGHT_TASKS || m->stacks[task].samples == 0) {
+        return 0;
+    }
+
+    const stack_usage_t* s = &m->stacks[task];
+
+    report->stack_bytes = s->stack_bytes;
+    report->used_bytes = s->min_free_bytes < s->stack_bytes ? s->stack_bytes - s->min_free_bytes : 0;
+    report->recommended_bytes = monitor_recommend_stack(s->stack_bytes, s->min_free_bytes);
+    report->change_bytes = (int32_t) report->recommended_bytes - (int32_t) s->stack_bytes;
+    report->low = s->min_free_bytes < STACK_LOW_WATER_BYTES;
+
+    return 1;
+}
+
+/**
+ * @brief RAM change if every sampled task in mask took its recommended size
+ * @return bytes, negative if stacks can shrink overall
+ */
+int32_t monitor_total_change(const resource_monitor_t* m, uint32_t mask) {
+    stack_report_t report;
+    int32_t total = 0;
+
+    for(uint8_t i = 0; i < NUM_FLIGHT_TASKS; i++) {
+        if((mask & (1UL << i)) && monitor_stack_report(m, i, &report)) {
+            total += report.change_bytes;
+        }
+    }
+
+    return total;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file resource_monitor.h
+ * @brief Stack and heap watermarks and stack size recommendations
+ *
+ * The monitor task samples the stack high water mark of every flight task and the heap
+ * statistics once per RESOURCE_MONITOR_INTERVAL. The lowest free stack seen gives the
+ * peak use of each task. monitor_recommend_stack() adds a margin to the peak use and
+ * rounds it up, so after a flight the sizing report says which entries of flight_tasks
+ * (task_schedule.cpp) can shrink and how much RAM that frees for log buffers.
+ *
+ * A task only reaches its peak stack use on the paths it actually ran, so sizes should be
+ * taken from a report written after a full flight, not from one on the pad
+ */
+
+#ifndef RESOURCE_MONITOR_H
+#define RESOURCE_MONITOR_H
+
+#include <stdint.h>
+#include "task_schedule.h"
+
+#define STACK_MARGIN_PERCENT    25      /*!< headroom on top of the peak stack use */
+#define STACK_MARGIN_BYTES      512     /*!< fixed headroom for paths not seen, e.g. error logging */
+#define STACK_ROUNDING          256     /*!< recommended sizes are multiples of this */
+#define STACK_MIN_BYTES         1024    /*!< never recommend less */
+#define STACK_LOW_WATER_BYTES   256     /*!< free stack below this is reported as a warning */
+
+typedef struct {
+    uint32_t stack_bytes;               /*!< allocated stack */
+    uint32_t min_free_bytes;            /*!< lowest high water mark seen, UINT32_MAX until sampled */
+    uint32_t samples;
+} stack_usage_t;
+
+typedef struct {
+    stack_usage_t stacks[NUM_FLIGHT_TASKS];
+    uint32_t free_heap;                 /*!< at the last sample */
+    uint32_t min_free_heap;             /*!< lowest free heap since boot */
+    uint32_t largest_free_block;        /*!< at the last sample */
+    uint32_t min_largest_free_block;    /*!< lowest largest free block seen, a fragmentation measure */
+    uint32_t heap_samples;
+} resource_monitor_t;
+
+typedef struct {
+    uint32_t stack_bytes;
+    uint32_t used_bytes;                /*!< peak use */
+    uint32_t recommended_bytes;
+    int32_t change_bytes;               /*!< recommended - allocated, negative frees RAM */
+    uint8_t low;                        /*!< free stack fell below STACK_LOW_WATER_BYTES */
+} stack_report_t;
+
+void monitor_init(resource_monitor_t* m, const task_spec_t* tasks);
+void monitor_sample_stack(resource_monitor_t* m, uint8_t task, uint32_t free_bytes);
+void monitor_sample_heap(resource_monitor_t* m, uint32_t free_heap, uint32_t min_free_heap, uint32_t largest_free_block);
+uint32_t monitor_recommend_stack(uint32_t stack_bytes, uint32_t min_free_bytes);
+uint8_t monitor_stack_report(const resource_monitor_t* m, uint8_t task, stack_report_t* report);
+int32_t monitor_total_change(const resource_monitor_t* m, uint32_t mask);
+
+#endif
@@ -0,0 +1,71 @@
+/**
+ * @file sample_clock.cpp
+ * @brief implements the task side of the sample timer handoff
+ */
+
+#include <string.h>
+#include "sample_clock.h"
+
+static_assert((SAMPLE_CLOCK_SLOTS & (SAMPLE_CLOCK_SLOTS - 1)) == 0, "SAMPLE_CLOCK_SLOTS must be a power of two");
+
+void sample_clock_init(sample_clock_t* c, uint32_t period_us) {
+    memset(c, 0, sizeof(sample_clock_t));
+    c->period_us = period_us;
+    c->min_jitter_us = INT32_MAX;
+    c->max_jitter_us = INT32_MIN;
+}
+
+/**
+ * @brief take the latest tick, called by the sensor task once it was notified
+ * Ticks the task fell behind on are counted as missed, their samples are not taken
+ * @param now_us microsecond clock when the task runs, for the wake latency
+ * @param stamp_us set to the time of the tick, the sample time
+ * @return 1 if there was a new tick, 0 if the task woke without one
+ */
+uint8_t sample_clock_take(sample_clock_t* c, uint32_t now_us, uint32_t* stamp_us) {
+    uint32_t tick = __atomic_load_n(&c->ticks, __ATOMIC_ACQUIRE);
+
+    if(tick == c->taken) {
+        return 0;
+    }
+
+    uint32_t stamp = c->stamps[tick & (SAMPLE_CLOCK_SLOTS - 1)];
+    uint32_t elapsed = tick - c->taken;
+
+    // the first tick only sets the reference
+    if(c->taken > 0) {
+        c->missed += elapsed - 1;
+
+        int32_t jitter = (int32_t) (stamp - c->last_stamp - elapsed * c->period_us);
+        if(jitter < c->min_jitter_us) {
+            c->min_jitter_us = jitter;
+        }
+        if(jitter > c->max_jitter_us) {
+            c->max_jitter_us = jitter;
+        }
+        c->sum_abs_jitter_us += jitter < 0 ? -jitter : jitter;
+        c->intervals++;
+    }
+
+    uint32_t latency = now_us - stamp;
+    if(latency > c->max_latency_us) {
+        c->max_latency_us = latency;
+    }
+
+    c->taken = tick;
+    c->last_stamp = stamp;
+    *stamp_us = stamp;
+
+    return 1;
+}
+
+/**
+ * @return mean absolute deviation of the tick intervals from the period in microseconds
+ */
+uint32_t sample_clock_mean_jitter(const sample_clock_t* c) {
+    if(c->intervals == 0) {
+        return 0;
+    }
+
+    return (uint32_t) (c->sum_abs_jitter_us / c->intervals);
+}
@@ -0,0 +1,57 @@
+/**
+ * @file sample_clock.h
+ * @brief Hardware timer sample ticks handed from the timer ISR to a sensor task
+ *
+ * A hardware timer fires at the sample period. Its ISR stamps the tick with the
+ * microsecond clock and notifies the sensor task, so the sample time is set by the
+ * timer and not by when the scheduler gets around to the task. The task reads the stamp
+ * of the latest tick with sample_clock_take() and uses it as the sample time.
+ *
+ * The ISR is the only writer of ticks and stamps, the sensor task the only reader. The
+ * stamp of tick n is kept in slot n % SAMPLE_CLOCK_SLOTS, so the reader gets a matching
+ * stamp unless the ISR ran SAMPLE_CLOCK_SLOTS times between the two reads. The reader
+ * also keeps the interval jitter, missed ticks and wake latency of its task.
+ *
+ * sample_clock_tick() is always inlined so it is compiled into the IRAM ISR that calls it
+ */
+
+#ifndef SAMPLE_CLOCK_H
+#define SAMPLE_CLOCK_H
+
+#include <stdint.h>
+
+#define SAMPLE_CLOCK_SLOTS  4           /*!< stamps kept, a power of two */
+
+typedef struct {
+    uint32_t period_us;
+
+    /* written by the ISR */
+    uint32_t ticks;                     /*!< ticks since init */
+    uint32_t stamps[SAMPLE_CLOCK_SLOTS];/*!< microsecond time of the latest ticks */
+
+    /* written by the task */
+    uint32_t taken;                     /*!< tick last handed to the task */
+    uint32_t last_stamp;                /*!< stamp of that tick */
+    uint32_t missed;                    /*!< ticks the task did not take before the next one */
+    uint32_t intervals;                 /*!< intervals measured between taken ticks */
+    int32_t min_jitter_us;              /*!< smallest deviation of an interval from the period */
+    int32_t max_jitter_us;
+    uint64_t sum_abs_jitter_us;
+    uint32_t max_latency_us;            /*!< longest time from tick to sample_clock_take() */
+} sample_clock_t;
+
+void sample_clock_init(sample_clock_t* c, uint32_t period_us);
+uint8_t sample_clock_take(sample_clock_t* c, uint32_t now_us, uint32_t* stamp_us);
+uint32_t sample_clock_mean_jitter(const sample_clock_t* c);
+
+/**
+ * @brief record a timer tick, called from the timer ISR only
+ * @param now_us microsecond clock read in the ISR
+ */
+static inline __attribute__((always_inline)) void sample_clock_tick(sample_clock_t* c, uint32_t now_us) {
+    uint32_t tick = c->ticks + 1;
+    c->stamps[tick & (SAMPLE_CLOCK_SLOTS - 1)] = now_us;
+    __atomic_store_n(&c->ticks, tick, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,216 @@
+/**
+ * @file sensor_fusion.cpp
+ * @brief implements the multi-rate sensor fusion stage
+ */
+
+#include <string.h>
+#include "sensor_fusion.h"
+
+static_assert((FUSION_HISTORY & (FUSION_HISTORY - 1)) == 0, "FUSION_HISTORY must be a power of two");
+
+/**
+ * @brief initialize the fusion stage. Every stream starts as FUSION_HOLD and never goes
+ * stale, configure them with fusion_set_stream()
+ * @param period_us time between records
+ * @param delay_us time a record is built after its time, longer than the slowest
+ * interpolated stream takes from one sample to the arrival of the next
+ */
+void fusion_init(sensor_fusion_t* f, uint32_t period_us, uint32_t delay_us) {
+    memset(f, 0, sizeof(sensor_fusion_t));
+
+    for(uint8_t i = 0; i < NUM_FUSION_STREAMS; i++) {
+        f->streams[i].mode = FUSION_HOLD;
+        f->streams[i].max_age_us = UINT32_MAX;
+    }
+
+    f->period_us = period_us;
+    f->delay_us = delay_us;
+}
+
+/**
+ * @brief set how a stream is aligned to the record times
+ * @param max_age_us the stream is left out of records more than this after its last sample
+ */
+void fusion_set_stream(sensor_fusion_t* f, FUSION_STREAM stream, FUSION_MODE mode, uint32_t max_age_us) {
+    f->streams[stream].mode = mode;
+    f->streams[stream].max_age_us = max_age_us;
+}
+
+/**
+ * @brief add the sensor groups of a packet to their streams, see telemetry_type_t::data_flags
+ * The first sample sets the time of the first record
+ */
+void fusion_push(sensor_fusion_t* f, const telemetry_type_t* packet) {
+    for(uint8_t i = 0; i < NUM_FUSION_STREAMS; i++) {
+        if(!(packet->data_flags & (1 << i))) {
+            continue;
+        }
+
+        fusion_stream_t* s = &f->streams[i];
+
+        // a repeated packet, e.g. after a failed sensor read, carries the time of the previous sample
+        if(s->count > 0 && (int32_t) (packet->acquired_us - s->samples[(s->count - 1) & (FUSION_HISTORY - 1)].time_us) <= 0) {
+            s->rejected++;
+            continue;
+        }
+
+        fusion_sample_t* sample = &s->samples[s->count & (FUSION_HISTORY - 1)];
+        sample->time_us = packet->acquired_us;
+        sample->trace_id = packet->trace_id;
+
+        switch (i) {
+            case FUSION_ACCEL:
+                sample->data.acc = packet->acc_data;
+                break;
+
+            case FUSION_GYRO:
+                sample->data.gyro = packet->gyro_data;
+                break;
+
+            case FUSION_ALTIMETER:
+                sample->data.alt = packet->alt_data;
+                break;
+
+            case FUSION_GPS:
+                sample->data.gps = packet->gps_data;
+                break;
+        }
+
+        s->count++;
+
+        if(!f->started) {
+            f->started = 1;
+            f->next_us = packet->acquired_us;
+        }
+    }
+}
+
+static float lerpf(float a, float b, float w) {
+    return a + (b - a) * w;
+}
+
+static double lerpd(double a, double b, double w) {
+    return a + (b - a) * w;
+}
+
+/**
+ * @brief interpolate the group of a stream between two samples into a record
+ * @param w weight of b, 0 gives a
+ */
+static void interpolate(uint8_t stream, const fusion_sample_t* a, const fusion_sample_t* b, float w, telemetry_type_t* record) {
+    switch (stream) {
+        case FUSION_ACCEL:
+            record->acc_data.ax = lerpf(a->data.acc.ax, b->data.acc.ax, w);
+            record->acc_data.ay = lerpf(a->data.acc.ay, b->data.acc.ay, w);
+            record->acc_data.az = lerpf(a->data.acc.az, b->data.acc.az, w);
+            record->acc_data.pitch = lerpf(a->data.acc.pitch, b->data.acc.pitch, w);
+            record->acc_data.roll = lerpf(a->data.acc.roll, b->data.acc.roll, w);
+            break;
+
+        case FUSION_GYRO:
+            record->gyro_data.gx = lerpd(a->data.gyro.gx, b->data.gyro.gx, w);
+            record->gyro_data.gy = lerpd(a->data.gyro.gy, b->data.gyro.gy, w);
+            record->gyro_data.gz = lerpd(a->data.gyro.gz, b->data.gyro.gz, w);
+            break;
+
+        case FUSION_ALTIMETER:
+            record->alt_data.pressure = lerpd(a->data.alt.pressure, b->data.alt.pressure, w);
+            record->alt_data.altitude = lerpd(a->data.alt.altitude, b->data.alt.altitude, w);
+            record->alt_data.velocity = lerpd(a->data.alt.velocity, b->data.alt.velocity, w);
+            record->alt_data.temperature = lerpd(a->data.alt.temperature, b->data.alt.temperature, w);
+            record->alt_data.AGL = lerpd(a->data.alt.AGL, b->data.alt.AGL, w);
+            break;
+
+        case FUSION_GPS:
+            record->gps_data.latitude = lerpd(a->data.gps.latitude, b->data.gps.latitude, w);
+            record->gps_data.longitude = lerpd(a->data.gps.longitude, b->data.gps.longitude, w);
+            record->gps_data.gps_altitude = (uint16_t) (lerpf(a->data.gps.gps_altitude, b->data.gps.gps_altitude, w) + 0.5f);
+            record->gps_data.time = a->data.gps.time;
+            break;
+    }
+}
+
+/**
+ * @brief build the next record once its time is delay_us in the past
+ * Call until it returns 0. If the caller fell more than half the history behind, the
+ * missed record times are skipped and counted
+ * @param now_us current time on the acquired_us clock
+ * @param record set to the fused record, acquired_us is the record time and record_number
+ * counts the records. state and operation_mode are left to the caller
+ * @return 1 if a record was built
+ */
+uint8_t fusion_output(sensor_fusion_t* f, uint32_t now_us, telemetry_type_t* record) {
+    if(!f->started) {
+        return 0;
+    }
+
+    int32_t lag = (int32_t) (now_us - f->delay_us - f->next_us);
+    if(lag < 0) {
+        return 0;
+    }
+
+    uint32_t behind = lag / f->period_us;
+    if(behind >= FUSION_HISTORY / 2) {
+        f->next_us += behind * f->period_us;
+        f->skipped += behind;
+    }
+
+    uint32_t t = f->next_us;
+    memset(record, 0, sizeof(telemetry_type_t));
+
+    for(uint8_t i = 0; i < NUM_FUSION_STREAMS; i++) {
+        fusion_stream_t* s = &f->streams[i];
+        const fusion_sample_t* a = NULL;
+        const fusion_sample_t* b = NULL;
+
+        // latest sample at or before t, and the one after it
+        uint32_t kept = s->count < FUSION_HISTORY ? s->count : FUSION_HISTORY;
+        for(uint32_t n = s->count; n > s->count - kept; n--) {
+            const fusion_sample_t* sample = &s->samples[(n - 1) & (FUSION_HISTORY - 1)];
+            if((int32_t) (sample->time_us - t) <= 0) {
+                a = sample;
+                break;
+            }
+            b = sample;
+        }
+
+        if(a == NULL) {
+            continue;
+        }
+
+        uint32_t age = t - a->time_us;
+        if(age > s->max_age_us) {
+            s->stale++;
+            continue;
+        }
+
+        if(s->mode == FUSION_INTERPOLATE && b != NULL) {
+            interpolate(i, a, b, (float) age / (float) (b->time_us - a->time_us), record);
+        } else {
+            interpolate(i, a, a, 0, record);
+        }
+
+        if(record->data_flags == 0) {
+            record->trace_id = a->trace_id;
+        }
+
+        // each sample is fresh in one record, the one it is nearest to or the first one holding it
+        uint8_t fresh;
+        if(s->mode == FUSION_INTERPOLATE) {
+            fresh = age < f->period_us / 2 || (b != NULL && b->time_us - t <= f->period_us / 2);
+        } else {
+            fresh = age < f->period_us;
+        }
+
+        record->data_flags |= 1 << i;
+        if(fresh) {
+            record->fresh_flags |= 1 << i;
+        }
+    }
+
+    record->acquired_us = t;
+    record->record_number = ++f->records;
+    f->next_us += f->period_us;
+
+    return 1;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file sensor_fusion.h
+ * @brief Multi-rate sensor fusion onto a fixed output rate
+ *
+ * The IMU, barometer and GPS tasks produce packets at their own rates, each filling only
+ * its own group of telemetry_type_t. The fusion stage keeps the last FUSION_HISTORY samples
+ * of every stream with their acquisition time and builds one complete record per output
+ * period. A record for time t is built once every stream had the chance to deliver a sample
+ * after t, that is delay_us after t:
+ * - FUSION_INTERPOLATE streams are interpolated linearly between the samples around t, or
+ *   held at the last sample before t if the next one has not arrived
+ * - FUSION_HOLD streams keep the last sample before t
+ * - a stream whose last sample before t is older than its max_age_us is left out
+ *
+ * data_flags of a record has the groups that hold data, fresh_flags those with a new sample:
+ * acquired within half a period of t for an interpolated stream, since the previous record
+ * for a held one. A record is traced as the sample of its lowest data flag, see latency_trace.h
+ *
+ * Samples of a stream must arrive in acquisition order, a sample not newer than the last
+ * one of its stream is rejected. One task pushes and builds records, it is not thread-safe
+ */
+
+#ifndef SENSOR_FUSION_H
+#define SENSOR_FUSION_H
+
+#include <stdint.h>
+#include "data_types.h"
+
+#define FUSION_HISTORY  16              /*!< samples kept per stream, a power of two covering delay_us at the fastest rate */
+
+/**
+ * Fused streams, indexed by the bit of their data flag
+ */
+typedef enum {
+    FUSION_ACCEL = 0,
+    FUSION_GYRO,
+    FUSION_ALTIMETER,
+    FUSION_GPS,
+    NUM_FUSION_STREAMS
+} FUSION_STREAM;
+
+typedef enum {
+    FUSION_HOLD = 0,                    /*!< sample and hold */
+    FUSION_INTERPOLATE                  /*!< linear interpolation between samples */
+} FUSION_MODE;
+
+typedef struct {
+    uint32_t time_us;                   /*!< acquired_us of the packet */
+    uint32_t trace_id;
+    union {
+        accel_type_t acc;
+        gyro_type_t gyro;
+        altimeter_type_t alt;
+        gps_type_t gps;
+    } data;
+} fusion_sample_t;
+
+typedef struct {
+    uint8_t mode;                       /*!< FUSION_MODE */
+    uint32_t max_age_us;                /*!< a sample older than this at the record time is not used */
+    fusion_sample_t samples[FUSION_HISTORY];
+    uint32_t count;                     /*!< samples pushed */
+    uint32_t rejected;                  /*!< samples not newer than the previous one */
+    uint32_t stale;                     /*!< records the stream was left out of, it had data before */
+} fusion_stream_t;
+
+typedef struct {
+    fusion_stream_t streams[NUM_FUSION_STREAMS];
+    uint32_t period_us;                 /*!< output period */
+    uint32_t delay_us;                  /*!< a record is built this long after its time */
+    uint32_t next_us;                   /*!< time of the next record */
+    uint8_t started;                    /*!< 1 once the first sample set next_us */
+    uint32_t records;                   /*!< records built */
+    uint32_t skipped;                   /*!< record times passed over because the caller fell behind */
+} sensor_fusion_t;
+
+void fusion_init(sensor_fusion_t* f, uint32_t period_us, uint32_t delay_us);
+void fusion_set_stream(sensor_fusion_t* f, FUSION_STREAM stream, FUSION_MODE mode, uint32_t max_age_us);
+void fusion_push(sensor_fusion_t* f, const telemetry_type_t* packet);
+uint8_t fusion_output(sensor_fusion_t* f, uint32_t now_us, telemetry_type_t* record);
+
+#endif
@@ -0,0 +1,36 @@
+/**
+ * @file static_arena.cpp
+ * @brief implements the boot time bump allocator
+ */
+
+#include "static_arena.h"
+
+void arena_init(static_arena_t* a, void* buffer, size_t size) {
+    a->base = (uint8_t*) buffer;
+    a->size = size;
+    a->used = 0;
+    a->failed = 0;
+}
+
+/**
+ * @brief take a block of ARENA_ALIGNMENT aligned memory
+ * @return the block, NULL if the arena is too small
+ */
+void* arena_alloc(static_arena_t* a, size_t size) {
+    uintptr_t start = (uintptr_t) (a->base + a->used);
+    size_t padding = (ARENA_ALIGNMENT - start % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+
+    if(size == 0 || padding + size > a->size - a->used) {
+        a->failed++;
+        return NULL;
+    }
+
+    void* block = a->base + a->used + padding;
+    a->used += padding + size;
+
+    return block;
+}
+
+size_t arena_available(const static_arena_t* a) {
+    return a->size - a->used;
+}
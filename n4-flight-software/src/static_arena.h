@@ -0,0 +1,29 @@
+/**
+ * @file static_arena.h
+ * @brief Bump allocator over a fixed buffer for boot time allocations
+ *
+ * Task stacks and queue storage are carved from statically allocated buffers while
+ * setup() runs, so their size is fixed at link time and nothing of the runtime comes
+ * from the heap. There is no free, an arena only grows until it is full
+ */
+
+#ifndef STATIC_ARENA_H
+#define STATIC_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ARENA_ALIGNMENT     8       /*!< alignment of every block, enough for double and the FreeRTOS control blocks */
+
+typedef struct {
+    uint8_t* base;
+    size_t size;                    /*!< bytes in the buffer */
+    size_t used;                    /*!< bytes handed out, alignment padding included */
+    size_t failed;                  /*!< requests that did not fit */
+} static_arena_t;
+
+void arena_init(static_arena_t* a, void* buffer, size_t size);
+void* arena_alloc(static_arena_t* a, size_t size);
+size_t arena_available(const static_arena_t* a);
+
+#endif
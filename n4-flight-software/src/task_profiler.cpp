@@ -0,0 +1,179 @@
+/**
+ * @file task_profiler.cpp
+ * @brief implements the task loop profiler
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "task_profiler.h"
+
+/**
+ * @brief clear all statistics
+ * @param read_cycles returns the CPU cycle counter
+ * @param cycles_per_us CPU clock in MHz
+ */
+void profiler_init(profiler_t* p, profiler_clock_t read_cycles, uint32_t cycles_per_us) {
+    memset(p, 0, sizeof(profiler_t));
+    p->read_cycles = read_cycles;
+    p->cycles_per_us = cycles_per_us > 0 ? cycles_per_us : 1;
+
+    for(uint8_t i = 0; i < NUM_PROFILE_SECTIONS; i++) {
+        p->sections[i].name = "";
+        p->sections[i].min_us = UINT32_MAX;
+    }
+}
+
+/**
+ * @param name short name used in the summary, must stay valid
+ * @param period_us expected time between two PROFILE_BEGIN, 0 to not count late starts
+ */
+void profiler_set_section(profiler_t* p, uint8_t section, const char* name, uint32_t period_us) {
+    if(section >= NUM_PROFILE_SECTIONS) {
+        return;
+    }
+
+    p->sections[section].name = name;
+    p->sections[section].period_us = period_us;
+}
+
+void profiler_begin(profiler_t* p, uint8_t section) {
+    profile_section_t* s = &p->sections[section];
+    uint32_t now = p->read_cycles();
+
+    if(s->started && s->period_us > 0) {
+        uint32_t gap_us = (now - s->last_start) / p->cycles_per_us;
+        if(gap_us > s->period_us + s->period_us / 2) {
+            s->late++;
+        }
+    }
+
+    s->start = now;
+    s->last_start = now;
+    s->started = 1;
+}
+
+void profiler_end(profiler_t* p, uint8_t section) {
+    profile_section_t* s = &p->sections[section];
+    profiler_record(p, section, (p->read_cycles() - s->start) / p->cycles_per_us);
+}
+
+/**
+ * @brief histogram bucket of a duration
+ * below 4 us every microsecond has its own bucket, above the range of every power of two
+ * is split into PROFILER_SUB_BUCKETS equal buckets
+ */
+uint8_t profiler_bucket(uint32_t duration_us) {
+    if(duration_us < PROFILER_SUB_BUCKETS) {
+        return duration_us;
+    }
+
+    uint8_t msb = 31 - __builtin_clz(duration_us);
+    uint32_t bucket = (msb - 1) * PROFILER_SUB_BUCKETS + ((duration_us >> (msb - 2)) & (PROFILER_SUB_BUCKETS - 1));
+
+    return bucket < PROFILER_BUCKETS ? bucket : PROFILER_BUCKETS - 1;
+}
+
+/**
+ * @brief smallest duration that falls into a bucket
+ */
+static uint32_t bucket_floor(uint8_t bucket) {
+    if(bucket < PROFILER_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    uint8_t msb = bucket / PROFILER_SUB_BUCKETS + 1;
+    return (uint32_t) (PROFILER_SUB_BUCKETS + bucket % PROFILER_SUB_BUCKETS) << (msb - 2);
+}
+
+/**
+ * @brief add one duration to a section, for time measured outside the profiler
+ */
+void profiler_record(profiler_t* p, uint8_t section, uint32_t duration_us) {
+    if(section >= NUM_PROFILE_SECTIONS) {
+        return;
+    }
+
+    profile_section_t* s = &p->sections[section];
+
+    s->count++;
+    s->sum_us += duration_us;
+    if(duration_us < s->min_us) {
+        s->min_us = duration_us;
+    }
+    if(duration_us > s->max_us) {
+        s->max_us = duration_us;
+    }
+
+    s->histogram[profiler_bucket(duration_us)]++;
+}
+
+/**
+ * @brief duration below which the given fraction of iterations completed
+ * @param fraction e.g. 0.99 for the 99th percentile
+ * @return upper edge of the bucket holding the percentile, never above the maximum
+ */
+uint32_t profiler_percentile(const profile_section_t* s, float fraction) {
+    if(s->count == 0) {
+        return 0;
+    }
+
+    uint32_t target = (uint32_t) (s->count * fraction);
+    if(target < s->count * fraction || target == 0) {
+        target++;
+    }
+
+    uint32_t seen = 0;
+    for(uint8_t b = 0; b < PROFILER_BUCKETS - 1; b++) {
+        seen += s->histogram[b];
+        if(seen >= target) {
+            uint32_t edge = bucket_floor(b + 1) - 1;
+            return edge < s->max_us ? edge : s->max_us;
+        }
+    }
+
+    return s->max_us;
+}
+
+void profiler_summary(const profiler_t* p, uint8_t section, profile_summary_t* summary) {
+    const profile_section_t* s = &p->sections[section];
+
+    memset(summary, 0, sizeof(profile_summary_t));
+    summary->count = s->count;
+    summary->late = s->late;
+
+    if(s->count == 0) {
+        return;
+    }
+
+    summary->min_us = s->min_us;
+    summary->mean_us = (uint32_t) (s->sum_us / s->count);
+    summary->max_us = s->max_us;
+    summary->p99_us = profiler_percentile(s, 0.99f);
+}
+
+/**
+ * @brief format the summary record of one section, see task_profiler.h
+ * @param buffer output buffer, PROFILER_RECORD_LENGTH is always enough
+ * @param now current time in ms
+ * @return length of the record excluding the terminating NUL, 0 if it does not fit
+ */
+size_t profiler_format(const profiler_t* p, uint8_t section, char* buffer, size_t size, uint32_t now) {
+    profile_summary_t summary;
+
+    if(buffer == NULL || size == 0 || section >= NUM_PROFILE_SECTIONS) {
+        return 0;
+    }
+
+    profiler_summary(p, section, &summary);
+
+    int length = snprintf(buffer, size, "P,%lu,%s,%lu,%lu,%lu,%lu,%lu,%lu\n", (unsigned long) now, p->sections[section].name,
+                          (unsigned long) summary.count, (unsigned long) summary.min_us, (unsigned long) summary.mean_us,
+                          (unsigned long) summary.max_us, (unsigned long) summary.p99_us, (unsigned long) summary.late);
+
+    if(length < 0 || (size_t) length >= size) {
+        buffer[0] = '\0';
+        return 0;
+    }
+
+    return length;
+}
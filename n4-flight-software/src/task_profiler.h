@@ -0,0 +1,98 @@
+/**
+ * @file task_profiler.h
+ * @brief Run time profiling of the task loop bodies
+ *
+ * PROFILE_BEGIN and PROFILE_END bracket one section of a task loop, e.g. one IMU reading
+ * or one flash write. The duration is measured with the CPU cycle counter and kept in
+ * fixed memory: exact count, min, max and sum, plus a log-linear histogram with 4 buckets
+ * per power of two from 1 us to 131 ms for the 99th percentile (within 25 %).
+ *
+ * Sections with a period also count late starts: an iteration that begins more than half
+ * a period after it was due, i.e. the task missed its cadence.
+ *
+ * The cycle counter is read through a function pointer so the profiler runs on the host
+ * with a mocked clock. The cycle counter is per core, which is fine because every task is
+ * pinned (see task_schedule.h). Each section must only be used from one task.
+ *
+ * Summary record sent with the telemetry (one text line per section):
+ * P,<time ms>,<section>,<count>,<min us>,<mean us>,<max us>,<p99 us>,<late>\n
+ *
+ * With TASK_PROFILING 0 (see defs.h) the macros expand to nothing
+ */
+
+#ifndef TASK_PROFILER_H
+#define TASK_PROFILER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef TASK_PROFILING
+    #define TASK_PROFILING 0
+#endif
+
+#define PROFILER_SUB_BUCKETS    4       /*!< histogram buckets per power of two */
+#define PROFILER_BUCKETS        64      /*!< covers 0 to 131071 us, longer durations land in the last bucket */
+#define PROFILER_RECORD_LENGTH  96      /*!< buffer size that is always large enough for one summary record */
+
+typedef enum {
+    PROFILE_ACQUISITION = 0,            /*!< one IMU reading */
+    PROFILE_ALTIMETER,                  /*!< one barometer reading, conversion delays included */
+    PROFILE_FILTER,                     /*!< one vertical Kalman filter update */
+    PROFILE_STATE_CHECK,                /*!< one packet through the flight detectors */
+    PROFILE_LOG_WRITE,                  /*!< one record written to flash */
+    PROFILE_PUBLISH,                    /*!< one telemetry batch sent on every link */
+    NUM_PROFILE_SECTIONS
+} PROFILE_SECTION;
+
+typedef uint32_t (*profiler_clock_t)(void);
+
+typedef struct {
+    const char* name;
+    uint32_t period_us;                 /*!< expected time between starts, 0 for event driven sections */
+    uint32_t start;                     /*!< cycle count at PROFILE_BEGIN */
+    uint32_t last_start;                /*!< cycle count at the previous PROFILE_BEGIN */
+    uint8_t started;                    /*!< 1 once last_start is valid */
+
+    uint32_t count;                     /*!< completed iterations */
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t late;                      /*!< iterations that started more than half a period late */
+    uint32_t histogram[PROFILER_BUCKETS];
+} profile_section_t;
+
+typedef struct {
+    profile_section_t sections[NUM_PROFILE_SECTIONS];
+    profiler_clock_t read_cycles;
+    uint32_t cycles_per_us;             /*!< CPU clock in MHz, update it when the clock changes */
+} profiler_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t mean_us;
+    uint32_t max_us;
+    uint32_t p99_us;
+    uint32_t late;
+} profile_summary_t;
+
+void profiler_init(profiler_t* p, profiler_clock_t read_cycles, uint32_t cycles_per_us);
+void profiler_set_section(profiler_t* p, uint8_t section, const char* name, uint32_t period_us);
+void profiler_begin(profiler_t* p, uint8_t section);
+void profiler_end(profiler_t* p, uint8_t section);
+void profiler_record(profiler_t* p, uint8_t section, uint32_t duration_us);
+uint8_t profiler_bucket(uint32_t duration_us);
+uint32_t profiler_percentile(const profile_section_t* s, float fraction);
+void profiler_summary(const profiler_t* p, uint8_t section, profile_summary_t* summary);
+size_t profiler_format(const profiler_t* p, uint8_t section, char* buffer, size_t size, uint32_t now);
+
+#if TASK_PROFILING
+    extern profiler_t task_profiler;
+    #define PROFILE_BEGIN(section)  profiler_begin(&task_profiler, section)
+    #define PROFILE_END(section)    profiler_end(&task_profiler, section)
+#else
+    #define PROFILE_BEGIN(section)
+    #define PROFILE_END(section)
+#endif
+
+#endif
@@ -0,0 +1,301 @@
+/**
+ * @file task_schedule.cpp
+ * @brief the flight task table, response time analysis and a tick based simulation of it
+ */
+
+#include <string.h>
+#include <math.h>
+#include "static_arena.h"
+#include "task_schedule.h"
+
+/**
+ * Task table indexed by FLIGHT_TASK
+ * Execution times are measured worst cases with margin. The barometer sleeps through its
+ * temperature (4.5 ms) and OSS 3 pressure (25.5 ms) conversions. flightStateCallback does
+ * no I/O in flight, its figure is the wake up and the dispatch of the state bits. The
+ * recovery mode shutdown it runs after landing is not included, no deadline on the
+ * acquisition core matters any more then. The sensor fusion figure covers draining its
+ * queue and building two records. The resource monitor figure includes its periodic SPIFFS
+ * log write and the once per flight apogee vote log. The health monitor figure is the
+ * check of every watched task, the rare recovery attempts and their log lines are not
+ * included. The I2C bus manager runs the IMU burst read and a barometer transfer per
+ * release, suspended while they are on the bus at 400 kHz, retries and bus recoveries are
+ * not included
+ */
+constexpr task_spec_t flight_tasks[NUM_FLIGHT_TASKS] = {
+    /* READ_ACCELERATION */     { "readAcceleration",    TASK_PERIODIC, 10,  10,  1500,  0,     6, ACQUISITION_CORE, 2048 },
+    /* READ_ALTIMETER */        { "readAltimeter",       TASK_PERIODIC, 50,  50,  1000,  30000, 3, ACQUISITION_CORE, 3072 },
+    /* READ_GPS */              { "readGPS",             TASK_PERIODIC, 100, 100, 2000,  0,     2, ACQUISITION_CORE, 2048 },
+    /* CHECK_FLIGHT_STATE */    { "checkFlightState",    TASK_SPORADIC, 10,  10,  300,   0,     5, ACQUISITION_CORE, 2048 },
+    /* FLIGHT_STATE_CALLBACK */ { "flightStateCallback", TASK_SPORADIC, 10,  5,   100,   0,     7, ACQUISITION_CORE, 2048 },
+    /* SENSOR_FUSION */         { "sensorFusion",        TASK_PERIODIC, 10,  10,  400,   0,     4, ACQUISITION_CORE, 2048 },
+    /* TRANSMIT_TELEMETRY */    { "transmitTelemetry",   TASK_SPORADIC, 100, 100, 20000, 0,     2, NETWORK_CORE,     4096 },
+    /* DEBUG_TO_TERMINAL */     { "debugToTerminal",     TASK_SPORADIC, 10,  10,  1000,  0,     3, NETWORK_CORE,     4096 },
+    /* LOG_TO_MEMORY */         { "logToMemory",         TASK_SPORADIC, 5,   5,   800,   0,     4, NETWORK_CORE,     1024 },
+    /* RESOURCE_MONITOR */      { "resourceMonitor",     TASK_PERIODIC, 1000, 1000, 30000, 0,   1, NETWORK_CORE,     3072 },
+    /* HEALTH_MONITOR */        { "healthMonitor",       TASK_PERIODIC, 10,  10,  300,   0,     5, NETWORK_CORE,     3072 },
+    /* I2C_BUS */               { "i2cBus",              TASK_SPORADIC, 5,   5,   200,   400,   8, ACQUISITION_CORE, 2048 }
+};
+
+/* stack bytes of flight_tasks[i] and every task after it, with every task enabled */
+static constexpr uint32_t stack_sum(uint8_t i) {
+    return i == NUM_FLIGHT_TASKS ? 0 : flight_tasks[i].stack_depth + stack_sum(i + 1);
+}
+
+/* every stack is carved from task_stacks without alignment padding */
+static constexpr bool stacks_aligned(uint8_t i) {
+    return i == NUM_FLIGHT_TASKS || (flight_tasks[i].stack_depth % ARENA_ALIGNMENT == 0 && stacks_aligned(i + 1));
+}
+
+static_assert(stacks_aligned(0), "every stack_depth in flight_tasks must be a multiple of ARENA_ALIGNMENT");
+static_assert(stack_sum(0) <= TASK_STACK_ARENA_SIZE, "TASK_STACK_ARENA_SIZE is smaller than the stacks in flight_tasks");
+
+static uint8_t in_set(uint32_t mask, uint8_t i, const task_spec_t* t, uint8_t core) {
+    return (mask & (1UL << i)) && t->core == core;
+}
+
+/**
+ * @brief CPU share of the selected tasks on one core, suspension excluded
+ * @param mask bit i set to include tasks[i]
+ */
+float task_core_utilization(const task_spec_t* tasks, uint8_t count, uint32_t mask, uint8_t core) {
+    float u = 0;
+
+    for(uint8_t i = 0; i < count; i++) {
+        if(in_set(mask, i, &tasks[i], core)) {
+            u += (float) tasks[i].wcet_us / (tasks[i].period_ms * 1000.0f);
+        }
+    }
+
+    return u;
+}
+
+/**
+ * @brief stack bytes the selected tasks need, to check against TASK_STACK_ARENA_SIZE
+ * @param mask bit i set to include tasks[i]
+ */
+uint32_t task_stack_total(const task_spec_t* tasks, uint8_t count, uint32_t mask) {
+    uint32_t total = 0;
+
+    for(uint8_t i = 0; i < count; i++) {
+        if(mask & (1UL << i)) {
+            total += tasks[i].stack_depth;
+        }
+    }
+
+    return total;
+}
+
+uint8_t task_core_count(const task_spec_t* tasks, uint8_t count, uint32_t mask, uint8_t core) {
+    uint8_t n = 0;
+
+    for(uint8_t i = 0; i < count; i++) {
+        if(in_set(mask, i, &tasks[i], core)) {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * @brief Liu and Layland utilization bound for rate monotonic priorities, n(2^(1/n) - 1)
+ * A core below the bound is schedulable without further analysis
+ */
+float task_rm_bound(uint8_t count) {
+    if(count == 0) {
+        return 1.0f;
+    }
+
+    return count * (powf(2.0f, 1.0f / count) - 1.0f);
+}
+
+/**
+ * @brief worst case response time of every selected task
+ * Tasks of equal or higher priority on the same core interfere. A self suspending task
+ * interferes as if released with jitter R - C
+ * @param mask bit i set to include tasks[i]
+ * @param results one entry per task, entries outside mask are zeroed
+ * @return 1 if every selected task meets its deadline
+ */
+uint8_t task_analyze(const task_spec_t* tasks, uint8_t count, uint32_t mask, task_result_t* results) {
+    uint8_t done[32] = {0};
+    uint8_t all_ok = 1;
+
+    if(count > 32) {
+        return 0;
+    }
+
+    memset(results, 0, count * sizeof(task_result_t));
+
+    // highest priority first, so the response time of every interfering task is known
+    for(uint8_t n = 0; n < count; n++) {
+        int16_t next = -1;
+        for(uint8_t i = 0; i < count; i++) {
+            if(!(mask & (1UL << i)) || done[i]) {
+                continue;
+            }
+            if(next < 0 || tasks[i].priority > tasks[next].priority) {
+                next = i;
+            }
+        }
+
+        if(next < 0) {
+            break;
+        }
+
+        const task_spec_t* t = &tasks[next];
+        uint64_t deadline = t->deadline_ms * 1000ULL;
+        uint64_t own = t->wcet_us + t->suspend_us;
+        uint64_t r = own;
+
+        while(1) {
+            uint64_t demand = own;
+
+            for(uint8_t j = 0; j < count; j++) {
+                const task_spec_t* h = &tasks[j];
+                if(j == next || !in_set(mask, j, h, t->core) || h->priority < t->priority) {
+                    continue;
+                }
+
+                // an equal priority task not analysed yet is assumed to just meet its deadline
+                uint64_t jitter = 0;
+                if(h->suspend_us > 0) {
+                    jitter = (done[j] ? results[j].response_us : h->deadline_ms * 1000ULL) - h->wcet_us;
+                }
+
+                uint64_t period = h->period_ms * 1000ULL;
+                demand += ((r + jitter + period - 1) / period) * h->wcet_us;
+            }
+
+            if(demand == r || demand > deadline) {
+                r = demand;
+                break;
+            }
+            r = demand;
+        }
+
+        results[next].response_us = r > UINT32_MAX ? UINT32_MAX : (uint32_t) r;
+        results[next].schedulable = r <= deadline;
+        all_ok &= results[next].schedulable;
+        done[next] = 1;
+    }
+
+    return all_ok;
+}
+
+typedef struct {
+    uint8_t active;
+    uint8_t phase;                  /* 0 first half of the work, 1 suspended, 2 second half */
+    int32_t remaining_us;
+    uint32_t release_us;
+    uint32_t next_release_us;
+} sim_job_t;
+
+/**
+ * @brief preemptive fixed priority simulation of the selected tasks, all released at 0
+ * Sporadic tasks are released at their maximum rate. A job works half its execution time,
+ * sleeps suspend_us, then does the rest. A release that finds the previous job still
+ * running is counted as missed and dropped
+ * @param horizon_ms simulated time, use a multiple of the hyperperiod
+ * @param step_us time resolution, execution and suspension times should be multiples of it
+ * @param results one entry per task
+ * @return total deadline misses
+ */
+uint32_t task_simulate(const task_spec_t* tasks, uint8_t count, uint32_t mask, uint32_t horizon_ms, uint32_t step_us, task_sim_result_t* results) {
+    sim_job_t jobs[32];
+    uint32_t total_misses = 0;
+
+    if(count > 32 || step_us == 0) {
+        return 0;
+    }
+
+    memset(jobs, 0, sizeof(jobs));
+    memset(results, 0, count * sizeof(task_sim_result_t));
+
+    for(uint32_t now = 0; now < horizon_ms * 1000UL; now += step_us) {
+        int16_t running[NUM_TASK_CORES];
+
+        for(uint8_t c = 0; c < NUM_TASK_CORES; c++) {
+            running[c] = -1;
+        }
+
+        for(uint8_t i = 0; i < count; i++) {
+            const task_spec_t* t = &tasks[i];
+            sim_job_t* j = &jobs[i];
+
+            if(!(mask & (1UL << i)) || t->core >= NUM_TASK_CORES) {
+                continue;
+            }
+
+            if(now >= j->next_release_us) {
+                j->next_release_us += t->period_ms * 1000UL;
+
+                if(j->active) {
+                    results[i].misses++;
+                    total_misses++;
+                } else {
+                    j->active = 1;
+                    j->phase = 0;
+                    j->remaining_us = t->wcet_us / 2;
+                    j->release_us = now;
+                }
+            }
+
+            if(j->active && j->phase == 1) {
+                j->remaining_us -= step_us;
+                if(j->remaining_us <= 0) {
+                    j->phase = 2;
+                    j->remaining_us = t->wcet_us - t->wcet_us / 2;
+                }
+            }
+
+            if(j->active && j->phase != 1) {
+                int16_t r = running[t->core];
+                if(r < 0 || t->priority > tasks[r].priority) {
+                    running[t->core] = i;
+                }
+            }
+        }
+
+        for(uint8_t c = 0; c < NUM_TASK_CORES; c++) {
+            if(running[c] < 0) {
+                continue;
+            }
+
+            uint8_t i = running[c];
+            const task_spec_t* t = &tasks[i];
+            sim_job_t* j = &jobs[i];
+
+            j->remaining_us -= step_us;
+            if(j->remaining_us > 0) {
+                continue;
+            }
+
+            if(j->phase == 0) {
+                j->phase = t->suspend_us > 0 ? 1 : 2;
+                j->remaining_us = j->phase == 1 ? (int32_t) t->suspend_us : (int32_t) (t->wcet_us - t->wcet_us / 2);
+                if(j->remaining_us > 0) {
+                    continue;
+                }
+            }
+
+            if(j->phase == 1) {
+                continue;
+            }
+
+            uint32_t response = now + step_us - j->release_us;
+            j->active = 0;
+            results[i].jobs++;
+            if(response > results[i].max_response_us) {
+                results[i].max_response_us = response;
+            }
+            if(response > t->deadline_ms * 1000UL) {
+                results[i].misses++;
+                total_misses++;
+            }
+        }
+    }
+
+    return total_misses;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file task_schedule.h
+ * @brief Declared FreeRTOS task table and its schedulability analysis
+ *
+ * Every task has a fixed period (or, for the queue and notification driven tasks, a
+ * minimum time between releases), a worst case execution time, a priority and a core.
+ * Acquisition and estimation run on ACQUISITION_CORE, the telemetry links and logging
+ * on NETWORK_CORE next to the WiFi stack, so a slow publish or flash write cannot delay
+ * a sensor reading. Priorities are rate monotonic per core: the shorter the period, the
+ * higher the priority.
+ *
+ * task_analyze() runs fixed priority response time analysis per core. Time a task sleeps
+ * waiting on hardware (suspend_us, e.g. the barometer conversion) adds to its own
+ * response time and, as release jitter, to the interference it causes lower priority
+ * tasks. task_simulate() replays the table tick by tick from a synchronous release for
+ * a cross check on the host
+ */
+
+#ifndef TASK_SCHEDULE_H
+#define TASK_SCHEDULE_H
+
+#include <stdint.h>
+
+#define ACQUISITION_CORE        1       /*!< APP_CPU - sensors, estimation, flight state */
+#define NETWORK_CORE            0       /*!< PRO_CPU - WiFi stack, telemetry, logging */
+#define NUM_TASK_CORES          2
+#define TASK_STACK_ARENA_SIZE   30720   /*!< bytes of static stack for all tasks, at least the sum of stack_depth in flight_tasks, checked when task_schedule.cpp compiles */
+
+typedef enum {
+    TASK_PERIODIC = 0,                  /*!< released every period by vTaskDelayUntil or the sample timer */
+    TASK_SPORADIC                       /*!< released by a queue or notification, at most once per period */
+} TASK_KIND;
+
+typedef enum {
+    TASK_READ_ACCELERATION = 0,
+    TASK_READ_ALTIMETER,
+    TASK_READ_GPS,
+    TASK_CHECK_FLIGHT_STATE,
+    TASK_FLIGHT_STATE_CALLBACK,
+    TASK_SENSOR_FUSION,
+    TASK_TRANSMIT_TELEMETRY,
+    TASK_DEBUG_TO_TERMINAL,
+    TASK_LOG_TO_MEMORY,
+    TASK_RESOURCE_MONITOR,
+    TASK_HEALTH_MONITOR,
+    TASK_I2C_BUS,
+    NUM_FLIGHT_TASKS
+} FLIGHT_TASK;
+
+typedef struct {
+    const char* name;
+    uint8_t kind;
+    uint32_t period_ms;             /*!< release period, minimum time between releases for a sporadic task */
+    uint32_t deadline_ms;           /*!< latest completion after release, at most period_ms */
+    uint32_t wcet_us;               /*!< worst case CPU time per release */
+    uint32_t suspend_us;            /*!< time per release spent sleeping on hardware, not using the CPU */
+    uint8_t priority;               /*!< FreeRTOS priority, higher runs first */
+    uint8_t core;
+    uint32_t stack_depth;           /*!< stack size handed to xTaskCreatePinnedToCore, bytes on ESP-IDF */
+} task_spec_t;
+
+typedef struct {
+    uint32_t response_us;           /*!< worst case response time, valid if schedulable */
+    uint8_t schedulable;            /*!< 1 if the response time is within the deadline */
+} task_result_t;
+
+typedef struct {
+    uint32_t jobs;                  /*!< releases completed */
+    uint32_t misses;                /*!< releases that completed after their deadline */
+    uint32_t max_response_us;       /*!< longest observed response time */
+} task_sim_result_t;
+
+extern const task_spec_t flight_tasks[NUM_FLIGHT_TASKS];
+
+float task_core_utilization(const task_spec_t* tasks, uint8_t count, uint32_t mask, uint8_t core);
+float task_rm_bound(uint8_t count);
+uint32_t task_stack_total(const task_spec_t* tasks, uint8_t count, uint32_t mask);
+uint8_t task_core_count(const task_spec_t* tasks, uint8_t count, uint32_t mask, uint8_t core);
+uint8_t task_analyze(const task_spec_t* tasks, uint8_t count, uint32_t mask, task_result_t* results);
+uint32_t task_simulate(const task_spec_t* tasks, uint8_t count, uint32_t mask, uint32_t horizon_ms, uint32_t step_us, task_sim_result_t* results);
+
+#endif
@@ -0,0 +1,79 @@
+/**
+ * @file task_shutdown.cpp
+ * @brief implements the ordered task shutdown
+ */
+
+#include "task_shutdown.h"
+
+static const char* const outcome_names[] = { "done", "skipped", "timed out" };
+
+/**
+ * @brief true while the step has something left to wait for
+ */
+static bool pending(const shutdown_step_t* step) {
+    switch(step->kind) {
+        case SHUTDOWN_AWAIT_SUSPEND:
+            return eTaskGetState(*step->task) != eSuspended;
+
+        case SHUTDOWN_SUSPEND: {
+            eTaskState state = eTaskGetState(*step->task);
+            return state == eRunning || state == eReady;
+        }
+
+        case SHUTDOWN_DRAIN:
+            return queue_waiting(step->queue) > 0;
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief run the shutdown steps in order, polling once per tick
+ * @param timeout_ms longest wait of each step
+ * @param results count entries, the outcome and duration of each step
+ * @return number of steps that timed out
+ */
+uint8_t shutdown_run(const shutdown_step_t* steps, uint8_t count, uint32_t timeout_ms, shutdown_result_t* results) {
+    uint8_t timeouts = 0;
+
+    for(uint8_t i = 0; i < count; i++) {
+        const shutdown_step_t* step = &steps[i];
+        shutdown_result_t* result = &results[i];
+        TickType_t start = xTaskGetTickCount();
+
+        result->outcome = SHUTDOWN_DONE;
+
+        bool on_task = step->kind == SHUTDOWN_AWAIT_SUSPEND || step->kind == SHUTDOWN_SUSPEND;
+        if(on_task && *step->task == NULL) {
+            result->outcome = SHUTDOWN_SKIPPED;
+        } else if(step->kind == SHUTDOWN_CALL) {
+            step->call();
+        } else {
+            while(pending(step)) {
+                if((xTaskGetTickCount() - start) * portTICK_PERIOD_MS >= timeout_ms) {
+                    result->outcome = SHUTDOWN_TIMED_OUT;
+                    timeouts++;
+                    break;
+                }
+                vTaskDelay(1);
+            }
+
+            // a task that did not block in time is stopped wherever it is
+            if(step->kind == SHUTDOWN_SUSPEND) {
+                vTaskSuspend(*step->task);
+            }
+        }
+
+        result->elapsed_ms = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+    }
+
+    return timeouts;
+}
+
+/**
+ * @brief short name of a SHUTDOWN_OUTCOME for the log
+ */
+const char* shutdown_outcome_name(uint8_t outcome) {
+    return outcome <= SHUTDOWN_TIMED_OUT ? outcome_names[outcome] : "unknown";
+}
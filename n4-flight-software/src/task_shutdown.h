@@ -0,0 +1,57 @@
+/**
+ * @file task_shutdown.h
+ * @brief Ordered shutdown of the flight tasks after landing
+ *
+ * The shutdown is a table of steps run in order, each one bounded by the same timeout:
+ * - SHUTDOWN_AWAIT_SUSPEND waits for a task to suspend itself, the sensor tasks do so
+ *   between two readings once they see the recovery flag
+ * - SHUTDOWN_SUSPEND suspends a task once it is blocked, so it is not stopped halfway
+ *   through a flash write or a dispatch. On timeout the task is suspended anyway
+ * - SHUTDOWN_DRAIN waits for a queue to empty while its consumer still runs
+ * - SHUTDOWN_CALL calls a function, e.g. to stop the sample timer
+ *
+ * A step on a task that was never created is skipped. A step that times out does not stop
+ * the sequence, the result of every step is reported to the caller.
+ *
+ * Only the FreeRTOS task API is used, so the module also builds against the host shim in
+ * test/queue-stress
+ */
+
+#ifndef TASK_SHUTDOWN_H
+#define TASK_SHUTDOWN_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "queue_monitor.h"
+
+typedef enum {
+    SHUTDOWN_AWAIT_SUSPEND = 0,         /*!< wait for the task to suspend itself */
+    SHUTDOWN_SUSPEND,                   /*!< suspend the task once it is blocked */
+    SHUTDOWN_DRAIN,                     /*!< wait for the queue to empty */
+    SHUTDOWN_CALL                       /*!< call the function */
+} SHUTDOWN_STEP;
+
+typedef enum {
+    SHUTDOWN_DONE = 0,
+    SHUTDOWN_SKIPPED,                   /*!< the task was never created */
+    SHUTDOWN_TIMED_OUT
+} SHUTDOWN_OUTCOME;
+
+typedef struct {
+    uint8_t kind;                       /*!< SHUTDOWN_STEP */
+    const char* name;                   /*!< task or queue name used in the log */
+    TaskHandle_t* task;                 /*!< handle of the task, read when the step runs */
+    monitored_queue_t* queue;           /*!< SHUTDOWN_DRAIN only */
+    void (*call)();                     /*!< SHUTDOWN_CALL only */
+} shutdown_step_t;
+
+typedef struct {
+    uint8_t outcome;                    /*!< SHUTDOWN_OUTCOME */
+    uint32_t elapsed_ms;                /*!< time the step took */
+} shutdown_result_t;
+
+uint8_t shutdown_run(const shutdown_step_t* steps, uint8_t count, uint32_t timeout_ms, shutdown_result_t* results);
+const char* shutdown_outcome_name(uint8_t outcome);
+
+#endif
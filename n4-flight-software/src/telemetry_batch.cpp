@@ -0,0 +1,128 @@
+/**
+ * @file telemetry_batch.cpp
+ * @brief implements the telemetry batching functions
+ */
+
+#include <string.h>
+#include "telemetry_batch.h"
+
+/**
+ * @brief initialize a batch
+ * @param batch_size records per publish, the lower bound in adaptive mode
+ * @param max_batch_size upper bound on records per publish in adaptive mode
+ * @param max_latency_ms maximum time a record waits in the batch
+ * @param congestion_time_ms publish duration above which the link is treated as congested
+ * @param adaptive 1 to grow the batch on a congested link
+ */
+void batch_init(telemetry_batch_t* b, uint16_t batch_size, uint16_t max_batch_size, uint32_t max_latency_ms, uint32_t congestion_time_ms, uint8_t adaptive) {
+    if(batch_size == 0) {
+        batch_size = 1;
+    }
+    if(max_batch_size < batch_size) {
+        max_batch_size = batch_size;
+    }
+
+    b->batch_size = batch_size;
+    b->min_batch_size = batch_size;
+    b->max_batch_size = max_batch_size;
+    b->max_latency_ms = max_latency_ms;
+    b->congestion_time_ms = congestion_time_ms;
+    b->adaptive = adaptive;
+
+    b->published_batches = 0;
+    b->published_samples = 0;
+    b->failed_batches = 0;
+
+    batch_clear(b);
+}
+
+/**
+ * @brief add one record to the batch
+ * @param record record bytes, usually a CSV row ending in '\n'
+ * @param length length of record in bytes
+ * @param now current time in ms
+ * @return 1 if appended, 0 if the record does not fit - flush the batch and append again
+ */
+uint8_t batch_append(telemetry_batch_t* b, const char* record, size_t length, uint32_t now) {
+    if(length == 0 || b->length + length > TELEMETRY_BATCH_PAYLOAD_SIZE) {
+        return 0;
+    }
+
+    if(b->samples == 0) {
+        b->first_sample_time = now;
+    }
+
+    memcpy(b->payload + b->length, record, length);
+    b->length += length;
+    b->samples++;
+
+    return 1;
+}
+
+/**
+ * @brief check whether the batch should be published now
+ * @return 1 if the batch is full or its oldest record reached the latency cap
+ */
+uint8_t batch_ready(const telemetry_batch_t* b, uint32_t now) {
+    if(b->samples == 0) {
+        return 0;
+    }
+
+    if(b->samples >= b->batch_size) {
+        return 1;
+    }
+
+    return (now - b->first_sample_time) >= b->max_latency_ms;
+}
+
+/**
+ * @brief time left before the oldest record reaches the latency cap
+ * use this as the queue receive timeout while the batch is not empty
+ * @return time in ms, 0 if the batch is already due
+ */
+uint32_t batch_time_to_deadline(const telemetry_batch_t* b, uint32_t now) {
+    uint32_t waited = now - b->first_sample_time;
+
+    if(b->samples == 0) {
+        return b->max_latency_ms;
+    }
+
+    return waited >= b->max_latency_ms ? 0 : b->max_latency_ms - waited;
+}
+
+/**
+ * @brief feed back the result of publishing the batch, then clear it
+ * @param success 1 if the publish succeeded
+ * @param duration_ms how long the publish call took
+ */
+void batch_report_publish(telemetry_batch_t* b, uint8_t success, uint32_t duration_ms) {
+    uint8_t congested = !success || duration_ms > b->congestion_time_ms;
+
+    if(success) {
+        b->published_batches++;
+        b->published_samples += b->samples;
+    } else {
+        b->failed_batches++;
+    }
+
+    if(b->adaptive) {
+        if(congested) {
+            // fewer, larger publishes amortize the per message overhead
+            uint32_t grown = (uint32_t) b->batch_size * 2;
+            b->batch_size = grown > b->max_batch_size ? b->max_batch_size : grown;
+        } else if(b->batch_size > b->min_batch_size) {
+            b->batch_size--;
+        }
+    }
+
+    batch_clear(b);
+}
+
+/**
+ * @brief drop all records in the batch
+ */
+void batch_clear(telemetry_batch_t* b) {
+    b->length = 0;
+    b->samples = 0;
+    b->first_sample_time = 0;
+}
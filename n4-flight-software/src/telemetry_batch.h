@@ -0,0 +1,44 @@
+/**
+ * @file telemetry_batch.h
+ * @brief Aggregates several telemetry records into one MQTT publish
+ *
+ * A batch is flushed when it holds batch_size records, when the oldest record
+ * has waited max_latency_ms, or when the next record would not fit.
+ * In adaptive mode the batch size doubles when a publish fails or is slow (congested link)
+ * and shrinks by one record when publishes complete quickly
+ */
+
+#ifndef TELEMETRY_BATCH_H
+#define TELEMETRY_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TELEMETRY_BATCH_PAYLOAD_SIZE 1024       /*!< max size of one batched payload in bytes */
+
+typedef struct {
+    char payload[TELEMETRY_BATCH_PAYLOAD_SIZE];
+    size_t length;                  /*!< bytes currently in payload */
+    uint16_t samples;               /*!< records currently in payload */
+    uint32_t first_sample_time;     /*!< time in ms the oldest record in the payload was added */
+
+    uint16_t batch_size;            /*!< current flush threshold in records */
+    uint16_t min_batch_size;        /*!< lower bound for adaptive mode, also the configured size */
+    uint16_t max_batch_size;        /*!< upper bound for adaptive mode */
+    uint32_t max_latency_ms;        /*!< latency cap - no record waits longer than this */
+    uint32_t congestion_time_ms;    /*!< a publish slower than this counts as congestion */
+    uint8_t adaptive;               /*!< 1 to adapt batch_size to the link */
+
+    uint32_t published_batches;     /*!< number of successful publishes */
+    uint32_t published_samples;     /*!< number of records delivered in successful publishes */
+    uint32_t failed_batches;        /*!< number of publishes that failed or were only queued */
+} telemetry_batch_t;
+
+void batch_init(telemetry_batch_t* b, uint16_t batch_size, uint16_t max_batch_size, uint32_t max_latency_ms, uint32_t congestion_time_ms, uint8_t adaptive);
+uint8_t batch_append(telemetry_batch_t* b, const char* record, size_t length, uint32_t now);
+uint8_t batch_ready(const telemetry_batch_t* b, uint32_t now);
+uint32_t batch_time_to_deadline(const telemetry_batch_t* b, uint32_t now);
+void batch_report_publish(telemetry_batch_t* b, uint8_t success, uint32_t duration_ms);
+void batch_clear(telemetry_batch_t* b);
+
+#endif
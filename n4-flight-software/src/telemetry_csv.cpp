@@ -0,0 +1,264 @@
+/**
+ * @file telemetry_csv.cpp
+ * @brief Implements fixed precision formatting of telemetry packets into CSV rows
+ *
+ * A binary floating point value is m * 2^e. Multiplying by 10^decimals and
+ * shifting by e gives the scaled integer and the discarded remainder, which is
+ * all that is needed to round exactly the way printf does.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "telemetry_csv.h"
+
+static const uint64_t DECIMAL_SCALE = 100;     /* 10^TELEMETRY_CSV_DECIMALS */
+
+/**
+ * @brief write the decimal digits of value at p
+ * @return pointer one past the last digit written or NULL if there is no room
+ */
+static char* append_digits(char* p, const char* end, uint64_t value, uint8_t min_digits) {
+    char digits[20];
+    uint8_t n = 0;
+
+    do {
+        digits[n++] = '0' + (value % 10);
+        value /= 10;
+    } while(value != 0 || n < min_digits);
+
+    if(p == NULL || end - p < n) {
+        return NULL;
+    }
+
+    while(n > 0) {
+        *p++ = digits[--n];
+    }
+
+    return p;
+}
+
+static char* append_text(char* p, const char* end, const char* text) {
+    size_t n = strlen(text);
+    if(p == NULL || (size_t)(end - p) < n) {
+        return NULL;
+    }
+    memcpy(p, text, n);
+    return p + n;
+}
+
+/**
+ * @brief write a value given as sign, integer mantissa and binary exponent
+ * @param mantissa_bits number of significant bits in the mantissa, used to detect overflow
+ */
+static char* append_fixed(char* p, const char* end, bool negative, uint64_t mantissa, int exponent, uint8_t mantissa_bits) {
+    uint64_t scaled;
+
+    if(exponent >= 0) {
+        // 7 bits for the x100 scaling, stay within 63 bits
+        if(mantissa_bits + 7 + exponent > 63) {
+            return NULL;
+        }
+        scaled = (mantissa * DECIMAL_SCALE) << exponent;
+    } else {
+        uint64_t product = mantissa * DECIMAL_SCALE;
+        int shift = -exponent;
+
+        if(shift >= 63) {
+            // |value| * 100 < 0.5, rounds to zero
+            scaled = 0;
+        } else {
+            uint64_t remainder = product & ((1ULL << shift) - 1);
+            uint64_t half = 1ULL << (shift - 1);
+            scaled = product >> shift;
+
+            // round half to even, same as printf
+            if(remainder > half || (remainder == half && (scaled & 1))) {
+                scaled++;
+            }
+        }
+    }
+
+    if(negative) {
+        if(p == NULL || p >= end) {
+            return NULL;
+        }
+        *p++ = '-';
+    }
+
+    p = append_digits(p, end, scaled / DECIMAL_SCALE, 1);
+    if(p == NULL || p >= end) {
+        return NULL;
+    }
+    *p++ = '.';
+
+    return append_digits(p, end, scaled % DECIMAL_SCALE, TELEMETRY_CSV_DECIMALS);
+}
+
+/**
+ * @brief fallback for magnitudes the integer path cannot represent (|value| > ~2^56)
+ */
+static char* append_printf(char* p, const char* end, double value) {
+    if(p == NULL) {
+        return NULL;
+    }
+
+    size_t room = end - p;
+    int n = snprintf(p, room + 1, "%.2f", value);
+    if(n < 0 || (size_t)n > room) {
+        return NULL;
+    }
+
+    return p + n;
+}
+
+/**
+ * @brief append an unsigned integer
+ * @return pointer past the written characters, NULL if the buffer is too small
+ */
+char* csv_append_uint(char* p, const char* end, uint32_t value) {
+    return append_digits(p, end, value, 1);
+}
+
+/**
+ * @brief append a signed integer
+ * @return pointer past the written characters, NULL if the buffer is too small
+ */
+char* csv_append_int(char* p, const char* end, int32_t value) {
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t) value : (uint32_t) value;
+
+    if(value < 0) {
+        p = append_text(p, end, "-");
+    }
+
+    return append_digits(p, end, magnitude, 1);
+}
+
+/**
+ * @brief append a float with TELEMETRY_CSV_DECIMALS decimals
+ * @return pointer past the written characters, NULL if the buffer is too small
+ */
+char* csv_append_float(char* p, const char* end, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    bool negative = bits >> 31;
+    int biased_exponent = (bits >> 23) & 0xFF;
+    uint64_t mantissa = bits & 0x7FFFFF;
+
+    if(biased_exponent == 0xFF) {
+        p = negative ? append_text(p, end, "-") : p;
+        return append_text(p, end, mantissa ? "nan" : "inf");
+    }
+
+    if(biased_exponent == 0) {
+        biased_exponent = 1;                // subnormal
+    } else {
+        mantissa |= (1UL << 23);
+    }
+
+    char* r = append_fixed(p, end, negative, mantissa, biased_exponent - 127 - 23, 24);
+    return r != NULL ? r : append_printf(p, end, value);
+}
+
+/**
+ * @brief append a double with TELEMETRY_CSV_DECIMALS decimals
+ * @return pointer past the written characters, NULL if the buffer is too small
+ */
+char* csv_append_double(char* p, const char* end, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    bool negative = bits >> 63;
+    int biased_exponent = (bits >> 52) & 0x7FF;
+    uint64_t mantissa = bits & 0xFFFFFFFFFFFFFULL;
+
+    if(biased_exponent == 0x7FF) {
+        p = negative ? append_text(p, end, "-") : p;
+        return append_text(p, end, mantissa ? "nan" : "inf");
+    }
+
+    if(biased_exponent == 0) {
+        biased_exponent = 1;                // subnormal
+    } else {
+        mantissa |= (1ULL << 52);
+    }
+
+    char* r = append_fixed(p, end, negative, mantissa, biased_exponent - 1023 - 52, 53);
+    return r != NULL ? r : append_printf(p, end, value);
+}
+
+/**
+ * @brief append a single character, usually a separator
+ * @return pointer past the written character, NULL if the buffer is too small
+ */
+char* csv_append_char(char* p, const char* end, char c) {
+    if(p == NULL || p >= end) {
+        return NULL;
+    }
+    *p++ = c;
+    return p;
+}
+
+/**
+ * @brief format a telemetry packet as one CSV row terminated by '\n'
+ *
+ * record number, operation_mode, state, ax, ay, az, pitch, roll, gx, gy,
+ * latitude, longitude, gps_altitude, pressure, temperature, altitude_agl, velocity
+ *
+ * @param buffer caller provided output buffer
+ * @param size size of buffer in bytes, TELEMETRY_CSV_ROW_LENGTH is always enough
+ * @param packet packet to format
+ * @return number of characters written excluding the terminating NUL, 0 if the row did not fit
+ */
+size_t telemetry_to_csv(char* buffer, size_t size, const telemetry_type_t* packet) {
+    if(buffer == NULL || size == 0) {
+        return 0;
+    }
+
+    // keep one byte for the terminating NUL
+    const char* end = buffer + size - 1;
+    char* p = buffer;
+
+    p = csv_append_uint(p, end, packet->record_number);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_uint(p, end, packet->operation_mode);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_uint(p, end, packet->state);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_float(p, end, packet->acc_data.ax);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_float(p, end, packet->acc_data.ay);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_float(p, end, packet->acc_data.az);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_float(p, end, packet->acc_data.pitch);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_float(p, end, packet->acc_data.roll);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_double(p, end, packet->gyro_data.gx);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_double(p, end, packet->gyro_data.gy);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_double(p, end, packet->gps_data.latitude);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_double(p, end, packet->gps_data.longitude);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_uint(p, end, packet->gps_data.gps_altitude);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_double(p, end, packet->alt_data.pressure);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_double(p, end, packet->alt_data.temperature);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_double(p, end, packet->alt_data.AGL);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_double(p, end, packet->alt_data.velocity);
+    p = csv_append_char(p, end, '\n');
+
+    if(p == NULL) {
+        buffer[0] = '\0';
+        return 0;
+    }
+
+    *p = '\0';
+    return p - buffer;
+}
@@ -0,0 +1,29 @@
+/**
+ * @file telemetry_csv.h
+ * @brief Fixed precision text formatting of telemetry packets
+ *
+ * Replaces the sprintf("%.2f") calls on the debug, MQTT and logger paths.
+ * Values are converted using integer arithmetic on the raw float/double bits, so
+ * there is no locale handling, no varargs double promotion and the output matches
+ * printf("%.2f") digit for digit (including round-half-even on exact ties)
+ */
+
+#ifndef TELEMETRY_CSV_H
+#define TELEMETRY_CSV_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "data_types.h"
+
+#define TELEMETRY_CSV_DECIMALS     2        /*!< number of decimal places written for real valued fields */
+#define TELEMETRY_CSV_ROW_LENGTH   256      /*!< buffer size that is always large enough for one telemetry row */
+
+char* csv_append_char(char* p, const char* end, char c);
+char* csv_append_uint(char* p, const char* end, uint32_t value);
+char* csv_append_int(char* p, const char* end, int32_t value);
+char* csv_append_float(char* p, const char* end, float value);
+char* csv_append_double(char* p, const char* end, double value);
+
+size_t telemetry_to_csv(char* buffer, size_t size, const telemetry_type_t* packet);
+
+#endif
@@ -0,0 +1,320 @@
+/**
+ * @file telemetry_scheduler.cpp
+ * @brief implements the link aware telemetry scheduler
+ */
+
+#include <string.h>
+#include "telemetry_scheduler.h"
+#include "telemetry_csv.h"
+
+#define CHANNEL_FIELDS_LENGTH   96          /* largest encoded channel */
+#define FRAME_HEADER_LENGTH     16          /* "F,<time>,<mask>" upper bound */
+
+/**
+ * @brief initialize the scheduler. All channels start at priority 0 with a 1 s interval,
+ * configure them with scheduler_set_channel()
+ * @param frame_interval_ms time between frames
+ * @param initial_link_rate starting link throughput estimate in bytes/s
+ * @param min_link_rate lower bound of the estimate in bytes/s
+ * @param max_link_rate upper bound of the estimate in bytes/s
+ */
+void scheduler_init(telemetry_scheduler_t* s, uint32_t frame_interval_ms, float initial_link_rate, float min_link_rate, float max_link_rate) {
+    memset(s, 0, sizeof(telemetry_scheduler_t));
+
+    for(uint8_t i = 0; i < NUM_TELEMETRY_CHANNELS; i++) {
+        s->channels[i].interval_ms = 1000;
+        s->order[i] = i;
+    }
+
+    s->frame_interval_ms = frame_interval_ms;
+    s->min_link_rate = min_link_rate;
+    s->max_link_rate = max_link_rate;
+    s->link_rate = initial_link_rate;
+}
+
+/**
+ * @brief set priority and target rate of a channel
+ * @param priority 0 is the most important
+ * @param interval_ms target send period
+ */
+void scheduler_set_channel(telemetry_scheduler_t* s, TELEMETRY_CHANNEL channel, uint8_t priority, uint32_t interval_ms) {
+    s->channels[channel].priority = priority;
+    s->channels[channel].interval_ms = interval_ms;
+
+    // keep order sorted by priority, channel index breaks ties
+    for(uint8_t i = 0; i < NUM_TELEMETRY_CHANNELS; i++) {
+        s->order[i] = i;
+    }
+
+    for(uint8_t i = 1; i < NUM_TELEMETRY_CHANNELS; i++) {
+        uint8_t c = s->order[i];
+        int8_t j = i - 1;
+        while(j >= 0 && s->channels[s->order[j]].priority > s->channels[c].priority) {
+            s->order[j + 1] = s->order[j];
+            j--;
+        }
+        s->order[j + 1] = c;
+    }
+}
+
+static void mark_fresh(telemetry_scheduler_t* s, TELEMETRY_CHANNEL channel, uint32_t now) {
+    s->channels[channel].last_update = now;
+    s->channels[channel].has_data = 1;
+    s->channels[channel].pending = 1;
+}
+
+/**
+ * @brief take the valid sensor groups of a packet, see telemetry_type_t::data_flags
+ * Only groups with a new sample, see telemetry_type_t::fresh_flags, mark their channels fresh
+ */
+void scheduler_update(telemetry_scheduler_t* s, const telemetry_type_t* packet, uint32_t now) {
+    if(packet->data_flags & ALTIMETER_DATA_FLAG) {
+        s->latest.alt_data = packet->alt_data;
+        if(packet->fresh_flags & ALTIMETER_DATA_FLAG) {
+            mark_fresh(s, CHANNEL_ALTITUDE, now);
+            mark_fresh(s, CHANNEL_VELOCITY, now);
+        }
+    }
+
+    if(packet->data_flags & ACCEL_DATA_FLAG) {
+        s->latest.acc_data = packet->acc_data;
+        if(packet->fresh_flags & ACCEL_DATA_FLAG) {
+            mark_fresh(s, CHANNEL_ATTITUDE, now);
+        }
+    }
+
+    if(packet->data_flags & GYRO_DATA_FLAG) {
+        s->latest.gyro_data = packet->gyro_data;
+    }
+
+    if(packet->data_flags & GPS_DATA_FLAG) {
+        s->latest.gps_data = packet->gps_data;
+        if(packet->fresh_flags & GPS_DATA_FLAG) {
+            mark_fresh(s, CHANNEL_GPS, now);
+        }
+    }
+
+    s->latest.record_number = packet->record_number;
+}
+
+/**
+ * @brief update the flight state channel
+ */
+void scheduler_update_state(telemetry_scheduler_t* s, uint8_t state, uint8_t operation_mode, uint32_t now) {
+    // a state change is sent in the next frame regardless of the channel rate
+    if(s->channels[CHANNEL_STATE].has_data && s->latest.state != state) {
+        s->channels[CHANNEL_STATE].last_sent = now - s->channels[CHANNEL_STATE].interval_ms;
+    }
+
+    s->latest.state = state;
+    s->latest.operation_mode = operation_mode;
+    mark_fresh(s, CHANNEL_STATE, now);
+}
+
+/**
+ * @brief update the health channel
+ * @param health caller defined health word
+ */
+void scheduler_update_health(telemetry_scheduler_t* s, uint32_t health, uint32_t now) {
+    s->health = health;
+    mark_fresh(s, CHANNEL_HEALTH, now);
+}
+
+/**
+ * @brief bytes the link carries in one frame interval at the estimated rate
+ */
+uint32_t scheduler_frame_budget(const telemetry_scheduler_t* s) {
+    return (uint32_t) (s->link_rate * s->frame_interval_ms / 1000.0f);
+}
+
+/**
+ * @brief encode the fields of one channel
+ * @return pointer past the written fields, NULL if they do not fit
+ */
+static char* encode_channel(const telemetry_scheduler_t* s, uint8_t channel, char* p, const char* end) {
+    const telemetry_type_t* t = &s->latest;
+
+    switch (channel) {
+        case CHANNEL_STATE:
+            p = csv_append_uint(p, end, t->state);
+            p = csv_append_char(p, end, ',');
+            p = csv_append_uint(p, end, t->operation_mode);
+            break;
+
+        case CHANNEL_ALTITUDE:
+            p = csv_append_double(p, end, t->alt_data.altitude);
+            p = csv_append_char(p, end, ',');
+            p = csv_append_double(p, end, t->alt_data.AGL);
+            p = csv_append_char(p, end, ',');
+            p = csv_append_double(p, end, t->alt_data.pressure);
+            break;
+
+        case CHANNEL_VELOCITY:
+            p = csv_append_double(p, end, t->alt_data.velocity);
+            break;
+
+        case CHANNEL_GPS:
+            // micro degrees keep the GPS resolution the 2 decimal format would lose
+            p = csv_append_int(p, end, (int32_t) (t->gps_data.latitude * 1e6));
+            p = csv_append_char(p, end, ',');
+            p = csv_append_int(p, end, (int32_t) (t->gps_data.longitude * 1e6));
+            p = csv_append_char(p, end, ',');
+            p = csv_append_uint(p, end, t->gps_data.gps_altitude);
+            break;
+
+        case CHANNEL_ATTITUDE:
+            p = csv_append_float(p, end, t->acc_data.ax);
+            p = csv_append_char(p, end, ',');
+            p = csv_append_float(p, end, t->acc_data.ay);
+            p = csv_append_char(p, end, ',');
+            p = csv_append_float(p, end, t->acc_data.az);
+            p = csv_append_char(p, end, ',');
+            p = csv_append_float(p, end, t->acc_data.pitch);
+            p = csv_append_char(p, end, ',');
+            p = csv_append_float(p, end, t->acc_data.roll);
+            break;
+
+        case CHANNEL_HEALTH:
+            p = csv_append_uint(p, end, s->health);
+            p = csv_append_char(p, end, ',');
+            p = csv_append_double(p, end, t->alt_data.temperature);
+            break;
+
+        default:
+            return NULL;
+    }
+
+    return p;
+}
+
+/**
+ * @brief build the next frame
+ * @param buffer output buffer, TELEMETRY_FRAME_LENGTH is enough for every channel
+ * @param size size of buffer in bytes
+ * @param now current time in ms
+ * @return length of the frame excluding the terminating NUL, 0 if there is nothing to send
+ */
+size_t scheduler_build_frame(telemetry_scheduler_t* s, char* buffer, size_t size, uint32_t now) {
+    char fields[NUM_TELEMETRY_CHANNELS][CHANNEL_FIELDS_LENGTH];
+    uint8_t lengths[NUM_TELEMETRY_CHANNELS];
+    uint8_t selected = 0;
+
+    if(buffer == NULL || size <= FRAME_HEADER_LENGTH) {
+        return 0;
+    }
+
+    // budget left unused by earlier frames carries over, so large channels get through on a slow link
+    s->credit += scheduler_frame_budget(s);
+    if(s->credit > size - 1) {
+        s->credit = size - 1;
+    }
+    uint32_t budget = (uint32_t) s->credit;
+
+    for(uint8_t c = 0; c < NUM_TELEMETRY_CHANNELS; c++) {
+        char* end = encode_channel(s, c, fields[c], fields[c] + CHANNEL_FIELDS_LENGTH);
+        lengths[c] = end == NULL ? 0 : end - fields[c];
+    }
+
+    uint32_t used = FRAME_HEADER_LENGTH + 1;
+
+    // first pass: channels due at their target rate, in priority order
+    for(uint8_t i = 0; i < NUM_TELEMETRY_CHANNELS; i++) {
+        uint8_t c = s->order[i];
+        telemetry_channel_t* ch = &s->channels[c];
+
+        if(!ch->pending || lengths[c] == 0 || (now - ch->last_sent) < ch->interval_ms) {
+            continue;
+        }
+
+        // the most important due channel always goes out, even over budget
+        if(used + lengths[c] + 1 <= budget || (selected == 0 && used + lengths[c] + 1 <= size - 1)) {
+            selected |= (1 << c);
+            used += lengths[c] + 1;
+        }
+    }
+
+    // second pass: spend the remaining budget on fresh data of the other channels
+    for(uint8_t i = 0; i < NUM_TELEMETRY_CHANNELS; i++) {
+        uint8_t c = s->order[i];
+        telemetry_channel_t* ch = &s->channels[c];
+
+        if(selected & (1 << c) || !ch->pending || lengths[c] == 0) {
+            continue;
+        }
+
+        if(used + lengths[c] + 1 <= budget) {
+            selected |= (1 << c);
+            used += lengths[c] + 1;
+        }
+    }
+
+    if(selected == 0) {
+        return 0;
+    }
+
+    const char* end = buffer + size - 1;
+    char* p = buffer;
+
+    p = csv_append_char(p, end, 'F');
+    p = csv_append_char(p, end, ',');
+    p = csv_append_uint(p, end, now);
+    p = csv_append_char(p, end, ',');
+    p = csv_append_uint(p, end, selected);
+
+    for(uint8_t c = 0; c < NUM_TELEMETRY_CHANNELS; c++) {
+        if(!(selected & (1 << c))) {
+            continue;
+        }
+
+        p = csv_append_char(p, end, ',');
+        if(p == NULL || (size_t)(end - p) < lengths[c]) {
+            return 0;
+        }
+        memcpy(p, fields[c], lengths[c]);
+        p += lengths[c];
+
+        s->channels[c].last_sent = now;
+        s->channels[c].pending = 0;
+    }
+
+    p = csv_append_char(p, end, '\n');
+    if(p == NULL) {
+        return 0;
+    }
+
+    *p = '\0';
+
+    s->credit -= p - buffer;
+    if(s->credit < 0) {
+        s->credit = 0;
+    }
+
+    return p - buffer;
+}
+
+/**
+ * @brief feed back the result of sending data over the link
+ * The estimate grows slowly while the link keeps up and backs off on congestion or failure
+ * @param bytes bytes sent
+ * @param duration_ms time the send took
+ * @param success 1 if the data was accepted by the link
+ * @param congested 1 if the send was slower than expected or the link only queued the data
+ */
+void scheduler_report_link(telemetry_scheduler_t* s, size_t bytes, uint32_t duration_ms, uint8_t success, uint8_t congested) {
+    if(!success) {
+        s->link_rate *= 0.5f;
+    } else if(congested) {
+        float measured = bytes * 1000.0f / (duration_ms > 0 ? duration_ms : 1);
+        if(measured < s->link_rate) {
+            s->link_rate = 0.7f * s->link_rate + 0.3f * measured;
+        }
+    } else {
+        s->link_rate *= 1.05f;
+    }
+
+    if(s->link_rate < s->min_link_rate) {
+        s->link_rate = s->min_link_rate;
+    } else if(s->link_rate > s->max_link_rate) {
+        s->link_rate = s->max_link_rate;
+    }
+}
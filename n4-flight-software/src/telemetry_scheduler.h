@@ -0,0 +1,75 @@
+/**
+ * @file telemetry_scheduler.h
+ * @brief Link aware telemetry decimation and priority scheduling
+ *
+ * The sensor tasks produce data far faster than the radio link can carry. Instead of
+ * forwarding every packet, the scheduler keeps the latest value of each telemetry channel
+ * and, once per frame interval, builds a frame that fits the measured link budget.
+ * Channels that are due at their target rate go first in priority order, the remaining
+ * budget carries the freshest data of the other channels.
+ *
+ * Frame format (one text line):
+ * F,<time ms>,<channel mask>[,<channel fields>...]\n
+ * channel fields appear in channel order for every bit set in the mask:
+ * STATE     state,operation_mode
+ * ALTITUDE  altitude,AGL,pressure
+ * VELOCITY  velocity
+ * GPS       latitude x1e6,longitude x1e6,gps_altitude
+ * ATTITUDE  ax,ay,az,pitch,roll
+ * HEALTH    health word,temperature
+ */
+
+#ifndef TELEMETRY_SCHEDULER_H
+#define TELEMETRY_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "data_types.h"
+
+typedef enum {
+    CHANNEL_STATE = 0,
+    CHANNEL_ALTITUDE,
+    CHANNEL_VELOCITY,
+    CHANNEL_GPS,
+    CHANNEL_ATTITUDE,
+    CHANNEL_HEALTH,
+    NUM_TELEMETRY_CHANNELS
+} TELEMETRY_CHANNEL;
+
+#define TELEMETRY_FRAME_LENGTH  192         /*!< largest frame the scheduler builds */
+
+/**
+ * Scheduling parameters and bookkeeping of one telemetry channel
+ */
+typedef struct {
+    uint8_t priority;               /*!< 0 is the most important */
+    uint32_t interval_ms;           /*!< target send period */
+    uint32_t last_sent;             /*!< time in ms this channel was last sent */
+    uint32_t last_update;           /*!< time in ms fresh data last arrived */
+    uint8_t has_data;               /*!< 1 once the channel received any data */
+    uint8_t pending;                /*!< 1 if fresh data has not been sent yet */
+} telemetry_channel_t;
+
+typedef struct {
+    telemetry_channel_t channels[NUM_TELEMETRY_CHANNELS];
+    uint8_t order[NUM_TELEMETRY_CHANNELS];      /*!< channel indices sorted by priority */
+    telemetry_type_t latest;                    /*!< latest value of every field */
+    uint32_t health;                            /*!< caller defined health word e.g. the subsystem init mask */
+
+    uint32_t frame_interval_ms;                 /*!< time between frames */
+    float link_rate;                            /*!< estimated link throughput in bytes/s */
+    float credit;                               /*!< unused byte budget carried over from earlier frames */
+    float min_link_rate;                        /*!< the estimate never drops below this */
+    float max_link_rate;                        /*!< the estimate never rises above this */
+} telemetry_scheduler_t;
+
+void scheduler_init(telemetry_scheduler_t* s, uint32_t frame_interval_ms, float initial_link_rate, float min_link_rate, float max_link_rate);
+void scheduler_set_channel(telemetry_scheduler_t* s, TELEMETRY_CHANNEL channel, uint8_t priority, uint32_t interval_ms);
+void scheduler_update(telemetry_scheduler_t* s, const telemetry_type_t* packet, uint32_t now);
+void scheduler_update_state(telemetry_scheduler_t* s, uint8_t state, uint8_t operation_mode, uint32_t now);
+void scheduler_update_health(telemetry_scheduler_t* s, uint32_t health, uint32_t now);
+uint32_t scheduler_frame_budget(const telemetry_scheduler_t* s);
+size_t scheduler_build_frame(telemetry_scheduler_t* s, char* buffer, size_t size, uint32_t now);
+void scheduler_report_link(telemetry_scheduler_t* s, size_t bytes, uint32_t duration_ms, uint8_t success, uint8_t congested);
+
+#endif
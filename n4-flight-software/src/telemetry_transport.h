@@ -0,0 +1,58 @@
+/**
+ * @file telemetry_transport.h
+ * @brief Common interface of the links used to send telemetry to ground
+ *
+ * The telemetry task only talks to this interface, so MQTT over WiFi and the XBee radio
+ * can be enabled together (see MQTT and XBEE in defs.h)
+ */
+
+#ifndef TELEMETRY_TRANSPORT_H
+#define TELEMETRY_TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Result of TelemetryTransport::send()
+ */
+typedef enum {
+    TELEMETRY_SENT = 0,         /*!< handed to the link */
+    TELEMETRY_QUEUED,           /*!< kept by the transport until the link can take it, e.g. while reconnecting */
+    TELEMETRY_REFUSED           /*!< not taken, the link is down or busy and the message is lost */
+} TELEMETRY_SEND_STATUS;
+
+class TelemetryTransport {
+    public:
+        virtual ~TelemetryTransport() {}
+
+        /**
+         * @brief initialize the link hardware
+         * @return true on success
+         */
+        virtual bool begin() = 0;
+
+        /**
+         * @brief service the link - receive status, reconnect etc. Call often from the telemetry task
+         */
+        virtual void poll() = 0;
+
+        /**
+         * @brief check whether the link can take a message now
+         */
+        virtual bool ready() = 0;
+
+        /**
+         * @brief queue one message for transmission
+         * @param payload message bytes
+         * @param length message length in bytes
+         * @return a TELEMETRY_SEND_STATUS
+         */
+        virtual uint8_t send(const uint8_t* payload, size_t length) = 0;
+
+        /**
+         * @brief short name for logs
+         */
+        virtual const char* name() = 0;
+};
+
+#endif
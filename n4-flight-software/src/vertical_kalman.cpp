@@ -0,0 +1,99 @@
+/**
+ * @file vertical_kalman.cpp
+ * @brief implements the altitude and vertical velocity Kalman filter
+ */
+
+#include "vertical_kalman.h"
+
+/**
+ * @brief reset the filter, the first measurement sets the altitude
+ * @param altitude_sigma barometer noise standard deviation in m
+ * @param accel_sigma process noise standard deviation in m/s^2
+ * @param gate innovation gate in standard deviations, rejects baro spikes. 0 disables it
+ */
+void vkf_init(vertical_kalman_t* kf, float altitude_sigma, float accel_sigma, float gate) {
+    kf->altitude = 0;
+    kf->velocity = 0;
+    kf->p[0][0] = altitude_sigma * altitude_sigma;
+    kf->p[0][1] = 0;
+    kf->p[1][0] = 0;
+    kf->p[1][1] = 1.0f;
+    kf->altitude_variance = altitude_sigma * altitude_sigma;
+    kf->accel_variance = accel_sigma * accel_sigma;
+    kf->gate = gate;
+    kf->rejected = 0;
+    kf->consecutive_rejections = 0;
+    kf->initialized = 0;
+}
+
+/**
+ * @brief propagate the estimate
+ * @param accel measured vertical acceleration in m/s^2 with gravity removed, 0 if unknown
+ * @param dt time since the last prediction in s
+ */
+void vkf_predict(vertical_kalman_t* kf, float accel, float dt) {
+    float dt2 = dt * dt;
+
+    kf->altitude += kf->velocity * dt + 0.5f * accel * dt2;
+    kf->velocity += accel * dt;
+
+    // P = F P F' + Q, F = [1 dt; 0 1], Q = G G' accel_variance, G = [dt^2/2; dt]
+    float p00 = kf->p[0][0] + dt * (kf->p[1][0] + kf->p[0][1]) + dt2 * kf->p[1][1];
+    float p01 = kf->p[0][1] + dt * kf->p[1][1];
+    float p11 = kf->p[1][1];
+
+    kf->p[0][0] = p00 + 0.25f * dt2 * dt2 * kf->accel_variance;
+    kf->p[0][1] = p01 + 0.5f * dt2 * dt * kf->accel_variance;
+    kf->p[1][0] = kf->p[0][1];
+    kf->p[1][1] = p11 + dt2 * kf->accel_variance;
+}
+
+/**
+ * @brief correct the estimate with a barometric altitude
+ * @return 1 if the measurement was used, 0 if the gate rejected it
+ */
+uint8_t vkf_correct(vertical_kalman_t* kf, float altitude) {
+    if(!kf->initialized) {
+        kf->altitude = altitude;
+        kf->initialized = 1;
+        return 1;
+    }
+
+    float innovation = altitude - kf->altitude;
+    float s = kf->p[0][0] + kf->altitude_variance;
+
+    // a spike is a single sample, a real manoeuvre the model missed persists and is accepted
+    if(kf->gate > 0 && innovation * innovation > kf->gate * kf->gate * s
+        && kf->consecutive_rejections < VKF_MAX_REJECTIONS) {
+        kf->rejected++;
+        kf->consecutive_rejections++;
+        return 0;
+    }
+    kf->consecutive_rejections = 0;
+    float k0 = kf->p[0][0] / s;
+    float k1 = kf->p[1][0] / s;
+
+    kf->altitude += k0 * innovation;
+    kf->velocity += k1 * innovation;
+
+    // P = (I - K H) P, H = [1 0]
+    float p00 = kf->p[0][0];
+    float p01 = kf->p[0][1];
+    kf->p[0][0] = (1 - k0) * p00;
+    kf->p[0][1] = (1 - k0) * p01;
+    kf->p[1][0] = kf->p[0][1];
+    kf->p[1][1] -= k1 * p01;
+
+    return 1;
+}
+
+/**
+ * @brief predict over dt then correct with the new altitude
+ * @return 1 if the measurement was used, 0 if the gate rejected it
+ */
+uint8_t vkf_update(vertical_kalman_t* kf, float altitude, float accel, float dt) {
+    if(kf->initialized) {
+        vkf_predict(kf, accel, dt);
+    }
+    return vkf_correct(kf, altitude);
+}
@@ -0,0 +1,34 @@
+/**
+ * @file vertical_kalman.h
+ * @brief Two state (altitude, vertical velocity) Kalman filter fed by the barometer
+ *
+ * Constant velocity model driven by an optional measured vertical acceleration.
+ * Unmodelled acceleration (drag, thrust when no IMU input is given) is treated as
+ * white process noise with standard deviation accel_sigma
+ */
+
+#ifndef VERTICAL_KALMAN_H
+#define VERTICAL_KALMAN_H
+
+#include <stdint.h>
+
+#define VKF_MAX_REJECTIONS      2           /*!< consecutive gated samples after which the measurement is trusted again */
+
+typedef struct {
+    float altitude;             /*!< estimated altitude in m */
+    float velocity;             /*!< estimated vertical velocity in m/s, positive up */
+    float p[2][2];              /*!< estimate covariance */
+    float altitude_variance;    /*!< barometer measurement variance in m^2 */
+    float accel_variance;       /*!< process noise variance in (m/s^2)^2 */
+    float gate;                 /*!< measurements further than this many sigma from the prediction are rejected, 0 to accept all */
+    uint32_t rejected;          /*!< measurements rejected by the gate */
+    uint8_t consecutive_rejections;
+    uint8_t initialized;        /*!< 0 until the first measurement */
+} vertical_kalman_t;
+
+void vkf_init(vertical_kalman_t* kf, float altitude_sigma, float accel_sigma, float gate);
+void vkf_predict(vertical_kalman_t* kf, float accel, float dt);
+uint8_t vkf_correct(vertical_kalman_t* kf, float altitude);
+uint8_t vkf_update(vertical_kalman_t* kf, float altitude, float accel, float dt);
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ * @file wire_bus.cpp
+ * @brief implements the bus manager hardware on the Wire driver
+ */
+
+#include <Wire.h>
+#include "wire_bus.h"
+
+/**
+ * @brief class constructor
+ * @param sda SDA pin
+ * @param scl SCL pin
+ * @param clock SCL frequency in Hz
+ * @param timeout time in ms after which a transfer is abandoned
+ */
+WireBus::WireBus(int sda, int scl, uint32_t clock, uint16_t timeout) {
+    this->_sda = sda;
+    this->_scl = scl;
+    this->_clock = clock;
+    this->_timeout = timeout;
+}
+
+/**
+ * @brief start the I2C controller
+ * @return true on success
+ */
+bool WireBus::begin() {
+    bool started = Wire.begin(this->_sda, this->_scl, this->_clock);
+    Wire.setTimeOut(this->_timeout);
+
+    return started;
+}
+
+/**
+ * @brief write the register bytes, then read after a repeated start if the transaction reads
+ * @return I2C_DONE, I2C_NACK or I2C_BUS_ERROR
+ */
+uint8_t WireBus::transfer(i2c_txn_t* txn) {
+    Wire.beginTransmission(txn->address);
+    Wire.write(txn->tx, txn->tx_len);
+
+    // 2 and 3 are a NACK on the address and on the data
+    uint8_t error = Wire.endTransmission(txn->rx_len == 0);
+    if(error != 0) {
+        return (error == 2 || error == 3) ? I2C_NACK : I2C_BUS_ERROR;
+    }
+
+    if(txn->rx_len == 0) {
+        return I2C_DONE;
+    }
+
+    if(Wire.requestFrom(txn->address, txn->rx_len) != txn->rx_len) {
+        return I2C_BUS_ERROR;
+    }
+
+    for(uint8_t i = 0; i < txn->rx_len; i++) {
+        txn->rx[i] = Wire.read();
+    }
+
+    return I2C_DONE;
+}
+
+/**
+ * @brief SDA reads low between transfers only if a device is holding it
+ */
+bool WireBus::sdaStuck() {
+    return digitalRead(this->_sda) == LOW;
+}
+
+/**
+ * @brief free an I2C bus held low by a device and restart the Wire driver
+ * A device stopped in the middle of a byte holds SDA low until it has clocked out its
+ * bits. Up to nine SCL pulses let it finish, a STOP then releases the bus
+ */
+void WireBus::recover() {
+    Wire.end();
+
+    pinMode(this->_sda, INPUT_PULLUP);
+    pinMode(this->_scl, OUTPUT_OPEN_DRAIN);
+    digitalWrite(this->_scl, HIGH);
+
+    for(uint8_t i = 0; i < 9 && digitalRead(this->_sda) == LOW; i++) {
+        digitalWrite(this->_scl, LOW);
+        delayMicroseconds(5);
+        digitalWrite(this->_scl, HIGH);
+        delayMicroseconds(5);
+    }
+
+    // STOP - SDA rises while SCL is high
+    pinMode(this->_sda, OUTPUT_OPEN_DRAIN);
+    digitalWrite(this->_sda, LOW);
+    delayMicroseconds(5);
+    digitalWrite(this->_scl, HIGH);
+    delayMicroseconds(5);
+    digitalWrite(this->_sda, HIGH);
+    delayMicroseconds(5);
+
+    this->begin();
+}
+
+uint32_t WireBus::timeUs() {
+    return micros();
+}
@@ -0,0 +1,32 @@
+/**
+ * @file wire_bus.h
+ * @brief The I2C bus manager on the Wire driver
+ *
+ * The Arduino Wire driver has no DMA, a transfer blocks the calling task while the I2C
+ * interrupt moves the bytes through the controller FIFO. Run from the bus manager task,
+ * only that task waits, the sensor tasks wait on their transaction
+ */
+
+#ifndef WIRE_BUS_H
+#define WIRE_BUS_H
+
+#include <Arduino.h>
+#include "i2c_bus.h"
+
+class WireBus : public I2CBusHardware {
+    private:
+        int _sda;
+        int _scl;
+        uint32_t _clock;
+        uint16_t _timeout;
+
+    public:
+        WireBus(int sda, int scl, uint32_t clock, uint16_t timeout);
+        bool begin();
+        uint8_t transfer(i2c_txn_t* txn);
+        bool sdaStuck();
+        void recover();
+        uint32_t timeUs();
+};
+
+#endif
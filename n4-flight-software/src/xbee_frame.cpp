@@ -0,0 +1,175 @@
+/**
+ * @file xbee_frame.cpp
+ * @brief implements the XBee API frame builder and parser
+ */
+
+#include <string.h>
+#include "xbee_frame.h"
+
+static uint8_t needs_escape(uint8_t b) {
+    return b == XBEE_START_DELIMITER || b == XBEE_ESCAPE || b == XBEE_XON || b == XBEE_XOFF;
+}
+
+/**
+ * @brief write one byte, escaping it when needed
+ * @return number of bytes written, 0 if there is no room
+ */
+static size_t put_escaped(uint8_t* out, size_t pos, size_t size, uint8_t b) {
+    if(needs_escape(b)) {
+        if(pos + 2 > size) {
+            return 0;
+        }
+        out[pos] = XBEE_ESCAPE;
+        out[pos + 1] = b ^ XBEE_ESCAPE_XOR;
+        return 2;
+    }
+
+    if(pos + 1 > size) {
+        return 0;
+    }
+    out[pos] = b;
+    return 1;
+}
+
+/**
+ * @brief build an escaped transmit request frame ready to be written to the UART
+ * @param out output buffer, XBEE_MAX_ENCODED_FRAME bytes always suffice
+ * @param size size of out in bytes
+ * @param frame_id non zero to request a transmit status frame, 0 for none
+ * @param destination 64 bit address of the receiver, 0xFFFF for broadcast
+ * @param payload RF data
+ * @param length RF data length, at most XBEE_MAX_PAYLOAD
+ * @return number of bytes written to out, 0 if the frame does not fit
+ */
+size_t xbee_build_tx_request(uint8_t* out, size_t size, uint8_t frame_id, uint64_t destination, const uint8_t* payload, size_t length) {
+    uint8_t header[XBEE_TX_REQUEST_OVERHEAD];
+
+    if(length > XBEE_MAX_PAYLOAD || size < 1) {
+        return 0;
+    }
+
+    header[0] = XBEE_API_TX_REQUEST;
+    header[1] = frame_id;
+    for(uint8_t i = 0; i < 8; i++) {
+        header[2 + i] = (destination >> (56 - 8 * i)) & 0xFF;
+    }
+    header[10] = 0xFF;          // 16 bit address unknown
+    header[11] = 0xFE;
+    header[12] = 0x00;          // broadcast radius - maximum hops
+    header[13] = 0x00;          // transmit options - use the radio defaults
+
+    uint16_t frame_length = XBEE_TX_REQUEST_OVERHEAD + length;
+    uint8_t sum = 0;
+    size_t pos = 0;
+    size_t n;
+
+    out[pos++] = XBEE_START_DELIMITER;
+
+    if((n = put_escaped(out, pos, size, frame_length >> 8)) == 0) return 0;
+    pos += n;
+    if((n = put_escaped(out, pos, size, frame_length & 0xFF)) == 0) return 0;
+    pos += n;
+
+    for(uint8_t i = 0; i < XBEE_TX_REQUEST_OVERHEAD; i++) {
+        sum += header[i];
+        if((n = put_escaped(out, pos, size, header[i])) == 0) return 0;
+        pos += n;
+    }
+
+    for(size_t i = 0; i < length; i++) {
+        sum += payload[i];
+        if((n = put_escaped(out, pos, size, payload[i])) == 0) return 0;
+        pos += n;
+    }
+
+    if((n = put_escaped(out, pos, size, 0xFF - sum)) == 0) return 0;
+    pos += n;
+
+    return pos;
+}
+
+/**
+ * @brief reset the parser to wait for a start delimiter
+ */
+void xbee_parser_init(xbee_parser_t* p) {
+    p->state = XBEE_WAIT_START;
+    p->escaped = 0;
+    p->expected = 0;
+    p->received = 0;
+    p->sum = 0;
+    p->checksum_errors = 0;
+    p->length_errors = 0;
+}
+
+/**
+ * @brief feed one byte received from the UART
+ * A start delimiter always restarts the parser, so a lost byte only costs one frame
+ * @param frame filled in when a complete frame with a valid checksum was received
+ * @return 1 if frame holds a new frame, 0 otherwise
+ */
+uint8_t xbee_parser_feed(xbee_parser_t* p, uint8_t byte, xbee_frame_t* frame) {
+    if(byte == XBEE_START_DELIMITER) {
+        p->state = XBEE_LENGTH_MSB;
+        p->escaped = 0;
+        p->received = 0;
+        p->sum = 0;
+        return 0;
+    }
+
+    if(p->state == XBEE_WAIT_START) {
+        return 0;
+    }
+
+    if(byte == XBEE_ESCAPE) {
+        p->escaped = 1;
+        return 0;
+    }
+
+    if(p->escaped) {
+        byte ^= XBEE_ESCAPE_XOR;
+        p->escaped = 0;
+    }
+
+    switch (p->state) {
+        case XBEE_LENGTH_MSB:
+            p->expected = (uint16_t) byte << 8;
+            p->state = XBEE_LENGTH_LSB;
+            break;
+
+        case XBEE_LENGTH_LSB:
+            p->expected |= byte;
+            if(p->expected == 0 || p->expected > sizeof(p->buffer)) {
+                p->length_errors++;
+                p->state = XBEE_WAIT_START;
+            } else {
+                p->state = XBEE_FRAME_DATA;
+            }
+            break;
+
+        case XBEE_FRAME_DATA:
+            p->buffer[p->received++] = byte;
+            p->sum += byte;
+            if(p->received == p->expected) {
+                p->state = XBEE_CHECKSUM;
+            }
+            break;
+
+        case XBEE_CHECKSUM:
+            p->state = XBEE_WAIT_START;
+            if((uint8_t) (p->sum + byte) != 0xFF) {
+                p->checksum_errors++;
+                return 0;
+            }
+
+            frame->api_id = p->buffer[0];
+            frame->length = p->expected - 1;
+            memcpy(frame->data, p->buffer + 1, frame->length);
+            return 1;
+
+        default:
+            p->state = XBEE_WAIT_START;
+            break;
+    }
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file xbee_frame.h
+ * @brief XBee API mode 2 (escaped) frame builder and parser
+ *
+ * Frame layout on the wire:
+ * 0x7E | length MSB | length LSB | frame data (API id + fields) | checksum
+ * every byte after the start delimiter that equals 0x7E, 0x7D, 0x11 or 0x13 is sent
+ * as 0x7D followed by the byte XOR 0x20. The checksum is 0xFF minus the 8 bit sum
+ * of the unescaped frame data bytes
+ */
+
+#ifndef XBEE_FRAME_H
+#define XBEE_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define XBEE_START_DELIMITER        0x7E
+#define XBEE_ESCAPE                 0x7D
+#define XBEE_XON                    0x11
+#define XBEE_XOFF                   0x13
+#define XBEE_ESCAPE_XOR             0x20
+
+#define XBEE_API_TX_REQUEST         0x10    /*!< transmit request, 64 bit destination */
+#define XBEE_API_TX_STATUS          0x8B    /*!< transmit status for a transmit request */
+#define XBEE_API_RX_PACKET          0x90    /*!< received RF packet */
+
+#define XBEE_TX_REQUEST_OVERHEAD    14      /*!< frame data bytes of a transmit request before the RF data */
+#define XBEE_MAX_PAYLOAD            200     /*!< RF data bytes per frame - keep below the radio's NP value */
+#define XBEE_MAX_FRAME_DATA         (XBEE_TX_REQUEST_OVERHEAD + XBEE_MAX_PAYLOAD)
+#define XBEE_MAX_ENCODED_FRAME      (2 * (XBEE_MAX_FRAME_DATA + 3) + 1)  /*!< worst case, every byte escaped */
+
+#define XBEE_DELIVERY_SUCCESS       0x00    /*!< delivery status of a successful transmit */
+
+/**
+ * A received and checksum verified API frame
+ */
+typedef struct {
+    uint8_t api_id;
+    uint8_t data[XBEE_MAX_FRAME_DATA];      /*!< frame data after the API id */
+    uint16_t length;                        /*!< bytes in data */
+} xbee_frame_t;
+
+typedef enum {
+    XBEE_WAIT_START = 0,
+    XBEE_LENGTH_MSB,
+    XBEE_LENGTH_LSB,
+    XBEE_FRAME_DATA,
+    XBEE_CHECKSUM
+} XBEE_PARSER_STATE;
+
+/**
+ * Byte at a time parser for incoming API frames
+ */
+typedef struct {
+    uint8_t state;
+    uint8_t escaped;                        /*!< 1 if the previous byte was the escape byte */
+    uint16_t expected;                      /*!< frame data length from the header */
+    uint16_t received;                      /*!< frame data bytes received so far */
+    uint8_t sum;                            /*!< running checksum */
+    uint8_t buffer[XBEE_MAX_FRAME_DATA + 1];
+    uint32_t checksum_errors;               /*!< frames dropped because of a bad checksum */
+    uint32_t length_errors;                 /*!< frames dropped because they were too long */
+} xbee_parser_t;
+
+size_t xbee_build_tx_request(uint8_t* out, size_t size, uint8_t frame_id, uint64_t destination, const uint8_t* payload, size_t length);
+void xbee_parser_init(xbee_parser_t* p);
+uint8_t xbee_parser_feed(xbee_parser_t* p, uint8_t byte, xbee_frame_t* frame);
+
+#endif
@@ -0,0 +1,218 @@
+/**
+ * @file xbee_transport.cpp
+ * @brief implements the XBee telemetry transport
+ */
+
+#include "xbee_transport.h"
+#include "defs.h"
+
+/**
+ * @brief class constructor
+ * @param serial UART the radio is connected to
+ * @param rx_pin UART RX pin
+ * @param tx_pin UART TX pin
+ * @param destination 64 bit address of the ground radio, 0xFFFF to broadcast
+ * @param status_timeout time in ms after which a frame without transmit status counts as lost
+ */
+XBeeTransport::XBeeTransport(HardwareSerial& serial, int8_t rx_pin, int8_t tx_pin, uint64_t destination, uint32_t status_timeout) : _serial(serial) {
+    this->_rx_pin = rx_pin;
+    this->_tx_pin = tx_pin;
+    this->_destination = destination;
+    this->_status_timeout = status_timeout;
+
+    memset(this->_inflight_id, 0, sizeof(this->_inflight_id));
+    memset(&this->stats, 0, sizeof(this->stats));
+    xbee_parser_init(&this->_parser);
+}
+
+/**
+ * @brief start the UART, frames wait in the staging buffer rather than in its TX ring buffer
+ * @return true on success
+ */
+bool XBeeTransport::begin() {
+    // must be set before begin() - the UART driver allocates its ring buffers there
+    this->_serial.setTxBufferSize(XBEE_UART_TX_SIZE);
+    this->_serial.begin(XBEE_BAUD_RATE, SERIAL_8N1, this->_rx_pin, this->_tx_pin);
+    return true;
+}
+
+/**
+ * @brief number of transmit requests that can still be sent before waiting for status
+ */
+uint8_t XBeeTransport::freeSlots() {
+    uint8_t n = 0;
+    for(uint8_t i = 0; i < XBEE_MAX_INFLIGHT; i++) {
+        if(this->_inflight_id[i] == 0) {
+            n++;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief handle one frame received from the radio
+ */
+void XBeeTransport::handleFrame(const xbee_frame_t* frame) {
+    if(frame->api_id == XBEE_API_TX_STATUS && frame->length >= 5) {
+        // frame id, 16 bit address, retry count, delivery status, discovery status
+        uint8_t id = frame->data[0];
+        uint8_t delivery_status = frame->data[4];
+
+        for(uint8_t i = 0; i < XBEE_MAX_INFLIGHT; i++) {
+            if(this->_inflight_id[i] != id) {
+                continue;
+            }
+
+            this->_inflight_id[i] = 0;
+            this->stats.latency_last = millis() - this->_inflight_time[i];
+            if(this->stats.latency_last > this->stats.latency_max) {
+                this->stats.latency_max = this->stats.latency_last;
+            }
+
+            if(delivery_status == XBEE_DELIVERY_SUCCESS) {
+                this->stats.frames_delivered++;
+            } else {
+                this->stats.frames_failed++;
+            }
+            break;
+        }
+
+    } else if(frame->api_id == XBEE_API_RX_PACKET) {
+        this->stats.frames_received++;
+    }
+}
+
+/**
+ * @brief write as much of the staged frames as the UART TX ring buffer has room for
+ */
+void XBeeTransport::flush() {
+    if(this->_staged == 0) {
+        return;
+    }
+
+    size_t room = (size_t) this->_serial.availableForWrite();
+    size_t n = room < this->_staged ? room : this->_staged;
+
+    if(n > 0) {
+        this->_serial.write(this->_staging + this->_staged_offset, n);
+        this->_staged_offset += n;
+        this->_staged -= n;
+        this->_written += n;
+    }
+
+    if(this->_staged == 0) {
+        this->_staged_offset = 0;
+    } else {
+        this->stats.partial_writes++;
+    }
+}
+
+/**
+ * @brief write staged frames, parse everything the radio sent and expire frames whose
+ * status never arrived
+ */
+void XBeeTransport::poll() {
+    this->flush();
+
+    while(this->_serial.available()) {
+        if(xbee_parser_feed(&this->_parser, this->_serial.read(), &this->_frame)) {
+            this->handleFrame(&this->_frame);
+        }
+    }
+
+    uint32_t now = millis();
+    for(uint8_t i = 0; i < XBEE_MAX_INFLIGHT; i++) {
+        // a frame still in the staging buffer is not waiting for its status yet
+        if(this->_inflight_id[i] != 0 && (int32_t) (this->_written - this->_inflight_end[i]) < 0) {
+            this->_inflight_time[i] = now;
+            continue;
+        }
+
+        if(this->_inflight_id[i] != 0 && now - this->_inflight_time[i] > this->_status_timeout) {
+            this->_inflight_id[i] = 0;
+            this->stats.frames_timed_out++;
+        }
+    }
+}
+
+bool XBeeTransport::ready() {
+    return this->freeSlots() > 0;
+}
+
+/**
+ * @brief split the message into transmit requests, stage them behind the frames still
+ * waiting and write what the UART driver has room for
+ * Frames are cut after a '\n' where possible so a lost frame only loses whole records
+ * @return TELEMETRY_SENT if every frame is in the UART driver, TELEMETRY_QUEUED if some wait
+ * in the staging buffer, TELEMETRY_REFUSED if nothing was queued
+ */
+uint8_t XBeeTransport::send(const uint8_t* payload, size_t length) {
+    uint8_t ids[XBEE_MAX_INFLIGHT];
+    size_t ends[XBEE_MAX_INFLIGHT];
+    uint8_t frames = 0;
+    size_t offset = 0;
+    uint8_t slots = this->freeSlots();
+    uint8_t first_id = this->_next_frame_id;
+
+    this->flush();
+
+    // the new frames go right after the ones still waiting
+    if(this->_staged_offset > 0) {
+        memmove(this->_staging, this->_staging + this->_staged_offset, this->_staged);
+        this->_staged_offset = 0;
+    }
+    size_t staged = this->_staged;
+
+    while(offset < length) {
+        size_t chunk = length - offset;
+
+        if(chunk > XBEE_MAX_PAYLOAD) {
+            chunk = XBEE_MAX_PAYLOAD;
+            for(size_t i = XBEE_MAX_PAYLOAD; i > 0; i--) {
+                if(payload[offset + i - 1] == '\n') {
+                    chunk = i;
+                    break;
+                }
+            }
+        }
+
+        uint8_t id = this->_next_frame_id;
+        size_t n = frames == slots ? 0 : xbee_build_tx_request(this->_staging + staged, sizeof(this->_staging) - staged, id, this->_destination, payload + offset, chunk);
+        if(n == 0) {
+            this->_next_frame_id = first_id;
+            this->stats.messages_rejected++;
+            return TELEMETRY_REFUSED;
+        }
+
+        // frame id 0 disables the transmit status, skip it
+        this->_next_frame_id = id == 255 ? 1 : id + 1;
+        staged += n;
+        ids[frames] = id;
+        ends[frames++] = staged;
+        offset += chunk;
+    }
+
+    this->_staged = staged;
+
+    uint32_t now = millis();
+    uint8_t f = 0;
+    for(uint8_t i = 0; i < XBEE_MAX_INFLIGHT && f < frames; i++) {
+        if(this->_inflight_id[i] == 0) {
+            this->_inflight_id[i] = ids[f];
+            this->_inflight_time[i] = now;
+            this->_inflight_end[i] = this->_written + ends[f];
+            f++;
+        }
+    }
+
+    this->stats.frames_sent += frames;
+
+    // never block on the UART, what does not fit now is written from poll()
+    this->flush();
+
+    return this->_staged == 0 ? TELEMETRY_SENT : TELEMETRY_QUEUED;
+}
+
+const char* XBeeTransport::name() {
+    return "XBEE";
+}
@@ -0,0 +1,73 @@
+/**
+ * @file xbee_transport.h
+ * @brief Telemetry transport over an XBee radio in API mode 2
+ *
+ * send() never waits on the UART. The frames are encoded into a staging buffer and
+ * written to the UART driver TX ring buffer as far as it has room, the UART interrupt
+ * drains it to the radio and poll() writes the rest. A message is only refused if the
+ * staging buffer or the transmit status slots are full. Transmit status frames are
+ * matched to the frames in flight to measure delivery and latency
+ */
+
+#ifndef XBEE_TRANSPORT_H
+#define XBEE_TRANSPORT_H
+
+#include <Arduino.h>
+#include "telemetry_transport.h"
+#include "xbee_frame.h"
+
+#define XBEE_MAX_INFLIGHT       8           /*!< transmit requests waiting for a status frame */
+#define XBEE_STAGING_SIZE       2048        /*!< encoded frames waiting for room in the UART TX ring buffer */
+#define XBEE_UART_TX_SIZE       256         /*!< UART driver TX ring buffer, small so a written frame is on air within ~250 ms at 9600 baud */
+
+/**
+ * Delivery statistics of the XBee link
+ */
+typedef struct {
+    uint32_t frames_sent;           /*!< transmit requests written to the UART */
+    uint32_t frames_delivered;      /*!< transmit status reported success */
+    uint32_t frames_failed;         /*!< transmit status reported a failure */
+    uint32_t frames_timed_out;      /*!< no transmit status within the timeout */
+    uint32_t messages_rejected;     /*!< send() calls refused because the staging buffer or radio was busy */
+    uint32_t partial_writes;        /*!< writes that left part of the staged frames for a later poll() */
+    uint32_t frames_received;       /*!< RF packets received from ground */
+    uint32_t latency_last;          /*!< time in ms from write to transmit status of the last frame */
+    uint32_t latency_max;           /*!< largest latency seen */
+} xbee_stats_t;
+
+class XBeeTransport : public TelemetryTransport {
+    private:
+        HardwareSerial& _serial;
+        uint64_t _destination;
+        int8_t _rx_pin;
+        int8_t _tx_pin;
+        uint32_t _status_timeout;
+
+        uint8_t _next_frame_id = 1;
+        uint8_t _inflight_id[XBEE_MAX_INFLIGHT];        /*!< 0 marks a free slot */
+        uint32_t _inflight_time[XBEE_MAX_INFLIGHT];     /*!< time in ms the frame was written to the UART */
+        uint32_t _inflight_end[XBEE_MAX_INFLIGHT];      /*!< value of _written once the whole frame is written */
+
+        xbee_parser_t _parser;
+        xbee_frame_t _frame;
+        uint8_t _staging[XBEE_STAGING_SIZE];
+        size_t _staged = 0;             /*!< encoded bytes not yet written to the UART */
+        size_t _staged_offset = 0;      /*!< first of them in _staging */
+        uint32_t _written = 0;          /*!< bytes written to the UART so far, wraps */
+
+        uint8_t freeSlots();
+        void flush();
+        void handleFrame(const xbee_frame_t* frame);
+
+    public:
+        xbee_stats_t stats;
+
+        XBeeTransport(HardwareSerial& serial, int8_t rx_pin, int8_t tx_pin, uint64_t destination, uint32_t status_timeout);
+        bool begin();
+        void poll();
+        bool ready();
+        uint8_t send(const uint8_t* payload, size_t length);
+        const char* name();
+};
+
+#endif
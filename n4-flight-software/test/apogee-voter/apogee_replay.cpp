@@ -0,0 +1,395 @@
+/**
+ * Host replay of the apogee voter in src/apogee_detector.cpp with the vertical Kalman filter,
+ * as readAltimeterTask and checkFlightState drive them: the IMU axial reading every 10 ms,
+ * the barometer every 50 ms through vkf_update() with the flight config defaults. The voter
+ * is armed at launch and its lockout restarted at burnout, as the POWERED_FLIGHT and
+ * COASTING entry hooks do. Profiles:
+ * - synthetic flights with quadratic drag, from a 3.5 g heavy rocket to a 22 g motor
+ * - scripts/altitude_data.csv, the acceleration taken from its altitude
+ * each with barometer noise and 1% spikes and the IMU clipping at its 16 g range, and
+ * with the faults the voter has to survive:
+ * - the barometer stuck at its last reading 0.5 s after burnout
+ * - the IMU saturated at full scale for 0.2 s in the burn
+ * - both at once, where only the timeout is left
+ * - barometer samples that reach the voter after apogee_arm() stamped before it, or before
+ *   the launch sample, as they do behind a 30 ms conversion
+ * Also a benchmark of the voter per sample and of the whole replay. This is the apogee
+ * benchmark on the flight CSV and the noisy synthetic profiles as well.
+ *
+ * build and run from this directory:
+ *     g++ -O2 -I../common -I../../src apogee_replay.cpp ../../src/apogee_detector.cpp ../../src/vertical_kalman.cpp -o apogee_replay && ./apogee_replay
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "apogee_detector.h"
+#include "vertical_kalman.h"
+#include "check.h"
+
+#define LOCKOUT_MS          3000        /* APOGEE_LOCKOUT_TIME */
+#define COAST_LOCKOUT_MS    1000        /* COAST_APOGEE_LOCKOUT_TIME */
+#define CONFIDENCE          3           /* APOGEE_CONFIDENCE */
+#define TIMEOUT_MS          30000       /* APOGEE_TIMEOUT_TIME */
+#define SATURATION_G        (16 * 0.98f)    /* APOGEE_ACCEL_SATURATION */
+#define IMU_RANGE_G         16.0f       /* MPU_ACCEL_RANGE */
+#define ALTITUDE_SIGMA      1.0f        /* KALMAN_ALTITUDE_SIGMA */
+#define ACCEL_SIGMA         20.0f       /* KALMAN_ACCEL_SIGMA */
+#define INNOVATION_GATE     5.0f        /* KALMAN_INNOVATION_GATE */
+
+#define ACCEL_PERIOD        10
+#define BARO_PERIOD         50
+#define BARO_NOISE          0.5f        /* m */
+#define BARO_SPIKES         0.01f       /* share of barometer samples that are spikes */
+#define STUCK_AFTER         500         /* ms after burnout the barometer sticks */
+#define SATURATED_AT        300         /* ms after launch the IMU reads full scale, for SATURATED_MS */
+#define SATURATED_MS        200
+#define LAUNCH_G            2.5f        /* LAUNCH_ACCEL_THRESHOLD */
+#define LAUNCH_DELAY        40          /* LAUNCH_ACCEL_SUSTAIN_TIME and a sample, from the launch sample to apogee_arm() */
+#define PAD_MS              2000
+#define PROFILE_MS          80000
+#define START_MS            100000      /* millis() at the start of a run */
+#define SEEDS               50
+
+/* latency bounds to the true apogee, in ms */
+#define LATE_BOUND          1000        /* no deployment later than this after apogee */
+#define EARLY_BOUND         50          /* no deployment more than one barometer period before apogee */
+#define STUCK_EARLY_BOUND   80          /* ACCEL alone, the 0.08 s early deployment seen when the voter was written */
+
+static uint32_t rng_state;
+
+static float uniform() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (rng_state & 0xFFFFFF) / 16777216.0f;
+}
+
+/* roughly normal, unit standard deviation */
+static float noise() {
+    return (uniform() + uniform() + uniform() - 1.5f) * 2.0f;
+}
+
+/*
+ * profiles, the axial specific force in g and the altitude in m every ms from START_MS
+ */
+
+typedef struct {
+    const char* name;
+    float sf[PROFILE_MS];
+    float alt[PROFILE_MS];
+    uint32_t launch;            /* ms from the start of the first IMU sample over LAUNCH_G */
+    uint32_t burnout;           /* ms from the start, the specific force drops below 1 g */
+    uint32_t apogee;            /* ms from the start of the highest altitude */
+    float max_sf;
+} profile_t;
+
+static void find_events(profile_t* p) {
+    p->launch = 0;
+    p->burnout = 0;
+    p->apogee = 0;
+    p->max_sf = 0;
+    for(uint32_t t = PAD_MS; t < PROFILE_MS; t++) {
+        if(p->launch == 0 && t % ACCEL_PERIOD == 0 && p->sf[t] > LAUNCH_G) {
+            p->launch = t;
+        }
+        if(p->burnout == 0 && t > PAD_MS + 100 && p->sf[t] < 1.0f) {
+            p->burnout = t;
+        }
+        if(p->alt[t] > p->alt[p->apogee]) {
+            p->apogee = t;
+        }
+        p->max_sf = p->sf[t] > p->max_sf ? p->sf[t] : p->max_sf;
+    }
+}
+
+static void motor(profile_t* p, const char* name, float thrust_g, uint32_t burn_ms, float drag) {
+    p->name = name;
+
+    float velocity = 0;
+    float altitude = 0;
+    for(uint32_t t = 0; t < PROFILE_MS; t++) {
+        float sf = 1.0f;
+        if(t >= PAD_MS) {
+            // the IMU reads thrust and drag, drag against the motion
+            float thrust = t - PAD_MS < burn_ms ? thrust_g : 0;
+            sf = thrust - drag * velocity * fabsf(velocity) / 9.81f;
+            if(altitude <= 0 && velocity <= 0 && sf < 1.0f) {
+                sf = 1.0f;      /* on the pad or landed */
+            }
+        }
+        velocity += (sf - 1.0f) * 9.81f * 0.001f;
+        altitude += velocity * 0.001f;
+        p->sf[t] = sf;
+        p->alt[t] = altitude;
+    }
+    find_events(p);
+}
+
+static bool replayed_flight(profile_t* p) {
+    FILE* f = fopen("../../scripts/altitude_data.csv", "r");
+    if(f == NULL) {
+        return false;
+    }
+
+    static float h[PROFILE_MS];
+    uint32_t n = 0;
+    float t;
+    while(n < PROFILE_MS - PAD_MS && fscanf(f, "%f,%f", &t, &h[n]) == 2) {
+        n++;
+    }
+    fclose(f);
+    if(n < PROFILE_MS - PAD_MS) {
+        return false;
+    }
+
+    p->name = "altitude_data.csv";
+    for(uint32_t i = 0; i < PROFILE_MS; i++) {
+        p->sf[i] = 1.0f;
+        p->alt[i] = 0;
+    }
+    for(uint32_t i = 0; i < n; i++) {
+        uint32_t c = i < 25 ? 25 : (i + 25 >= n ? n - 26 : i);
+        float a = (h[c + 25] - 2 * h[c] + h[c - 25]) / (0.025f * 0.025f);
+        p->sf[PAD_MS + i] = a / 9.81f + 1.0f;
+        p->alt[PAD_MS + i] = h[i];
+    }
+    find_events(p);
+    return true;
+}
+
+/*
+ * the sensors, the two tasks and the state check
+ */
+
+typedef enum { FAULT_NONE = 0, FAULT_STUCK_BARO, FAULT_SATURATED_IMU, FAULT_BOTH, NUM_FAULTS } FAULT;
+static const char* const fault_names[NUM_FAULTS] = { "nominal", "barometer stuck", "IMU saturated 0.2 s", "both" };
+
+#define BIT(voter)  (1 << (voter))
+
+typedef struct {
+    uint8_t decision;
+    int32_t latency;            /* ms from the true apogee to the decision */
+    uint32_t decided;           /* ms from the start of the decision */
+    uint8_t votes;              /* apogee_detector_t::detect_votes */
+    uint8_t healthy;
+    double baro_ns;             /* time in the barometer path */
+    double accel_ns;
+    uint32_t baro_samples;
+    uint32_t accel_samples;
+} run_result_t;
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static run_result_t run(const profile_t* p, uint8_t fault, uint32_t seed, uint32_t timeout_ms) {
+    run_result_t r = {};
+    apogee_detector_t d;
+    vertical_kalman_t kf;
+
+    rng_state = seed;
+    apogee_init(&d, LOCKOUT_MS, 0, 0, CONFIDENCE, timeout_ms, SATURATION_G);
+    vkf_init(&kf, ALTITUDE_SIGMA, ACCEL_SIGMA, INNOVATION_GATE);
+
+    bool stuck = fault == FAULT_STUCK_BARO || fault == FAULT_BOTH;
+    bool saturated = fault == FAULT_SATURATED_IMU || fault == FAULT_BOTH;
+    float stuck_reading = 0;
+
+    for(uint32_t t = 0; t < PROFILE_MS && !d.detected; t += ACCEL_PERIOD) {
+        uint32_t now = START_MS + t;
+
+        float axial = p->sf[t] + 0.05f * noise();
+        if(saturated && t >= p->launch + SATURATED_AT && t < p->launch + SATURATED_AT + SATURATED_MS) {
+            axial = IMU_RANGE_G;
+        }
+        axial = axial > IMU_RANGE_G ? IMU_RANGE_G : axial;
+
+        auto start = std::chrono::steady_clock::now();
+        uint8_t decision = apogee_update_accel(&d, now, axial);
+        r.accel_ns += elapsed_ns(start);
+        r.accel_samples++;
+
+        // poweredFlightEntry() and coastingEntry(), each a little after the event
+        if(t == p->launch + LAUNCH_DELAY) {
+            apogee_arm(&d, now, 1, START_MS + p->launch);
+        }
+        if(t == p->burnout + 100) {
+            apogee_restart_lockout(&d, now, COAST_LOCKOUT_MS);
+        }
+
+        if(decision == APOGEE_NONE && t % BARO_PERIOD == 0) {
+            float altitude = p->alt[t] + BARO_NOISE * noise();
+            if(uniform() < BARO_SPIKES) {
+                altitude += (uniform() < 0.5f ? -1 : 1) * (20 + 40 * uniform());
+            }
+            if(stuck && t >= p->burnout + STUCK_AFTER) {
+                altitude = stuck_reading;
+            }
+            stuck_reading = altitude;
+
+            start = std::chrono::steady_clock::now();
+            vkf_update(&kf, altitude, 0, BARO_PERIOD * 0.001f);
+            decision = apogee_update(&d, now, altitude, kf.velocity);
+            r.baro_ns += elapsed_ns(start);
+            r.baro_samples++;
+        }
+
+        if(decision != APOGEE_NONE) {
+            r.decision = decision;
+            r.decided = t;
+            r.latency = (int32_t) (t - p->apogee);
+        }
+    }
+
+    r.votes = d.detect_votes;
+    r.healthy = apogee_health_mask(&d);
+    return r;
+}
+
+/* 1 if the run decided as the estimators the fault leaves healthy should, within its bounds */
+static bool as_expected(const profile_t* p, uint8_t fault, uint32_t timeout_ms, const run_result_t* r) {
+    uint8_t healthy = BIT(APOGEE_VOTER_BARO) | BIT(APOGEE_VOTER_KALMAN) | BIT(APOGEE_VOTER_ACCEL);
+    if(fault == FAULT_STUCK_BARO || fault == FAULT_BOTH) {
+        healthy &= ~(BIT(APOGEE_VOTER_BARO) | BIT(APOGEE_VOTER_KALMAN));
+    }
+    if(fault == FAULT_SATURATED_IMU || fault == FAULT_BOTH || p->max_sf > SATURATION_G) {
+        healthy &= ~BIT(APOGEE_VOTER_ACCEL);
+    }
+
+    if(r->healthy != healthy) {
+        return false;
+    }
+
+    if(healthy == 0) {
+        return r->decision == APOGEE_TIMEOUT && r->decided == p->launch + timeout_ms;
+    }
+
+    // the votes held are healthy ones, two of them unless a single one is left
+    uint8_t votes = (r->votes & 1) + ((r->votes >> 1) & 1) + ((r->votes >> 2) & 1);
+    bool quorum = (r->votes & ~healthy) == 0 && votes >= (healthy == BIT(APOGEE_VOTER_ACCEL) ? 1 : 2);
+
+    int32_t early = healthy == BIT(APOGEE_VOTER_ACCEL) ? STUCK_EARLY_BOUND : EARLY_BOUND;
+    return r->decision == APOGEE_VOTED && quorum && r->latency >= -early && r->latency <= LATE_BOUND;
+}
+
+/* descending barometer samples stamped before the arm time, 1 if none of them decided */
+static bool late_samples_ignored(int32_t before_arm_ms) {
+    apogee_detector_t d;
+    uint8_t decision = APOGEE_NONE;
+
+    apogee_init(&d, LOCKOUT_MS, 0, 0, CONFIDENCE, TIMEOUT_MS, SATURATION_G);
+
+    // a full window on the pad, then launch detected at START_MS, 40 ms into the burn
+    for(uint32_t t = 0; t < APOGEE_WINDOW_SIZE * BARO_PERIOD; t += BARO_PERIOD) {
+        apogee_update(&d, START_MS - 2000 + t, 100.0f - t * 0.01f, -5.0f);
+    }
+    apogee_arm(&d, START_MS, 1, START_MS - LAUNCH_DELAY);
+
+    for(uint8_t i = 0; i < 2 * CONFIDENCE; i++) {
+        decision |= apogee_update(&d, START_MS - before_arm_ms + i, 50.0f - i, -5.0f);
+    }
+
+    return decision == APOGEE_NONE && apogee_vote_mask(&d) == 0;
+}
+
+static int32_t percentile(std::vector<int32_t> v, float q) {
+    if(v.empty()) {
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[(size_t) (q * (v.size() - 1))];
+}
+
+int main() {
+    static profile_t flights[5];
+
+    motor(&flights[0], "6 g for 2 s", 6.0f, 2000, 0.0004f);
+    motor(&flights[1], "12 g for 1.2 s", 12.0f, 1200, 0.0004f);
+    motor(&flights[2], "3.5 g for 4 s, heavy", 3.5f, 4000, 0.0002f);
+    motor(&flights[3], "22 g for 0.8 s, clips", 22.0f, 800, 0.0003f);
+    bool replayed = replayed_flight(&flights[4]);
+
+    check(replayed, "altitude_data.csv replayed");
+    int count = replayed ? 5 : 4;
+
+    // the replayed flight climbs for 50 s, past APOGEE_TIMEOUT_TIME, it gets a timeout about 10 s after its apogee
+    uint32_t timeouts[5] = { TIMEOUT_MS, TIMEOUT_MS, TIMEOUT_MS, TIMEOUT_MS, ((flights[4].apogee - flights[4].launch) / 1000 + 10) * 1000 };
+
+    bool expected[NUM_FAULTS] = { true, true, true, true };
+    bool deterministic = true;
+    int32_t stuck_earliest = 0;
+    double baro_ns = 0;
+    double accel_ns = 0;
+    uint32_t baro_samples = 0;
+    uint32_t accel_samples = 0;
+
+    printf("latency from the true apogee to the decision, %d seeds each\n", SEEDS);
+    printf("    %-24s %-20s %8s %8s %8s  %s\n", "flight", "fault", "min", "p50", "max", "votes at the decision");
+
+    auto replay_start = std::chrono::steady_clock::now();
+
+    for(int f = 0; f < count; f++) {
+        const profile_t* p = &flights[f];
+
+        for(uint8_t fault = 0; fault < NUM_FAULTS; fault++) {
+            std::vector<int32_t> latency;
+            uint8_t votes = 0;
+
+            for(uint32_t seed = 1; seed <= SEEDS; seed++) {
+                run_result_t r = run(p, fault, seed * 7919, timeouts[f]);
+                expected[fault] &= as_expected(p, fault, timeouts[f], &r);
+                latency.push_back(r.latency);
+                votes |= r.votes;
+                baro_ns += r.baro_ns;
+                accel_ns += r.accel_ns;
+                baro_samples += r.baro_samples;
+                accel_samples += r.accel_samples;
+
+                if(seed == 1) {
+                    run_result_t again = run(p, fault, seed * 7919, timeouts[f]);
+                    deterministic &= again.decision == r.decision && again.latency == r.latency && again.votes == r.votes;
+                }
+            }
+
+            if(fault == FAULT_STUCK_BARO && p->max_sf <= SATURATION_G) {
+                stuck_earliest = std::min(stuck_earliest, percentile(latency, 0));
+            }
+
+            char names[32] = "";
+            for(uint8_t v = 0; v < NUM_APOGEE_VOTERS; v++) {
+                if(votes & BIT(v)) {
+                    snprintf(names + strlen(names), sizeof(names) - strlen(names), "%s%s", names[0] ? " " : "", apogee_voter_name(v));
+                }
+            }
+            printf("    %-24s %-20s %6.2f s %6.2f s %6.2f s  %s\n", p->name, fault_names[fault], percentile(latency, 0) * 0.001f,
+                   percentile(latency, 0.5f) * 0.001f, percentile(latency, 1.0f) * 0.001f, names[0] ? names : "timeout");
+        }
+    }
+
+    double replay_ms = elapsed_ns(replay_start) * 1e-6;
+
+    printf("    earliest deployment by ACCEL alone %.2f s\n", stuck_earliest * 0.001f);
+    check(expected[FAULT_NONE], "nominal, voted within EARLY_BOUND before and LATE_BOUND after apogee");
+    check(expected[FAULT_STUCK_BARO], "barometer stuck, BARO and KALMAN dropped, ACCEL decides alone");
+    check(stuck_earliest >= -STUCK_EARLY_BOUND, "barometer stuck, never more than STUCK_EARLY_BOUND early");
+    check(expected[FAULT_SATURATED_IMU], "IMU saturated, ACCEL dropped, BARO and KALMAN decide");
+    check(expected[FAULT_BOTH], "both faults, the timeout deploys");
+    check(deterministic, "a replay with the same seed gives the same decision");
+
+    printf("barometer samples stamped before apogee_arm()\n");
+    check(late_samples_ignored(LAUNCH_DELAY / 2), "stamped before the arm time, held in the lockout");
+    check(late_samples_ignored(2 * LAUNCH_DELAY), "stamped before the launch sample, no timeout");
+
+    printf("benchmark\n");
+    printf("    barometer sample, vkf_update and apogee_update   %6.1f ns\n", baro_ns / baro_samples);
+    printf("    IMU sample, apogee_update_accel                  %6.1f ns\n", accel_ns / accel_samples);
+    printf("    %lu replays in %.0f ms\n", (unsigned long) (count * NUM_FAULTS * (SEEDS + 1)), replay_ms);
+
+    return check_summary();
+}
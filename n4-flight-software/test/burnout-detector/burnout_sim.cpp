@@ -0,0 +1,263 @@
+/**
+ * Host simulation of the burnout detector in src/burnout_detector.cpp on generated flights.
+ * A rocket of given mass flies a thrust curve with a build up, a plateau and a tail-off,
+ * against quadratic drag. The IMU reads the axial specific force every 10 ms, thrust less
+ * drag over the weight, with its X axis up or down the rocket, and the detector is armed
+ * 40 ms into the burn as poweredFlightEntry() does. Runs:
+ * - motors from a 15 g short burn to a heavy rocket at 2.5 g, with tail-offs from 20 ms to
+ *   progressive ones falling at 6 to 8 g/s, and a low drag rocket whose coast reads barely
+ *   below zero
+ * - each with the IMU X axis up and down, and quiet, with motor vibration, and with
+ *   vibration and single sample dropouts to zero in the burn
+ * - the latency from the true burnout, where thrust falls below drag, to the detection,
+ *   no detection while the thrust still exceeds the drag, none missed
+ * - a benchmark of burnout_update()
+ *
+ * build and run from this directory:
+ *     g++ -O2 -I../common -I../../src burnout_sim.cpp ../../src/burnout_detector.cpp -o burnout_sim && ./burnout_sim
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "burnout_detector.h"
+#include "check.h"
+
+#define ACCEL_THRESHOLD     0.0f        /* BURNOUT_ACCEL_THRESHOLD */
+#define JERK_THRESHOLD      4.0f        /* BURNOUT_JERK_THRESHOLD */
+#define SUSTAIN_MS          20          /* BURNOUT_SUSTAIN_TIME */
+#define JERK_WINDOW_MS      500         /* BURNOUT_JERK_WINDOW */
+#define FILTER_ALPHA        0.3f        /* BURNOUT_FILTER_ALPHA */
+
+#define ACCEL_PERIOD        10
+#define ARM_DELAY           40          /* launch detection, from ignition to burnout_arm() */
+#define RAMP_MS             30          /* thrust build up */
+#define PROFILE_MS          15000
+#define START_MS            100000      /* millis() at ignition */
+#define SEEDS               50
+#define BENCH_ITERATIONS    1000000
+
+/* bounds on the detection, from the sample where thrust falls below drag */
+#define LATE_BOUND          100         /* the sustain time, the filter lag and a margin for vibration */
+#define EARLY_SF            0.3f        /* no detection while the true axial force is above this, in g */
+
+static uint32_t rng_state;
+
+static float uniform() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (rng_state & 0xFFFFFF) / 16777216.0f;
+}
+
+/* roughly normal, unit standard deviation */
+static float noise() {
+    return (uniform() + uniform() + uniform() - 1.5f) * 2.0f;
+}
+
+/*
+ * flights, the true axial specific force in g every ms from ignition
+ */
+
+typedef struct {
+    const char* name;
+    float thrust_g;             /* plateau thrust over the weight */
+    uint32_t burn_ms;           /* ignition to the start of the tail-off */
+    uint32_t tail_ms;           /* tail-off from the plateau to no thrust */
+    float drag;                 /* drag over the weight per (m/s)^2 */
+} motor_t;
+
+typedef struct {
+    const char* name;
+    float sf[PROFILE_MS];
+    uint32_t burnout;           /* first ms the thrust is below the drag */
+    float coast_sf;             /* axial force just after burnout */
+} flight_t;
+
+static void fly(flight_t* f, const motor_t* m) {
+    float velocity = 0;
+
+    f->name = m->name;
+    f->burnout = 0;
+
+    for(uint32_t t = 0; t < PROFILE_MS; t++) {
+        float thrust = 0;
+        if(t < RAMP_MS) {
+            thrust = m->thrust_g * t / RAMP_MS;
+        } else if(t < m->burn_ms) {
+            thrust = m->thrust_g;
+        } else if(t < m->burn_ms + m->tail_ms) {
+            thrust = m->thrust_g * (1.0f - (float) (t - m->burn_ms) / m->tail_ms);
+        }
+
+        // thrust and drag along the axis, gravity is not felt by the IMU
+        float drag = m->drag * velocity * fabsf(velocity);
+        float sf = t < RAMP_MS && thrust < 1.0f ? 1.0f : thrust - drag;
+
+        f->sf[t] = sf;
+        if(f->burnout == 0 && t > RAMP_MS && sf < 0) {
+            f->burnout = t;
+            f->coast_sf = sf;
+        }
+
+        velocity += (sf - 1.0f) * 9.81f * 0.001f;
+    }
+}
+
+static const motor_t motors[] = {
+    { "15 g for 0.8 s, sharp",      15.0f, 800,  20,  0.0004f },
+    { "8 g for 1.5 s",              8.0f,  1500, 100, 0.0004f },
+    { "5 g for 2 s, 600 ms tail",   5.0f,  2000, 600, 0.0003f },
+    { "2.5 g for 4 s, heavy",       2.5f,  4000, 200, 0.0002f },
+    { "3 g for 3 s, 500 ms tail",   3.0f,  3000, 500, 0.0002f },
+    { "6 g for 2 s, low drag",      6.0f,  2000, 150, 0.00005f }
+};
+
+#define NUM_MOTORS      (sizeof(motors) / sizeof(motors[0]))
+
+/*
+ * the IMU and the detector as checkFlightState drives it
+ */
+
+typedef enum { VIBRATION_NONE = 0, VIBRATION_MOTOR, VIBRATION_DROPOUTS, NUM_VIBRATIONS } VIBRATION;
+static const char* const vibration_names[NUM_VIBRATIONS] = { "quiet", "vibration", "vibration, dropouts" };
+
+typedef struct {
+    bool detected;
+    int32_t latency;            /* ms from the true burnout to the detection */
+    float sf_at_detection;      /* true axial force on the detecting sample */
+} run_result_t;
+
+/* the axial reading of the sample at t, thrust up the X axis when axis_sign is 1 */
+static float reading(const flight_t* f, uint32_t t, int8_t axis_sign, uint8_t vibration) {
+    float sf = f->sf[t];
+    bool burning = t < f->burnout;
+
+    if(vibration != VIBRATION_NONE) {
+        // combustion roughness and airframe modes, strongest while the motor burns
+        sf += (burning ? 0.4f : 0.1f) * noise() + (burning ? 0.6f : 0.05f) * sinf(t * 0.9f);
+    }
+    if(vibration == VIBRATION_DROPOUTS && burning && uniform() < 0.02f) {
+        sf = 0;
+    }
+
+    return axis_sign * (0.02f * noise() + sf);
+}
+
+static run_result_t run(const flight_t* f, int8_t axis_sign, uint8_t vibration, uint32_t seed) {
+    run_result_t r = {};
+    burnout_detector_t d;
+
+    rng_state = seed;
+    burnout_init(&d, ACCEL_THRESHOLD, JERK_THRESHOLD, SUSTAIN_MS, JERK_WINDOW_MS, FILTER_ALPHA);
+
+    for(uint32_t t = 0; t < PROFILE_MS; t += ACCEL_PERIOD) {
+        if(t == ARM_DELAY) {
+            burnout_arm(&d, axis_sign);
+        }
+
+        if(burnout_update(&d, START_MS + t, reading(f, t, axis_sign, vibration))) {
+            r.detected = true;
+            r.latency = (int32_t) (d.detect_time - START_MS) - (int32_t) f->burnout;
+            r.sf_at_detection = f->sf[t];
+            break;
+        }
+    }
+
+    return r;
+}
+
+static int32_t percentile(std::vector<int32_t> v, float q) {
+    if(v.empty()) {
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[(size_t) (q * (v.size() - 1))];
+}
+
+static void benchmark(const flight_t* f) {
+    burnout_detector_t d;
+    uint32_t detections = 0;
+
+    printf("benchmark\n");
+
+    burnout_init(&d, ACCEL_THRESHOLD, JERK_THRESHOLD, SUSTAIN_MS, JERK_WINDOW_MS, FILTER_ALPHA);
+    burnout_arm(&d, 1);
+
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        uint32_t t = (i * ACCEL_PERIOD) % PROFILE_MS;
+        if(t == 0) {
+            burnout_arm(&d, 1);
+        }
+        detections += burnout_update(&d, START_MS + i * ACCEL_PERIOD, f->sf[t]);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_ITERATIONS;
+
+    printf("    burnout_update()                                 %6.1f ns  (%lu)\n", ns, (unsigned long) detections);
+}
+
+int main() {
+    static flight_t flights[NUM_MOTORS];
+
+    for(uint8_t m = 0; m < NUM_MOTORS; m++) {
+        fly(&flights[m], &motors[m]);
+    }
+
+    printf("latency from the true burnout to the detection, %d seeds, both mountings\n", SEEDS);
+    printf("    %-28s %-20s %8s %8s %8s  %s\n", "flight", "IMU", "min", "p50", "max", "coast force");
+
+    bool all_detected = true;
+    bool none_early = true;
+    bool within_bound = true;
+    bool signs_agree = true;
+    float highest_sf = -1e9f;
+
+    for(uint8_t m = 0; m < NUM_MOTORS; m++) {
+        const flight_t* f = &flights[m];
+
+        for(uint8_t vibration = 0; vibration < NUM_VIBRATIONS; vibration++) {
+            std::vector<int32_t> latency;
+
+            for(uint32_t seed = 1; seed <= SEEDS; seed++) {
+                for(int8_t axis_sign = -1; axis_sign <= 1; axis_sign += 2) {
+                    run_result_t r = run(f, axis_sign, vibration, seed * 7919);
+
+                    all_detected &= r.detected;
+                    if(!r.detected) {
+                        continue;
+                    }
+
+                    none_early &= r.sf_at_detection <= EARLY_SF;
+                    within_bound &= r.latency <= LATE_BOUND;
+                    highest_sf = std::max(highest_sf, r.sf_at_detection);
+                    latency.push_back(r.latency);
+                }
+
+                // the same noise read through either mounting gives the same detection
+                if(vibration == VIBRATION_NONE) {
+                    run_result_t up = run(f, 1, vibration, seed * 7919);
+                    run_result_t down = run(f, -1, vibration, seed * 7919);
+                    signs_agree &= up.detected == down.detected && up.latency == down.latency;
+                }
+            }
+
+            printf("    %-28s %-20s %5ld ms %5ld ms %5ld ms  %5.2f g\n", f->name, vibration_names[vibration],
+                   (long) percentile(latency, 0), (long) percentile(latency, 0.5f), (long) percentile(latency, 1.0f), f->coast_sf);
+        }
+    }
+
+    printf("    highest true axial force at a detection %.2f g\n", highest_sf);
+    check(all_detected, "every burnout detected, none missed");
+    check(none_early, "no detection while thrust exceeds drag by EARLY_SF");
+    check(within_bound, "every detection within LATE_BOUND of the true burnout");
+    check(signs_agree, "X axis up or down the rocket, the same detection");
+
+    benchmark(&flights[1]);
+
+    return check_summary();
+}
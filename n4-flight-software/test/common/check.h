@@ -0,0 +1,27 @@
+/**
+ * Checks shared by the host tests in test/, each built from its own directory with -I../common
+ * A test calls check() for every condition it verifies, one aligned line with ok or FAILED,
+ * and ends main() with return check_summary(), the verdict and the exit status, 1 if any
+ * check failed
+ */
+
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <stdio.h>
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    printf("    %-64s %s\n", what, condition ? "ok" : "FAILED");
+    if(!condition) {
+        failures++;
+    }
+}
+
+static int check_summary() {
+    printf("%s\n", failures == 0 ? "all checks passed" : "some checks FAILED");
+    return failures == 0 ? 0 : 1;
+}
+
+#endif
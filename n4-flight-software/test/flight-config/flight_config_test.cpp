@@ -0,0 +1,283 @@
+/**
+ * Host test of the flight config record in src/flight_config.cpp, loaded the way
+ * loadFlightConfig() does: the defaults from defs.h stay in place unless the whole record
+ * is accepted. Runs:
+ * - a round trip through flight_config_serialize() and flight_config_parse()
+ * - every single bit flip of a record, every truncation, older and newer versions with a
+ *   valid CRC, and values out of range, each one leaving the defaults untouched
+ * - records generated and verified by scripts/flight-config.py, if python3 is installed
+ * - a benchmark of the CRC and of parsing a record
+ *
+ * build and run from this directory:
+ *     g++ -O2 -I../common -I../../src flight_config_test.cpp ../../src/flight_config.cpp -o flight_config_test && ./flight_config_test
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <chrono>
+#include "flight_config.h"
+#include "check.h"
+
+#define BENCH_RECORDS       100000
+#define SCRIPT              "../../scripts/flight-config.py"
+
+/* loaded_flight_config in main.cpp, the values of include/defs.h */
+static const flight_config_t defaults = {
+    10,         /* LAUNCH_DETECTION_THRESHOLD */
+    2.5f,       /* LAUNCH_ACCEL_THRESHOLD */
+    30,         /* LAUNCH_ACCEL_SUSTAIN_TIME */
+    2000,       /* LAUNCH_CONFIRM_TIME */
+    0,          /* BURNOUT_ACCEL_THRESHOLD */
+    4,          /* BURNOUT_JERK_THRESHOLD */
+    20,         /* BURNOUT_SUSTAIN_TIME */
+    500,        /* BURNOUT_JERK_WINDOW */
+    0.3f,       /* BURNOUT_FILTER_ALPHA */
+    3000,       /* APOGEE_LOCKOUT_TIME */
+    1000,       /* COAST_APOGEE_LOCKOUT_TIME */
+    0,          /* APOGEE_VELOCITY_THRESHOLD */
+    0,          /* APOGEE_SLOPE_THRESHOLD */
+    3,          /* APOGEE_CONFIDENCE */
+    30000,      /* APOGEE_TIMEOUT_TIME */
+    1000,       /* MAIN_EJECTION_HEIGHT */
+    10,         /* MAIN_EJECTION_HYSTERESIS */
+    3,          /* MAIN_EJECTION_CONFIRM */
+    5000,       /* LANDING_LOCKOUT_TIME */
+    1.0f,       /* LANDING_VELOCITY_THRESHOLD */
+    2.0f,       /* LANDING_ALTITUDE_BAND */
+    5000,       /* LANDING_STABLE_TIME */
+    5000,       /* GROUND_CALIBRATION_TIME */
+    1.0f,       /* KALMAN_ALTITUDE_SIGMA */
+    20.0f,      /* KALMAN_ACCEL_SIGMA */
+    5.0f,       /* KALMAN_INNOVATION_GATE */
+    100,        /* LOG_INTERVAL_GROUND */
+    10,         /* LOG_INTERVAL_POWERED */
+    5,          /* LOG_INTERVAL_COASTING */
+    50,         /* LOG_INTERVAL_DESCENT */
+    10          /* TELEMETRY_DATA_QUEUE_LENGTH */
+};
+
+/* a site config that differs from the defaults in every field */
+static flight_config_t site_config() {
+    flight_config_t c;
+    c.launch_detection_threshold = 15;
+    c.launch_accel_threshold = 3.0f;
+    c.launch_accel_sustain_ms = 40;
+    c.launch_confirm_ms = 2500;
+    c.burnout_accel_threshold = -0.2f;
+    c.burnout_jerk_threshold = 8;
+    c.burnout_sustain_ms = 25;
+    c.burnout_jerk_window_ms = 400;
+    c.burnout_filter_alpha = 0.5f;
+    c.apogee_lockout_ms = 4000;
+    c.coast_apogee_lockout_ms = 1500;
+    c.apogee_velocity_threshold = 0.5f;
+    c.apogee_slope_threshold = -0.5f;
+    c.apogee_confidence = 4;
+    c.apogee_timeout_ms = 40000;
+    c.main_ejection_height = 450;
+    c.main_ejection_hysteresis = 15;
+    c.main_ejection_confirm = 5;
+    c.landing_lockout_ms = 8000;
+    c.landing_velocity_threshold = 0.8f;
+    c.landing_altitude_band = 3.0f;
+    c.landing_stable_ms = 6000;
+    c.ground_calibration_ms = 4000;
+    c.kalman_altitude_sigma = 1.5f;
+    c.kalman_accel_sigma = 25.0f;
+    c.kalman_innovation_gate = 4.0f;
+    c.log_interval_ground_ms = 200;
+    c.log_interval_powered_ms = 8;
+    c.log_interval_coasting_ms = 4;
+    c.log_interval_descent_ms = 40;
+    c.data_queue_length = 16;
+    return c;
+}
+
+static flight_config_t loaded;
+
+/* loadFlightConfig(), the defaults stay unless the record is accepted */
+static uint8_t load(const uint8_t* record, size_t length) {
+    loaded = defaults;
+    return flight_config_parse(&loaded, record, length);
+}
+
+static bool is_defaults() {
+    return memcmp(&loaded, &defaults, sizeof(flight_config_t)) == 0;
+}
+
+static void set_crc(uint8_t* record) {
+    size_t crc_offset = FLIGHT_CONFIG_HEADER_SIZE + FLIGHT_CONFIG_PAYLOAD_SIZE;
+    uint32_t crc = flight_config_crc32(record, crc_offset);
+    for(uint8_t i = 0; i < 4; i++) {
+        record[crc_offset + i] = (crc >> (8 * i)) & 0xFF;
+    }
+}
+
+/* a record of c with one field changed and a valid CRC */
+static void with_field(const flight_config_t* c, uint8_t* record, size_t offset, const void* value) {
+    flight_config_t changed = *c;
+    memcpy((uint8_t*) &changed + offset, value, 4);
+    flight_config_serialize(&changed, record, FLIGHT_CONFIG_RECORD_SIZE);
+}
+
+static bool read_file(const char* path, uint8_t* buffer, size_t size, size_t* length) {
+    FILE* f = fopen(path, "rb");
+    if(f == NULL) {
+        return false;
+    }
+    *length = fread(buffer, 1, size, f);
+    fclose(f);
+    return true;
+}
+
+int main() {
+    uint8_t record[FLIGHT_CONFIG_RECORD_SIZE];
+    uint8_t bad[FLIGHT_CONFIG_RECORD_SIZE];
+    flight_config_t site = site_config();
+
+    printf("round trip\n");
+
+    check(flight_config_validate(&defaults) == FLIGHT_CONFIG_OK, "the defs.h defaults validate");
+    check(flight_config_serialize(&site, record, sizeof(record)) == FLIGHT_CONFIG_RECORD_SIZE, "serialized to FLIGHT_CONFIG_RECORD_SIZE bytes");
+    check(flight_config_serialize(&site, record, sizeof(record) - 1) == 0, "nothing serialized into a short buffer");
+    check(load(record, sizeof(record)) == FLIGHT_CONFIG_OK && memcmp(&loaded, &site, sizeof(site)) == 0,
+          "parsed back field for field");
+
+    static const uint8_t check_string[] = "123456789";
+    check(flight_config_crc32(check_string, 9) == 0xCBF43926, "CRC-32 check value of \"123456789\"");
+
+    printf("rejected records, the defaults stay\n");
+
+    bool flips_rejected = true;
+    bool flips_defaults = true;
+    uint32_t statuses = 0;
+    for(size_t bit = 0; bit < 8 * sizeof(record); bit++) {
+        memcpy(bad, record, sizeof(record));
+        bad[bit / 8] ^= 1 << (bit % 8);
+        uint8_t status = load(bad, sizeof(bad));
+        flips_rejected &= status != FLIGHT_CONFIG_OK;
+        flips_defaults &= is_defaults();
+        statuses |= 1 << status;
+    }
+    check(flips_rejected && flips_defaults, "every single bit flip rejected");
+    check(statuses & (1 << FLIGHT_CONFIG_BAD_CRC), "payload and CRC flips fail the CRC");
+
+    bool short_rejected = true;
+    for(size_t length = 0; length < sizeof(record); length++) {
+        uint8_t status = load(record, length);
+        uint8_t expected = length < FLIGHT_CONFIG_HEADER_SIZE + FLIGHT_CONFIG_CRC_SIZE ? FLIGHT_CONFIG_TOO_SHORT : FLIGHT_CONFIG_BAD_LENGTH;
+        short_rejected &= status == expected && is_defaults();
+    }
+    check(short_rejected, "every truncated record rejected, TOO_SHORT or BAD_LENGTH");
+    check(load(NULL, sizeof(record)) == FLIGHT_CONFIG_TOO_SHORT && is_defaults(), "no record, TOO_SHORT");
+
+    uint8_t longer[FLIGHT_CONFIG_RECORD_SIZE + 16] = {};
+    memcpy(longer, record, sizeof(record));
+    check(load(longer, sizeof(longer)) == FLIGHT_CONFIG_OK, "trailing bytes after the CRC ignored");
+
+    memcpy(bad, record, sizeof(record));
+    bad[4] = FLIGHT_CONFIG_VERSION - 1;
+    set_crc(bad);
+    check(load(bad, sizeof(bad)) == FLIGHT_CONFIG_OLD_VERSION && is_defaults(), "older version with a valid CRC, OLD_VERSION");
+
+    memcpy(bad, record, sizeof(record));
+    bad[4] = FLIGHT_CONFIG_VERSION + 1;
+    set_crc(bad);
+    check(load(bad, sizeof(bad)) == FLIGHT_CONFIG_NEW_VERSION && is_defaults(), "newer version with a valid CRC, NEW_VERSION");
+
+    memcpy(bad, record, sizeof(record));
+    bad[6] -= 4;
+    set_crc(bad);
+    check(load(bad, sizeof(bad)) == FLIGHT_CONFIG_BAD_LENGTH && is_defaults(), "payload length one field short, BAD_LENGTH");
+
+    memcpy(bad, record, sizeof(record));
+    bad[0] ^= 0xFF;
+    set_crc(bad);
+    check(load(bad, sizeof(bad)) == FLIGHT_CONFIG_BAD_MAGIC && is_defaults(), "other magic, BAD_MAGIC");
+
+    float nan = NAN;
+    uint32_t zero = 0;
+    uint32_t long_queue = FLIGHT_CONFIG_MAX_QUEUE_LENGTH + 1;
+    uint32_t short_timeout = site.apogee_lockout_ms;
+    float alpha = 1.5f;
+
+    with_field(&site, bad, offsetof(flight_config_t, main_ejection_height), &nan);
+    bool range = load(bad, sizeof(bad)) == FLIGHT_CONFIG_OUT_OF_RANGE && is_defaults();
+    with_field(&site, bad, offsetof(flight_config_t, apogee_slope_threshold), &nan);
+    range &= load(bad, sizeof(bad)) == FLIGHT_CONFIG_OUT_OF_RANGE && is_defaults();
+    with_field(&site, bad, offsetof(flight_config_t, data_queue_length), &zero);
+    range &= load(bad, sizeof(bad)) == FLIGHT_CONFIG_OUT_OF_RANGE && is_defaults();
+    with_field(&site, bad, offsetof(flight_config_t, data_queue_length), &long_queue);
+    range &= load(bad, sizeof(bad)) == FLIGHT_CONFIG_OUT_OF_RANGE && is_defaults();
+    with_field(&site, bad, offsetof(flight_config_t, apogee_timeout_ms), &short_timeout);
+    range &= load(bad, sizeof(bad)) == FLIGHT_CONFIG_OUT_OF_RANGE && is_defaults();
+    with_field(&site, bad, offsetof(flight_config_t, burnout_filter_alpha), &alpha);
+    range &= load(bad, sizeof(bad)) == FLIGHT_CONFIG_OUT_OF_RANGE && is_defaults();
+    with_field(&site, bad, offsetof(flight_config_t, log_interval_descent_ms), &zero);
+    range &= load(bad, sizeof(bad)) == FLIGHT_CONFIG_OUT_OF_RANGE && is_defaults();
+    check(range, "NaN, zero and too long values with a valid CRC, OUT_OF_RANGE");
+
+    printf("scripts/flight-config.py\n");
+
+    if(system("python3 --version > /dev/null 2>&1") != 0) {
+        printf("    python3 not found, skipped\n");
+    } else {
+        char path[64];
+        char command[256];
+        snprintf(path, sizeof(path), "/tmp/flight_config_test_%d.bin", (int) getpid());
+
+        snprintf(command, sizeof(command), "python3 " SCRIPT " generate %s > /dev/null", path);
+        size_t length = 0;
+        bool generated = system(command) == 0 && read_file(path, bad, sizeof(bad), &length);
+        check(generated && load(bad, length) == FLIGHT_CONFIG_OK && is_defaults(), "generated with no settings, the defaults");
+
+        snprintf(command, sizeof(command), "python3 " SCRIPT " generate %s main_ejection_height=450 data_queue_length=16 > /dev/null", path);
+        generated = system(command) == 0 && read_file(path, bad, sizeof(bad), &length);
+        check(generated && load(bad, length) == FLIGHT_CONFIG_OK && loaded.main_ejection_height == 450 && loaded.data_queue_length == 16,
+              "generated with settings, parsed with them");
+
+        FILE* f = fopen(path, "wb");
+        fwrite(record, 1, sizeof(record), f);
+        fclose(f);
+        snprintf(command, sizeof(command), "python3 " SCRIPT " verify %s > /dev/null", path);
+        check(system(command) == 0, "a serialized record verifies");
+
+        f = fopen(path, "wb");
+        fwrite(record, 1, sizeof(record) - 1, f);
+        fclose(f);
+        check(system(command) != 0, "a truncated record does not");
+
+        remove(path);
+    }
+
+    printf("benchmark\n");
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t crc = 0;
+    for(int i = 0; i < BENCH_RECORDS; i++) {
+        record[8] = (uint8_t) i;
+        crc += flight_config_crc32(record, FLIGHT_CONFIG_RECORD_SIZE - FLIGHT_CONFIG_CRC_SIZE);
+    }
+    double crc_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_RECORDS;
+
+    flight_config_serialize(&site, record, sizeof(record));
+    start = std::chrono::steady_clock::now();
+    uint32_t accepted = 0;
+    for(int i = 0; i < BENCH_RECORDS; i++) {
+        accepted += load(record, sizeof(record)) == FLIGHT_CONFIG_OK;
+    }
+    double parse_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_RECORDS;
+
+    size_t crc_bytes = FLIGHT_CONFIG_RECORD_SIZE - FLIGHT_CONFIG_CRC_SIZE;
+    printf("    CRC-32 of a record, %lu bytes                  %8.1f ns  %6.1f MB/s  (%08x)\n", (unsigned long) crc_bytes, crc_ns,
+           crc_bytes / crc_ns * 1000, crc);
+    printf("    flight_config_parse() of a whole record         %8.1f ns  (%u accepted)\n", parse_ns, accepted);
+
+    return check_summary();
+}
@@ -0,0 +1,381 @@
+/**
+ * Host check of the flight state machine in src/flight_fsm.cpp
+ * - every (state, event) cell of the transition table against the transitions listed in
+ *   flight_fsm.h, with the entry hooks called along the way
+ * - the guards at and just inside their lockouts
+ * - the transient states chaining through EVENT_DONE, events posted from hooks and a
+ *   full event queue
+ * - a benchmark of fsm_dispatch() per cell and of the decision latency of one sample
+ *   through the detectors and the state machine, as checkFlightState runs them
+ *
+ * build and run from this directory:
+ *     g++ -O2 -I../common -I../../src fsm_table.cpp ../../src/flight_fsm.cpp ../../src/launch_detector.cpp ../../src/burnout_detector.cpp \
+ *         ../../src/apogee_detector.cpp ../../src/altitude_trigger.cpp ../../src/landing_detector.cpp -o fsm_table && ./fsm_table
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "flight_fsm.h"
+#include "launch_detector.h"
+#include "burnout_detector.h"
+#include "apogee_detector.h"
+#include "altitude_trigger.h"
+#include "landing_detector.h"
+#include "check.h"
+
+#define APOGEE_LOCKOUT      3000        /* APOGEE_LOCKOUT_TIME */
+#define COAST_LOCKOUT       1000        /* COAST_APOGEE_LOCKOUT_TIME */
+#define LANDING_LOCKOUT     5000        /* LANDING_LOCKOUT_TIME */
+#define START_MS            1000
+#define LATE_MS             100000      /* past every lockout */
+#define BENCH_DISPATCHES    200000
+
+#define S(state)            ARMED_FLIGHT_STATE::state
+#define STAY                FSM_NO_TRANSITION
+
+/* the transitions listed in flight_fsm.h, one step, STAY where the event is ignored */
+static const uint8_t expected_next[NUM_FLIGHT_STATES][NUM_FLIGHT_EVENTS] = {
+    /*                       LAUNCH             BURNOUT      APOGEE       MAIN_ALTITUDE     LANDED                 LAUNCH_REJECTED        DONE */
+    /* PRE_FLIGHT_GROUND */  { S(POWERED_FLIGHT), STAY,       STAY,        STAY,             STAY,                  STAY,                  STAY },
+    /* POWERED_FLIGHT */     { STAY,              S(COASTING), S(APOGEE),  STAY,             STAY,                  S(PRE_FLIGHT_GROUND),  STAY },
+    /* COASTING */           { STAY,              STAY,       S(APOGEE),   STAY,             STAY,                  STAY,                  STAY },
+    /* APOGEE */             { STAY,              STAY,       STAY,        STAY,             STAY,                  STAY,                  S(DROGUE_DEPLOY) },
+    /* DROGUE_DEPLOY */      { STAY,              STAY,       STAY,        STAY,             STAY,                  STAY,                  S(DROGUE_DESCENT) },
+    /* DROGUE_DESCENT */     { STAY,              STAY,       STAY,        S(MAIN_DEPLOY),   S(POST_FLIGHT_GROUND), STAY,                  STAY },
+    /* MAIN_DEPLOY */        { STAY,              STAY,       STAY,        STAY,             STAY,                  STAY,                  S(MAIN_DESCENT) },
+    /* MAIN_DESCENT */       { STAY,              STAY,       STAY,        STAY,             S(POST_FLIGHT_GROUND), STAY,                  STAY },
+    /* POST_FLIGHT_GROUND */ { STAY,              STAY,       STAY,        STAY,             STAY,                  STAY,                  STAY }
+};
+
+static bool transient(uint8_t state) {
+    return state == S(APOGEE) || state == S(DROGUE_DEPLOY) || state == S(MAIN_DEPLOY);
+}
+
+/* the states entered, in order */
+static uint8_t entered[32];
+static uint8_t entered_count;
+static uint8_t post_on_entry = NUM_FLIGHT_EVENTS;      /* event the DROGUE_DESCENT hook posts, NUM_FLIGHT_EVENTS for none */
+static uint8_t posts_on_entry = 0;
+
+static void record_entry(flight_fsm_t* fsm, uint8_t state) {
+    if(entered_count < sizeof(entered)) {
+        entered[entered_count++] = state;
+    }
+    if(state == S(DROGUE_DESCENT)) {
+        for(uint8_t i = 0; i < posts_on_entry; i++) {
+            fsm_post(fsm, post_on_entry);
+        }
+    }
+}
+
+static flight_fsm_t fsm;
+
+static void reset(uint8_t state) {
+    fsm_init(&fsm, APOGEE_LOCKOUT, COAST_LOCKOUT, LANDING_LOCKOUT, START_MS);
+    for(uint8_t s = 0; s < NUM_FLIGHT_STATES; s++) {
+        fsm_set_hooks(&fsm, s, record_entry, NULL);
+    }
+    fsm.state = state;
+    entered_count = 0;
+    post_on_entry = NUM_FLIGHT_EVENTS;
+    posts_on_entry = 0;
+}
+
+static void table() {
+    printf("every (state, event) cell, guards open\n");
+
+    bool lookup_ok = true;
+    bool dispatch_ok = true;
+    uint32_t taken = 0;
+
+    for(uint8_t state = 0; state < NUM_FLIGHT_STATES; state++) {
+        for(uint8_t event = 0; event < NUM_FLIGHT_EVENTS; event++) {
+            const fsm_transition_t* t = fsm_lookup(state, event);
+            lookup_ok &= t != NULL && t->next_state == expected_next[state][event];
+
+            // the states a dispatch passes through, transient ones are left on EVENT_DONE
+            uint8_t path[8];
+            uint8_t length = 0;
+            uint8_t next = expected_next[state][event];
+            while(next != STAY) {
+                path[length++] = next;
+                next = transient(next) ? expected_next[next][EVENT_DONE] : STAY;
+            }
+
+            reset(state);
+            uint8_t final_state = fsm_dispatch(&fsm, event, LATE_MS);
+
+            bool ok = final_state == (length > 0 ? path[length - 1] : state) && fsm.transitions == length
+                      && entered_count == length && memcmp(entered, path, length) == 0 && fsm.event_count == 0
+                      && fsm.rejected == 0;
+            if(!ok) {
+                printf("    %s on %s ends in %s\n", fsm_state_name(state), fsm_event_name(event), fsm_state_name(final_state));
+            }
+            dispatch_ok &= ok;
+            taken += length > 0;
+        }
+    }
+
+    printf("    %d cells, %lu take a transition\n", NUM_FLIGHT_STATES * NUM_FLIGHT_EVENTS, (unsigned long) taken);
+    check(lookup_ok, "fsm_lookup matches the transitions of flight_fsm.h");
+    check(dispatch_ok, "every dispatch ends in the expected state through its hooks");
+    check(expected_next[S(COASTING)][EVENT_LAUNCH_REJECTED] == STAY, "COASTING ignores LAUNCH_REJECTED");
+    check(fsm_lookup(NUM_FLIGHT_STATES, 0) == NULL && fsm_lookup(0, NUM_FLIGHT_EVENTS) == NULL, "lookup out of range returns NULL");
+    check(strcmp(fsm_state_name(NUM_FLIGHT_STATES), "UNKNOWN") == 0 && strcmp(fsm_event_name(NUM_FLIGHT_EVENTS), "UNKNOWN") == 0,
+          "names out of range are UNKNOWN");
+}
+
+static void guards() {
+    printf("guards\n");
+
+    // POWERED_FLIGHT apogee, lockout from launch
+    reset(S(POWERED_FLIGHT));
+    fsm.launch_time = START_MS;
+    bool early = fsm_dispatch(&fsm, EVENT_APOGEE, START_MS + APOGEE_LOCKOUT - 1) == S(POWERED_FLIGHT) && fsm.rejected == 1;
+    bool late = fsm_dispatch(&fsm, EVENT_APOGEE, START_MS + APOGEE_LOCKOUT) == S(DROGUE_DESCENT);
+    check(early && late && fsm.apogee_time == START_MS + APOGEE_LOCKOUT, "apogee in POWERED_FLIGHT from APOGEE_LOCKOUT after launch");
+
+    // COASTING apogee, lockout from burnout
+    reset(S(COASTING));
+    fsm.burnout_time = START_MS;
+    early = fsm_dispatch(&fsm, EVENT_APOGEE, START_MS + COAST_LOCKOUT - 1) == S(COASTING) && fsm.rejected == 1;
+    late = fsm_dispatch(&fsm, EVENT_APOGEE, START_MS + COAST_LOCKOUT) == S(DROGUE_DESCENT);
+    check(early && late, "apogee in COASTING from COAST_LOCKOUT after burnout");
+
+    // landing, lockout from apogee, in both descent states
+    bool landing = true;
+    const uint8_t descent[] = { S(DROGUE_DESCENT), S(MAIN_DESCENT) };
+    for(uint8_t state : descent) {
+        reset(state);
+        fsm.apogee_time = START_MS;
+        landing &= fsm_dispatch(&fsm, EVENT_LANDED, START_MS + LANDING_LOCKOUT - 1) == state && fsm.rejected == 1;
+        landing &= fsm_dispatch(&fsm, EVENT_LANDED, START_MS + LANDING_LOCKOUT) == S(POST_FLIGHT_GROUND);
+    }
+    check(landing, "landing in both descent states from LANDING_LOCKOUT after apogee");
+
+    // the lockouts are differences, they hold across the millis() wrap
+    reset(S(POWERED_FLIGHT));
+    fsm.launch_time = 0xFFFFFF00;
+    early = fsm_dispatch(&fsm, EVENT_APOGEE, 0xFFFFFF00 + APOGEE_LOCKOUT - 1) == S(POWERED_FLIGHT);
+    late = fsm_dispatch(&fsm, EVENT_APOGEE, 0xFFFFFF00 + APOGEE_LOCKOUT) == S(DROGUE_DESCENT);
+    check(early && late, "lockout across the millis() wrap");
+}
+
+static void chaining() {
+    printf("transient states and posted events\n");
+
+    // a whole flight, one event at a time
+    reset(S(PRE_FLIGHT_GROUND));
+    fsm_dispatch(&fsm, EVENT_LAUNCH, 2000);
+    fsm_dispatch(&fsm, EVENT_BURNOUT, 4000);
+    fsm_dispatch(&fsm, EVENT_APOGEE, 20000);
+    fsm_dispatch(&fsm, EVENT_MAIN_ALTITUDE, 60000);
+    uint8_t final_state = fsm_dispatch(&fsm, EVENT_LANDED, 90000);
+
+    const uint8_t flight[] = { S(POWERED_FLIGHT), S(COASTING), S(APOGEE), S(DROGUE_DEPLOY), S(DROGUE_DESCENT),
+                               S(MAIN_DEPLOY), S(MAIN_DESCENT), S(POST_FLIGHT_GROUND) };
+    check(final_state == S(POST_FLIGHT_GROUND) && entered_count == sizeof(flight) && memcmp(entered, flight, sizeof(flight)) == 0,
+          "a flight enters every state once, in order");
+    check(fsm.launch_time == 2000 && fsm.burnout_time == 4000 && fsm.apogee_time == 20000 && fsm.state_entry_time == 90000,
+          "launch, burnout and apogee times recorded by the actions");
+
+    // an event posted by a hook is handled after the DONE chain that is under way
+    reset(S(COASTING));
+    fsm.burnout_time = START_MS;
+    post_on_entry = EVENT_MAIN_ALTITUDE;
+    posts_on_entry = 1;
+    final_state = fsm_dispatch(&fsm, EVENT_APOGEE, LATE_MS);
+    const uint8_t chain[] = { S(APOGEE), S(DROGUE_DEPLOY), S(DROGUE_DESCENT), S(MAIN_DEPLOY), S(MAIN_DESCENT) };
+    check(final_state == S(MAIN_DESCENT) && entered_count == sizeof(chain) && memcmp(entered, chain, sizeof(chain)) == 0,
+          "an event posted from a hook runs after the transition completes");
+    check(fsm.state_entry_time == LATE_MS && fsm.transitions == sizeof(chain), "one dispatch, five transitions at the same time");
+
+    // a hook flooding the queue loses the events that do not fit, the DONE chain is already over
+    reset(S(DROGUE_DEPLOY));
+    post_on_entry = EVENT_LAUNCH;
+    posts_on_entry = FSM_EVENT_QUEUE_LENGTH + 3;
+    final_state = fsm_dispatch(&fsm, EVENT_DONE, LATE_MS);
+    check(final_state == S(DROGUE_DESCENT) && fsm.dropped == 3 && fsm.event_count == 0, "a full queue drops and counts the extra events");
+
+    reset(S(PRE_FLIGHT_GROUND));
+    check(fsm_post(&fsm, NUM_FLIGHT_EVENTS) == 0 && fsm.dropped == 1 && fsm.event_count == 0, "an invalid event is dropped");
+}
+
+/*
+ * benchmarks
+ */
+
+static double elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void no_hooks(flight_fsm_t* fsm, uint8_t state) {
+}
+
+static void dispatch_benchmark() {
+    printf("benchmark, fsm_dispatch per cell\n");
+
+    double worst = 0;
+    double total = 0;
+    uint8_t worst_state = 0;
+    uint8_t worst_event = 0;
+
+    for(uint8_t state = 0; state < NUM_FLIGHT_STATES; state++) {
+        for(uint8_t event = 0; event < NUM_FLIGHT_EVENTS; event++) {
+            fsm_init(&fsm, APOGEE_LOCKOUT, COAST_LOCKOUT, LANDING_LOCKOUT, START_MS);
+            for(uint8_t s = 0; s < NUM_FLIGHT_STATES; s++) {
+                fsm_set_hooks(&fsm, s, no_hooks, NULL);
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            for(int i = 0; i < BENCH_DISPATCHES; i++) {
+                fsm.state = state;
+                fsm_dispatch(&fsm, event, LATE_MS);
+            }
+            double ns = elapsed_ns(start) / BENCH_DISPATCHES;
+
+            total += ns;
+            if(ns > worst) {
+                worst = ns;
+                worst_state = state;
+                worst_event = event;
+            }
+        }
+    }
+
+    printf("    mean over the cells %6.1f ns\n", total / (NUM_FLIGHT_STATES * NUM_FLIGHT_EVENTS));
+    printf("    worst cell          %6.1f ns, %s on %s\n", worst, fsm_state_name(worst_state), fsm_event_name(worst_event));
+    check(worst < 1000, "worst cell under 1 us");
+}
+
+/* a synthetic flight, one accelerometer sample every 10 ms and an altitude every 50 ms */
+typedef struct {
+    uint32_t now;
+    float ax;
+    uint8_t has_altitude;
+    float agl;
+    float velocity;
+} bench_sample_t;
+
+static void decision_benchmark() {
+    printf("benchmark, decision latency per sample through the detectors\n");
+
+    std::vector<bench_sample_t> samples;
+    float velocity = 0;
+    float altitude = 0;
+    uint32_t ms = 0;
+    for(; ms < 200000 && (ms < 5000 || altitude > 0); ms++) {
+        float sf = 1.0f;
+        if(ms >= 2000 && ms < 4000) {
+            sf = 8.0f;                                  /* burn */
+        } else if(ms >= 4000) {
+            sf = velocity > 0 ? -0.2f : (velocity < -40 ? 1.0f : 0.2f);   /* coast, then under the drogue */
+        }
+        if(ms >= 60000 && velocity < -6) {
+            sf = 1.0f;                                  /* main chute, steady descent */
+        }
+        velocity += (sf - 1.0f) * 9.81f * 0.001f;
+        altitude += velocity * 0.001f;
+        if(altitude < 0) {
+            altitude = 0;
+            velocity = 0;
+        }
+
+        if(ms % 10 == 0) {
+            samples.push_back({ START_MS + ms, sf, (uint8_t) (ms % 50 == 0), altitude, velocity });
+        }
+    }
+    // on the ground for the landing detector
+    for(uint32_t t = 0; t < 10000; t += 10) {
+        samples.push_back({ START_MS + ms + t, 1.0f, (uint8_t) (t % 50 == 0), 0, 0 });
+    }
+
+    static launch_detector_t launch;
+    static burnout_detector_t burnout;
+    static apogee_detector_t apogee;
+    static altitude_trigger_t main_trigger;
+    static landing_detector_t landing;
+
+    uint8_t last_state = 0;
+    const uint32_t repeats = 5;
+    std::vector<double> best(samples.size(), 1e30);
+
+    // each flight is replayed from scratch, the best of the repeats filters out preemption
+    for(uint32_t r = 0; r < repeats; r++) {
+        launch_init(&launch, 2.5f, 30, 10, 2000, 500);
+        burnout_init(&burnout, 0, 4, 20, 500, 0.3f);
+        apogee_init(&apogee, APOGEE_LOCKOUT, 0, 0, 3, 30000, 16 * 0.98f);
+        altitude_trigger_init(&main_trigger, 1000, 10, 3);
+        landing_init(&landing, 1.0f, 2.0f, 5000);
+        fsm_init(&fsm, APOGEE_LOCKOUT, COAST_LOCKOUT, LANDING_LOCKOUT, START_MS);
+
+        for(size_t i = 0; i < samples.size(); i++) {
+            const bench_sample_t& s = samples[i];
+            auto start = std::chrono::steady_clock::now();
+
+            // the detectors are armed by the state hooks on the target, inline here
+            if(launch_update_accel(&launch, s.now, s.ax) == LAUNCH_DETECTED) {
+                fsm_dispatch(&fsm, EVENT_LAUNCH, s.now);
+                burnout_arm(&burnout, launch.axis_sign);
+                apogee_arm(&apogee, s.now, launch.axis_sign, launch.launch_time);
+            }
+            burnout_update(&burnout, s.now, s.ax);
+            if(apogee_update_accel(&apogee, s.now, s.ax)) {
+                fsm_dispatch(&fsm, EVENT_APOGEE, s.now);
+            }
+
+            if(s.has_altitude) {
+                if(launch_update_baro(&launch, s.now, s.agl) == LAUNCH_DETECTED) {
+                    fsm_dispatch(&fsm, EVENT_LAUNCH, s.now);
+                }
+                if(burnout.detected && launch.confirmed && fsm.state == S(POWERED_FLIGHT)) {
+                    fsm_dispatch(&fsm, EVENT_BURNOUT, s.now);
+                    apogee_restart_lockout(&apogee, s.now, COAST_LOCKOUT);
+                }
+                if(apogee_update(&apogee, s.now, s.agl, s.velocity)) {
+                    fsm_dispatch(&fsm, EVENT_APOGEE, s.now);
+                }
+                if(fsm.state == S(DROGUE_DESCENT) && !main_trigger.armed) {
+                    altitude_trigger_arm(&main_trigger);
+                    landing_arm(&landing);
+                }
+                if(altitude_trigger_update(&main_trigger, s.agl)) {
+                    fsm_dispatch(&fsm, EVENT_MAIN_ALTITUDE, s.now);
+                }
+                if(landing_update(&landing, s.now, s.agl, s.velocity)) {
+                    fsm_dispatch(&fsm, EVENT_LANDED, s.now);
+                }
+            }
+
+            double ns = elapsed_ns(start);
+            best[i] = ns < best[i] ? ns : best[i];
+        }
+        last_state = fsm.state;
+    }
+
+    std::vector<double> sorted = best;
+    std::sort(sorted.begin(), sorted.end());
+    size_t worst = std::max_element(best.begin(), best.end()) - best.begin();
+
+    printf("    %lu samples, the flight ends in %s\n", (unsigned long) samples.size(), fsm_state_name(last_state));
+    printf("    p50 %6.0f ns  p99 %6.0f ns  worst %6.0f ns at %.2f s\n", sorted[sorted.size() / 2],
+           sorted[sorted.size() * 99 / 100], sorted.back(), (samples[worst].now - START_MS) / 1000.0);
+    check(last_state == S(POST_FLIGHT_GROUND), "the benchmark flight reaches POST_FLIGHT_GROUND");
+    // the ESP32 runs this some 50x slower than a desktop, the sample period is 10 ms
+    check(sorted.back() < 100000, "worst sample under 100 us, 1/100 of the sample period");
+}
+
+int main() {
+    table();
+    guards();
+    chaining();
+    dispatch_benchmark();
+    decision_benchmark();
+
+    return check_summary();
+}
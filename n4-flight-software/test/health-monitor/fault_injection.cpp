@@ -0,0 +1,343 @@
+/**
+ * Host fault injection for the task health monitor in src/health_monitor.cpp
+ * The three sensor tasks check in at their periods, anywhere between the time they sleep on
+ * hardware and their worst case response time in task-schedule-sim, and the monitor checks
+ * them every 10 ms and acts like healthMonitorTask: the first recovery attempt of an I2C
+ * task resets the bus, the next restarts the task. A stall is due one period, the check-in
+ * jitter and a margin after the last check-in, the first one after the watch or a recovery
+ * attempt also has the sleep on hardware, as healthMonitorInit() sets them. Injected faults:
+ * - a hung I2C bus stalls the IMU and the barometer until the bus is reset, the IMU times
+ *   out first and its bus reset clears the barometer too
+ * - a stuck barometer task only comes back after a restart
+ * - a dead IMU is failed over, and restored when it checks in again
+ * - in a flight, a barometer that freezes mid ascent is failed over and every altitude
+ *   the detectors get is from the GPS from then on, although frozen barometer packets
+ *   keep arriving, until the barometer is restored
+ *
+ * build and run from this directory:
+ *     g++ -I../common -I../../src fault_injection.cpp ../../src/health_monitor.cpp ../../src/altitude_source.cpp \
+ *         ../../src/vertical_kalman.cpp -o fault_injection && ./fault_injection
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "health_monitor.h"
+#include "altitude_source.h"
+#include "check.h"
+
+#define MONITOR_PERIOD      10
+#define JITTER_MARGIN       2       /* HEALTH_JITTER_MARGIN */
+#define MAX_RECOVERIES      2       /* HEALTH_MAX_RECOVERIES */
+#define RUN_MS              12000
+
+#define BUS_HANG_AT         2000
+#define TASK_STUCK_AT       5000
+#define IMU_DEAD_AT         8000
+#define IMU_BACK_AT         10000
+
+#define ALTIMETER_DATA_FLAG (1 << 2)  /* data_types.h */
+#define GPS_ALTITUDE_SIGMA  5.0f    /* GPS_ALTITUDE_SIGMA */
+#define ACCEL_SIGMA         20.0f   /* KALMAN_ACCEL_SIGMA */
+#define INNOVATION_GATE     5.0f    /* KALMAN_INNOVATION_GATE */
+#define PAD_ALTITUDE        1500.0f /* GPS altitude of the pad above sea level */
+#define LAUNCH_AT           2000
+#define BURNOUT_AT          5000    /* 200 m up at 80 m/s, coast to 526 m, down at 10 m/s */
+#define BARO_FROZEN_AT      4000
+#define BARO_BACK_AT        25000
+#define FLIGHT_MS           30000
+#define GPS_AGL_TOLERANCE   20.0f   /* m from the true altitude while the barometer is failed */
+
+static uint32_t rng_state = 0x1234567;
+
+static uint32_t uniform(uint32_t range) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state % (range + 1);
+}
+
+typedef struct {
+    uint8_t task;
+    uint8_t on_i2c;
+    uint32_t period;
+    uint32_t suspend;           /* sleep on hardware before every check-in, suspend_us in ms */
+    uint32_t jitter;            /* worst case response time less suspend, rounded up */
+    uint32_t release;           /* next release of the loop */
+    uint32_t checkin_at;        /* check-in of the current loop, release plus suspend plus jitter */
+    uint8_t stuck;              /* stuck in its loop until restarted */
+    uint8_t dead;               /* never checks in */
+    uint32_t restarts;
+    uint32_t detect_latency;    /* worst time from the latest the missed check-in was due to the stall detection */
+} sim_task_t;
+
+static const char* action_names[] = { "none", "recover", "failover", "restored" };
+
+static float noise(float sigma) {
+    // sum of 12 uniforms, about normal
+    float sum = 0;
+    for(uint8_t i = 0; i < 12; i++) {
+        sum += uniform(1000) / 1000.0f;
+    }
+    return (sum - 6.0f) * sigma;
+}
+
+static float true_agl(uint32_t now) {
+    float burn = (BURNOUT_AT - LAUNCH_AT) / 1000.0f;
+    float coast = 80.0f / 9.81f;
+
+    if(now < LAUNCH_AT) {
+        return 0;
+    }
+
+    float t = (now - LAUNCH_AT) / 1000.0f;
+    if(t < burn) {
+        return 0.5f * (80.0f / burn) * t * t;
+    }
+
+    t -= burn;
+    if(t < coast) {
+        return 40.0f * burn + 80.0f * t - 0.5f * 9.81f * t * t;
+    }
+
+    float agl = 40.0f * burn + 40.0f * coast - 10.0f * (t - coast);
+    return agl > 0 ? agl : 0;
+}
+
+/**
+ * the altitude checkFlightState gets from a barometer that freezes mid ascent: its packets
+ * still arrive with the last altitude it measured, it no longer checks in
+ */
+static void barometer_failover() {
+    health_monitor_t m;
+    altitude_source_t source;
+    uint8_t failed_sensors = 0;
+    uint32_t failed_over_at = 0;
+    uint32_t restored_at = 0;
+    float baro_agl = 0;
+
+    uint32_t baro_before = 0;
+    uint32_t gps_before = 0;
+    uint32_t baro_while_failed = 0;
+    uint32_t gps_while_failed = 0;
+    uint32_t baro_after = 0;
+    uint32_t gps_after = 0;
+    float worst_error = 0;
+
+    printf("barometer frozen at %d ms in a flight, GPS fixes at 10 Hz\n", BARO_FROZEN_AT);
+
+    health_init(&m);
+    health_watch(&m, TASK_READ_ALTIMETER, 50 + 15 + JITTER_MARGIN, 50 + 30 + 15 + JITTER_MARGIN, MAX_RECOVERIES, 0);
+    altitude_source_init(&source, GPS_ALTITUDE_SIGMA, ACCEL_SIGMA, INNOVATION_GATE);
+
+    for(uint32_t now = 1; now <= FLIGHT_MS; now++) {
+        uint8_t baro_frozen = now >= BARO_FROZEN_AT && now < BARO_BACK_AT;
+
+        // the barometer sends every 50 ms, the GPS every 100 ms, with a new fix in every packet
+        uint8_t baro_sample = now % 50 == 0;
+        uint8_t gps_packet = now % 100 == 25;
+
+        if(baro_sample) {
+            if(!baro_frozen) {
+                baro_agl = true_agl(now) + noise(0.5f);
+                health_checkin(&m, TASK_READ_ALTIMETER, now);
+            }
+
+            // handleHealthAction() in the monitor task runs before the packet is checked
+            uint8_t baro_failed = (failed_sensors & ALTIMETER_DATA_FLAG) != 0;
+            uint8_t s = altitude_select(baro_failed, 1, 0);
+
+            if(s == ALTITUDE_BAROMETER && baro_failed) {
+                float error = fabsf(baro_agl - true_agl(now));
+                if(error > worst_error) {
+                    worst_error = error;
+                }
+            }
+
+            // the frozen packets before the failover are the monitor's detection time
+            if(s == ALTITUDE_BAROMETER) {
+                if(baro_failed) {
+                    baro_while_failed++;
+                } else if(now < BARO_FROZEN_AT) {
+                    baro_before++;
+                } else if(restored_at > 0) {
+                    baro_after++;
+                }
+            }
+        }
+
+        if(gps_packet) {
+            uint8_t fix = altitude_gps_fix(&source, now * 1000, PAD_ALTITUDE + true_agl(now) + noise(GPS_ALTITUDE_SIGMA), now < LAUNCH_AT);
+            uint8_t baro_failed = (failed_sensors & ALTIMETER_DATA_FLAG) != 0;
+
+            if(altitude_select(baro_failed, 0, fix) == ALTITUDE_GPS) {
+                float error = fabsf(altitude_gps_agl(&source) - true_agl(now));
+                if(baro_failed && error > worst_error) {
+                    worst_error = error;
+                }
+
+                if(now < BARO_FROZEN_AT) {
+                    gps_before++;
+                } else if(baro_failed) {
+                    gps_while_failed++;
+                } else {
+                    gps_after++;
+                }
+            }
+        }
+
+        if(now % MONITOR_PERIOD == 0) {
+            uint8_t action = health_check(&m, TASK_READ_ALTIMETER, now);
+
+            if(action == HEALTH_FAILOVER) {
+                failed_sensors |= ALTIMETER_DATA_FLAG;
+                failed_over_at = now;
+            } else if(action == HEALTH_RESTORED) {
+                failed_sensors &= ~ALTIMETER_DATA_FLAG;
+                restored_at = now;
+            }
+        }
+    }
+
+    printf("    failed over at %lu ms, restored at %lu ms, altitude within %.1f m\n", (unsigned long) failed_over_at,
+           (unsigned long) restored_at, worst_error);
+
+    check(baro_before > 0 && gps_before == 0, "barometer used, GPS ignored before the fault");
+    check(failed_over_at > BARO_FROZEN_AT && failed_over_at < BARO_FROZEN_AT + 1000, "frozen barometer failed over within a second");
+    check(baro_while_failed == 0, "no frozen barometer packet used after the failover");
+    check(gps_while_failed >= (BARO_BACK_AT - failed_over_at) / 100 - 1, "every GPS fix used while the barometer is failed");
+    check(worst_error < GPS_AGL_TOLERANCE, "altitude used while failed within GPS_AGL_TOLERANCE");
+    check(restored_at >= BARO_BACK_AT && baro_after > 0 && gps_after == 0, "barometer back in use once restored");
+}
+
+int main() {
+    health_monitor_t m;
+    sim_task_t tasks[] = {
+        { TASK_READ_ACCELERATION, 1, 10,  0,  2,  0, 0, 0, 0, 0, 0 },
+        { TASK_READ_ALTIMETER,    1, 50,  30, 15, 0, 0, 0, 0, 0, 0 },
+        { TASK_READ_GPS,          0, 100, 0,  6,  0, 0, 0, 0, 0, 0 },
+    };
+    const uint8_t num_tasks = sizeof(tasks) / sizeof(tasks[0]);
+    uint8_t bus_hung = 0;
+    uint32_t bus_resets = 0;
+    uint32_t bus_hang_resets = 0;
+    uint32_t actions[4] = {};
+    uint32_t false_alarms = 0;
+    uint8_t imu_failed_over = 0;
+    uint8_t imu_failed_at_end = 1;
+
+    health_init(&m);
+    for(uint8_t i = 0; i < num_tasks; i++) {
+        const sim_task_t* t = &tasks[i];
+        health_watch(&m, t->task, t->period + t->jitter + JITTER_MARGIN, t->period + t->suspend + t->jitter + JITTER_MARGIN, MAX_RECOVERIES, 0);
+        tasks[i].release = tasks[i].period;
+        tasks[i].checkin_at = tasks[i].period + tasks[i].suspend;
+    }
+
+    for(uint32_t now = 1; now <= RUN_MS; now++) {
+        if(now == BUS_HANG_AT) {
+            bus_hung = 1;
+        }
+        if(now == TASK_STUCK_AT) {
+            tasks[1].stuck = 1;
+        }
+        if(now == IMU_DEAD_AT) {
+            tasks[0].dead = 1;
+        }
+        if(now == IMU_BACK_AT) {
+            tasks[0].dead = 0;
+        }
+
+        // a task checks in after its sleep on hardware, up to its jitter later
+        for(uint8_t i = 0; i < num_tasks; i++) {
+            sim_task_t* t = &tasks[i];
+            if(now < t->checkin_at) {
+                continue;
+            }
+            t->release += t->period;
+            t->checkin_at = t->release + t->suspend + uniform(t->jitter);
+
+            if(t->dead || t->stuck || (t->on_i2c && bus_hung)) {
+                continue;
+            }
+
+            health_checkin(&m, t->task, now);
+        }
+
+        if(now % MONITOR_PERIOD != 0) {
+            continue;
+        }
+
+        for(uint8_t i = 0; i < num_tasks; i++) {
+            sim_task_t* t = &tasks[i];
+            uint8_t action = health_check(&m, t->task, now);
+            const health_entry_t* e = &m.tasks[t->task];
+
+            if(action == HEALTH_NONE) {
+                continue;
+            }
+            actions[action]++;
+            printf("    %5lu ms  task %d %-8s attempt %d\n", (unsigned long) now, t->task, action_names[action], e->recoveries);
+
+            bool faulted = (now > BUS_HANG_AT && t->on_i2c) || (now > TASK_STUCK_AT && i == 1) || (now > IMU_DEAD_AT && i == 0);
+            if(!faulted) {
+                false_alarms++;
+            }
+
+            if(action == HEALTH_RECOVER) {
+                if(e->recoveries == 1 && e->stalls > 0) {
+                    uint32_t latency = now - (e->stall_start + t->period + t->jitter);
+                    if(latency > t->detect_latency) {
+                        t->detect_latency = latency;
+                    }
+                }
+
+                if(t->on_i2c && e->recoveries == 1) {
+                    if(bus_hung) {
+                        bus_hang_resets++;
+                    }
+                    bus_hung = 0;
+                    bus_resets++;
+                } else {
+                    t->stuck = 0;
+                    t->restarts++;
+                }
+            }
+
+            if(action == HEALTH_FAILOVER && i == 0) {
+                imu_failed_over = (m.failed & (1UL << TASK_READ_ACCELERATION)) != 0;
+            }
+        }
+
+        if(now > IMU_BACK_AT + 100) {
+            imu_failed_at_end = (m.failed & (1UL << TASK_READ_ACCELERATION)) != 0;
+        }
+    }
+
+    const health_entry_t* imu = &m.tasks[TASK_READ_ACCELERATION];
+    const health_entry_t* baro = &m.tasks[TASK_READ_ALTIMETER];
+    const health_entry_t* gps = &m.tasks[TASK_READ_GPS];
+
+    printf("bus resets %lu, restarts imu %lu baro %lu, detection after the missed check-in imu %lu ms baro %lu ms\n",
+           (unsigned long) bus_resets, (unsigned long) tasks[0].restarts, (unsigned long) tasks[1].restarts,
+           (unsigned long) tasks[0].detect_latency, (unsigned long) tasks[1].detect_latency);
+
+    check(false_alarms == 0, "no action on a healthy task");
+    check(gps->stalls == 0, "jittered check-ins are not stalls");
+    check(imu->stalls == 2 && baro->stalls == 1, "every injected stall detected");
+    check(tasks[0].detect_latency <= JITTER_MARGIN + MONITOR_PERIOD, "IMU stall found within the margin and a check");
+    check(tasks[1].detect_latency <= JITTER_MARGIN + MONITOR_PERIOD, "barometer stall found within the margin and a check");
+    check(bus_hang_resets == 1, "one reset clears the hung bus for both sensors");
+    check(bus_resets == 3, "first recovery of every I2C stall resets the bus");
+    check(tasks[1].restarts == 1, "stuck task cleared by a restart");
+    check(imu_failed_over, "dead IMU failed over after its recoveries");
+    check(imu->failovers == 1 && baro->failovers == 0, "failover only for the dead sensor");
+    check(actions[HEALTH_RESTORED] == 3, "every recovered task restored");
+    check(!imu_failed_at_end, "IMU back in use once it checks in again");
+    check(imu->longest_stall_ms >= IMU_BACK_AT - IMU_DEAD_AT, "longest stall is the dead IMU");
+
+    barometer_failover();
+
+    return check_summary();
+}
@@ -0,0 +1,345 @@
+/**
+ * Host check that the flight path does not allocate once the pyros are armed
+ * malloc, calloc, realloc and free are interposed and count every call. A producer
+ * thread feeds a simulated flight through statically created monitored queues (FreeRTOS
+ * shim from test/queue-stress) to a consumer running the detectors and the state
+ * machine like checkFlightState, with telemetry batching, latency tracing and profiling
+ * on the way. The guard arms on entry to POWERED_FLIGHT, as the pyros do on the target,
+ * and any allocation from then until POST_FLIGHT_GROUND fails the test
+ *
+ * build and run from this directory:
+ *     g++ -std=c++11 -pthread -I../queue-stress/shim -I../common -I../../src post_arm_alloc.cpp ../queue-stress/shim/freertos_shim.cpp \
+ *         ../../src/queue_monitor.cpp ../../src/heap_guard.cpp ../../src/static_arena.cpp ../../src/flight_fsm.cpp \
+ *         ../../src/launch_detector.cpp ../../src/burnout_detector.cpp ../../src/apogee_detector.cpp \
+ *         ../../src/altitude_trigger.cpp ../../src/landing_detector.cpp ../../src/vertical_kalman.cpp \
+ *         ../../src/telemetry_batch.cpp ../../src/latency_trace.cpp ../../src/task_profiler.cpp -o post_arm_alloc && ./post_arm_alloc
+ *
+ * exit status is 1 if anything allocated after arming
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include "queue_monitor.h"
+#include "heap_guard.h"
+#include "static_arena.h"
+#include "flight_fsm.h"
+#include "launch_detector.h"
+#include "burnout_detector.h"
+#include "apogee_detector.h"
+#include "altitude_trigger.h"
+#include "landing_detector.h"
+#include "vertical_kalman.h"
+#include "telemetry_batch.h"
+#include "latency_trace.h"
+#include "task_profiler.h"
+#include "check.h"
+
+/* ---------------------------------------------------------------- interposer */
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* block, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+extern "C" void __libc_free(void* block);
+
+static std::atomic<int> armed(0);
+static std::atomic<uint32_t> allocations(0);            /* calls that returned memory */
+static std::atomic<uint32_t> post_arm_allocations(0);   /* of those, made while armed */
+static std::atomic<uint32_t> live_blocks(0);
+
+static void* counted(void* block) {
+    if(block != NULL) {
+        allocations++;
+        live_blocks++;
+        if(armed) {
+            post_arm_allocations++;
+        }
+    }
+    return block;
+}
+
+extern "C" void* malloc(size_t size) {
+    return counted(__libc_malloc(size));
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    return counted(__libc_calloc(count, size));
+}
+
+extern "C" void* realloc(void* block, size_t size) {
+    if(block == NULL) {
+        return malloc(size);
+    }
+    if(armed) {
+        post_arm_allocations++;
+    }
+    return __libc_realloc(block, size);
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size) {
+    return counted(__libc_memalign(alignment, size));
+}
+
+extern "C" int posix_memalign(void** block, size_t alignment, size_t size) {
+    *block = counted(__libc_memalign(alignment, size));
+    return *block != NULL ? 0 : 12;
+}
+
+extern "C" void free(void* block) {
+    if(block != NULL) {
+        live_blocks--;
+    }
+    __libc_free(block);
+}
+
+/* ------------------------------------------------------------ flight pipeline */
+
+#define SAMPLE_PERIOD_MS    10          /* accelerometer rate, the altimeter runs at a fifth of it */
+#define LAUNCH_TIME_MS      6000
+#define BURN_TIME_MS        2500
+#define QUEUE_LENGTH        10
+#define G                   9.81f
+
+typedef struct {
+    uint32_t now;
+    uint8_t data_flags;                 /* ACCEL 1, ALTIMETER 4 as in data_types.h */
+    uint32_t trace_id;
+    uint32_t acquired_us;
+    float ax;                           /* axial specific force in g */
+    float agl;
+    float velocity;
+} sample_t;
+
+static monitored_queue_t state_queue;
+static uint8_t queue_storage[QUEUE_LENGTH * sizeof(sample_t)] __attribute__((aligned(ARENA_ALIGNMENT)));
+
+static flight_fsm_t fsm;
+static launch_detector_t launch_detector;
+static burnout_detector_t burnout_detector;
+static apogee_detector_t apogee_detector;
+static altitude_trigger_t main_trigger;
+static landing_detector_t landing_detector;
+static vertical_kalman_t kalman;
+static telemetry_batch_t batch;
+static trace_buffer_t trace;
+static profiler_t profiler;
+static heap_guard_t guard;
+
+static std::atomic<int> landed(0);
+static uint8_t guard_result = HEAP_GUARD_OK;
+static uint32_t post_arm = 0;
+static uint32_t states_seen = 0;
+static uint32_t pyro_fired = 0;
+static uint32_t sim_now = 0;
+
+static uint32_t read_cycles() {
+    return sim_now * 1000;
+}
+
+static void state_entry(flight_fsm_t* f, uint8_t state) {
+    states_seen |= 1UL << state;
+
+    switch(state) {
+        case ARMED_FLIGHT_STATE::POWERED_FLIGHT:
+            armed = 1;
+            heap_guard_arm(&guard, live_blocks, 0);
+            burnout_arm(&burnout_detector, launch_detector.axis_sign);
+            apogee_arm(&apogee_detector, f->now, launch_detector.axis_sign, launch_detector.launch_time);
+            break;
+
+        case ARMED_FLIGHT_STATE::COASTING:
+            apogee_restart_lockout(&apogee_detector, f->now, 1000);
+            break;
+
+        case ARMED_FLIGHT_STATE::DROGUE_DEPLOY:
+        case ARMED_FLIGHT_STATE::MAIN_DEPLOY:
+            pyro_fired++;
+            break;
+
+        case ARMED_FLIGHT_STATE::DROGUE_DESCENT:
+            altitude_trigger_arm(&main_trigger);
+            landing_arm(&landing_detector);
+            break;
+
+        // checked before the threads wind down, their exit frees memory of its own
+        case ARMED_FLIGHT_STATE::POST_FLIGHT_GROUND:
+            guard_result = heap_guard_check(&guard, live_blocks, 0);
+            post_arm = post_arm_allocations;
+            armed = 0;
+            landed = 1;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * simulated trajectory: pad, boost at 8 g, coast with drag, drogue descent at 20 m/s,
+ * main descent at 6 m/s below 1000 m, then still on the ground
+ */
+static void trajectory(uint32_t now, float* altitude, float* velocity, float* ax) {
+    static float h = 0, v = 0;
+    static uint8_t drogue = 0;
+    float dt = SAMPLE_PERIOD_MS * 0.001f;
+
+    if(now < LAUNCH_TIME_MS) {
+        *ax = 1.0f;
+    } else if(now < LAUNCH_TIME_MS + BURN_TIME_MS) {
+        *ax = 8.0f;
+        v += (*ax - 1.0f) * G * dt;
+    } else if(!drogue) {
+        *ax = -0.3f;
+        v += (*ax - 1.0f) * G * dt;
+        if(v < 0) {
+            drogue = 1;
+        }
+    } else if(h > 0) {
+        *ax = 1.0f;
+        v = h > 1000 ? -20.0f : -6.0f;
+    }
+
+    h += v * dt;
+    if(h <= 0 && now > LAUNCH_TIME_MS) {
+        h = 0;
+        v = 0;
+        *ax = 1.0f;
+    }
+
+    *altitude = h;
+    *velocity = v;
+}
+
+static void producer() {
+    sample_t sample = {};
+    float altitude = 0, velocity = 0, ax = 1.0f;
+    uint32_t trace_id = 0;
+
+    for(uint32_t now = 0; !landed && now < 600000; now += SAMPLE_PERIOD_MS) {
+        trajectory(now, &altitude, &velocity, &ax);
+
+        sample.now = now;
+        sample.trace_id = ++trace_id;
+        sample.acquired_us = now * 1000;
+        sample.data_flags = 1;
+        sample.ax = ax;
+        queue_send(&state_queue, &sample, portMAX_DELAY);
+
+        if((now / SAMPLE_PERIOD_MS) % 5 == 0) {
+            vkf_update(&kalman, altitude, 0, 5 * SAMPLE_PERIOD_MS * 0.001f);
+            sample.data_flags = 4;
+            sample.agl = kalman.altitude;
+            sample.velocity = kalman.velocity;
+            queue_send(&state_queue, &sample, portMAX_DELAY);
+        }
+    }
+
+    sample.data_flags = 0;
+    queue_send(&state_queue, &sample, portMAX_DELAY);
+}
+
+static void consumer() {
+    sample_t s;
+    char record[QUEUE_RECORD_LENGTH];
+
+    while(queue_receive(&state_queue, &s, portMAX_DELAY) && s.data_flags != 0) {
+        sim_now = s.now;
+        profiler_begin(&profiler, PROFILE_STATE_CHECK);
+        trace_record(&trace, s.trace_id, s.data_flags, TRACE_DEQUEUED, s.now * 1000 - s.acquired_us);
+
+        if(s.data_flags & 1) {
+            if(launch_update_accel(&launch_detector, s.now, s.ax) == LAUNCH_DETECTED) {
+                fsm_dispatch(&fsm, EVENT_LAUNCH, s.now);
+            }
+            if(burnout_update(&burnout_detector, s.now, s.ax)) {
+                fsm_dispatch(&fsm, EVENT_BURNOUT, s.now);
+            }
+            if(apogee_update_accel(&apogee_detector, s.now, s.ax)) {
+                fsm_dispatch(&fsm, EVENT_APOGEE, s.now);
+            }
+        } else {
+            switch(launch_update_baro(&launch_detector, s.now, s.agl)) {
+                case LAUNCH_DETECTED:
+                    fsm_dispatch(&fsm, EVENT_LAUNCH, s.now);
+                    break;
+                case LAUNCH_REJECTED:
+                    fsm_dispatch(&fsm, EVENT_LAUNCH_REJECTED, s.now);
+                    break;
+                default:
+                    break;
+            }
+            if(apogee_update(&apogee_detector, s.now, s.agl, s.velocity)) {
+                fsm_dispatch(&fsm, EVENT_APOGEE, s.now);
+            }
+            if(altitude_trigger_update(&main_trigger, s.agl)) {
+                fsm_dispatch(&fsm, EVENT_MAIN_ALTITUDE, s.now);
+            }
+            if(landing_update(&landing_detector, s.now, s.agl, s.velocity)) {
+                fsm_dispatch(&fsm, EVENT_LANDED, s.now);
+            }
+        }
+
+        profiler_end(&profiler, PROFILE_STATE_CHECK);
+
+        // the telemetry path: format a record into the batch, publish when due
+        size_t length = queue_format(&state_queue, record, sizeof(record), s.now);
+        if(!batch_append(&batch, record, length, s.now) || batch_ready(&batch, s.now)) {
+            batch_report_publish(&batch, 1, 5);
+            batch_clear(&batch);
+            batch_append(&batch, record, length, s.now);
+        }
+    }
+
+    landed = 1;
+}
+
+int main() {
+    // the interposer has to see allocations or a pass means nothing
+    uint32_t before = allocations;
+    armed = 1;
+    int* probe = new int(1);
+    armed = 0;
+    check(allocations == before + 1 && post_arm_allocations == 1, "interposer counts allocations while armed");
+    delete probe;
+    post_arm_allocations = 0;
+
+    // everything is set up before arming, like setup() on the target
+    queue_create(&state_queue, "state", QUEUE_LENGTH, sizeof(sample_t), queue_storage);
+    fsm_init(&fsm, 3000, 1000, 5000, 0);
+    for(uint8_t state = 0; state < NUM_FLIGHT_STATES; state++) {
+        fsm_set_hooks(&fsm, state, state_entry, NULL);
+    }
+    launch_init(&launch_detector, 2.5f, 30, 10, 2000, 500);
+    burnout_init(&burnout_detector, 0, 4, 20, 500, 0.3f);
+    apogee_init(&apogee_detector, 3000, 0, 0, 3, 30000, 15.7f);
+    altitude_trigger_init(&main_trigger, 1000, 10, 3);
+    landing_init(&landing_detector, 1.0f, 2.0f, 5000);
+    vkf_init(&kalman, 1.0f, 20.0f, 5.0f);
+    batch_init(&batch, 10, 20, 500, 1000, 1);
+    trace_init(&trace);
+    profiler_init(&profiler, read_cycles, 1);
+    profiler_set_section(&profiler, PROFILE_STATE_CHECK, "state", 0);
+    heap_guard_init(&guard, 0);
+    printf("simulated flight\n");
+
+    std::thread consume(consumer);
+    std::thread produce(producer);
+    produce.join();
+    consume.join();
+
+    armed = 0;
+
+    uint8_t flown = ARMED_FLIGHT_STATE::POST_FLIGHT_GROUND;
+    check(states_seen & (1UL << ARMED_FLIGHT_STATE::POWERED_FLIGHT), "guard armed at launch");
+    check(states_seen & (1UL << ARMED_FLIGHT_STATE::DROGUE_DEPLOY), "apogee reached, drogue deployed");
+    check(states_seen & (1UL << ARMED_FLIGHT_STATE::MAIN_DEPLOY), "main deployed");
+    check(states_seen & (1UL << flown), "landing detected");
+    check(pyro_fired == 2, "both pyro channels fired once");
+    check(post_arm == 0, "no allocation between arming and landing");
+    check(guard_result == HEAP_GUARD_OK && guard.violations == 0, "heap guard saw no growth");
+
+    printf("    %lu allocations before arming, %lu after\n", (unsigned long) (allocations - post_arm), (unsigned long) post_arm);
+    return check_summary();
+}
@@ -0,0 +1,529 @@
+/**
+ * Host simulation of the I2C bus manager in src/i2c_bus.cpp
+ * A simulated bus times every transfer by its bits at the SCL clock plus a fixed driver
+ * overhead, and answers reads with a pattern of the device address and register so a
+ * transfer that got another task's bytes is caught. Runs:
+ * - throughput: the per-axis IMU reads at 100 kHz as before against one burst at 400 kHz
+ * - contention: IMU and barometer released on the same timer ticks, the IMU task waking up
+ *   to WAKE_JITTER_US late, with priorities and with one FIFO like a plain mutex would
+ *   give, and the IMU at 1 kHz as a stress case
+ * - stuck SDA: a device holding SDA that recovery frees, and one that holds it 30 ms
+ * - the pending list bounds and ordering, and the BMP180 datasheet compensation example
+ *
+ * build and run from this directory:
+ *     g++ -I../common -I../../src bus_sim.cpp ../../src/i2c_bus.cpp ../../src/bmp180.cpp -o bus_sim && ./bus_sim
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "i2c_bus.h"
+#include "bmp180.h"
+#include "check.h"
+
+#define IMU_ADDRESS         0x68
+#define BARO_ADDRESS        0x77
+#define ACCEL_XOUT_H        0x3B
+#define DRIVER_OVERHEAD_US  40          /* Wire driver setup and interrupt handling per transfer */
+#define TRANSFER_TIMEOUT_US 5000        /* I2C_TRANSFER_TIMEOUT */
+#define RECOVERY_US         120         /* nine SCL pulses, STOP and a driver restart */
+#define MAX_RETRIES         2           /* I2C_MAX_RETRIES */
+#define WAKE_JITTER_US      500         /* latest IMU task wake after its timer tick */
+
+static uint8_t device_byte(uint8_t address, uint8_t reg) {
+    return (uint8_t) (address * 7 + reg * 13);
+}
+
+class SimBus : public I2CBusHardware {
+    public:
+        uint32_t now_us = 0;
+        uint32_t clock_hz = 400000;
+        uint8_t sda_low = 0;                /* a device holds SDA low */
+        uint32_t sda_release_us = 0;        /* recovery frees SDA from this time on */
+
+        uint8_t transfer(i2c_txn_t* txn) {
+            if(this->sda_low) {
+                this->now_us += TRANSFER_TIMEOUT_US;
+                return I2C_BUS_ERROR;
+            }
+
+            // START, address, data bytes, each byte with its ACK bit, STOP or repeated START
+            uint32_t bits = 1 + 9 + 9 * txn->tx_len + 1;
+            if(txn->address != IMU_ADDRESS && txn->address != BARO_ADDRESS) {
+                this->now_us += DRIVER_OVERHEAD_US + 11 * 1000000 / this->clock_hz;
+                return I2C_NACK;
+            }
+
+            if(txn->rx_len > 0) {
+                bits += 9 + 9 * txn->rx_len + 1;
+            }
+            if(txn->tx_len == 0) {
+                bits -= 10;
+            }
+
+            this->now_us += DRIVER_OVERHEAD_US + (bits * 1000000 + this->clock_hz - 1) / this->clock_hz;
+
+            for(uint8_t i = 0; i < txn->rx_len; i++) {
+                txn->rx[i] = device_byte(txn->address, (txn->tx_len > 0 ? txn->tx[0] : 0) + i);
+            }
+
+            return I2C_DONE;
+        }
+
+        bool sdaStuck() {
+            return this->sda_low;
+        }
+
+        void recover() {
+            this->now_us += RECOVERY_US;
+            if(this->now_us >= this->sda_release_us) {
+                this->sda_low = 0;
+            }
+        }
+
+        uint32_t timeUs() {
+            return this->now_us;
+        }
+};
+
+/*
+ * throughput
+ */
+
+static uint32_t run_direct(i2c_bus_t* bus, SimBus* hw, i2c_txn_t* txn) {
+    uint32_t start = hw->now_us;
+    txn->submitted_us = start;
+    i2c_bus_run(bus, txn);
+    return hw->now_us - start;
+}
+
+/* the MPU6050 driver reads two bytes per axis in two transfers, five axis reads per sample */
+static uint32_t imu_per_axis_us(i2c_bus_t* bus, SimBus* hw) {
+    i2c_txn_t txn = {};
+    uint8_t rx[2];
+    uint32_t total = 0;
+
+    for(uint8_t read = 0; read < 5; read++) {
+        i2c_txn_read(&txn, IMU_ADDRESS, ACCEL_XOUT_H, rx, 0);
+        total += run_direct(bus, hw, &txn);
+        txn.tx_len = 0;
+        txn.rx = rx;
+        txn.rx_len = 2;
+        total += run_direct(bus, hw, &txn);
+    }
+
+    return total;
+}
+
+static uint32_t imu_burst_us(i2c_bus_t* bus, SimBus* hw) {
+    i2c_txn_t txn = {};
+    uint8_t rx[6];
+
+    i2c_txn_read(&txn, IMU_ADDRESS, ACCEL_XOUT_H, rx, 6);
+    return run_direct(bus, hw, &txn);
+}
+
+static uint32_t baro_us(i2c_bus_t* bus, SimBus* hw) {
+    i2c_txn_t txn = {};
+    uint8_t rx[3];
+    uint32_t total = 0;
+
+    i2c_txn_write(&txn, BARO_ADDRESS, BMP180_CONTROL, BMP180_READ_TEMPERATURE);
+    total += run_direct(bus, hw, &txn);
+    i2c_txn_read(&txn, BARO_ADDRESS, BMP180_RESULT, rx, 2);
+    total += run_direct(bus, hw, &txn);
+    i2c_txn_write(&txn, BARO_ADDRESS, BMP180_CONTROL, bmp180_pressure_command(3));
+    total += run_direct(bus, hw, &txn);
+    i2c_txn_read(&txn, BARO_ADDRESS, BMP180_RESULT, rx, 3);
+    total += run_direct(bus, hw, &txn);
+
+    return total;
+}
+
+static void throughput() {
+    SimBus hw;
+    i2c_bus_t bus;
+
+    printf("throughput, bus time per sample\n");
+
+    i2c_bus_init(&bus, &hw, MAX_RETRIES);
+    hw.clock_hz = 100000;
+    uint32_t imu_old = imu_per_axis_us(&bus, &hw);
+    uint32_t baro_old = baro_us(&bus, &hw);
+
+    hw.clock_hz = 400000;
+    uint32_t imu_new = imu_burst_us(&bus, &hw);
+    uint32_t baro_new = baro_us(&bus, &hw);
+
+    // IMU at 100 Hz and barometer at 20 Hz
+    float load_old = (imu_old * 100.0f + baro_old * 20.0f) / 1e6f;
+    float load_new = (imu_new * 100.0f + baro_new * 20.0f) / 1e6f;
+
+    printf("    IMU per-axis reads at 100 kHz %5lu us, burst at 400 kHz %4lu us\n", (unsigned long) imu_old, (unsigned long) imu_new);
+    printf("    barometer at 100 kHz          %5lu us, at 400 kHz       %4lu us\n", (unsigned long) baro_old, (unsigned long) baro_new);
+    printf("    bus load at the flight rates  %.3f before, %.3f now\n", load_old, load_new);
+    printf("    highest IMU rate on an otherwise idle bus %lu Hz before, %lu Hz now\n",
+           (unsigned long) (1000000 / imu_old), (unsigned long) (1000000 / imu_new));
+
+    check(imu_new * 5 < imu_old, "IMU burst takes under a fifth of the per-axis bus time");
+    check(baro_new * 2 < baro_old, "400 kHz halves the barometer bus time");
+    check(load_new < 0.05f, "bus load under 5% at the flight rates");
+    check(bus.failed == 0, "no transfer failed");
+}
+
+/*
+ * contention
+ */
+
+typedef enum {
+    CLIENT_IMU = 0,
+    CLIENT_BARO
+} CLIENT_KIND;
+
+typedef struct {
+    uint8_t kind;
+    uint32_t period_us;
+    i2c_txn_t txn;
+    uint8_t rx[8];
+    uint8_t step;                       /* barometer: temperature start, read, pressure start, read */
+    uint8_t waiting;                    /* transaction submitted, not done */
+    uint32_t release_us;                /* start of the current sample */
+    uint32_t next_us;                   /* time of the next submission */
+
+    uint32_t submitted;
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t bad_data;                  /* reads with bytes of another device or register */
+    uint32_t samples;
+    uint32_t max_wait_us;
+    uint64_t wait_sum_us;
+    uint32_t max_transfer_us;
+} sim_client_t;
+
+static SimBus* active_hw;
+static uint32_t rng_state = 0x2545F491;
+
+static uint32_t uniform(uint32_t range) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state % (range + 1);
+}
+
+static void client_done(i2c_txn_t* txn) {
+    sim_client_t* c = (sim_client_t*) txn->context;
+    uint32_t wait = txn->started_us - txn->submitted_us;
+
+    c->waiting = 0;
+    c->completed++;
+    c->wait_sum_us += wait;
+    if(wait > c->max_wait_us) {
+        c->max_wait_us = wait;
+    }
+
+    if(txn->status != I2C_DONE) {
+        c->failed++;
+    } else {
+        for(uint8_t i = 0; i < txn->rx_len; i++) {
+            if(txn->rx[i] != device_byte(txn->address, txn->tx[0] + i)) {
+                c->bad_data++;
+                break;
+            }
+        }
+
+        if(txn->completed_us - txn->started_us > c->max_transfer_us) {
+            c->max_transfer_us = txn->completed_us - txn->started_us;
+        }
+    }
+
+    uint32_t now = active_hw->now_us;
+
+    if(c->kind == CLIENT_IMU) {
+        c->samples++;
+        c->release_us += c->period_us;
+        c->next_us = c->release_us + uniform(WAKE_JITTER_US);
+        return;
+    }
+
+    // the barometer waits out its conversions off the bus, a failed step ends the sample
+    if(txn->status != I2C_DONE || c->step == 3) {
+        c->samples++;
+        c->step = 0;
+        c->release_us += c->period_us;
+        c->next_us = c->release_us;
+    } else {
+        c->step++;
+        c->next_us = now + (c->step == 1 ? BMP180_TEMPERATURE_TIME * 1000 : c->step == 3 ? bmp180_pressure_time(3) * 1000 : 0);
+    }
+
+    // a sample that overran its period starts at the next release
+    while((int32_t) (c->next_us - c->release_us) >= (int32_t) c->period_us && c->step == 0) {
+        c->release_us += c->period_us;
+        c->next_us = c->release_us;
+    }
+}
+
+static void prepare(sim_client_t* c) {
+    if(c->kind == CLIENT_IMU) {
+        i2c_txn_read(&c->txn, IMU_ADDRESS, ACCEL_XOUT_H, c->rx, 6);
+        return;
+    }
+
+    switch (c->step) {
+        case 0:
+            i2c_txn_write(&c->txn, BARO_ADDRESS, BMP180_CONTROL, BMP180_READ_TEMPERATURE);
+            break;
+        case 1:
+            i2c_txn_read(&c->txn, BARO_ADDRESS, BMP180_RESULT, c->rx, 2);
+            break;
+        case 2:
+            i2c_txn_write(&c->txn, BARO_ADDRESS, BMP180_CONTROL, bmp180_pressure_command(3));
+            break;
+        default:
+            i2c_txn_read(&c->txn, BARO_ADDRESS, BMP180_RESULT, c->rx, 3);
+            break;
+    }
+}
+
+typedef struct {
+    const char* name;
+    uint32_t imu_period_us;
+    uint8_t one_fifo;                   /* both clients on one priority */
+    uint32_t stuck_at_us;               /* a device pulls SDA low here, 0 for never */
+    uint32_t stuck_for_us;              /* recovery frees it after this long */
+    uint32_t horizon_us;
+} scenario_t;
+
+typedef struct {
+    sim_client_t imu;
+    sim_client_t baro;
+    i2c_bus_t bus;
+    uint32_t pending_left;
+} scenario_result_t;
+
+static void client_init(sim_client_t* c, uint8_t kind, uint32_t period_us, uint8_t priority) {
+    memset(c, 0, sizeof(sim_client_t));
+    c->kind = kind;
+    c->period_us = period_us;
+    c->txn.priority = priority;
+    c->txn.done = client_done;
+    c->txn.context = c;
+}
+
+static void run_scenario(const scenario_t* s, scenario_result_t* r) {
+    SimBus hw;
+    sim_client_t* clients[] = { &r->baro, &r->imu };     /* on a shared tick the barometer submits first */
+
+    active_hw = &hw;
+    i2c_bus_init(&r->bus, &hw, MAX_RETRIES);
+    client_init(&r->imu, CLIENT_IMU, s->imu_period_us, I2C_PRIORITY_HIGH);
+    client_init(&r->baro, CLIENT_BARO, 50000, s->one_fifo ? I2C_PRIORITY_HIGH : I2C_PRIORITY_LOW);
+
+    uint8_t stuck_done = 0;
+
+    while(hw.now_us < s->horizon_us) {
+        if(s->stuck_at_us != 0 && !stuck_done && hw.now_us >= s->stuck_at_us) {
+            hw.sda_low = 1;
+            hw.sda_release_us = hw.now_us + s->stuck_for_us;
+            stuck_done = 1;
+        }
+
+        // submit in time order everything due by now
+        while(1) {
+            sim_client_t* due = NULL;
+            for(uint8_t i = 0; i < 2; i++) {
+                sim_client_t* c = clients[i];
+                if(!c->waiting && (int32_t) (c->next_us - hw.now_us) <= 0 && (due == NULL || (int32_t) (c->next_us - due->next_us) < 0)) {
+                    due = c;
+                }
+            }
+
+            if(due == NULL) {
+                break;
+            }
+
+            prepare(due);
+            due->waiting = 1;
+            due->submitted++;
+            i2c_bus_submit(&r->bus, &due->txn, due->next_us);
+        }
+
+        i2c_txn_t* txn = i2c_bus_next(&r->bus);
+        if(txn != NULL) {
+            i2c_bus_run(&r->bus, txn);
+            continue;
+        }
+
+        // bus idle until the next submission
+        uint32_t next = hw.now_us + 1000000;
+        for(uint8_t i = 0; i < 2; i++) {
+            if(!clients[i]->waiting && (int32_t) (clients[i]->next_us - next) < 0) {
+                next = clients[i]->next_us;
+            }
+        }
+        hw.now_us = next;
+    }
+
+    r->pending_left = 0;
+    while(i2c_bus_next(&r->bus) != NULL) {
+        r->pending_left++;
+    }
+
+    float load = (float) r->bus.busy_us / hw.now_us;
+    printf("    %-22s IMU wait mean %3lu max %4lu us, barometer wait max %4lu us, bus load %.3f\n", s->name,
+           (unsigned long) (r->imu.completed ? r->imu.wait_sum_us / r->imu.completed : 0), (unsigned long) r->imu.max_wait_us,
+           (unsigned long) r->baro.max_wait_us, load);
+}
+
+static bool all_accounted(const scenario_result_t* r) {
+    return r->imu.completed == r->imu.submitted - r->imu.waiting && r->baro.completed == r->baro.submitted - r->baro.waiting
+           && r->pending_left == r->imu.waiting + r->baro.waiting;
+}
+
+static void contention() {
+    scenario_result_t prio, fifo, stress;
+    const scenario_t s_prio = { "priorities, IMU 100 Hz", 10000, 0, 0, 0, 10000000 };
+    const scenario_t s_fifo = { "one FIFO, IMU 100 Hz", 10000, 1, 0, 0, 10000000 };
+    const scenario_t s_stress = { "priorities, IMU 1 kHz", 1000, 0, 0, 0, 10000000 };
+
+    printf("contention, 10 s\n");
+    run_scenario(&s_prio, &prio);
+    run_scenario(&s_fifo, &fifo);
+    run_scenario(&s_stress, &stress);
+
+    check(all_accounted(&prio) && all_accounted(&fifo) && all_accounted(&stress), "every transaction completed once");
+    check(prio.imu.bad_data + prio.baro.bad_data + stress.imu.bad_data + stress.baro.bad_data == 0, "no read got bytes of another transfer");
+    check(prio.imu.samples >= 999 && prio.baro.samples >= 199, "IMU at 100 Hz and barometer at 20 Hz kept up");
+    check(stress.imu.samples >= 9990 && stress.baro.samples >= 199, "IMU at 1 kHz and barometer at 20 Hz kept up");
+    check(prio.imu.max_wait_us <= prio.baro.max_transfer_us, "IMU waits at most one barometer transfer");
+    check(stress.imu.max_wait_us <= stress.baro.max_transfer_us, "same at 1 kHz");
+    check(prio.imu.max_wait_us <= fifo.imu.max_wait_us, "IMU never waits longer than with a plain FIFO");
+    check(prio.bus.failed + stress.bus.failed + prio.bus.rejected + stress.bus.rejected == 0, "nothing failed or rejected");
+}
+
+/*
+ * stuck SDA
+ */
+
+static void stuck_sda() {
+    scenario_result_t freed, held;
+    const scenario_t s_freed = { "SDA freed by recovery", 10000, 0, 2000000, 0, 4000000 };
+    const scenario_t s_held = { "SDA held 30 ms", 10000, 0, 2000000, 30000, 4000000 };
+
+    printf("stuck SDA\n");
+    run_scenario(&s_freed, &freed);
+    run_scenario(&s_held, &held);
+
+    printf("    freed: retries %lu recoveries %lu failed %lu, held: retries %lu recoveries %lu failed %lu\n",
+           (unsigned long) freed.bus.retries, (unsigned long) freed.bus.recoveries, (unsigned long) freed.bus.failed,
+           (unsigned long) held.bus.retries, (unsigned long) held.bus.recoveries, (unsigned long) held.bus.failed);
+
+    check(freed.bus.recoveries == 1 && freed.bus.retries == 1 && freed.bus.failed == 0, "one recovery frees the bus, the retry succeeds");
+    check(all_accounted(&freed) && all_accounted(&held), "every transaction completed once");
+    check(held.bus.failed > 0 && held.bus.failed <= 3, "a held bus fails only the transactions in the 30 ms");
+    check(held.imu.failed + held.baro.failed == held.bus.failed, "every failed transaction reported to its task");
+    check(held.imu.samples >= 395 && held.baro.samples >= 79, "sampling goes on after the device lets go");
+    check(freed.imu.bad_data + held.imu.bad_data == 0, "no read got bytes of another transfer");
+}
+
+/*
+ * pending lists
+ */
+
+static uint32_t done_count = 0;
+
+static void count_done(i2c_txn_t* txn) {
+    (void) txn;
+    done_count++;
+}
+
+static void pending_lists() {
+    SimBus hw;
+    i2c_bus_t bus;
+    i2c_txn_t high[I2C_QUEUE_LENGTH + 1];
+    i2c_txn_t low[2];
+    uint8_t rx[2];
+
+    printf("pending lists\n");
+    i2c_bus_init(&bus, &hw, MAX_RETRIES);
+    memset(high, 0, sizeof(high));
+    memset(low, 0, sizeof(low));
+
+    for(uint8_t i = 0; i < 2; i++) {
+        i2c_txn_read(&low[i], BARO_ADDRESS, BMP180_RESULT, rx, 2);
+        low[i].priority = I2C_PRIORITY_LOW;
+        low[i].done = count_done;
+        i2c_bus_submit(&bus, &low[i], 0);
+    }
+
+    uint8_t queued = 0;
+    for(uint8_t i = 0; i < I2C_QUEUE_LENGTH + 1; i++) {
+        i2c_txn_read(&high[i], IMU_ADDRESS, ACCEL_XOUT_H, rx, 2);
+        high[i].done = count_done;
+        queued += i2c_bus_submit(&bus, &high[i], 0);
+    }
+
+    check(queued == I2C_QUEUE_LENGTH && high[I2C_QUEUE_LENGTH].status == I2C_REJECTED && bus.rejected == 1, "a full list rejects the submission");
+    check(i2c_bus_submit(&bus, &high[0], 0) == 0 && bus.rejected == 1, "a pending transaction is not queued twice");
+
+    bool order = true;
+    for(uint8_t i = 0; i < I2C_QUEUE_LENGTH; i++) {
+        order = order && i2c_bus_next(&bus) == &high[i];
+    }
+    order = order && i2c_bus_next(&bus) == &low[0];
+
+    i2c_txn_t nack;
+    memset(&nack, 0, sizeof(nack));
+    i2c_txn_read(&nack, 0x42, 0, rx, 1);
+    nack.done = count_done;
+    i2c_bus_submit(&bus, &nack, 0);
+    order = order && i2c_bus_next(&bus) == &nack;
+    check(order, "highest priority first, submission order within one");
+
+    done_count = 0;
+    check(i2c_bus_run(&bus, &nack) == I2C_NACK && nack.status == I2C_NACK && done_count == 1, "a missing device fails with a NACK");
+    check(bus.retries == MAX_RETRIES && bus.recoveries == 0, "retried without recovery, SDA was free");
+
+    i2c_bus_request_recovery(&bus);
+    check(i2c_bus_check_recovery(&bus) == 1 && i2c_bus_check_recovery(&bus) == 0 && bus.recoveries == 1, "a requested recovery runs once");
+
+    i2c_bus_request_recovery(&bus);
+    check(i2c_bus_run(&bus, &low[1]) == I2C_DONE && bus.recoveries == 2, "before the next transfer");
+}
+
+/*
+ * BMP180 compensation, example of the datasheet
+ */
+
+static void bmp180_example() {
+    const uint8_t raw[BMP180_CALIBRATION_LENGTH] = {
+        0x01, 0x98, 0xFF, 0xB8, 0xC7, 0xD1, 0x7F, 0xE5, 0x7F, 0xF5, 0x5A, 0x71,
+        0x18, 0x2E, 0x00, 0x04, 0x80, 0x00, 0xDD, 0xF9, 0x0B, 0x34
+    };
+    const uint8_t ut_raw[2] = { 0x6C, 0xFA };
+    const uint8_t up_raw[3] = { 0x5D, 0x23, 0x00 };
+    bmp180_calibration_t cal;
+
+    printf("BMP180\n");
+    bmp180_parse_calibration(&cal, raw);
+
+    int32_t b5 = bmp180_b5(&cal, bmp180_raw_temperature(ut_raw));
+    int32_t p = bmp180_pressure_pa(&cal, bmp180_raw_pressure(up_raw, 0), 0, b5);
+
+    printf("    T %.1f C, p %ld Pa\n", bmp180_temperature(b5), (long) p);
+    check(cal.ac1 == 408 && cal.ac4 == 32741 && cal.mb == -32768 && cal.md == 2868, "calibration unpacked");
+    check(bmp180_temperature(b5) == 15.0 && p == 69964, "datasheet example 15.0 C and 69964 Pa");
+    check(bmp180_pressure_command(3) == 0xF4 && bmp180_pressure_time(3) == 26, "oversampling 3 command and time");
+    check(bmp180_altitude(1013.25, 1013.25) == 0 && bmp180_altitude(899.0, 1013.25) > 990 && bmp180_altitude(899.0, 1013.25) < 1010, "altitude from pressure");
+}
+
+int main() {
+    throughput();
+    contention();
+    stuck_sda();
+    pending_lists();
+    bmp180_example();
+
+    return check_summary();
+}
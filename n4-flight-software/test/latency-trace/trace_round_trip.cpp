@@ -0,0 +1,307 @@
+/**
+ * Host test of the sample latency trace in src/latency_trace.cpp and of its reader,
+ * scripts/latency-trace.py. Runs:
+ * - a traced flight written to a trace file the way flushLatencyTrace() writes it, read
+ *   back record for record by the script, and its report checked against the counts and
+ *   percentiles computed here
+ * - a file of another version and a truncated last record
+ * - the ring lapped by its writers, and two writer threads racing a reader: every record
+ *   read is whole, read and lost add up to written
+ * - a benchmark of trace_record()
+ *
+ * build and run from this directory, the script checks need python3:
+ *     g++ -std=c++11 -O2 -pthread -I../common -I../../src trace_round_trip.cpp ../../src/latency_trace.cpp -o trace_round_trip && ./trace_round_trip
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency_trace.h"
+#include "check.h"
+
+#define ACCELEROMETER_DATA_FLAG     1   /* data_types.h */
+#define ALTIMETER_DATA_FLAG         4
+
+#define SCRIPT              "../../scripts/latency-trace.py"
+#define FLIGHT_SAMPLES      3000        /* trace ids of each sensor */
+#define RACE_RECORDS        200000      /* per writer thread */
+#define BENCH_RECORDS       1000000
+
+static uint32_t rng_state = 1;
+
+static float uniform() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (rng_state & 0xFFFFFF) / 16777216.0f;
+}
+
+static bool same(const trace_record_t& a, const trace_record_t& b) {
+    return a.trace_id == b.trace_id && a.stage == b.stage && a.source == b.source && a.latency_us == b.latency_us;
+}
+
+/* the records of a flight, each sensor's samples through the stages its data reaches */
+static void fly(trace_buffer_t* ring, std::vector<trace_record_t>* file_records) {
+    static const uint8_t stages[] = { TRACE_FILTERED, TRACE_DEQUEUED, TRACE_STATE_CHECKED, TRACE_LOGGED, TRACE_PUBLISHED };
+    trace_record_t chunk[64];
+
+    for(uint32_t id = 0; id < FLIGHT_SAMPLES; id++) {
+        for(uint8_t sensor = 0; sensor < 2; sensor++) {
+            uint8_t source = sensor == 0 ? ACCELEROMETER_DATA_FLAG : ALTIMETER_DATA_FLAG;
+            uint32_t latency = 0;
+
+            for(uint8_t i = 0; i < sizeof(stages); i++) {
+                // the IMU data skips the Kalman filter
+                if(source == ACCELEROMETER_DATA_FLAG && stages[i] == TRACE_FILTERED) {
+                    continue;
+                }
+                latency += 50 + (uint32_t) (uniform() * uniform() * (stages[i] == TRACE_PUBLISHED ? 200000 : 5000));
+                if(trace_sampled(id, stages[i])) {
+                    trace_record(ring, id, source, stages[i], latency);
+                }
+
+                // the main chute fired on one altimeter sample, always traced
+                if(source == ALTIMETER_DATA_FLAG && id == 2345 && stages[i] == TRACE_STATE_CHECKED) {
+                    trace_record(ring, id, source, TRACE_PYRO_FIRED, latency + 120);
+                }
+            }
+        }
+
+        // flushLatencyTrace() every TRACE_FLUSH_INTERVAL, in reads of 64
+        if(id % 100 == 99) {
+            size_t count;
+            while((count = trace_read(ring, chunk, 64)) > 0) {
+                file_records->insert(file_records->end(), chunk, chunk + count);
+            }
+        }
+    }
+}
+
+static bool write_trace(const char* path, const std::vector<trace_record_t>& records, uint16_t version, size_t cut) {
+    trace_file_header_t header;
+    trace_file_header(&header);
+    header.version = version;
+
+    FILE* f = fopen(path, "wb");
+    if(f == NULL) {
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(records.data(), sizeof(trace_record_t), records.size(), f);
+    fclose(f);
+
+    return cut == 0 || truncate(path, sizeof(header) + records.size() * sizeof(trace_record_t) - cut) == 0;
+}
+
+static std::vector<std::string> run(const std::string& command, int* status) {
+    std::vector<std::string> lines;
+    FILE* p = popen(command.c_str(), "r");
+    char line[256];
+
+    while(p != NULL && fgets(line, sizeof(line), p) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        lines.push_back(line);
+    }
+    *status = p != NULL ? pclose(p) : -1;
+    return lines;
+}
+
+/* the nearest rank, as percentile() of the script */
+static uint32_t percentile(std::vector<uint32_t> v, double fraction) {
+    std::sort(v.begin(), v.end());
+    size_t rank = (size_t) ceil(fraction * v.size() - 1e-9);
+    rank = std::max((size_t) 1, std::min(rank, v.size()));
+    return v[rank - 1];
+}
+
+/* the report line print_group() writes for these values */
+static std::string group_line(const char* title, const std::vector<uint32_t>& v) {
+    char line[160];
+    snprintf(line, sizeof(line), "%-34s n %6d  p50 %8d  p90 %8d  p99 %8d  max %8d us", title, (int) v.size(),
+             (int) percentile(v, 0.5), (int) percentile(v, 0.9), (int) percentile(v, 0.99), (int) *std::max_element(v.begin(), v.end()));
+    return line;
+}
+
+static bool has_line(const std::vector<std::string>& lines, const std::string& line) {
+    return std::find(lines.begin(), lines.end(), line) != lines.end();
+}
+
+static void script_round_trip() {
+    static trace_buffer_t ring;
+    std::vector<trace_record_t> records;
+
+    trace_init(&ring);
+    fly(&ring, &records);
+
+    printf("a traced flight, %lu records\n", (unsigned long) records.size());
+
+    check(ring.lost == 0 && ring.read_index == ring.write_index, "every record flushed, none lost");
+
+    if(system("python3 --version > /dev/null 2>&1") != 0) {
+        printf("    python3 not found, script checks skipped\n");
+        return;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/trace_round_trip_%d.bin", (int) getpid());
+    check(write_trace(path, records, TRACE_FILE_VERSION, 0), "trace file written");
+
+    // read_trace() of the script, one record per line
+    std::string decode = std::string("python3 -c \"import importlib.util, sys; "
+        "spec = importlib.util.spec_from_file_location('latency_trace', '" SCRIPT "'); "
+        "m = importlib.util.module_from_spec(spec); spec.loader.exec_module(m); "
+        "[print('%d,%d,%d,%d' % r) for r in m.read_trace(sys.argv[1])]\" ") + path;
+
+    int status;
+    std::vector<std::string> decoded = run(decode, &status);
+    bool equal = status == 0 && decoded.size() == records.size();
+    for(size_t i = 0; equal && i < records.size(); i++) {
+        unsigned id, stage, source, latency;
+        trace_record_t r = {};
+        equal = sscanf(decoded[i].c_str(), "%u,%u,%u,%u", &id, &stage, &source, &latency) == 4;
+        r.trace_id = id;
+        r.stage = stage;
+        r.source = source;
+        r.latency_us = latency;
+        equal &= same(r, records[i]);
+    }
+    check(equal, "read back by the script record for record");
+
+    std::vector<std::string> report = run(std::string("python3 " SCRIPT " ") + path, &status);
+
+    std::vector<uint32_t> logged;
+    std::vector<uint32_t> published;
+    std::vector<uint32_t> dequeued_to_checked;
+    uint32_t dequeued_at[FLIGHT_SAMPLES] = {};
+    for(const trace_record_t& r : records) {
+        if(r.source != ALTIMETER_DATA_FLAG) {
+            continue;
+        }
+        if(r.stage == TRACE_LOGGED) {
+            logged.push_back(r.latency_us);
+        } else if(r.stage == TRACE_PUBLISHED) {
+            published.push_back(r.latency_us);
+        } else if(r.stage == TRACE_DEQUEUED) {
+            dequeued_at[r.trace_id] = r.latency_us;
+        } else if(r.stage == TRACE_STATE_CHECKED) {
+            dequeued_to_checked.push_back(r.latency_us - dequeued_at[r.trace_id]);
+        }
+    }
+
+    char count_line[32];
+    snprintf(count_line, sizeof(count_line), "%lu records", (unsigned long) records.size());
+    check(status == 0 && has_line(report, count_line), "report counts every record");
+    check(has_line(report, group_line("altimeter logged", logged)) && has_line(report, group_line("altimeter published", published)),
+          "report percentiles from acquisition");
+    check(has_line(report, group_line("altimeter dequeued -> state_checked", dequeued_to_checked)), "report percentiles between stages");
+    auto pyro = std::find_if(records.begin(), records.end(), [](const trace_record_t& r) { return r.stage == TRACE_PYRO_FIRED; });
+    check(pyro != records.end() && has_line(report, "    altimeter sample 2345: " + std::to_string(pyro->latency_us) + " us"),
+          "report lists the pyro firing");
+
+    std::vector<trace_record_t> few(records.begin(), records.begin() + 10);
+    write_trace(path, few, TRACE_FILE_VERSION, 3);
+    decoded = run(decode, &status);
+    check(status == 0 && decoded.size() == 9, "a truncated last record dropped");
+
+    write_trace(path, few, TRACE_FILE_VERSION + 1, 0);
+    report = run(std::string("python3 " SCRIPT " ") + path, &status);
+    check(status != 0 && !report.empty() && report[0].compare(0, 8, "INVALID:") == 0, "another version rejected");
+
+    remove(path);
+}
+
+static void ring() {
+    printf("the ring\n");
+
+    static trace_buffer_t b;
+    trace_record_t out[TRACE_BUFFER_LENGTH];
+
+    check(trace_source(ALTIMETER_DATA_FLAG | 8) == ALTIMETER_DATA_FLAG && trace_source(7) == ACCELEROMETER_DATA_FLAG,
+          "a fused record traced as its lowest data flag");
+    check(trace_sampled(20, TRACE_LOGGED) && !trace_sampled(21, TRACE_LOGGED) && trace_sampled(21, TRACE_PYRO_FIRED),
+          "one sample in TRACE_SAMPLE_DIVIDER traced, pyro always");
+
+    trace_init(&b);
+    for(uint32_t i = 0; i < TRACE_BUFFER_LENGTH + 100; i++) {
+        trace_record(&b, i, ALTIMETER_DATA_FLAG, TRACE_LOGGED, i);
+    }
+    size_t count = trace_read(&b, out, TRACE_BUFFER_LENGTH);
+    bool newest = count == TRACE_BUFFER_LENGTH;
+    for(size_t i = 0; newest && i < count; i++) {
+        newest = out[i].latency_us == 100 + i;
+    }
+    check(b.lost == 100 && newest, "lapped, the oldest 100 lost, the newest read in order");
+    check(trace_read(&b, out, TRACE_BUFFER_LENGTH) == 0, "nothing read twice");
+
+    // two tasks on either core write while the flush reads
+    trace_init(&b);
+    std::atomic<int> writers(2);
+    auto writer = [&](uint8_t source) {
+        for(uint32_t i = 0; i < RACE_RECORDS; i++) {
+            trace_record(&b, i, source, (uint8_t) (i % NUM_TRACE_STAGES), i * 3 + source);
+            // a burst of samples, then a pause the flush catches up in
+            if(i % 256 == 255) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+        writers--;
+    };
+
+    std::thread imu(writer, ACCELEROMETER_DATA_FLAG);
+    std::thread altimeter(writer, ALTIMETER_DATA_FLAG);
+
+    uint64_t read = 0;
+    bool whole = true;
+    bool drained = false;
+    while(!drained) {
+        drained = writers == 0;
+        while((count = trace_read(&b, out, 64)) > 0) {
+            for(size_t i = 0; i < count; i++) {
+                const trace_record_t& r = out[i];
+                uint32_t sample = (r.latency_us - r.source) / 3;
+                whole &= (r.source == ACCELEROMETER_DATA_FLAG || r.source == ALTIMETER_DATA_FLAG) &&
+                         r.latency_us == sample * 3 + r.source && r.trace_id == (uint16_t) sample && r.stage == sample % NUM_TRACE_STAGES;
+            }
+            read += count;
+        }
+    }
+    imu.join();
+    altimeter.join();
+
+    printf("    %llu records read, %lu lost\n", (unsigned long long) read, (unsigned long) b.lost);
+    check(whole, "every record read whole");
+    check(read + b.lost == 2ULL * RACE_RECORDS, "read and lost add up to written");
+}
+
+static void benchmark() {
+    printf("benchmark\n");
+
+    static trace_buffer_t b;
+    trace_init(&b);
+
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t i = 0; i < BENCH_RECORDS; i++) {
+        trace_record(&b, i, ALTIMETER_DATA_FLAG, TRACE_LOGGED, i);
+    }
+    double record_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_RECORDS;
+
+    printf("    trace_record()                                  %8.1f ns\n", record_ns);
+}
+
+int main() {
+    script_round_trip();
+    ring();
+    benchmark();
+
+    return check_summary();
+}
@@ -0,0 +1,440 @@
+/**
+ * Host replay of the launch and burnout detectors with the flight state machine, as
+ * checkFlightState drives them. A rejected launch takes POWERED_FLIGHT back to
+ * PRE_FLIGHT_GROUND and disarms the pyros, so a real flight must never be rejected and
+ * a knock on the pad always must. Profiles:
+ * - synthetic thrust curves, from a 12 g short burn to a heavy rocket at 3.2 g
+ * - the thrust phase of scripts/altitude_data.csv, the acceleration taken from its altitude
+ * - handling on the pad, replayed from sensor-data.csv, and synthetic knocks
+ * each with the barometer working, silent through the confirm window, stuck at the pad
+ * reading, or marked failed with the lagging GPS altitude in its place. The accelerometer
+ * (10 ms), barometer (50 ms, queued 30 ms after its tick) and GPS samples share one queue
+ * to the state check, which is delayed by no latency, by jitter, or by bursts of up to
+ * 250 ms while it is starved
+ *
+ * build and run from this directory:
+ *     g++ -I../common -I../../src launch_replay.cpp ../../src/flight_fsm.cpp ../../src/launch_detector.cpp ../../src/burnout_detector.cpp -o launch_replay && ./launch_replay
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "flight_fsm.h"
+#include "launch_detector.h"
+#include "burnout_detector.h"
+#include "check.h"
+
+#define ACCEL_THRESHOLD     2.5f        /* LAUNCH_ACCEL_THRESHOLD */
+#define SUSTAIN_MS          30          /* LAUNCH_ACCEL_SUSTAIN_TIME */
+#define BARO_THRESHOLD      10.0f       /* LAUNCH_DETECTION_THRESHOLD */
+#define CONFIRM_MS          2000        /* LAUNCH_CONFIRM_TIME */
+#define MIN_BURN_MS         500         /* LAUNCH_MIN_BURN_TIME */
+
+#define RAMP_MS             20          /* thrust build up of the synthetic motors */
+#define ACCEL_PERIOD        10
+#define BARO_PERIOD         50
+#define BARO_CONVERSION     30          /* readBarometer, a sample is queued this long after its tick */
+#define GPS_PERIOD          100
+#define GPS_LAG             800         /* the GPS altitude trails the rocket */
+#define PAD_MS              3000        /* on the pad before ignition */
+#define FLIGHT_MS           8000
+#define PROFILE_MS          (PAD_MS + FLIGHT_MS)
+#define START_MS            100000      /* millis() at the start of a run */
+#define IGNITION            (START_MS + PAD_MS)
+#define SEEDS               10
+
+static uint32_t rng_state;
+
+static float uniform() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (rng_state & 0xFFFFFF) / 16777216.0f;
+}
+
+/* roughly normal, unit standard deviation */
+static float noise() {
+    return (uniform() + uniform() + uniform() - 1.5f) * 2.0f;
+}
+
+/*
+ * profiles, the axial specific force in g and the altitude in m every ms from START_MS
+ */
+
+typedef struct {
+    const char* name;
+    float sf[PROFILE_MS];
+    float alt[PROFILE_MS];
+} profile_t;
+
+static void motor(profile_t* p, const char* name, float thrust_g, uint32_t burn_ms) {
+    p->name = name;
+
+    float velocity = 0;
+    float altitude = 0;
+    for(uint32_t t = 0; t < PROFILE_MS; t++) {
+        float sf = 1.0f;
+        if(t >= PAD_MS) {
+            uint32_t since = t - PAD_MS;
+            if(since < burn_ms) {
+                sf = since < RAMP_MS ? 1.0f + (thrust_g - 1.0f) * since / RAMP_MS : thrust_g;
+            } else {
+                sf = -0.2f;         /* drag only */
+            }
+        }
+        velocity += (sf - 1.0f) * 9.81f * 0.001f;
+        altitude += velocity * 0.001f;
+        p->sf[t] = sf;
+        p->alt[t] = altitude;
+    }
+}
+
+static bool replayed_climb(profile_t* p) {
+    FILE* f = fopen("../../scripts/altitude_data.csv", "r");
+    if(f == NULL) {
+        return false;
+    }
+
+    static float h[FLIGHT_MS + 51];
+    uint32_t n = 0;
+    float t;
+    while(n < FLIGHT_MS + 51 && fscanf(f, "%f,%f", &t, &h[n]) == 2) {
+        n++;
+    }
+    fclose(f);
+    if(n < FLIGHT_MS + 51) {
+        return false;
+    }
+
+    p->name = "altitude_data.csv";
+    for(uint32_t i = 0; i < PROFILE_MS; i++) {
+        p->sf[i] = 1.0f;
+        p->alt[i] = 0;
+    }
+    for(uint32_t i = 0; i < FLIGHT_MS; i++) {
+        uint32_t c = i < 25 ? 25 : i;
+        float a = (h[c + 25] - 2 * h[c] + h[c - 25]) / (0.025f * 0.025f);
+        p->sf[PAD_MS + i] = a / 9.81f + 1.0f;
+        p->alt[PAD_MS + i] = h[i];
+    }
+    return true;
+}
+
+static void knock(profile_t* p, const char* name, float g, uint32_t duration_ms) {
+    p->name = name;
+    for(uint32_t t = 0; t < PROFILE_MS; t++) {
+        p->sf[t] = t >= PAD_MS && t < PAD_MS + duration_ms ? g : 1.0f;
+        p->alt[t] = 0;
+    }
+}
+
+/* the 4 s of the board being handled, its swing starts about 2 s in */
+static bool replayed_handling(profile_t* p) {
+    FILE* f = fopen("../../sensor-data.csv", "r");
+    if(f == NULL) {
+        return false;
+    }
+
+    double first = -1;
+    double time;
+    float value;
+    float last = 1.0f;
+    uint32_t t = 0;
+    uint32_t start = PAD_MS - 2000;
+
+    for(uint32_t i = 0; i < PROFILE_MS; i++) {
+        p->sf[i] = 1.0f;
+        p->alt[i] = 0;
+    }
+
+    uint32_t rows = 0;
+    while(fscanf(f, "%lf,%f", &time, &value) == 2) {
+        if(first < 0) {
+            first = time;
+        }
+        uint32_t at = start + (uint32_t) ((time - first) * 1000);
+        for(; t < at && t < PROFILE_MS; t++) {
+            p->sf[t] = last;
+        }
+        last = value;
+        rows++;
+    }
+    fclose(f);
+
+    p->name = "sensor-data.csv";
+    return rows > 100;
+}
+
+/*
+ * the sensor tasks and the queue to the state check
+ */
+
+typedef enum { BARO_OK = 0, BARO_SILENT, BARO_STUCK, BARO_FAILED, NUM_BARO_MODES } BARO_MODE;
+static const char* const baro_names[NUM_BARO_MODES] = { "barometer ok", "barometer silent 2.5 s", "barometer stuck", "barometer failed, GPS" };
+
+typedef enum { LATENCY_NONE = 0, LATENCY_JITTER, LATENCY_BURSTS, NUM_LATENCIES } LATENCY;
+static const char* const latency_names[NUM_LATENCIES] = { "no latency", "0-10 ms jitter", "bursts to 250 ms" };
+
+typedef enum { SAMPLE_ACCEL = 0, SAMPLE_BARO, SAMPLE_GPS } SAMPLE_KIND;
+
+typedef struct {
+    uint8_t kind;
+    uint32_t acquired;          /* sample time in ms, what acquired_us gives checkFlightState */
+    uint32_t sent;              /* time in ms it was queued */
+    float value;
+} sample_t;
+
+static std::vector<sample_t> make_samples(const profile_t* p, uint8_t baro) {
+    std::vector<sample_t> samples;
+
+    for(uint32_t t = 0; t < PROFILE_MS; t += ACCEL_PERIOD) {
+        samples.push_back({ SAMPLE_ACCEL, START_MS + t, START_MS + t + 1, p->sf[t] + 0.05f * noise() });
+    }
+
+    for(uint32_t t = 0; t < PROFILE_MS; t += BARO_PERIOD) {
+        float altitude = p->alt[t] + 0.3f * noise();
+        if(baro == BARO_FAILED || (baro == BARO_SILENT && t + 100 >= PAD_MS && t < PAD_MS + 2500)) {
+            continue;
+        }
+        if(baro == BARO_STUCK && t >= PAD_MS) {
+            altitude = 0.3f * noise();
+        }
+        samples.push_back({ SAMPLE_BARO, START_MS + t, START_MS + t + BARO_CONVERSION, altitude });
+    }
+
+    if(baro == BARO_FAILED) {
+        for(uint32_t t = 0; t < PROFILE_MS; t += GPS_PERIOD) {
+            float altitude = t >= GPS_LAG ? p->alt[t - GPS_LAG] : 0;
+            samples.push_back({ SAMPLE_GPS, START_MS + t, START_MS + t + 2, altitude + 1.5f * noise() });
+        }
+    }
+
+    std::stable_sort(samples.begin(), samples.end(), [](const sample_t& a, const sample_t& b) { return a.sent < b.sent; });
+    return samples;
+}
+
+/* time in ms the state check takes each sample out of the queue */
+static std::vector<uint32_t> dequeue_times(const std::vector<sample_t>& samples, uint8_t latency) {
+    std::vector<uint32_t> times;
+    uint32_t free_at = 0;
+
+    for(const sample_t& s : samples) {
+        uint32_t t = s.sent > free_at ? s.sent : free_at;
+        if(latency == LATENCY_JITTER) {
+            t += (uint32_t) (uniform() * 10);
+        } else if(latency == LATENCY_BURSTS && uniform() < 0.02f) {
+            t += 50 + (uint32_t) (uniform() * 200);
+        }
+        times.push_back(t);
+        free_at = t;
+    }
+    return times;
+}
+
+/*
+ * the state check, the launch and burnout part of checkFlightState
+ */
+
+static flight_fsm_t fsm;
+static launch_detector_t launch_detector;
+static burnout_detector_t burnout_detector;
+static bool pyros_armed;
+static uint32_t disarms;
+
+static void state_entry(flight_fsm_t* f, uint8_t state) {
+    if(state == ARMED_FLIGHT_STATE::POWERED_FLIGHT) {
+        pyros_armed = true;
+        burnout_arm(&burnout_detector, launch_detector.axis_sign);
+    } else if(state == ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND) {
+        disarms += pyros_armed;
+        pyros_armed = false;
+        launch_reset(&launch_detector);
+        burnout_disarm(&burnout_detector);
+    }
+}
+
+typedef struct {
+    bool launched;
+    uint32_t launch_dispatched;     /* dequeue time of the sample that launched */
+    uint32_t launch_time;           /* launch_detector.launch_time */
+    uint32_t rejected;
+    uint32_t reject_dispatched;
+    uint32_t disarms;
+    bool armed_at_end;
+    uint8_t state;
+} run_result_t;
+
+static run_result_t run(const profile_t* p, uint8_t baro, uint8_t latency, uint32_t seed) {
+    run_result_t r = {};
+
+    rng_state = seed;
+    std::vector<sample_t> samples = make_samples(p, baro);
+    std::vector<uint32_t> dequeued = dequeue_times(samples, latency);
+
+    fsm_init(&fsm, 3000, 1000, 5000, START_MS);
+    for(uint8_t state = 0; state < NUM_FLIGHT_STATES; state++) {
+        fsm_set_hooks(&fsm, state, state_entry, NULL);
+    }
+    launch_init(&launch_detector, ACCEL_THRESHOLD, SUSTAIN_MS, BARO_THRESHOLD, CONFIRM_MS, MIN_BURN_MS);
+    burnout_init(&burnout_detector, 0, 4, 20, 500, 0.3f);
+    pyros_armed = false;
+    disarms = 0;
+
+    for(size_t i = 0; i < samples.size(); i++) {
+        const sample_t& s = samples[i];
+        uint32_t now = dequeued[i];
+
+        if(s.kind == SAMPLE_ACCEL) {
+            if(launch_update_accel(&launch_detector, s.acquired, s.value) == LAUNCH_DETECTED) {
+                fsm_dispatch(&fsm, EVENT_LAUNCH, now);
+            }
+            burnout_update(&burnout_detector, s.acquired, s.value);
+        } else {
+            launch_set_baro_failed(&launch_detector, baro == BARO_FAILED);
+            switch(launch_update_baro(&launch_detector, s.acquired, s.value)) {
+                case LAUNCH_DETECTED:
+                    fsm_dispatch(&fsm, EVENT_LAUNCH, now);
+                    break;
+                case LAUNCH_REJECTED:
+                    if(r.rejected++ == 0) {
+                        r.reject_dispatched = now;
+                    }
+                    fsm_dispatch(&fsm, EVENT_LAUNCH_REJECTED, now);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        // checkBurnout(), COASTING ignores a rejection so burnout waits for a confirmed launch
+        if(burnout_detector.detected && launch_detector.confirmed && fsm.state == ARMED_FLIGHT_STATE::POWERED_FLIGHT) {
+            fsm_dispatch(&fsm, EVENT_BURNOUT, now);
+        }
+
+        if(!r.launched && fsm.state != ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND) {
+            r.launched = true;
+            r.launch_dispatched = now;
+            r.launch_time = launch_detector.launch_time;
+        }
+    }
+
+    r.disarms = disarms;
+    r.armed_at_end = pyros_armed;
+    r.state = fsm.state;
+    return r;
+}
+
+static uint32_t percentile(std::vector<uint32_t> v, float q) {
+    if(v.empty()) {
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[(size_t) (q * (v.size() - 1))];
+}
+
+int main() {
+    static profile_t flights[5];
+    static profile_t handling[3];
+
+    motor(&flights[0], "12 g for 1.2 s", 12.0f, 1200);
+    motor(&flights[1], "6 g for 2 s", 6.0f, 2000);
+    motor(&flights[2], "3.2 g for 3.5 s, heavy", 3.2f, 3500);
+    motor(&flights[3], "8 g for 0.6 s", 8.0f, 600);
+    bool replayed = replayed_climb(&flights[4]);
+
+    bool handled = replayed_handling(&handling[0]);
+    knock(&handling[1], "8 g knock for 50 ms", 8.0f, 50);
+    knock(&handling[2], "4 g swing for 350 ms", 4.0f, 350);
+
+    check(replayed && handled, "altitude_data.csv and sensor-data.csv replayed");
+
+    printf("flights, %d seeds per latency\n", SEEDS);
+
+    bool never_rejected[NUM_BARO_MODES] = { true, true, true, true };
+    bool same_launch_time = true;
+    std::vector<uint32_t> detect_latency[NUM_LATENCIES];
+
+    for(int f = 0; f < 5; f++) {
+        for(uint8_t baro = 0; baro < NUM_BARO_MODES; baro++) {
+            uint32_t rejected = 0;
+            uint32_t launch_time = 0;
+
+            for(uint8_t latency = 0; latency < NUM_LATENCIES; latency++) {
+                for(uint32_t seed = 1; seed <= SEEDS; seed++) {
+                    run_result_t r = run(&flights[f], baro, latency, seed * 7919);
+                    bool ok = r.launched && r.rejected == 0 && r.disarms == 0 && r.armed_at_end
+                              && r.state != ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND;
+                    never_rejected[baro] &= ok;
+                    rejected += r.rejected;
+
+                    // the seed only changes the noise and the latency, the first sample over the threshold is the same
+                    if(seed == 1) {
+                        if(latency == 0) {
+                            launch_time = r.launch_time;
+                        }
+                        same_launch_time &= r.launch_time == launch_time;
+                    }
+
+                    if(baro == BARO_OK) {
+                        detect_latency[latency].push_back(r.launch_dispatched - IGNITION);
+                    }
+                }
+            }
+            printf("    %-24s %-24s %3lu rejections\n", flights[f].name, baro_names[baro], (unsigned long) rejected);
+        }
+    }
+
+    printf("    launch latency from ignition to EVENT_LAUNCH\n");
+    for(uint8_t latency = 0; latency < NUM_LATENCIES; latency++) {
+        printf("        %-20s p50 %3lu ms  p99 %3lu ms  max %3lu ms\n", latency_names[latency],
+               (unsigned long) percentile(detect_latency[latency], 0.5f), (unsigned long) percentile(detect_latency[latency], 0.99f),
+               (unsigned long) percentile(detect_latency[latency], 1.0f));
+    }
+
+    check(never_rejected[BARO_OK], "barometer ok, no flight rejected, pyros armed throughout");
+    check(never_rejected[BARO_SILENT], "barometer silent through the window, no flight rejected");
+    check(never_rejected[BARO_STUCK], "barometer stuck, the burn confirms every flight");
+    check(never_rejected[BARO_FAILED], "barometer marked failed, no flight rejected on GPS altitude");
+    check(same_launch_time, "launch time taken from the sample, not the queue latency");
+    check(percentile(detect_latency[LATENCY_NONE], 1.0f) <= RAMP_MS + SUSTAIN_MS + 2 * ACCEL_PERIOD, "launch declared within the ramp, the sustain time and two samples");
+
+    printf("handling on the pad, %d seeds per latency\n", SEEDS);
+
+    bool knocks_rejected = true;
+    bool silent_rejected_late = true;
+    bool failed_kept = true;
+    uint32_t reject_delay = 0;
+
+    for(int h = 0; h < 3; h++) {
+        for(uint8_t latency = 0; latency < NUM_LATENCIES; latency++) {
+            for(uint32_t seed = 1; seed <= SEEDS; seed++) {
+                run_result_t r = run(&handling[h], BARO_OK, latency, seed * 104729);
+                // the replayed swing can cross the threshold twice, every launch it causes is rejected
+                knocks_rejected &= r.launched && r.rejected >= 1 && r.disarms == r.rejected && !r.armed_at_end
+                                   && r.state == ARMED_FLIGHT_STATE::PRE_FLIGHT_GROUND;
+                if(r.rejected > 0 && r.reject_dispatched - r.launch_dispatched > reject_delay) {
+                    reject_delay = r.reject_dispatched - r.launch_dispatched;
+                }
+
+                // with no barometer sample in the window the launch stands until the barometer is back
+                r = run(&handling[h], BARO_SILENT, latency, seed * 104729);
+                silent_rejected_late &= r.rejected >= 1 && !r.armed_at_end && r.reject_dispatched >= IGNITION + 2500;
+
+                r = run(&handling[h], BARO_FAILED, latency, seed * 104729);
+                failed_kept &= r.rejected == 0;
+            }
+        }
+        printf("    %s\n", handling[h].name);
+    }
+
+    printf("    longest time from launch to rejection %lu ms\n", (unsigned long) reject_delay);
+    check(knocks_rejected, "every knock rejected, pyros disarmed");
+    check(reject_delay <= CONFIRM_MS + BARO_PERIOD + BARO_CONVERSION + 250, "rejected within the confirm window, a sample and a burst");
+    check(silent_rejected_late, "barometer silent, rejected once its samples are back");
+    check(failed_kept, "barometer marked failed, never rejected");
+
+    return check_summary();
+}
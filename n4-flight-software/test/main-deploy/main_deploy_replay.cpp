@@ -0,0 +1,277 @@
+/**
+ * Host replay of the main chute deploy path: the pad calibration in src/ground_calibration.cpp,
+ * AGL from the barometer as readAltimeterTask computes it with src/bmp180.cpp, and the one-shot
+ * trigger in src/altitude_trigger.cpp as checkFlightState feeds it. Pressures come from the
+ * standard atmosphere with barometer noise and outliers. Runs:
+ * - the pad calibration at sea level and on pads above it, with outliers and a bad start
+ * - drogue descents through MAIN_EJECTION_HEIGHT above those pads
+ * - the hysteresis band: dither at the deploy height, spikes either way, and the count
+ *   restarting without a band
+ *
+ * build and run from this directory:
+ *     g++ -I../common -I../../src main_deploy_replay.cpp ../../src/ground_calibration.cpp ../../src/bmp180.cpp ../../src/altitude_trigger.cpp -o main_deploy_replay && ./main_deploy_replay
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "ground_calibration.h"
+#include "altitude_trigger.h"
+#include "bmp180.h"
+#include "check.h"
+
+#define MAIN_HEIGHT         1000.0f     /* MAIN_EJECTION_HEIGHT */
+#define MAIN_HYSTERESIS     10.0f       /* MAIN_EJECTION_HYSTERESIS */
+#define MAIN_CONFIRM        3           /* MAIN_EJECTION_CONFIRM */
+#define SEA_LEVEL           1013.25     /* SEA_LEVEL_PRESSURE in mb */
+#define CALIBRATION_MS      5000        /* GROUND_CALIBRATION_TIME */
+
+#define BARO_PERIOD         50
+#define PRESSURE_NOISE      0.06        /* mb, about 0.5 m, BMP180 standard mode */
+#define OUTLIERS            0.02f       /* share of pad samples that are outliers */
+#define DESCENT_RATE        25.0f       /* m/s under the drogue */
+#define SEEDS               50
+
+static uint32_t rng_state;
+
+static float uniform() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (rng_state & 0xFFFFFF) / 16777216.0f;
+}
+
+/* roughly normal, unit standard deviation */
+static float noise() {
+    return (uniform() + uniform() + uniform() - 1.5f) * 2.0f;
+}
+
+/* standard atmosphere pressure in mb at an altitude above sea level, the inverse of bmp180_altitude() */
+static double pressure_at(double altitude) {
+    return SEA_LEVEL * pow(1 - altitude / 44330.0, 5.255);
+}
+
+/* AGL as readAltimeterTask computes it once the pad is calibrated */
+static double agl_of(double pressure, const ground_calibration_t* g) {
+    return bmp180_altitude(pressure, SEA_LEVEL) - bmp180_altitude(g->ground_pressure, SEA_LEVEL);
+}
+
+typedef struct {
+    const char* name;
+    double altitude;            /* m above sea level */
+} pad_t;
+
+static const pad_t pads[] = {
+    { "sea level", 0 },
+    { "1600 m, a highland pad", 1600 },
+    { "2500 m", 2500 }
+};
+#define NUM_PADS    (sizeof(pads) / sizeof(pads[0]))
+
+/* calibrate on the pad, returns the time in ms it took, 0 if it never finished */
+static uint32_t calibrate(ground_calibration_t* g, double pad_altitude, uint32_t bad_start) {
+    ground_cal_init(g, CALIBRATION_MS);
+
+    for(uint32_t t = 0; t < 4 * CALIBRATION_MS; t += BARO_PERIOD) {
+        double pressure = pressure_at(pad_altitude) + PRESSURE_NOISE * noise();
+        if(t < bad_start * BARO_PERIOD) {
+            pressure = 1100;        /* the sensor settling after power up */
+        } else if(uniform() < OUTLIERS) {
+            pressure += (uniform() < 0.5f ? -1 : 1) * (3 + 7 * uniform());
+        }
+        if(ground_cal_update(g, t, pressure)) {
+            return t + BARO_PERIOD;
+        }
+    }
+    return 0;
+}
+
+static void pad_calibration() {
+    printf("pad calibration, %d seeds per pad\n", SEEDS);
+
+    bool finished = true;
+    bool on_time = true;
+    bool accurate = true;
+    bool zero = true;
+    bool skipped = true;
+    bool restarted = true;
+
+    for(size_t p = 0; p < NUM_PADS; p++) {
+        double worst_error = 0;
+        double worst_agl = 0;
+
+        for(uint32_t seed = 1; seed <= SEEDS; seed++) {
+            ground_calibration_t g;
+            rng_state = seed * 7919;
+
+            uint32_t took = calibrate(&g, pads[p].altitude, 0);
+            finished &= took != 0;
+            on_time &= took >= CALIBRATION_MS && took <= CALIBRATION_MS + 2 * BARO_PERIOD;
+            skipped &= g.skipped <= g.samples;
+
+            double error = fabs(g.ground_pressure - pressure_at(pads[p].altitude));
+            worst_error = error > worst_error ? error : worst_error;
+            accurate &= error < 0.03;
+
+            // the pad itself reads 0 m on average
+            double sum = 0;
+            for(int i = 0; i < 100; i++) {
+                sum += agl_of(pressure_at(pads[p].altitude) + PRESSURE_NOISE * noise(), &g);
+            }
+            worst_agl = fabs(sum / 100) > worst_agl ? fabs(sum / 100) : worst_agl;
+            zero &= fabs(sum / 100) < 0.5;
+
+            // the first samples are the bad ones, the calibration starts over without them
+            ground_calibration_t bad;
+            uint32_t took_bad = calibrate(&bad, pads[p].altitude, 5);
+            restarted &= took_bad != 0 && fabs(bad.ground_pressure - pressure_at(pads[p].altitude)) < 0.03;
+        }
+
+        printf("    %-24s ground pressure %7.2f mb, error up to %.3f mb, pad AGL up to %.2f m\n", pads[p].name,
+               pressure_at(pads[p].altitude), worst_error, worst_agl);
+    }
+
+    check(finished && on_time, "calibrated after GROUND_CALIBRATION_TIME on every pad");
+    check(accurate, "ground pressure within 0.03 mb, about 0.25 m");
+    check(zero, "the pad reads 0 m AGL within 0.5 m");
+    check(skipped, "outliers skipped, the calibration kept");
+    check(restarted, "a bad start is dropped, the calibration starts over");
+
+    ground_calibration_t g;
+    ground_cal_init(&g, CALIBRATION_MS);
+    uint8_t early = 0;
+    for(uint32_t t = 0; t < 9000; t += 1000) {
+        early |= ground_cal_update(&g, t, SEA_LEVEL);
+    }
+    check(!early && ground_cal_update(&g, 9000, SEA_LEVEL), "not calibrated with fewer than GROUND_CAL_MIN_SAMPLES samples");
+}
+
+static void descents() {
+    printf("drogue descent at %.0f m/s through MAIN_EJECTION_HEIGHT, %d seeds per pad\n", DESCENT_RATE, SEEDS);
+
+    bool once = true;
+    bool in_band = true;
+
+    // the last sample that counts is up to MAIN_CONFIRM - 1 periods below the first one
+    float lowest = MAIN_HEIGHT - MAIN_CONFIRM * DESCENT_RATE * BARO_PERIOD * 0.001f - 3;
+    float highest = MAIN_HEIGHT + 3;
+
+    for(size_t p = 0; p < NUM_PADS; p++) {
+        float low = 1e9f;
+        float high = -1e9f;
+        float reference_fired = 0;
+
+        for(uint32_t seed = 1; seed <= SEEDS; seed++) {
+            ground_calibration_t g;
+            rng_state = seed * 7919;
+            calibrate(&g, pads[p].altitude, 0);
+
+            altitude_trigger_t trigger;
+            altitude_trigger_init(&trigger, MAIN_HEIGHT, MAIN_HYSTERESIS, MAIN_CONFIRM);
+            altitude_trigger_arm(&trigger);
+
+            uint32_t fired = 0;
+            float fired_at = 0;
+            for(float true_agl = 3000; true_agl > 0; true_agl -= DESCENT_RATE * BARO_PERIOD * 0.001f) {
+                double pressure = pressure_at(pads[p].altitude + true_agl) + PRESSURE_NOISE * noise();
+                if(altitude_trigger_update(&trigger, agl_of(pressure, &g))) {
+                    fired++;
+                    fired_at = true_agl;
+                }
+            }
+
+            once &= fired == 1;
+            in_band &= fired_at >= lowest && fired_at <= highest;
+            low = fired_at < low ? fired_at : low;
+            high = fired_at > high ? fired_at : high;
+
+            // the ground pressure as the reference, what the AGL was measured from before
+            if(seed == 1) {
+                for(float true_agl = 3000; true_agl > 0; true_agl -= 0.1f) {
+                    if(bmp180_altitude(pressure_at(pads[p].altitude + true_agl), g.ground_pressure) <= MAIN_HEIGHT) {
+                        reference_fired = true_agl;
+                        break;
+                    }
+                }
+            }
+        }
+
+        printf("    %-24s fired at %6.1f to %6.1f m true AGL, %6.1f m measured from the ground pressure\n",
+               pads[p].name, low, high, reference_fired);
+    }
+
+    check(once, "the main chute fires once per descent");
+    check(in_band, "fired within the confirm samples of MAIN_EJECTION_HEIGHT true AGL");
+}
+
+static uint8_t feed(altitude_trigger_t* t, const float* agl, int n, int* fired_on) {
+    uint8_t fired = 0;
+    for(int i = 0; i < n; i++) {
+        if(altitude_trigger_update(t, agl[i])) {
+            fired++;
+            *fired_on = i;
+        }
+    }
+    return fired;
+}
+
+static void hysteresis() {
+    printf("hysteresis around MAIN_EJECTION_HEIGHT\n");
+
+    altitude_trigger_t t;
+    int fired_on = -1;
+
+    // dither across the threshold inside the band keeps the count
+    const float dither[] = { 1020, 1004, 999, 1003, 998, 1006, 997, 990, 980 };
+    altitude_trigger_init(&t, MAIN_HEIGHT, MAIN_HYSTERESIS, MAIN_CONFIRM);
+    altitude_trigger_arm(&t);
+    check(feed(&t, dither, 9, &fired_on) == 1 && fired_on == 6, "dither inside the band, fires on the third sample at or below");
+
+    // with no band the same dither restarts the count on every sample above
+    const float restart[] = { 999, 1001, 999, 1001, 999, 1001, 999, 1001 };
+    altitude_trigger_init(&t, MAIN_HEIGHT, 0, MAIN_CONFIRM);
+    altitude_trigger_arm(&t);
+    uint8_t without = feed(&t, restart, 8, &fired_on);
+    altitude_trigger_init(&t, MAIN_HEIGHT, MAIN_HYSTERESIS, MAIN_CONFIRM);
+    altitude_trigger_arm(&t);
+    check(without == 0 && feed(&t, restart, 8, &fired_on) == 1 && fired_on == 4, "without the band 1 m of dither never fires, with it fires");
+
+    // a single low spike high above the deploy height
+    const float spike_low[] = { 1200, 950, 1190, 1180, 940, 1170, 1160, 1150 };
+    altitude_trigger_init(&t, MAIN_HEIGHT, MAIN_HYSTERESIS, MAIN_CONFIRM);
+    altitude_trigger_arm(&t);
+    check(feed(&t, spike_low, 8, &fired_on) == 0 && t.count == 0, "low spikes above the band are forgotten");
+
+    // a high spike during the count restarts it
+    const float spike_high[] = { 999, 998, 1050, 997, 996, 995 };
+    altitude_trigger_init(&t, MAIN_HEIGHT, MAIN_HYSTERESIS, MAIN_CONFIRM);
+    altitude_trigger_arm(&t);
+    check(feed(&t, spike_high, 6, &fired_on) == 1 && fired_on == 5, "a high spike during the count restarts it");
+
+    // exactly at the threshold counts, exactly at the top of the band keeps the count
+    const float edges[] = { MAIN_HEIGHT, MAIN_HEIGHT + MAIN_HYSTERESIS, MAIN_HEIGHT, MAIN_HEIGHT };
+    altitude_trigger_init(&t, MAIN_HEIGHT, MAIN_HYSTERESIS, MAIN_CONFIRM);
+    altitude_trigger_arm(&t);
+    check(feed(&t, edges, 4, &fired_on) == 1 && fired_on == 3, "the threshold counts, the top of the band keeps the count");
+
+    // idle until armed, once per arming
+    const float below[] = { 900, 890, 880, 870, 860, 850, 840 };
+    altitude_trigger_init(&t, MAIN_HEIGHT, MAIN_HYSTERESIS, MAIN_CONFIRM);
+    check(feed(&t, below, 7, &fired_on) == 0, "not armed, never fires");
+    altitude_trigger_arm(&t);
+    check(feed(&t, below, 7, &fired_on) == 1, "armed, fires once");
+    altitude_trigger_arm(&t);
+    check(feed(&t, below, 7, &fired_on) == 0, "arming again without a disarm does not fire again");
+    altitude_trigger_disarm(&t);
+    altitude_trigger_arm(&t);
+    check(feed(&t, below, 7, &fired_on) == 1 && fired_on == 2, "after a disarm it fires again");
+}
+
+int main() {
+    pad_calibration();
+    descents();
+    hysteresis();
+
+    return check_summary();
+}
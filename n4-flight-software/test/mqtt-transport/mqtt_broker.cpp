@@ -0,0 +1,339 @@
+/**
+ * Host test of the MQTT transport in src/mqtt_transport.cpp against a broker stand-in
+ * The WiFi and PubSubClient stand-ins in shim/ talk to a simulated broker on a simulated
+ * clock. A TCP connect to an unreachable broker takes its whole timeout, the one without a
+ * timeout takes the 3 s WiFiClient default. The broker can refuse the MQTT CONNECT, drop
+ * the connection in the middle of a publish or between publishes. Runs:
+ * - a healthy broker, every message sent at once
+ * - an unreachable broker with WiFi up, the stall of one poll() and the reconnect backoff
+ * - forced disconnects mid-publish and a broker outage longer than the outbound queue
+ * - WiFi down, and a broker that refuses the MQTT CONNECT
+ *
+ * build and run from this directory:
+ *     g++ -Ishim -I../../include -I../common -I../../src mqtt_broker.cpp ../../src/mqtt_transport.cpp -o mqtt_broker && ./mqtt_broker
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "mqtt_transport.h"
+#include "check.h"
+
+#define RTT_MS              20          /* one round trip to the broker */
+#define DEFAULT_CONNECT_MS  3000        /* WIFI_CLIENT_DEF_CONN_TIMEOUT_MS of arduino-esp32 2.x */
+#define POLL_INTERVAL_MS    10
+
+/*
+ * the simulated clock, network and broker
+ */
+
+static uint32_t now_ms = 0;
+
+EspClass ESP;
+HostSerial Serial;
+
+uint32_t millis() {
+    return now_ms;
+}
+
+typedef struct {
+    bool wifi_up;
+    bool reachable;                     /* the broker answers TCP connects */
+    bool accepting;                     /* the broker accepts the MQTT CONNECT */
+    bool tcp_open;
+    uint32_t kill_at_publish;           /* the broker drops the connection during this publish, 0 for never */
+    uint32_t publishes;
+    uint32_t untimed_connects;          /* TCP connects made without a timeout */
+    std::vector<uint32_t> tcp_attempts; /* start time of every TCP connect */
+    std::vector<uint32_t> received;     /* sequence numbers as they reached the broker */
+} network_t;
+
+static network_t net;
+
+static void network_reset() {
+    net = network_t();
+    net.wifi_up = true;
+    net.reachable = true;
+    net.accepting = true;
+    now_ms = 1000;
+}
+
+WiFiClass WiFi;
+
+wl_status_t WiFiClass::status() {
+    return net.wifi_up ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    net.untimed_connects++;
+    return this->connect(host, port, DEFAULT_CONNECT_MS);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeout_ms) {
+    net.tcp_attempts.push_back(now_ms);
+    if(!net.wifi_up || !net.reachable) {
+        now_ms += timeout_ms;
+        return 0;
+    }
+    now_ms += RTT_MS;
+    net.tcp_open = true;
+    return 1;
+}
+
+uint8_t WiFiClient::connected() {
+    return net.tcp_open;
+}
+
+void WiFiClient::stop() {
+    net.tcp_open = false;
+}
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+    return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+    return true;
+}
+
+PubSubClient& PubSubClient::setSocketTimeout(uint16_t timeout) {
+    return *this;
+}
+
+bool PubSubClient::connect(const char* id) {
+    if(!this->_net->connected() && !this->_net->connect(MQTT_SERVER, MQTT_PORT)) {
+        return false;
+    }
+
+    now_ms += RTT_MS;
+    if(!net.accepting) {
+        this->_net->stop();
+        this->_session = false;
+        return false;
+    }
+
+    this->_session = true;
+    return true;
+}
+
+bool PubSubClient::connected() {
+    if(!this->_net->connected()) {
+        this->_session = false;
+    }
+    return this->_session;
+}
+
+bool PubSubClient::loop() {
+    return this->connected();
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+    if(!this->connected()) {
+        return false;
+    }
+
+    net.publishes++;
+    now_ms += 2;
+
+    if(net.publishes == net.kill_at_publish) {
+        // the connection drops before the broker has the whole message
+        net.tcp_open = false;
+        this->_session = false;
+        return false;
+    }
+
+    net.received.push_back((uint32_t) strtoul((const char*) payload, NULL, 10));
+    return true;
+}
+
+/*
+ * the telemetry task side
+ */
+
+static WiFiClient wifi_client;
+static PubSubClient client(wifi_client);
+
+static MQTTTransport* make_transport() {
+    static MQTTTransport* transport = NULL;
+
+    network_reset();
+    client = PubSubClient(wifi_client);
+    delete transport;
+    transport = new MQTTTransport(client, wifi_client, MQTT_SERVER, MQTT_PORT, MQTT_TOPIC);
+    transport->begin();
+    return transport;
+}
+
+static uint8_t send_sequence(MQTTTransport* mqtt, uint32_t sequence) {
+    char payload[16];
+    int length = snprintf(payload, sizeof(payload), "%u\n", sequence);
+    return mqtt->send((const uint8_t*) payload, length);
+}
+
+/* poll the link for duration_ms and return the longest poll() */
+static uint32_t poll_for(MQTTTransport* mqtt, uint32_t duration_ms) {
+    uint32_t end = now_ms + duration_ms;
+    uint32_t longest = 0;
+
+    while((int32_t) (now_ms - end) < 0) {
+        uint32_t start = now_ms;
+        mqtt->poll();
+        if(now_ms - start > longest) {
+            longest = now_ms - start;
+        }
+        now_ms += POLL_INTERVAL_MS;
+    }
+    return longest;
+}
+
+/* every sequence number at most once and in increasing order */
+static bool in_order_once(const std::vector<uint32_t>& received) {
+    for(size_t i = 1; i < received.size(); i++) {
+        if(received[i] <= received[i - 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void healthy_broker() {
+    printf("healthy broker\n");
+
+    MQTTTransport* mqtt = make_transport();
+    mqtt->poll();
+
+    uint32_t sent = 0;
+    for(uint32_t i = 0; i < 200; i++) {
+        poll_for(mqtt, 100);
+        sent += send_sequence(mqtt, i) == TELEMETRY_SENT;
+    }
+
+    check(mqtt->stats.connects == 1 && net.tcp_attempts.size() == 1, "one connection");
+    check(sent == 200, "every send returns TELEMETRY_SENT");
+    check(net.received.size() == 200 && in_order_once(net.received), "every message received once and in order");
+}
+
+static void unreachable_broker() {
+    printf("broker unreachable, WiFi up, 60 s\n");
+
+    MQTTTransport* mqtt = make_transport();
+    net.reachable = false;
+
+    uint32_t longest = 0;
+    uint32_t queued = 0;
+    uint32_t sequence = 0;
+    for(; sequence < 600; sequence++) {
+        uint32_t stall = poll_for(mqtt, 100);
+        longest = stall > longest ? stall : longest;
+        queued += send_sequence(mqtt, sequence) == TELEMETRY_QUEUED;
+    }
+
+    printf("    longest poll() %lu ms, %lu ms with the WiFiClient default timeout\n", (unsigned long) longest, (unsigned long) DEFAULT_CONNECT_MS);
+    check(longest <= MQTT_CONNECT_TIMEOUT, "a poll() stalls at most MQTT_CONNECT_TIMEOUT");
+    check(net.untimed_connects == 0, "no TCP connect without a timeout");
+    check(queued == sequence, "every send returns TELEMETRY_QUEUED");
+    check(mqtt->stats.dropped == sequence - MQTT_OUTBOUND_SLOTS, "the queue keeps the newest MQTT_OUTBOUND_SLOTS messages");
+
+    // attempts 500, 1000 ... 16000 ms apart, late by at most one poll and the connect timeout
+    bool backoff = net.tcp_attempts.size() >= 8;
+    uint32_t expected = MQTT_RECONNECT_MIN_DELAY;
+    printf("    attempts at");
+    for(size_t i = 1; i < net.tcp_attempts.size(); i++) {
+        uint32_t gap = net.tcp_attempts[i] - net.tcp_attempts[i - 1];
+        printf(" +%lu", (unsigned long) gap);
+        backoff &= gap >= expected && gap <= expected + MQTT_CONNECT_TIMEOUT + POLL_INTERVAL_MS;
+        expected = expected * 2 > MQTT_RECONNECT_MAX_DELAY ? MQTT_RECONNECT_MAX_DELAY : expected * 2;
+    }
+    printf(" ms\n");
+    check(backoff, "backoff doubles up to MQTT_RECONNECT_MAX_DELAY");
+
+    net.reachable = true;
+    poll_for(mqtt, MQTT_RECONNECT_MAX_DELAY + 100);
+
+    bool newest = net.received.size() == MQTT_OUTBOUND_SLOTS;
+    for(size_t i = 0; newest && i < net.received.size(); i++) {
+        newest &= net.received[i] == sequence - MQTT_OUTBOUND_SLOTS + i;
+    }
+    check(mqtt->stats.connects == 1 && newest, "broker back, the queued messages delivered oldest first");
+}
+
+static void forced_disconnects() {
+    printf("forced disconnects, a message every 200 ms for 60 s\n");
+
+    MQTTTransport* mqtt = make_transport();
+    mqtt->poll();
+
+    net.kill_at_publish = 50;
+    uint32_t statuses[3] = {};
+    for(uint32_t i = 0; i < 300; i++) {
+        poll_for(mqtt, 200);
+        if(i == 100 || i == 200) {
+            // the broker closes the connection between two publishes
+            net.tcp_open = false;
+        }
+        if(i == 150) {
+            net.kill_at_publish = net.publishes + 1;
+        }
+        statuses[send_sequence(mqtt, i)]++;
+    }
+    poll_for(mqtt, 1000);
+
+    printf("    %lu sent, %lu queued, %lu connections\n", (unsigned long) statuses[TELEMETRY_SENT],
+           (unsigned long) statuses[TELEMETRY_QUEUED], (unsigned long) mqtt->stats.connects);
+    check(statuses[TELEMETRY_QUEUED] >= 4 && statuses[TELEMETRY_REFUSED] == 0, "a send across a disconnect returns TELEMETRY_QUEUED");
+    check(mqtt->stats.connects == 5, "reconnected after every disconnect");
+    check(net.received.size() == 300 && in_order_once(net.received), "short outages, every message received once and in order");
+
+    printf("broker outage of 5 s\n");
+
+    uint32_t outage_start = 300;
+    net.reachable = false;
+    net.tcp_open = false;
+    for(uint32_t i = outage_start; i < outage_start + 25; i++) {
+        poll_for(mqtt, 200);
+        send_sequence(mqtt, i);
+    }
+    net.reachable = true;
+    poll_for(mqtt, MQTT_RECONNECT_MAX_DELAY + 100);
+
+    printf("    %lu received, %lu dropped\n", (unsigned long) net.received.size(), (unsigned long) mqtt->stats.dropped);
+    check(in_order_once(net.received), "every message received at most once and in order");
+    check(net.received.size() + mqtt->stats.dropped == outage_start + 25, "every message received or counted as dropped");
+    check(net.received.back() == outage_start + 24, "the newest message delivered after the outage");
+}
+
+static void no_wifi() {
+    printf("WiFi down, 10 s\n");
+
+    MQTTTransport* mqtt = make_transport();
+    net.wifi_up = false;
+
+    uint32_t longest = poll_for(mqtt, 10000);
+    uint8_t status = send_sequence(mqtt, 0);
+
+    check(longest == 0, "a poll() does not stall");
+    check(net.tcp_attempts.empty() && mqtt->stats.connect_failures > 0, "no TCP connect, attempts counted as failed");
+    check(status == TELEMETRY_QUEUED, "send returns TELEMETRY_QUEUED");
+
+    printf("broker refuses the MQTT CONNECT, 10 s\n");
+
+    mqtt = make_transport();
+    net.accepting = false;
+    longest = poll_for(mqtt, 10000);
+
+    check(longest <= 2 * RTT_MS, "a poll() stalls one TCP and one MQTT round trip");
+    check(net.tcp_attempts.size() == mqtt->stats.connect_failures && !net.tcp_open,
+          "the socket is closed after every refused attempt");
+    check(net.untimed_connects == 0, "no TCP connect without a timeout");
+}
+
+int main() {
+    healthy_broker();
+    unreachable_broker();
+    forced_disconnects();
+    no_wifi();
+
+    return check_summary();
+}
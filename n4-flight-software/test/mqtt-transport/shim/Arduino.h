@@ -0,0 +1,33 @@
+/**
+ * Host stand-in for Arduino.h, the clock, the chip MAC and the Serial calls of the
+ * debug macros. The clock and the objects are defined by the test
+ */
+
+#ifndef SHIM_ARDUINO_H
+#define SHIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+uint32_t millis();
+
+class EspClass {
+    public:
+        uint64_t getEfuseMac() { return 0x0000A4CF12345678ULL; }
+};
+
+extern EspClass ESP;
+
+/* debug output is dropped, the test prints its own */
+class HostSerial {
+    public:
+        template<typename T> void print(T) {}
+        template<typename T> void println(T) {}
+        template<typename T> void printf(const char*, T) {}
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,29 @@
+/**
+ * Host stand-in for PubSubClient 2.8, the calls the MQTT transport makes. As in the
+ * library, connect() only opens the TCP connection itself when the network client is
+ * not already connected. Implemented by the test
+ */
+
+#ifndef SHIM_PUBSUBCLIENT_H
+#define SHIM_PUBSUBCLIENT_H
+
+#include <stdint.h>
+#include <WiFi.h>
+
+class PubSubClient {
+    private:
+        WiFiClient* _net;
+        bool _session = false;
+
+    public:
+        PubSubClient(WiFiClient& client) : _net(&client) {}
+        PubSubClient& setServer(const char* domain, uint16_t port);
+        bool setBufferSize(uint16_t size);
+        PubSubClient& setSocketTimeout(uint16_t timeout);
+        bool connect(const char* id);
+        bool connected();
+        bool loop();
+        bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained);
+};
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ * Host stand-in for the ESP32 WiFi.h, the station status and the TCP client.
+ * The network behind them is implemented by the test
+ */
+
+#ifndef SHIM_WIFI_H
+#define SHIM_WIFI_H
+
+#include <stdint.h>
+
+typedef enum {
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+class WiFiClass {
+    public:
+        wl_status_t status();
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient {
+    public:
+        int connect(const char* host, uint16_t port);
+        int connect(const char* host, uint16_t port, int32_t timeout_ms);
+        uint8_t connected();
+        void stop();
+};
+
+#endif
@@ -0,0 +1,297 @@
+/**
+ * Host test of the pyro channel driver in src/pyro.cpp
+ * The GPIO and esp_timer stand-ins in shim/ are implemented here on a simulated clock. Every
+ * level written to a pin is recorded, so a pulse is measured from the pin history and not
+ * from the driver state. The timer callback is run by the clock like the esp_timer task
+ * would, or by hand to put it in a race with disarm(). Runs:
+ * - a channel that is SAFE refuses to fire and the pin never goes HIGH
+ * - one pulse of the pulse time per arming, the pin LOW after the pulse and after disarm
+ * - a pulse end that was already dispatched when disarm() ran
+ * - a timer that cannot be created or started, and the continuity input
+ *
+ * build and run from this directory:
+ *     g++ -Ishim -I../common -I../../src pyro_channel.cpp ../../src/pyro.cpp -o pyro_channel && ./pyro_channel
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <vector>
+#include "pyro.h"
+#include "check.h"
+
+#define FIRE_PIN        25
+#define SENSE_PIN       26
+#define PULSE_MS        5000        /* PYRO_PULSE_TIME */
+
+/*
+ * the simulated clock, pins and timer
+ */
+
+static uint32_t now_ms = 0;
+
+typedef struct {
+    uint32_t time;
+    uint8_t level;
+} edge_t;
+
+typedef struct {
+    uint8_t mode;
+    uint8_t level;
+    uint8_t input;                  /* level read back when the pin is an input */
+    std::vector<edge_t> edges;      /* every write that changed the level */
+} pin_t;
+
+static pin_t pins[40];
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    bool running;
+    uint64_t expiry_us;
+};
+
+static struct esp_timer timer;
+static bool timer_create_fails = false;
+static bool timer_start_fails = false;
+
+uint32_t millis() {
+    return now_ms;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    pins[pin].mode = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if(value != pins[pin].level) {
+        pins[pin].edges.push_back({now_ms, value});
+    }
+    pins[pin].level = value;
+}
+
+int digitalRead(uint8_t pin) {
+    return pins[pin].mode == INPUT ? pins[pin].input : pins[pin].level;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    if(timer_create_fails) {
+        return ESP_FAIL;
+    }
+    timer.callback = args->callback;
+    timer.arg = args->arg;
+    timer.running = false;
+    *handle = &timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t handle, uint64_t timeout_us) {
+    if(timer_start_fails) {
+        return ESP_FAIL;
+    }
+    if(handle->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->running = true;
+    handle->expiry_us = (uint64_t) now_ms * 1000 + timeout_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t handle) {
+    if(!handle->running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->running = false;
+    return ESP_OK;
+}
+
+static void reset() {
+    for(size_t i = 0; i < sizeof(pins) / sizeof(pins[0]); i++) {
+        pins[i] = pin_t();
+    }
+    // the pin floats HIGH until begin(), a write of LOW is an edge
+    pins[FIRE_PIN].level = HIGH;
+    timer = esp_timer();
+    timer_create_fails = false;
+    timer_start_fails = false;
+    now_ms = 1000;
+}
+
+/* advance the clock 1 ms at a time, the expired timer runs its callback like the esp_timer task */
+static void advance(uint32_t ms) {
+    for(uint32_t i = 0; i < ms; i++) {
+        now_ms++;
+        if(timer.running && (uint64_t) now_ms * 1000 >= timer.expiry_us) {
+            timer.running = false;
+            timer.callback(timer.arg);
+        }
+    }
+}
+
+/* number of HIGH pulses on the fire pin since index from, and the length of the last one */
+static uint32_t pulses(uint32_t* last_ms, size_t from = 0) {
+    const std::vector<edge_t>& edges = pins[FIRE_PIN].edges;
+    uint32_t count = 0;
+    for(size_t i = from; i < edges.size(); i++) {
+        if(edges[i].level != HIGH) {
+            continue;
+        }
+        count++;
+        if(last_ms != NULL) {
+            *last_ms = i + 1 < edges.size() ? edges[i + 1].time - edges[i].time : UINT32_MAX;
+        }
+    }
+    return count;
+}
+
+static void refused_when_safe() {
+    printf("refused when SAFE\n");
+    reset();
+
+    PyroChannel channel("main", FIRE_PIN, SENSE_PIN, PULSE_MS);
+    check(channel.begin(), "begin() creates the timer");
+    check(pins[FIRE_PIN].mode == OUTPUT && pins[FIRE_PIN].edges.size() == 1 && pins[FIRE_PIN].level == LOW,
+          "begin() drives the fire pin LOW");
+
+    check(channel.fire() == PYRO_FIRE_NOT_ARMED, "fire() before arm() is refused");
+    advance(PULSE_MS);
+    check(channel.state() == PYRO_SAFE && channel.fireCount() == 0, "the channel stays SAFE");
+
+    channel.arm();
+    channel.disarm();
+    check(channel.fire() == PYRO_FIRE_NOT_ARMED, "fire() after disarm() is refused");
+    advance(PULSE_MS);
+
+    check(pulses(NULL) == 0 && !timer.running, "the fire pin never went HIGH");
+}
+
+static void one_pulse_per_arming() {
+    printf("one pulse per arming\n");
+    reset();
+
+    PyroChannel channel("main", FIRE_PIN, SENSE_PIN, PULSE_MS);
+    channel.begin();
+    channel.arm();
+
+    uint32_t fired_at = now_ms;
+    check(channel.fire() == PYRO_FIRE_OK, "fire() when ARMED starts the pulse");
+    check(pins[FIRE_PIN].level == HIGH && channel.state() == PYRO_FIRING, "the pin is HIGH and the channel FIRING");
+    check(channel.fireTime() == fired_at && channel.fireCount() == 1, "fire time and count recorded");
+
+    advance(PULSE_MS / 2);
+    check(channel.fire() == PYRO_FIRE_ALREADY_FIRED, "a second fire() during the pulse is refused");
+    channel.arm();
+    check(channel.state() == PYRO_FIRING, "arm() during the pulse changes nothing");
+
+    advance(PULSE_MS);
+    uint32_t length = 0;
+    check(pins[FIRE_PIN].level == LOW && channel.state() == PYRO_FIRED, "pin LOW and the channel FIRED after the pulse end");
+    check(pulses(&length) == 1 && length == PULSE_MS, "one pulse of exactly the pulse time");
+
+    channel.arm();
+    check(channel.fire() == PYRO_FIRE_ALREADY_FIRED, "arm() and fire() after the pulse is refused");
+    advance(PULSE_MS);
+    check(pulses(NULL) == 1 && channel.fireCount() == 1, "still one pulse");
+
+    channel.disarm();
+    check(channel.fire() == PYRO_FIRE_NOT_ARMED, "disarmed, fire() is refused");
+    channel.arm();
+    check(channel.fire() == PYRO_FIRE_OK, "armed again, fire() starts a new pulse");
+    advance(2 * PULSE_MS);
+    check(pulses(&length) == 2 && length == PULSE_MS && channel.fireCount() == 2, "the second arming gave one more pulse");
+}
+
+static void disarm_mid_pulse() {
+    printf("disarm during the pulse\n");
+    reset();
+
+    PyroChannel channel("drogue", FIRE_PIN, SENSE_PIN, PULSE_MS);
+    channel.begin();
+    channel.arm();
+    channel.fire();
+    advance(PULSE_MS / 4);
+
+    channel.disarm();
+    uint32_t length = 0;
+    check(pins[FIRE_PIN].level == LOW && channel.state() == PYRO_SAFE, "pin LOW and the channel SAFE at once");
+    check(!timer.running, "the pulse timer stopped");
+    check(pulses(&length) == 1 && length == PULSE_MS / 4, "the pulse was cut at the disarm");
+
+    advance(2 * PULSE_MS);
+    check(pins[FIRE_PIN].level == LOW && channel.state() == PYRO_SAFE, "nothing changes when the pulse would have ended");
+
+    printf("pulse end already dispatched when disarm() runs\n");
+    reset();
+
+    channel.begin();
+    channel.arm();
+    channel.fire();
+    advance(PULSE_MS - 1);
+
+    // the esp_timer task took the expiry, disarm() runs before the callback does
+    now_ms++;
+    timer.running = false;
+    channel.disarm();
+    timer.callback(timer.arg);
+
+    check(pins[FIRE_PIN].level == LOW, "pin LOW");
+    check(channel.state() == PYRO_SAFE, "the late pulse end leaves the channel SAFE");
+    check(channel.fire() == PYRO_FIRE_NOT_ARMED, "fire() is refused");
+
+    channel.arm();
+    check(channel.state() == PYRO_ARMED && channel.fire() == PYRO_FIRE_OK, "the channel can be armed and fired again");
+    advance(PULSE_MS);
+    check(pulses(NULL) == 2 && pins[FIRE_PIN].level == LOW && channel.state() == PYRO_FIRED, "the second pulse ends normally");
+}
+
+static void timer_errors() {
+    printf("timer errors\n");
+    reset();
+
+    timer_create_fails = true;
+    PyroChannel channel("main", FIRE_PIN, SENSE_PIN, PULSE_MS);
+    check(!channel.begin(), "begin() reports the failed timer");
+    check(pins[FIRE_PIN].level == LOW, "the fire pin is LOW anyway");
+    channel.arm();
+    check(channel.fire() == PYRO_FIRE_TIMER_ERROR && pulses(NULL) == 0, "no timer, fire() refused and the pin never HIGH");
+
+    reset();
+    PyroChannel other("main", FIRE_PIN, SENSE_PIN, PULSE_MS);
+    other.begin();
+    other.arm();
+    timer_start_fails = true;
+
+    check(other.fire() == PYRO_FIRE_TIMER_ERROR, "the timer does not start, fire() reports it");
+    check(pins[FIRE_PIN].level == LOW && other.state() == PYRO_FIRED, "pin LOW at once and the channel latched");
+    check(other.fire() == PYRO_FIRE_ALREADY_FIRED, "no retry until disarmed");
+}
+
+static void continuity() {
+    printf("continuity\n");
+    reset();
+
+    PyroChannel sensed("main", FIRE_PIN, SENSE_PIN, PULSE_MS);
+    sensed.begin();
+    check(pins[SENSE_PIN].mode == INPUT, "begin() makes the sense pin an input");
+
+    pins[SENSE_PIN].input = HIGH;
+    check(sensed.continuity() == PYRO_CONTINUITY_OK, "sense HIGH reads PYRO_CONTINUITY_OK");
+    pins[SENSE_PIN].input = LOW;
+    check(sensed.continuity() == PYRO_CONTINUITY_OPEN, "sense LOW reads PYRO_CONTINUITY_OPEN");
+
+    sensed.arm();
+    check(sensed.status() == (PYRO_ARMED | (PYRO_CONTINUITY_OPEN << 2)), "status() packs the state and the continuity");
+
+    PyroChannel unsensed("drogue", FIRE_PIN, PYRO_NO_SENSE_PIN, PULSE_MS);
+    check(unsensed.continuity() == PYRO_CONTINUITY_UNKNOWN, "no sense pin reads PYRO_CONTINUITY_UNKNOWN");
+}
+
+int main() {
+    refused_when_safe();
+    one_pulse_per_arming();
+    disarm_mid_pulse();
+    timer_errors();
+    continuity();
+
+    return check_summary();
+}
@@ -0,0 +1,109 @@
+/**
+ * Host stress test of src/queue_monitor.cpp against the FreeRTOS shim in shim/
+ * Several producers overrun a slow consumer, once with the non-blocking sends the
+ * sensor tasks use and once with a send timeout, and the statistics are checked
+ * against what the threads actually did
+ *
+ * build and run from this directory:
+ *     g++ -std=c++11 -pthread -Ishim -I../common -I../../src queue_stress.cpp shim/freertos_shim.cpp ../../src/queue_monitor.cpp -o queue_stress && ./queue_stress
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "queue_monitor.h"
+#include "check.h"
+
+#define QUEUE_LENGTH        10
+#define PRODUCERS           3
+#define ITEMS_PER_PRODUCER  2000
+
+typedef struct {
+    uint32_t producer;
+    uint32_t sequence;
+} item_t;
+
+static void print_stats(const monitored_queue_t* q) {
+    char record[QUEUE_RECORD_LENGTH];
+    queue_format(q, record, sizeof(record), 0);
+    printf("    %s", record);
+}
+
+/**
+ * producers send every period_us with the given timeout, the consumer takes an item
+ * every consume_us and checks each producer's items arrive in order
+ */
+static void run(const char* title, TickType_t timeout, uint32_t period_us, uint32_t consume_us, uint32_t items) {
+    monitored_queue_t q;
+    std::atomic<uint32_t> attempts(0);
+    std::atomic<uint32_t> accepted(0);
+    std::atomic<int> running(PRODUCERS);
+    uint32_t consumed = 0;
+    uint32_t out_of_order = 0;
+    uint32_t last[PRODUCERS] = {0};
+
+    static uint8_t storage[QUEUE_LENGTH * sizeof(item_t)];
+
+    printf("%s\n", title);
+    queue_create(&q, "stress", QUEUE_LENGTH, sizeof(item_t), storage);
+
+    std::vector<std::thread> producers;
+    for(uint32_t p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&, p] {
+            for(uint32_t i = 1; i <= items; i++) {
+                item_t item = {p, i};
+                attempts++;
+                if(queue_send(&q, &item, timeout)) {
+                    accepted++;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(period_us));
+            }
+            running--;
+        });
+    }
+
+    item_t item;
+    while(running > 0 || queue_waiting(&q) > 0) {
+        if(queue_receive(&q, &item, pdMS_TO_TICKS(20))) {
+            consumed++;
+            if(item.sequence <= last[item.producer]) {
+                out_of_order++;
+            }
+            last[item.producer] = item.sequence;
+            std::this_thread::sleep_for(std::chrono::microseconds(consume_us));
+        }
+    }
+
+    for(auto& t : producers) {
+        t.join();
+    }
+
+    print_stats(&q);
+    check(q.enqueued + q.dropped == attempts, "every send counted as enqueued or dropped");
+    check(q.enqueued == accepted, "enqueued matches accepted sends");
+    check(q.received == consumed && consumed == q.enqueued, "every enqueued item received");
+    check(out_of_order == 0, "items of each producer received in order");
+    check(q.high_water <= QUEUE_LENGTH, "high water within the queue length");
+
+    if(timeout == 0) {
+        check(q.dropped > 0, "overload shows up as drops");
+        check(q.high_water == QUEUE_LENGTH, "overload fills the queue");
+        check(q.blocked_us == 0 && q.max_blocked_us == 0, "non-blocking sends never block");
+    } else {
+        // host threads wake up late, allow for that on top of the timeout
+        uint32_t limit_us = timeout * portTICK_PERIOD_MS * 1000 + 20000;
+        check(q.blocked_us > 0, "blocking sends account waiting time");
+        check(q.max_blocked_us <= limit_us, "no wait longer than the timeout");
+    }
+}
+
+int main() {
+    run("non-blocking sends, 3 producers at 5 kHz, consumer at 1 kHz", 0, 200, 1000, ITEMS_PER_PRODUCER);
+    run("2 ms send timeout, 3 producers at 1 kHz, consumer at 500 Hz", pdMS_TO_TICKS(2), 1000, 2000, ITEMS_PER_PRODUCER / 4);
+
+    return check_summary();
+}
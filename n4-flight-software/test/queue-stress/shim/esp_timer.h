@@ -0,0 +1,12 @@
+/**
+ * Host stand-in for esp_timer_get_time(), microseconds from a monotonic clock
+ */
+
+#ifndef SHIM_ESP_TIMER_H
+#define SHIM_ESP_TIMER_H
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,29 @@
+/**
+ * Host stand-in for the FreeRTOS types used by src/queue_monitor.cpp and src/task_shutdown.cpp
+ * One tick is one millisecond, as configured for the flight computer
+ */
+
+#ifndef SHIM_FREERTOS_H
+#define SHIM_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdPASS              1
+#define pdFAIL              0
+#define pdTRUE              1
+#define pdFALSE             0
+#define portMAX_DELAY       ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS  1
+#define pdMS_TO_TICKS(ms)   ((TickType_t) (ms))
+
+/* room for the shim's queue state, like the real StaticQueue_t it is only storage */
+typedef struct {
+    alignas(max_align_t) unsigned char opaque[256];
+} StaticQueue_t;
+
+#endif
@@ -0,0 +1,19 @@
+/**
+ * Host stand-in for the FreeRTOS queue API, a bounded copy queue on a mutex and two
+ * condition variables with the same send, receive and timeout semantics. Like the
+ * firmware only static creation is provided, it does not allocate
+ */
+
+#ifndef SHIM_FREERTOS_QUEUE_H
+#define SHIM_FREERTOS_QUEUE_H
+
+#include "FreeRTOS.h"
+
+typedef struct shim_queue* QueueHandle_t;
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t* storage, StaticQueue_t* control);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t timeout);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t timeout);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif
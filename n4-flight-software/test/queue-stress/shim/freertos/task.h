@@ -0,0 +1,46 @@
+/**
+ * Host stand-in for the FreeRTOS task API, each task is a thread. A task is eBlocked
+ * while it waits in a queue, a delay or a notification and eRunning otherwise. A task
+ * suspended by another one stops at its next call into the shim, one suspended while
+ * blocked does not take the item or notification it waits for until it is resumed
+ */
+
+#ifndef SHIM_FREERTOS_TASK_H
+#define SHIM_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef struct shim_task* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* parameters);
+
+typedef enum {
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid
+} eTaskState;
+
+typedef enum {
+    eNoAction = 0,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite
+} eNotifyAction;
+
+BaseType_t xTaskCreate(TaskFunction_t entry, const char* name, uint32_t stack_depth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created);
+TickType_t xTaskGetTickCount();
+void vTaskDelay(TickType_t ticks);
+void vTaskSuspend(TaskHandle_t task);
+void vTaskResume(TaskHandle_t task);
+eTaskState eTaskGetState(TaskHandle_t task);
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value, TickType_t timeout);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout);
+
+#endif
@@ -0,0 +1,292 @@
+/**
+ * Host implementation of the FreeRTOS queue, task and esp_timer stand-ins
+ */
+
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+using std::chrono::steady_clock;
+
+struct shim_queue {
+    std::mutex lock;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    unsigned char* storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+struct shim_task {
+    TaskFunction_t entry;
+    void* parameters;
+    const char* name;
+    std::atomic<int> state;
+    std::atomic<bool> suspended;
+    std::mutex lock;                    /* guards the notification */
+    std::condition_variable wake;       /* a notification or vTaskResume() */
+    uint32_t notify_value;
+    bool notify_pending;
+};
+
+/* the task running on this thread, NULL on the test's own threads */
+static thread_local shim_task* current = NULL;
+
+static steady_clock::time_point shim_start() {
+    static const steady_clock::time_point start = steady_clock::now();
+    return start;
+}
+
+static bool suspended_self() {
+    return current != NULL && current->suspended.load();
+}
+
+static void set_state(int state) {
+    if(current != NULL) {
+        current->state = state;
+    }
+}
+
+/* a task suspended by another one stops here until it is resumed */
+static void suspend_point() {
+    if(current == NULL) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(current->lock);
+    current->wake.wait(guard, [] { return !current->suspended.load(); });
+}
+
+/*
+ * wait on a condition for a FreeRTOS timeout, portMAX_DELAY waits forever. The task is
+ * eBlocked meanwhile, and once suspended it keeps waiting without taking what it waits for
+ */
+template <typename Predicate>
+static bool wait_for(std::condition_variable& cv, std::unique_lock<std::mutex>& guard, TickType_t timeout, Predicate ready) {
+    if(ready() && !suspended_self()) {
+        return true;
+    }
+
+    steady_clock::time_point deadline = steady_clock::now() + std::chrono::milliseconds(timeout * portTICK_PERIOD_MS);
+    set_state(eBlocked);
+
+    while(!ready() || suspended_self()) {
+        if(timeout != portMAX_DELAY && steady_clock::now() >= deadline && !suspended_self()) {
+            set_state(eRunning);
+            return false;
+        }
+        cv.wait_for(guard, std::chrono::milliseconds(1));
+    }
+
+    set_state(eRunning);
+    return true;
+}
+
+/*
+ * queues
+ */
+
+static_assert(sizeof(shim_queue) <= sizeof(StaticQueue_t), "StaticQueue_t too small for the shim queue");
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t* storage, StaticQueue_t* control) {
+    shim_queue* q = new (control) shim_queue;
+    q->storage = storage;
+    q->length = length;
+    q->item_size = item_size;
+    q->head = 0;
+    q->count = 0;
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t timeout) {
+    suspend_point();
+    std::unique_lock<std::mutex> guard(q->lock);
+
+    if(!wait_for(q->not_full, guard, timeout, [q] { return q->count < q->length; })) {
+        return pdFAIL;
+    }
+
+    UBaseType_t tail = (q->head + q->count) % q->length;
+    memcpy(&q->storage[tail * q->item_size], item, q->item_size);
+    q->count++;
+    q->not_empty.notify_one();
+
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t timeout) {
+    suspend_point();
+    std::unique_lock<std::mutex> guard(q->lock);
+
+    if(!wait_for(q->not_empty, guard, timeout, [q] { return q->count > 0; })) {
+        return pdFAIL;
+    }
+
+    memcpy(item, &q->storage[q->head * q->item_size], q->item_size);
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    q->not_full.notify_one();
+
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    std::lock_guard<std::mutex> guard(q->lock);
+    return q->count;
+}
+
+/*
+ * tasks, created once and never freed, like the firmware's
+ */
+
+BaseType_t xTaskCreate(TaskFunction_t entry, const char* name, uint32_t stack_depth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created) {
+    shim_task* t = new shim_task;
+    t->entry = entry;
+    t->parameters = parameters;
+    t->name = name;
+    t->state = eReady;
+    t->suspended = false;
+    t->notify_value = 0;
+    t->notify_pending = false;
+
+    if(created != NULL) {
+        *created = t;
+    }
+
+    std::thread([t] {
+        current = t;
+        t->state = eRunning;
+        t->entry(t->parameters);
+        t->state = eDeleted;
+    }).detach();
+
+    return pdPASS;
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t) std::chrono::duration_cast<std::chrono::milliseconds>(steady_clock::now() - shim_start()).count();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    suspend_point();
+    set_state(eBlocked);
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+    set_state(eRunning);
+    suspend_point();
+}
+
+void vTaskSuspend(TaskHandle_t task) {
+    shim_task* t = task != NULL ? task : current;
+    if(t == NULL) {
+        return;
+    }
+
+    t->suspended = true;
+    if(t == current) {
+        suspend_point();
+    }
+}
+
+void vTaskResume(TaskHandle_t t) {
+    {
+        std::lock_guard<std::mutex> guard(t->lock);
+        t->suspended = false;
+    }
+    t->wake.notify_all();
+}
+
+eTaskState eTaskGetState(TaskHandle_t t) {
+    if(t == current) {
+        return eRunning;
+    }
+    if(t->state == eDeleted) {
+        return eDeleted;
+    }
+    if(t->suspended) {
+        return eSuspended;
+    }
+    return (eTaskState) t->state.load();
+}
+
+BaseType_t xTaskNotify(TaskHandle_t t, uint32_t value, eNotifyAction action) {
+    suspend_point();
+    BaseType_t result = pdPASS;
+    {
+        std::lock_guard<std::mutex> guard(t->lock);
+        switch(action) {
+            case eSetBits:
+                t->notify_value |= value;
+                break;
+            case eIncrement:
+                t->notify_value++;
+                break;
+            case eSetValueWithOverwrite:
+                t->notify_value = value;
+                break;
+            case eSetValueWithoutOverwrite:
+                if(t->notify_pending) {
+                    result = pdFAIL;
+                } else {
+                    t->notify_value = value;
+                }
+                break;
+            default:
+                break;
+        }
+        t->notify_pending = true;
+    }
+    t->wake.notify_all();
+    return result;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t t) {
+    return xTaskNotify(t, 0, eIncrement);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value, TickType_t timeout) {
+    suspend_point();
+    std::unique_lock<std::mutex> guard(current->lock);
+
+    if(!current->notify_pending) {
+        current->notify_value &= ~clear_on_entry;
+    }
+
+    if(!wait_for(current->wake, guard, timeout, [] { return current->notify_pending; })) {
+        return pdFALSE;
+    }
+
+    if(value != NULL) {
+        *value = current->notify_value;
+    }
+    current->notify_value &= ~clear_on_exit;
+    current->notify_pending = false;
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t timeout) {
+    suspend_point();
+    std::unique_lock<std::mutex> guard(current->lock);
+
+    if(!wait_for(current->wake, guard, timeout, [] { return current->notify_value != 0; })) {
+        return 0;
+    }
+
+    uint32_t value = current->notify_value;
+    current->notify_value = clear ? 0 : value - 1;
+    current->notify_pending = false;
+    return value;
+}
+
+int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(steady_clock::now() - shim_start()).count();
+}
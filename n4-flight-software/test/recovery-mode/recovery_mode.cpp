@@ -0,0 +1,398 @@
+/**
+ * Host test of the way into recovery mode: landing detection in src/landing_detector.cpp fed
+ * by the barometer Kalman filter as checkFlightState feeds it, then the recovery_shutdown
+ * sequence of enterRecoveryMode() run by src/task_shutdown.cpp on stand-ins of the flight
+ * tasks, each a thread of the FreeRTOS shim in test/queue-stress. Runs:
+ * - descents under the main chute to landing sites below, level with and above the pad,
+ *   and a drift just under the velocity threshold that must not count as a landing
+ * - the shutdown with a sample timer, the two sensor tasks, the fusion stage, a logger
+ *   whose flash writes are slower than the sample rate, the terminal and the state check
+ * - the same shutdown with a sensor task stuck on the bus that never stops itself
+ *
+ * build and run from this directory:
+ *     g++ -std=c++11 -pthread -I../queue-stress/shim -I../common -I../../src recovery_mode.cpp ../queue-stress/shim/freertos_shim.cpp \
+ *         ../../src/queue_monitor.cpp ../../src/task_shutdown.cpp ../../src/landing_detector.cpp \
+ *         ../../src/vertical_kalman.cpp -o recovery_mode && ./recovery_mode
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "queue_monitor.h"
+#include "task_shutdown.h"
+#include "landing_detector.h"
+#include "vertical_kalman.h"
+#include "check.h"
+
+#define VELOCITY_THRESHOLD  1.0f        /* LANDING_VELOCITY_THRESHOLD */
+#define ALTITUDE_BAND       2.0f        /* LANDING_ALTITUDE_BAND */
+#define STABLE_MS           5000        /* LANDING_STABLE_TIME */
+#define ALTITUDE_SIGMA      1.0f        /* KALMAN_ALTITUDE_SIGMA */
+#define ACCEL_SIGMA         20.0f       /* KALMAN_ACCEL_SIGMA */
+#define INNOVATION_GATE     5.0f        /* KALMAN_INNOVATION_GATE */
+#define SHUTDOWN_TIMEOUT    1000        /* RECOVERY_SHUTDOWN_TIMEOUT */
+
+#define BARO_PERIOD         50
+#define BARO_NOISE          0.5f        /* m */
+#define BARO_SPIKES         0.01f       /* share of samples that are outliers */
+#define MAIN_RATE           5.0f        /* m/s under the main chute */
+#define DRIFT_RATE          0.9f        /* m/s, still by the velocity threshold, not by the altitude band */
+#define MAIN_HEIGHT         300.0f      /* m above the landing site the replay starts at */
+#define ON_GROUND_MS        20000
+#define SETTLE_MS           2500        /* filters settling after touchdown, on top of STABLE_MS */
+#define SEEDS               50
+
+#define QUEUE_LENGTH        32
+#define ACCEL_TICK          1           /* ms between sample timer ticks */
+#define ALTIMETER_TICKS     5           /* timer ticks per altimeter reading */
+#define FLASH_WRITE_US      2000        /* one log record, slower than the samples arrive */
+#define FLIGHT_MS           300         /* time the tasks run before the shutdown */
+#define SHUTDOWN_BOUND      500         /* ms the whole sequence may take with every task well behaved */
+
+static uint32_t rng_state;
+
+static float uniform() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (rng_state & 0xFFFFFF) / 16777216.0f;
+}
+
+/* roughly normal, unit standard deviation */
+static float noise() {
+    return (uniform() + uniform() + uniform() - 1.5f) * 2.0f;
+}
+
+/*
+ * landing detection
+ */
+
+typedef struct {
+    uint8_t landed;
+    uint32_t landed_at;         /* ms from the start of the replay */
+} landing_result_t;
+
+/* replay a descent at rate m/s from MAIN_HEIGHT above a site at site m AGL, on the ground for ON_GROUND_MS */
+static landing_result_t replay_descent(float site, float rate, uint32_t seed) {
+    landing_result_t r = {};
+    landing_detector_t d;
+    vertical_kalman_t kf;
+
+    rng_state = seed;
+    landing_init(&d, VELOCITY_THRESHOLD, ALTITUDE_BAND, STABLE_MS);
+    vkf_init(&kf, ALTITUDE_SIGMA, ACCEL_SIGMA, INNOVATION_GATE);
+    landing_arm(&d);
+
+    uint32_t touchdown = (uint32_t) (MAIN_HEIGHT / rate * 1000);
+
+    for(uint32_t t = 0; t < touchdown + ON_GROUND_MS; t += BARO_PERIOD) {
+        float agl = t < touchdown ? site + MAIN_HEIGHT - rate * t * 0.001f : site;
+        agl += BARO_NOISE * noise();
+        if(uniform() < BARO_SPIKES) {
+            agl += (uniform() < 0.5f ? -1 : 1) * (5 + 10 * uniform());
+        }
+
+        vkf_update(&kf, agl, 0, BARO_PERIOD * 0.001f);
+        if(landing_update(&d, 600000 + t, agl, kf.velocity)) {
+            r.landed = 1;
+            r.landed_at = t;
+        }
+    }
+
+    return r;
+}
+
+/*
+ * the flight tasks, as in main.cpp, around the queues between them
+ */
+
+typedef struct {
+    uint32_t time;
+    float value;
+} sample_t;
+
+typedef struct {
+    TaskHandle_t accel;
+    TaskHandle_t altimeter;
+    TaskHandle_t fusion;
+    TaskHandle_t logger;
+    TaskHandle_t terminal;
+    TaskHandle_t state_check;
+    TaskHandle_t callback;
+
+    monitored_queue_t fusion_queue;
+    monitored_queue_t log_queue;
+    monitored_queue_t terminal_queue;
+    monitored_queue_t state_queue;
+    sample_t storage[4][QUEUE_LENGTH];
+
+    std::atomic<bool> recovery_mode;
+    std::atomic<bool> timer_running;
+    std::atomic<bool> accel_hung;       /* stuck on the bus, never reaches the recovery check */
+    std::atomic<uint32_t> written;
+    std::atomic<bool> done;
+
+    uint32_t backlog;                   /* log records queued when the shutdown started */
+    uint8_t timeouts;
+    uint32_t shutdown_ms;
+    shutdown_result_t results[8];
+} flight_t;
+
+static flight_t* running;
+
+static void busy_us(uint32_t us) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+    while(std::chrono::steady_clock::now() < end) {
+    }
+}
+
+static void sensorTask(flight_t* f, bool accel) {
+    for(;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // stop here, between two readings, once the flight is over
+        if(f->recovery_mode) {
+            vTaskSuspend(NULL);
+        }
+
+        while(accel && f->accel_hung) {
+            vTaskDelay(1);
+        }
+
+        sample_t s = { xTaskGetTickCount(), accel ? 9.81f : 12.0f };
+        busy_us(100);
+        queue_send(&f->fusion_queue, &s, 0);
+    }
+}
+
+static void readAccelerationTask(void* parameters) {
+    sensorTask((flight_t*) parameters, true);
+}
+
+static void readAltimeterTask(void* parameters) {
+    sensorTask((flight_t*) parameters, false);
+}
+
+static void sensorFusionTask(void* parameters) {
+    flight_t* f = (flight_t*) parameters;
+    sample_t s;
+
+    for(;;) {
+        queue_receive(&f->fusion_queue, &s, portMAX_DELAY);
+        busy_us(50);
+        queue_send(&f->log_queue, &s, 0);
+        queue_send(&f->terminal_queue, &s, 0);
+        queue_send(&f->state_queue, &s, 0);
+    }
+}
+
+static void logToMemoryTask(void* parameters) {
+    flight_t* f = (flight_t*) parameters;
+    sample_t s;
+
+    for(;;) {
+        queue_receive(&f->log_queue, &s, portMAX_DELAY);
+        busy_us(FLASH_WRITE_US);
+        f->written++;
+    }
+}
+
+static void debugToTerminalTask(void* parameters) {
+    flight_t* f = (flight_t*) parameters;
+    sample_t s;
+
+    for(;;) {
+        queue_receive(&f->terminal_queue, &s, portMAX_DELAY);
+        busy_us(20);
+    }
+}
+
+static void checkFlightStateTask(void* parameters) {
+    flight_t* f = (flight_t*) parameters;
+    sample_t s;
+
+    for(;;) {
+        queue_receive(&f->state_queue, &s, portMAX_DELAY);
+        busy_us(20);
+    }
+}
+
+static void stopSampleTimer() {
+    running->timer_running = false;
+}
+
+/* enterRecoveryMode(), woken by the POST_FLIGHT_GROUND notification */
+static void flightStateCallback(void* parameters) {
+    flight_t* f = (flight_t*) parameters;
+
+    const shutdown_step_t steps[] = {
+        { SHUTDOWN_AWAIT_SUSPEND,   "readAcceleration",     &f->accel,          NULL,           NULL },
+        { SHUTDOWN_AWAIT_SUSPEND,   "readAltimeter",        &f->altimeter,      NULL,           NULL },
+        { SHUTDOWN_CALL,            "sample timer",         NULL,               NULL,           stopSampleTimer },
+        { SHUTDOWN_SUSPEND,         "sensorFusion",         &f->fusion,         NULL,           NULL },
+        { SHUTDOWN_DRAIN,           "log_to_mem_queue",     NULL,               &f->log_queue,  NULL },
+        { SHUTDOWN_SUSPEND,         "logToMemory",          &f->logger,         NULL,           NULL },
+        { SHUTDOWN_SUSPEND,         "debugToTerminal",      &f->terminal,       NULL,           NULL },
+        { SHUTDOWN_SUSPEND,         "checkFlightState",     &f->state_check,    NULL,           NULL }
+    };
+
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    f->recovery_mode = true;
+    f->backlog = queue_waiting(&f->log_queue);
+
+    TickType_t start = xTaskGetTickCount();
+    f->timeouts = shutdown_run(steps, 8, SHUTDOWN_TIMEOUT, f->results);
+    f->shutdown_ms = xTaskGetTickCount() - start;
+    f->done = true;
+
+    vTaskSuspend(NULL);
+}
+
+/* the hardware timer, wakes the IMU every tick and the altimeter every ALTIMETER_TICKS */
+static void sample_timer(flight_t* f) {
+    for(uint32_t tick = 0; f->timer_running; tick++) {
+        xTaskNotifyGive(f->accel);
+        if(tick % ALTIMETER_TICKS == 0) {
+            xTaskNotifyGive(f->altimeter);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(ACCEL_TICK));
+    }
+}
+
+static void fly(flight_t* f, bool hung) {
+    running = f;
+    f->recovery_mode = false;
+    f->timer_running = true;
+    f->accel_hung = false;
+    f->written = 0;
+    f->done = false;
+
+    queue_create(&f->fusion_queue, "fusion", QUEUE_LENGTH, sizeof(sample_t), (uint8_t*) f->storage[0]);
+    queue_create(&f->log_queue, "log", QUEUE_LENGTH, sizeof(sample_t), (uint8_t*) f->storage[1]);
+    queue_create(&f->terminal_queue, "terminal", QUEUE_LENGTH, sizeof(sample_t), (uint8_t*) f->storage[2]);
+    queue_create(&f->state_queue, "state", QUEUE_LENGTH, sizeof(sample_t), (uint8_t*) f->storage[3]);
+
+    xTaskCreate(readAccelerationTask, "readAcceleration", 0, f, 2, &f->accel);
+    xTaskCreate(readAltimeterTask, "readAltimeter", 0, f, 2, &f->altimeter);
+    xTaskCreate(sensorFusionTask, "sensorFusion", 0, f, 2, &f->fusion);
+    xTaskCreate(logToMemoryTask, "logToMemory", 0, f, 1, &f->logger);
+    xTaskCreate(debugToTerminalTask, "debugToTerminal", 0, f, 1, &f->terminal);
+    xTaskCreate(checkFlightStateTask, "checkFlightState", 0, f, 2, &f->state_check);
+    xTaskCreate(flightStateCallback, "flightStateCallback", 0, f, 3, &f->callback);
+
+    std::thread timer(sample_timer, f);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(FLIGHT_MS));
+    f->accel_hung = hung;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // landed, the state machine notifies flightStateCallback
+    xTaskNotifyGive(f->callback);
+
+    for(int i = 0; i < 5 * SHUTDOWN_TIMEOUT && !f->done; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    timer.join();
+}
+
+static bool all_suspended(const flight_t* f, bool with_accel) {
+    return (!with_accel || eTaskGetState(f->accel) == eSuspended) && eTaskGetState(f->altimeter) == eSuspended &&
+           eTaskGetState(f->fusion) == eSuspended && eTaskGetState(f->logger) == eSuspended &&
+           eTaskGetState(f->terminal) == eSuspended && eTaskGetState(f->state_check) == eSuspended;
+}
+
+static bool outcomes(const flight_t* f, uint8_t first, uint8_t last, uint8_t outcome) {
+    for(uint8_t i = first; i <= last; i++) {
+        if(f->results[i].outcome != outcome) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print_steps(const flight_t* f) {
+    static const char* const names[8] = { "readAcceleration", "readAltimeter", "sample timer", "sensorFusion",
+                                          "log_to_mem_queue", "logToMemory", "debugToTerminal", "checkFlightState" };
+    for(uint8_t i = 0; i < 8; i++) {
+        printf("        %-20s %-10s %4lu ms\n", names[i], shutdown_outcome_name(f->results[i].outcome),
+               (unsigned long) f->results[i].elapsed_ms);
+    }
+}
+
+int main() {
+    printf("landing detection, %d seeds each\n", SEEDS);
+
+    static const float sites[] = { -30.0f, 0.0f, 45.0f };
+    bool descent_quiet = true;
+    bool detected = true;
+    uint32_t earliest = 0xFFFFFFFF;
+    uint32_t latest = 0;
+
+    for(uint8_t s = 0; s < 3; s++) {
+        uint32_t touchdown = (uint32_t) (MAIN_HEIGHT / MAIN_RATE * 1000);
+        for(uint32_t seed = 1; seed <= SEEDS; seed++) {
+            landing_result_t r = replay_descent(sites[s], MAIN_RATE, seed * 7919);
+            descent_quiet &= !r.landed || r.landed_at >= touchdown;
+            detected &= r.landed && r.landed_at >= touchdown + STABLE_MS && r.landed_at <= touchdown + STABLE_MS + SETTLE_MS;
+            if(r.landed) {
+                uint32_t after = r.landed_at - touchdown;
+                earliest = after < earliest ? after : earliest;
+                latest = after > latest ? after : latest;
+            }
+        }
+    }
+
+    bool drift_quiet = true;
+    for(uint32_t seed = 1; seed <= SEEDS; seed++) {
+        landing_result_t r = replay_descent(0, DRIFT_RATE, seed * 7919);
+        drift_quiet &= !r.landed || r.landed_at >= (uint32_t) (MAIN_HEIGHT / DRIFT_RATE * 1000);
+    }
+
+    printf("    landing declared %.2f s to %.2f s after touchdown\n", earliest * 0.001f, latest * 0.001f);
+    check(descent_quiet, "no landing while descending under the main chute");
+    check(detected, "landing below, level with and above the pad, within SETTLE_MS");
+    check(drift_quiet, "no landing drifting down just under the velocity threshold");
+
+    printf("shutdown, every task well behaved\n");
+
+    static flight_t nominal;
+    fly(&nominal, false);
+    print_steps(&nominal);
+
+    uint32_t written = nominal.written;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    check(nominal.done, "the shutdown finished");
+    check(nominal.timeouts == 0 && outcomes(&nominal, 0, 7, SHUTDOWN_DONE), "every step done, none timed out");
+    check(all_suspended(&nominal, true), "every flight task suspended");
+    check(nominal.backlog > 0, "the log queue was backlogged when the shutdown started");
+    check(queue_waiting(&nominal.log_queue) == 0, "the log queue drained");
+    check(nominal.written == nominal.log_queue.enqueued, "every record accepted by the log queue written");
+    // a task suspended while running stops at its next call into the shim, a write cut short
+    // would show up as a record written after the shutdown
+    check(nominal.written == written, "the logger suspended between writes, nothing written after");
+    check(nominal.shutdown_ms < SHUTDOWN_BOUND, "the shutdown took less than SHUTDOWN_BOUND");
+
+    printf("shutdown, readAcceleration stuck on the bus\n");
+
+    static flight_t hung;
+    fly(&hung, true);
+    print_steps(&hung);
+
+    check(hung.done, "the shutdown finished");
+    check(hung.timeouts == 1 && hung.results[0].outcome == SHUTDOWN_TIMED_OUT, "only the stuck task timed out");
+    check(hung.results[0].elapsed_ms >= SHUTDOWN_TIMEOUT && hung.results[0].elapsed_ms < SHUTDOWN_TIMEOUT + 50,
+          "it timed out after RECOVERY_SHUTDOWN_TIMEOUT");
+    check(outcomes(&hung, 1, 7, SHUTDOWN_DONE), "the steps after it done");
+    check(all_suspended(&hung, false), "every other flight task suspended");
+    check(queue_waiting(&hung.log_queue) == 0 && hung.written == hung.log_queue.enqueued, "the log queue drained and written");
+
+    return check_summary();
+}
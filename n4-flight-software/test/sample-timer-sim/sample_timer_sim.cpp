@@ -0,0 +1,149 @@
+/**
+ * Host simulation of the sample timer path in src/main.cpp
+ * Runs the accelerometer task for a simulated flight twice: released by vTaskDelayUntil
+ * and stamped with micros() after the IMU reads, as before, and released by the sample
+ * timer ISR that stamps the tick, as now. Both stamp streams go through src/sample_clock.cpp
+ * and the interval jitter of the two is printed side by side. A stalled task then checks
+ * that missed ticks are counted
+ *
+ * The ISR entry latency, task wake delay and IMU read time are drawn from fixed ranges
+ * with a seeded generator, so every run gives the same numbers
+ *
+ * build and run from this directory:
+ *     g++ -I../common -I../../src sample_timer_sim.cpp ../../src/sample_clock.cpp -o sample_timer_sim && ./sample_timer_sim
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sample_clock.h"
+#include "check.h"
+
+#define PERIOD_US           10000   /* readAcceleration period */
+#define SAMPLES             6000    /* one minute of samples */
+
+#define ISR_LATENCY_MIN     1       /* timer interrupt entry */
+#define ISR_LATENCY_MAX     3
+#define ISR_CRITICAL_MAX    8       /* entry while another task holds interrupts off */
+#define ISR_CRITICAL_CHANCE 50      /* 1 in this many ticks */
+#define WAKE_DELAY_MIN      20      /* ready to running, preemption by higher priority work */
+#define WAKE_DELAY_MAX      600
+#define IMU_READ_MIN        350     /* four register reads and pitch and roll over I2C */
+#define IMU_READ_MAX        900
+
+#define MAX_TIMER_JITTER_US 10
+
+static uint32_t rng_state = 0x2545F491;
+
+static uint32_t uniform(uint32_t low, uint32_t high) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return low + rng_state % (high - low + 1);
+}
+
+static uint32_t isr_latency() {
+    if(uniform(1, ISR_CRITICAL_CHANCE) == 1) {
+        return uniform(ISR_LATENCY_MAX, ISR_CRITICAL_MAX);
+    }
+    return uniform(ISR_LATENCY_MIN, ISR_LATENCY_MAX);
+}
+
+static void print_stats(const char* name, const sample_clock_t* c) {
+    printf("    %-18s mean %5lu min %6ld max %6ld us, %lu missed, latency max %lu us\n", name,
+           (unsigned long) sample_clock_mean_jitter(c), (long) c->min_jitter_us, (long) c->max_jitter_us,
+           (unsigned long) c->missed, (unsigned long) c->max_latency_us);
+}
+
+/* released on the tick, the sample time is micros() after the reads */
+static void run_tick_path(sample_clock_t* c) {
+    uint32_t stamp;
+
+    for(uint32_t k = 1; k <= SAMPLES; k++) {
+        uint32_t release = k * PERIOD_US + isr_latency();
+        uint32_t sampled = release + uniform(WAKE_DELAY_MIN, WAKE_DELAY_MAX) + uniform(IMU_READ_MIN, IMU_READ_MAX);
+
+        sample_clock_tick(c, sampled);
+        sample_clock_take(c, sampled, &stamp);
+    }
+}
+
+/* released by the timer ISR, the sample time is the tick stamp */
+static uint32_t run_timer_path(sample_clock_t* c) {
+    uint32_t stamp;
+    uint32_t max_wake = 0;
+    uint32_t bad_stamps = 0;
+
+    for(uint32_t k = 1; k <= SAMPLES; k++) {
+        uint32_t tick = k * PERIOD_US + isr_latency();
+        uint32_t wake = uniform(WAKE_DELAY_MIN, WAKE_DELAY_MAX);
+
+        sample_clock_tick(c, tick);
+        sample_clock_take(c, tick + wake, &stamp);
+
+        if(stamp != tick) {
+            bad_stamps++;
+        }
+        if(wake > max_wake) {
+            max_wake = wake;
+        }
+    }
+
+    return bad_stamps == 0 ? max_wake : 0;
+}
+
+int main() {
+    sample_clock_t tick_clock;
+    sample_clock_t timer_clock;
+    uint32_t stamp;
+
+    printf("accelerometer at %d us, %d samples\n", PERIOD_US, SAMPLES);
+
+    sample_clock_init(&tick_clock, PERIOD_US);
+    run_tick_path(&tick_clock);
+
+    sample_clock_init(&timer_clock, PERIOD_US);
+    uint32_t max_wake = run_timer_path(&timer_clock);
+
+    print_stats("vTaskDelayUntil", &tick_clock);
+    print_stats("sample timer", &timer_clock);
+
+    check(sample_clock_take(&timer_clock, SAMPLES * PERIOD_US + PERIOD_US, &stamp) == 0, "no tick, nothing taken");
+    check(max_wake > 0, "every take returns the stamp of its tick");
+    check(timer_clock.intervals == SAMPLES - 1, "every interval measured");
+    check(timer_clock.missed == 0, "no missed ticks");
+    check(timer_clock.max_jitter_us <= MAX_TIMER_JITTER_US && timer_clock.min_jitter_us >= -MAX_TIMER_JITTER_US,
+          "timer jitter within 10 us");
+    check(timer_clock.max_latency_us == max_wake, "latency is the longest wake delay");
+    check(tick_clock.max_jitter_us - tick_clock.min_jitter_us > 10 * (timer_clock.max_jitter_us - timer_clock.min_jitter_us),
+          "timer jitter ten times below tick jitter");
+
+    printf("stalled task\n");
+
+    sample_clock_t stall;
+    uint32_t now = 0;
+    uint32_t tick = 0;
+
+    sample_clock_init(&stall, PERIOD_US);
+    for(uint32_t k = 1; k <= 10; k++) {
+        now = k * PERIOD_US;
+        sample_clock_tick(&stall, now);
+        sample_clock_take(&stall, now + 100, &stamp);
+    }
+
+    // blocked for more ticks than stamps are kept
+    for(uint32_t k = 11; k <= 11 + SAMPLE_CLOCK_SLOTS; k++) {
+        tick = k * PERIOD_US + 2;
+        sample_clock_tick(&stall, tick);
+    }
+    check(sample_clock_take(&stall, tick + 300, &stamp) == 1, "latest tick taken after the stall");
+    print_stats("stalled", &stall);
+
+    check(stamp == tick, "stamp of the latest tick");
+    check(stall.missed == SAMPLE_CLOCK_SLOTS, "ticks during the stall counted as missed");
+    check(stall.max_jitter_us == 2, "stall interval measured over the missed ticks");
+    check(stall.max_latency_us == 300, "latency from the latest tick");
+
+    return check_summary();
+}
@@ -0,0 +1,200 @@
+/**
+ * Host check of the fusion stage in src/sensor_fusion.cpp
+ * Synthetic IMU (100 Hz), barometer (20 Hz, delivered after its 30 ms conversion) and GPS
+ * (5 Hz) streams with timing jitter are pushed as the sensor tasks do and the records are
+ * taken every 10 ms as the sensorFusion task does. The signals are known functions of time,
+ * so the interpolated fields are checked against their true value at the record time.
+ * The barometer then drops out, a packet is pushed twice and the fusion task stalls
+ *
+ * build and run from this directory:
+ *     g++ -Ishim -I../common -I../../src fusion_sim.cpp ../../src/sensor_fusion.cpp -o fusion_sim && ./fusion_sim
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "sensor_fusion.h"
+#include "check.h"
+
+#define PERIOD_US           10000   /* sensorFusion period and IMU sample timer */
+#define BARO_PERIOD_US      50000
+#define BARO_CONVERSION_US  30000   /* the sample reaches the queue this long after its tick */
+#define GPS_PERIOD_US       200000
+#define DELAY_US            100000  /* FUSION_OUTPUT_DELAY */
+#define RUN_US              20000000
+#define BARO_DROPOUT_START  12000000
+#define BARO_DROPOUT_END    13000000
+#define STALL_START         16000000
+#define STALL_END           16300000
+
+static uint32_t rng_state = 0x9E3779B9;
+
+static int32_t jitter(int32_t range) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (int32_t) (rng_state % (2 * range + 1)) - range;
+}
+
+/* true signals, altitude is a climb that slows down, acceleration a slow oscillation */
+static double true_agl(uint32_t t) {
+    double s = t * 1e-6;
+    return 150.0 * s - 2.0 * s * s;
+}
+
+static float true_ax(uint32_t t) {
+    return (float) (10.0 * sin(t * 1e-6));
+}
+
+struct pending_t {
+    uint32_t arrival;
+    telemetry_type_t packet;
+};
+
+int main() {
+    sensor_fusion_t f;
+    telemetry_type_t acc = {};
+    telemetry_type_t baro = {};
+    telemetry_type_t gps = {};
+    telemetry_type_t record;
+    pending_t baro_pending = {};
+    uint8_t baro_waiting = 0;
+
+    acc.data_flags = acc.fresh_flags = ACCEL_DATA_FLAG;
+    baro.data_flags = baro.fresh_flags = ALTIMETER_DATA_FLAG;
+    gps.data_flags = gps.fresh_flags = GPS_DATA_FLAG;
+
+    fusion_init(&f, PERIOD_US, DELAY_US);
+    fusion_set_stream(&f, FUSION_ACCEL, FUSION_INTERPOLATE, 30000);
+    fusion_set_stream(&f, FUSION_ALTIMETER, FUSION_INTERPOLATE, 150000);
+    fusion_set_stream(&f, FUSION_GPS, FUSION_HOLD, 2000000);
+
+    uint32_t records = 0;
+    uint32_t bad_spacing = 0;
+    uint32_t last_time = 0;
+    uint32_t complete = 0;
+    uint32_t fresh[NUM_FUSION_STREAMS] = {};
+    double max_agl_error = 0;
+    double max_ax_error = 0;
+    uint32_t baro_missing = 0;
+    uint32_t baro_held_in_dropout = 0;
+    uint32_t baro_fresh_in_dropout = 0;
+    uint32_t gps_held_not_fresh = 0;
+
+    // 1 us steps are too slow, events happen on a 1 ms grid plus their jitter
+    for(uint32_t now = 1000; now <= RUN_US; now += 1000) {
+        // IMU, stamped by the sample timer at each tick
+        if(now % PERIOD_US == 0) {
+            acc.acquired_us = now + jitter(5);
+            acc.trace_id++;
+            acc.acc_data.ax = true_ax(acc.acquired_us);
+            fusion_push(&f, &acc);
+        }
+
+        // barometer, stamped at its tick and delivered after the conversion
+        if(now % BARO_PERIOD_US == 0 && !(now >= BARO_DROPOUT_START && now < BARO_DROPOUT_END)) {
+            baro.acquired_us = now + jitter(5);
+            baro.trace_id++;
+            baro.alt_data.AGL = true_agl(baro.acquired_us);
+            baro_pending.arrival = now + BARO_CONVERSION_US + jitter(2000);
+            baro_pending.packet = baro;
+            baro_waiting = 1;
+        }
+        if(baro_waiting && now >= baro_pending.arrival) {
+            fusion_push(&f, &baro_pending.packet);
+            baro_waiting = 0;
+        }
+
+        // GPS, stamped when the sentence is decoded
+        if(now % GPS_PERIOD_US == 0) {
+            gps.acquired_us = now + jitter(3000);
+            gps.trace_id++;
+            gps.gps_data.latitude = -1.28 + now * 1e-9;
+            fusion_push(&f, &gps);
+        }
+
+        // the fusion task runs every period, except while stalled
+        if(now % PERIOD_US != 0 || (now >= STALL_START && now < STALL_END)) {
+            continue;
+        }
+
+        while(fusion_output(&f, now + jitter(200), &record)) {
+            uint32_t t = record.acquired_us;
+
+            if(records > 0 && t - last_time != PERIOD_US && !(t > STALL_START && t < STALL_END)) {
+                bad_spacing++;
+            }
+            last_time = t;
+            records++;
+
+            if(record.data_flags == (ACCEL_DATA_FLAG | ALTIMETER_DATA_FLAG | GPS_DATA_FLAG)) {
+                complete++;
+            }
+            for(uint8_t i = 0; i < NUM_FUSION_STREAMS; i++) {
+                if(record.fresh_flags & (1 << i)) {
+                    fresh[i]++;
+                }
+            }
+
+            if((record.data_flags & GPS_DATA_FLAG) && !(record.fresh_flags & GPS_DATA_FLAG)) {
+                gps_held_not_fresh++;
+            }
+
+            if(record.data_flags & ACCEL_DATA_FLAG) {
+                double e = fabs(record.acc_data.ax - true_ax(t));
+                max_ax_error = e > max_ax_error ? e : max_ax_error;
+            }
+
+            // the last barometer sample is 150 ms old 100 ms into the dropout
+            if(t > 1000000 && !(record.data_flags & ALTIMETER_DATA_FLAG)) {
+                baro_missing++;
+            }
+            if(t > BARO_DROPOUT_START + 101000 && t < BARO_DROPOUT_END) {
+                if(record.data_flags & ALTIMETER_DATA_FLAG) {
+                    baro_held_in_dropout++;
+                }
+            }
+            if(t > BARO_DROPOUT_START - PERIOD_US / 2 && t < BARO_DROPOUT_END - PERIOD_US / 2) {
+                if(record.fresh_flags & ALTIMETER_DATA_FLAG) {
+                    baro_fresh_in_dropout++;
+                }
+            }
+
+            // held, not interpolated, from the last sample before the dropout to the first after it
+            if(t > 1000000 && (record.data_flags & ALTIMETER_DATA_FLAG) && !(t >= BARO_DROPOUT_START - BARO_PERIOD_US && t < BARO_DROPOUT_END)) {
+                double e = fabs(record.alt_data.AGL - true_agl(t));
+                max_agl_error = e > max_agl_error ? e : max_agl_error;
+            }
+        }
+    }
+
+    printf("%lu records, %lu complete, %lu skipped\n", (unsigned long) records, (unsigned long) complete, (unsigned long) f.skipped);
+    printf("fresh in records: accel %lu altimeter %lu gps %lu\n", (unsigned long) fresh[FUSION_ACCEL],
+           (unsigned long) fresh[FUSION_ALTIMETER], (unsigned long) fresh[FUSION_GPS]);
+    printf("largest error: AGL %.4f m, ax %.4f m/s^2\n", max_agl_error, max_ax_error);
+
+    uint32_t expected = (RUN_US - DELAY_US - PERIOD_US) / PERIOD_US + 1;
+    check(records + f.skipped >= expected - 1 && records + f.skipped <= expected, "one record per period");
+    check(bad_spacing == 0, "records exactly one period apart");
+    check(f.skipped == (STALL_END - STALL_START) / PERIOD_US, "records of the stall skipped");
+    check(max_agl_error < 0.05, "barometer interpolated to the record time");
+    check(max_ax_error < 0.01, "IMU interpolated to the record time");
+    check(fresh[FUSION_ACCEL] == records, "every record has a new IMU sample");
+    check(fresh[FUSION_ALTIMETER] > records / 5 - 30 && fresh[FUSION_ALTIMETER] < records / 5 + 5, "barometer fresh in one record in five");
+    check(fresh[FUSION_GPS] > records / 20 - 10 && fresh[FUSION_GPS] <= records / 20 + 5, "GPS fresh in one record in twenty");
+    check(gps_held_not_fresh > 0, "GPS held between fixes");
+    check(baro_missing > 0 && baro_held_in_dropout == 0, "barometer left out once stale");
+    check(baro_fresh_in_dropout == 0, "no fresh barometer in the dropout");
+    check(f.streams[FUSION_ALTIMETER].stale == baro_missing, "stale records counted");
+
+    // a packet pushed twice is rejected by its time, whoever sends it again
+    if(baro_waiting) {
+        fusion_push(&f, &baro_pending.packet);
+    }
+    uint32_t rejected = f.streams[FUSION_ALTIMETER].rejected;
+    fusion_push(&f, &baro_pending.packet);
+    check(f.streams[FUSION_ALTIMETER].rejected == rejected + 1, "repeated sample rejected");
+
+    return check_summary();
+}
@@ -0,0 +1,11 @@
+/**
+ * Host stand-in for Arduino.h, only the integer types data_types.h uses
+ */
+
+#ifndef SHIM_ARDUINO_H
+#define SHIM_ARDUINO_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * Host check of the stack sizing report in src/resource_monitor.cpp
+ * Feeds synthetic high water marks for the flight task table, prints the report the
+ * flight computer writes after landing and checks the recommendations
+ *
+ * build and run from this directory:
+ *     g++ -I../common -I../../src stack_report.cpp ../../src/resource_monitor.cpp ../../src/task_schedule.cpp -o stack_report && ./stack_report
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include "resource_monitor.h"
+#include "check.h"
+
+int main() {
+    resource_monitor_t m;
+    stack_report_t report;
+
+    /* lowest free stack per task in bytes, 0 for a task never sampled */
+    const uint32_t flight_min_free[NUM_FLIGHT_TASKS] = {
+        /* READ_ACCELERATION */     1400,
+        /* READ_ALTIMETER */        2200,
+        /* READ_GPS */              700,
+        /* CHECK_FLIGHT_STATE */    1100,
+        /* FLIGHT_STATE_CALLBACK */ 1300,
+        /* SENSOR_FUSION */         1500,
+        /* TRANSMIT_TELEMETRY */    600,
+        /* DEBUG_TO_TERMINAL */     0,
+        /* LOG_TO_MEMORY */         120,
+        /* RESOURCE_MONITOR */      1800,
+        /* HEALTH_MONITOR */        1900,
+        /* I2C_BUS */               1500
+    };
+
+    monitor_init(&m, flight_tasks);
+
+    // watermarks only go down, later samples with more free stack must not raise them
+    for(uint8_t i = 0; i < NUM_FLIGHT_TASKS; i++) {
+        if(flight_min_free[i] == 0) {
+            continue;
+        }
+        monitor_sample_stack(&m, i, flight_min_free[i] + 300);
+        monitor_sample_stack(&m, i, flight_min_free[i]);
+        monitor_sample_stack(&m, i, flight_min_free[i] + 100);
+    }
+
+    monitor_sample_heap(&m, 150000, 140000, 90000);
+    monitor_sample_heap(&m, 130000, 128000, 60000);
+    monitor_sample_heap(&m, 145000, 128000, 80000);
+
+    printf("%-20s %6s %6s %12s %7s\n", "task", "size", "peak", "recommended", "change");
+    for(uint8_t i = 0; i < NUM_FLIGHT_TASKS; i++) {
+        if(!monitor_stack_report(&m, i, &report)) {
+            printf("%-20s %6lu %6s\n", flight_tasks[i].name, (unsigned long) flight_tasks[i].stack_depth, "-");
+            continue;
+        }
+        printf("%-20s %6lu %6lu %12lu %+7ld%s\n", flight_tasks[i].name, (unsigned long) report.stack_bytes,
+               (unsigned long) report.used_bytes, (unsigned long) report.recommended_bytes, (long) report.change_bytes,
+               report.low ? "  LOW" : "");
+    }
+
+    uint32_t all = (1UL << NUM_FLIGHT_TASKS) - 1;
+    printf("total change %+ld bytes\n", (long) monitor_total_change(&m, all));
+    printf("heap free %lu min %lu largest block %lu min %lu\n\n", (unsigned long) m.free_heap, (unsigned long) m.min_free_heap,
+           (unsigned long) m.largest_free_block, (unsigned long) m.min_largest_free_block);
+
+    check(m.stacks[TASK_READ_ACCELERATION].min_free_bytes == 1400, "watermark keeps the lowest sample");
+    check(m.stacks[TASK_READ_ACCELERATION].samples == 3, "every sample counted");
+    check(!monitor_stack_report(&m, TASK_DEBUG_TO_TERMINAL, &report), "unsampled task has no report");
+
+    // 2048 - 1400 = 648 used, + 25% = 810, + 512 = 1322, rounded to 1536
+    monitor_stack_report(&m, TASK_READ_ACCELERATION, &report);
+    check(report.used_bytes == 648 && report.recommended_bytes == 1536 && report.change_bytes == -512, "accelerometer task shrinks to 1536");
+
+    // 1024 - 120 = 904 used, + 226 + 512 = 1642, rounded to 1792
+    monitor_stack_report(&m, TASK_LOG_TO_MEMORY, &report);
+    check(report.low && report.recommended_bytes == 1792 && report.change_bytes == 768, "nearly full logger stack grows and is flagged");
+
+    check(monitor_recommend_stack(4096, 4000) == STACK_MIN_BYTES, "recommendation never below STACK_MIN_BYTES");
+    check(monitor_recommend_stack(2048, 0) >= 2048 + 512, "overflowed stack recommended larger than allocated");
+    check(monitor_recommend_stack(3000, 1000) % STACK_ROUNDING == 0, "recommendations are multiples of STACK_ROUNDING");
+
+    int32_t expected = 0;
+    for(uint8_t i = 0; i < NUM_FLIGHT_TASKS; i++) {
+        if(monitor_stack_report(&m, i, &report)) {
+            expected += report.change_bytes;
+        }
+    }
+    check(monitor_total_change(&m, all) == expected, "total is the sum of the sampled tasks");
+    check(monitor_total_change(&m, 1UL << TASK_READ_ACCELERATION) == -512, "total only covers tasks in the mask");
+
+    check(m.free_heap == 145000 && m.largest_free_block == 80000, "heap keeps the last sample");
+    check(m.min_free_heap == 128000 && m.min_largest_free_block == 60000, "heap keeps the minimums");
+
+    return check_summary();
+}
@@ -0,0 +1,255 @@
+/**
+ * Host test of the flight state notification path: the state machine in src/flight_fsm.cpp
+ * runs in a checkFlightState stand-in whose entry hook sets the state's bit on the
+ * flightStateCallback task with xTaskNotify(eSetBits), as flightStateEntry() does, and the
+ * callback stand-in handles every bit it wakes up with, in flight order. Both are tasks of
+ * the FreeRTOS shim in test/queue-stress. Runs:
+ * - flights with a rejected launch, the events spaced out, every state entered is handled
+ *   once and in order, transient states included
+ * - the same flights with every event dispatched back to back
+ * - the transition to action latency, and for comparison the latency and missed states of
+ *   the former loop polling current_state every CONSUME_TASK_DELAY
+ *
+ * build and run from this directory:
+ *     g++ -std=c++11 -O2 -pthread -I../queue-stress/shim -I../common -I../../src state_notify.cpp ../queue-stress/shim/freertos_shim.cpp \
+ *         ../../src/flight_fsm.cpp -o state_notify && ./state_notify
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "flight_fsm.h"
+#include "check.h"
+
+#define APOGEE_LOCKOUT      3000        /* APOGEE_LOCKOUT_TIME */
+#define COAST_LOCKOUT       1000        /* COAST_APOGEE_LOCKOUT_TIME */
+#define LANDING_LOCKOUT     5000        /* LANDING_LOCKOUT_TIME */
+#define POLL_PERIOD         10          /* CONSUME_TASK_DELAY, the former polling period */
+
+#define FLIGHTS             50
+#define EVENT_SPACING       3           /* ms between the events of a spaced out flight */
+#define LATENCY_BOUND_US    1000        /* p99 of the transition to action latency */
+
+#define S(state)            ARMED_FLIGHT_STATE::state
+
+/* PREFLIGHT_BIT ... POST_FLIGHT_BIT */
+static const uint8_t state_notify_bit[NUM_FLIGHT_STATES] = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+
+/* a launch the barometer rejects, then a flight, at the times the detectors would post them */
+typedef struct {
+    uint8_t event;
+    uint32_t time;
+} flight_event_t;
+
+static const flight_event_t flight[] = {
+    { EVENT_LAUNCH,             1000 },
+    { EVENT_LAUNCH_REJECTED,    1500 },
+    { EVENT_LAUNCH,             60000 },
+    { EVENT_BURNOUT,            62000 },
+    { EVENT_APOGEE,             80000 },    /* APOGEE, DROGUE_DEPLOY, DROGUE_DESCENT */
+    { EVENT_MAIN_ALTITUDE,      150000 },   /* MAIN_DEPLOY, MAIN_DESCENT */
+    { EVENT_LANDED,             220000 }
+};
+
+#define NUM_EVENTS      (sizeof(flight) / sizeof(flight[0]))
+#define NUM_ENTRIES     10                  /* states entered by one flight */
+
+typedef std::chrono::steady_clock::time_point time_point;
+
+static double us_between(time_point a, time_point b) {
+    return std::chrono::duration<double, std::micro>(b - a).count();
+}
+
+/* shared by the stand-ins, one flight at a time */
+static TaskHandle_t callback_task;
+static flight_fsm_t fsm;
+static std::atomic<uint8_t> current_state;
+static time_point entered_at[NUM_FLIGHT_STATES];
+
+static uint8_t handled[64];
+static std::atomic<uint32_t> handled_count;
+static std::vector<double> latency_us;
+
+static bool back_to_back;
+static std::atomic<bool> flight_done;
+
+/* flightStateEntry() */
+static void flightStateEntry(flight_fsm_t* fsm, uint8_t state) {
+    entered_at[state] = std::chrono::steady_clock::now();
+    current_state = state;
+    xTaskNotify(callback_task, 1UL << state_notify_bit[state], eSetBits);
+}
+
+/* checkFlightState, dispatches the flight's events */
+static void checkFlightState(void* parameters) {
+    for(;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        fsm_init(&fsm, APOGEE_LOCKOUT, COAST_LOCKOUT, LANDING_LOCKOUT, 0);
+        for(uint8_t s = 0; s < NUM_FLIGHT_STATES; s++) {
+            fsm_set_hooks(&fsm, s, flightStateEntry, NULL);
+        }
+
+        for(uint8_t i = 0; i < NUM_EVENTS; i++) {
+            fsm_dispatch(&fsm, flight[i].event, flight[i].time);
+            if(!back_to_back) {
+                vTaskDelay(EVENT_SPACING);
+            }
+        }
+
+        flight_done = true;
+    }
+}
+
+/* flightStateCallback, every state entered since the last wake up, in flight order */
+static void flightStateCallback(void* parameters) {
+    uint32_t state_bits = 0;
+
+    for(;;) {
+        xTaskNotifyWait(0, 0xFFFFFFFF, &state_bits, portMAX_DELAY);      // ULONG_MAX on the ESP32
+        time_point woke = std::chrono::steady_clock::now();
+
+        for(uint8_t state = 0; state < NUM_FLIGHT_STATES; state++) {
+            if(!(state_bits & (1UL << state_notify_bit[state]))) {
+                continue;
+            }
+
+            uint32_t n = handled_count;
+            if(n < sizeof(handled)) {
+                handled[n] = state;
+            }
+            latency_us.push_back(us_between(entered_at[state], woke));
+            handled_count = n + 1;
+        }
+    }
+}
+
+/* the former loop, polling current_state every CONSUME_TASK_DELAY */
+static std::atomic<bool> polling;
+static uint32_t polled_states;
+static std::vector<double> polled_latency_us;
+
+static void pollingCallback(void* parameters) {
+    uint8_t last = S(PRE_FLIGHT_GROUND);
+
+    for(;;) {
+        vTaskDelay(POLL_PERIOD);
+        if(!polling) {
+            continue;
+        }
+
+        uint8_t state = current_state;
+        if(state != last) {
+            polled_states++;
+            polled_latency_us.push_back(us_between(entered_at[state], std::chrono::steady_clock::now()));
+            last = state;
+        }
+    }
+}
+
+static double percentile(std::vector<double> v, double q) {
+    if(v.empty()) {
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[(size_t) (q * (v.size() - 1))];
+}
+
+/* the states one flight enters, in order */
+static const uint8_t expected[NUM_ENTRIES] = {
+    S(POWERED_FLIGHT), S(PRE_FLIGHT_GROUND), S(POWERED_FLIGHT), S(COASTING), S(APOGEE),
+    S(DROGUE_DEPLOY), S(DROGUE_DESCENT), S(MAIN_DEPLOY), S(MAIN_DESCENT), S(POST_FLIGHT_GROUND)
+};
+
+/* fly once, true if every state entered was handled once and in order */
+static bool fly(TaskHandle_t state_check) {
+    handled_count = 0;
+    flight_done = false;
+
+    xTaskNotifyGive(state_check);
+    while(!flight_done) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    // let the callback handle what the last dispatch notified
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+    if(!back_to_back) {
+        if(handled_count != NUM_ENTRIES) {
+            return false;
+        }
+        for(uint8_t i = 0; i < NUM_ENTRIES; i++) {
+            if(handled[i] != expected[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // back to back the bits of one state entered twice merge, the rest is handled once, in order
+    uint8_t j = 0;
+    for(uint8_t i = 0; i < handled_count && i < sizeof(handled); i++) {
+        while(j < NUM_ENTRIES && expected[j] != handled[i]) {
+            j++;
+        }
+        if(j == NUM_ENTRIES) {
+            return false;
+        }
+        j++;
+    }
+    uint32_t seen = 0;
+    for(uint8_t i = 0; i < handled_count && i < sizeof(handled); i++) {
+        seen |= 1UL << handled[i];
+    }
+    return seen == (1UL << NUM_FLIGHT_STATES) - 1;
+}
+
+int main() {
+    TaskHandle_t state_check;
+    TaskHandle_t poller;
+
+    xTaskCreate(flightStateCallback, "flightStateCallback", 0, NULL, 3, &callback_task);
+    xTaskCreate(checkFlightState, "checkFlightState", 0, NULL, 2, &state_check);
+    xTaskCreate(pollingCallback, "pollingCallback", 0, NULL, 1, &poller);
+
+    printf("%d flights, events %d ms apart\n", FLIGHTS, EVENT_SPACING);
+
+    bool in_order = true;
+    polling = true;
+    for(int i = 0; i < FLIGHTS; i++) {
+        in_order &= fly(state_check);
+    }
+    polling = false;
+
+    std::vector<double> spaced = latency_us;
+    check(in_order, "every state entered handled once, in flight order");
+    check(percentile(spaced, 0.99) < LATENCY_BOUND_US, "p99 transition to action latency under LATENCY_BOUND_US");
+
+    printf("%d flights, events back to back\n", FLIGHTS);
+
+    back_to_back = true;
+    latency_us.clear();
+    bool all_states = true;
+    for(int i = 0; i < FLIGHTS; i++) {
+        all_states &= fly(state_check);
+    }
+    check(all_states, "every state handled, in flight order, transient ones too");
+
+    printf("latency from the state entry to the callback\n");
+    printf("    %-36s %8s %8s %8s  %s\n", "", "p50", "p99", "max", "states handled");
+    printf("    %-36s %6.0f us %6.0f us %6.0f us  %lu of %d\n", "xTaskNotify, events spaced out", percentile(spaced, 0.5),
+           percentile(spaced, 0.99), percentile(spaced, 1.0), (unsigned long) spaced.size(), FLIGHTS * NUM_ENTRIES);
+    printf("    %-36s %6.0f us %6.0f us %6.0f us\n", "xTaskNotify, back to back", percentile(latency_us, 0.5),
+           percentile(latency_us, 0.99), percentile(latency_us, 1.0));
+    printf("    %-36s %6.0f us %6.0f us %6.0f us  %lu of %d\n", "polling every CONSUME_TASK_DELAY", percentile(polled_latency_us, 0.5),
+           percentile(polled_latency_us, 0.99), percentile(polled_latency_us, 1.0), (unsigned long) polled_states,
+           FLIGHTS * NUM_ENTRIES);
+
+    return check_summary();
+}
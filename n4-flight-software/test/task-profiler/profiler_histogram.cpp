@@ -0,0 +1,227 @@
+/**
+ * Host test of the task loop profiler in src/task_profiler.cpp on a mocked cycle counter.
+ * Runs:
+ * - the histogram bucketing over every duration up to past the last bucket: buckets in
+ *   order, none skipped, each within 25 % of its floor, the overflow in the last one
+ * - the p99 against the exact one of uniform, long tailed and two peaked loop times
+ * - PROFILE_BEGIN / PROFILE_END durations across a counter wrap and a clock change,
+ *   late starts at the half period edge, the summary record and an empty section
+ * - the macros compiling to nothing with TASK_PROFILING 0
+ * - a benchmark of a begin and end pair and of the percentile
+ *
+ * build and run from this directory:
+ *     g++ -O2 -I../common -I../../src profiler_histogram.cpp ../../src/task_profiler.cpp -o profiler_histogram && ./profiler_histogram
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "task_profiler.h"
+#include "check.h"
+
+#define CPU_MHZ             240         /* the ESP32 clock in flight */
+#define RECOVERY_MHZ        80          /* RECOVERY_CPU_FREQUENCY */
+#define LAST_US             131072      /* first duration past the histogram range */
+#define SAMPLES             20000
+#define BENCH_ITERATIONS    1000000
+
+static uint32_t rng_state = 1;
+
+static float uniform() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (rng_state & 0xFFFFFF) / 16777216.0f;
+}
+
+/* the mocked CPU cycle counter, moved by hand */
+static uint32_t cycles;
+
+static uint32_t read_cycles() {
+    return cycles;
+}
+
+static uint32_t exact_percentile(std::vector<uint32_t> v, float fraction) {
+    std::sort(v.begin(), v.end());
+    size_t rank = (size_t) ceil(v.size() * fraction);
+    return v[rank > 0 ? rank - 1 : 0];
+}
+
+/* p99 of a set of durations through the profiler against the exact one */
+static bool p99_within_bucket(const char* name, const std::vector<uint32_t>& durations) {
+    profiler_t p;
+    profiler_init(&p, read_cycles, CPU_MHZ);
+    for(uint32_t d : durations) {
+        profiler_record(&p, PROFILE_FILTER, d);
+    }
+
+    const profile_section_t* s = &p.sections[PROFILE_FILTER];
+    uint32_t exact = exact_percentile(durations, 0.99f);
+    uint32_t p99 = profiler_percentile(s, 0.99f);
+
+    printf("    %-28s exact p99 %6lu us, profiler %6lu us\n", name, (unsigned long) exact, (unsigned long) p99);
+
+    // the upper edge of the bucket holding it, buckets are 25 % of their floor wide
+    return p99 >= exact && p99 <= exact + exact / 4 + 1 && p99 <= s->max_us;
+}
+
+static void bucketing() {
+    printf("histogram buckets\n");
+
+    bool ordered = true;
+    bool narrow = true;
+    uint8_t previous = 0;
+    uint32_t floor_us = 0;
+    uint32_t used = 1;
+
+    for(uint32_t d = 1; d < 4 * LAST_US; d++) {
+        uint8_t b = profiler_bucket(d);
+        if(b == previous) {
+            continue;
+        }
+
+        ordered &= b == previous + 1 && d < LAST_US;
+
+        // the bucket that just ended held floor_us to d - 1
+        if(previous >= PROFILER_SUB_BUCKETS) {
+            narrow &= (d - floor_us) * 4 <= floor_us;
+        }
+
+        previous = b;
+        floor_us = d;
+        used++;
+    }
+
+    check(profiler_bucket(0) == 0 && profiler_bucket(3) == 3, "below 4 us every microsecond has its own bucket");
+    check(ordered, "buckets in order, none skipped");
+    check(used == PROFILER_BUCKETS, "every bucket used");
+    check(narrow, "every bucket at most 25 % of its floor wide");
+    check(profiler_bucket(LAST_US - 1) == PROFILER_BUCKETS - 1 && profiler_bucket(LAST_US) == PROFILER_BUCKETS - 1 &&
+          profiler_bucket(UINT32_MAX) == PROFILER_BUCKETS - 1, "131071 us and longer in the last bucket");
+}
+
+static void percentiles() {
+    printf("p99 against the exact one, %d samples each\n", SAMPLES);
+
+    std::vector<uint32_t> flat;
+    std::vector<uint32_t> tail;
+    std::vector<uint32_t> peaks;
+
+    for(int i = 0; i < SAMPLES; i++) {
+        // an IMU reading, a Kalman update with rare long preemptions, a flash write with page erases
+        flat.push_back(300 + (uint32_t) (200 * uniform()));
+        tail.push_back((uint32_t) (40 * exp(2.5f * uniform() * uniform())));
+        peaks.push_back(uniform() < 0.97f ? 800 + (uint32_t) (100 * uniform()) : 20000 + (uint32_t) (5000 * uniform()));
+    }
+
+    bool within = p99_within_bucket("uniform 300-500 us", flat);
+    within &= p99_within_bucket("long tailed", tail);
+    within &= p99_within_bucket("writes and page erases", peaks);
+    check(within, "p99 never below the exact one, at most one bucket above");
+
+    profiler_t p;
+    profiler_init(&p, read_cycles, CPU_MHZ);
+    profiler_record(&p, PROFILE_FILTER, 1000);
+    check(profiler_percentile(&p.sections[PROFILE_FILTER], 0.99f) == 1000, "p99 of a single sample is the sample");
+}
+
+static void mocked_clock() {
+    printf("PROFILE_BEGIN and PROFILE_END on a mocked cycle counter\n");
+
+    profiler_t p;
+    profiler_init(&p, read_cycles, CPU_MHZ);
+    profiler_set_section(&p, PROFILE_ACQUISITION, "imu", 10000);
+    profiler_set_section(&p, PROFILE_LOG_WRITE, "log", 0);
+
+    // a reading of 250 us that starts just before the counter wraps
+    cycles = UINT32_MAX - 100 * CPU_MHZ;
+    profiler_begin(&p, PROFILE_ACQUISITION);
+    cycles += 250 * CPU_MHZ;
+    profiler_end(&p, PROFILE_ACQUISITION);
+    const profile_section_t* s = &p.sections[PROFILE_ACQUISITION];
+    check(s->count == 1 && s->min_us == 250 && s->max_us == 250, "250 us across the counter wrap");
+
+    // on time, exactly 1.5 periods, 1 us past 1.5 periods, early
+    uint32_t gaps_us[] = { 10000, 15000, 15001, 9000 };
+    for(uint8_t i = 0; i < 4; i++) {
+        cycles += gaps_us[i] * CPU_MHZ - 250 * CPU_MHZ;
+        profiler_begin(&p, PROFILE_ACQUISITION);
+        cycles += 250 * CPU_MHZ;
+        profiler_end(&p, PROFILE_ACQUISITION);
+    }
+    check(s->late == 1, "only the start more than half a period late counted");
+
+    profiler_begin(&p, PROFILE_LOG_WRITE);
+    cycles += 1000 * CPU_MHZ;
+    profiler_end(&p, PROFILE_LOG_WRITE);
+    cycles += 50000 * CPU_MHZ;
+    profiler_begin(&p, PROFILE_LOG_WRITE);
+    cycles += 500 * CPU_MHZ;
+    profiler_end(&p, PROFILE_LOG_WRITE);
+    check(p.sections[PROFILE_LOG_WRITE].late == 0, "no late starts without a period");
+
+    // the clock slowed down for recovery mode, cycles_per_us follows it
+    p.cycles_per_us = RECOVERY_MHZ;
+    profiler_begin(&p, PROFILE_LOG_WRITE);
+    cycles += 2000 * RECOVERY_MHZ;
+    profiler_end(&p, PROFILE_LOG_WRITE);
+    check(p.sections[PROFILE_LOG_WRITE].max_us == 2000, "2000 us at the recovery clock");
+
+    profile_summary_t summary;
+    profiler_summary(&p, PROFILE_ACQUISITION, &summary);
+    check(summary.count == 5 && summary.min_us == 250 && summary.mean_us == 250 && summary.max_us == 250 &&
+          summary.p99_us == 250 && summary.late == 1, "summary of the IMU section");
+
+    char record[PROFILER_RECORD_LENGTH];
+    size_t length = profiler_format(&p, PROFILE_ACQUISITION, record, sizeof(record), 123456);
+    check(length == strlen(record) && strcmp(record, "P,123456,imu,5,250,250,250,250,1\n") == 0, "summary record");
+    check(profiler_format(&p, PROFILE_ACQUISITION, record, 10, 123456) == 0 && record[0] == '\0', "nothing written to a short buffer");
+
+    profiler_summary(&p, PROFILE_PUBLISH, &summary);
+    check(summary.count == 0 && summary.min_us == 0 && summary.max_us == 0 && summary.p99_us == 0, "an empty section reports zeros");
+
+    // with TASK_PROFILING 0 the macros leave nothing behind, not even their argument
+    PROFILE_BEGIN(not_declared_anywhere);
+    PROFILE_END(not_declared_anywhere);
+    check(TASK_PROFILING == 0, "PROFILE_BEGIN and PROFILE_END compile to nothing when disabled");
+}
+
+static void benchmark() {
+    printf("benchmark\n");
+
+    profiler_t p;
+    profiler_init(&p, read_cycles, CPU_MHZ);
+    profiler_set_section(&p, PROFILE_ACQUISITION, "imu", 10000);
+
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < BENCH_ITERATIONS; i++) {
+        profiler_begin(&p, PROFILE_ACQUISITION);
+        cycles += (i & 1023) * CPU_MHZ;
+        profiler_end(&p, PROFILE_ACQUISITION);
+    }
+    double pair_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_ITERATIONS;
+
+    uint32_t sum = 0;
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < BENCH_ITERATIONS / 100; i++) {
+        sum += profiler_percentile(&p.sections[PROFILE_ACQUISITION], 0.99f - (i & 7) * 0.001f);
+    }
+    double p99_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (BENCH_ITERATIONS / 100);
+
+    printf("    profiler_begin() and profiler_end()             %8.1f ns\n", pair_ns);
+    printf("    profiler_percentile()                           %8.1f ns  (%lu)\n", p99_ns, (unsigned long) sum);
+}
+
+int main() {
+    bucketing();
+    percentiles();
+    mocked_clock();
+    benchmark();
+
+    return check_summary();
+}
@@ -0,0 +1,47 @@
+/**
+ * Host side check of the flight task table in src/task_schedule.cpp
+ * Runs the response time analysis and a tick simulation over two hyperperiods and
+ * reports deadline misses
+ *
+ * build and run from this directory:
+ *     g++ -I../../src schedule_sim.cpp ../../src/task_schedule.cpp -o schedule_sim && ./schedule_sim
+ *
+ * exit status is 1 if any task can miss its deadline or the stacks do not fit TASK_STACK_ARENA_SIZE
+ */
+
+#include <stdio.h>
+#include "task_schedule.h"
+
+#define HORIZON_MS  1000    /* one hyperperiod of the 10, 50, 100 and 1000 ms periods */
+#define STEP_US     10
+
+int main() {
+    task_result_t analysis[NUM_FLIGHT_TASKS];
+    task_sim_result_t sim[NUM_FLIGHT_TASKS];
+    uint32_t all = (1UL << NUM_FLIGHT_TASKS) - 1;
+
+    uint8_t ok = task_analyze(flight_tasks, NUM_FLIGHT_TASKS, all, analysis);
+    uint32_t misses = task_simulate(flight_tasks, NUM_FLIGHT_TASKS, all, HORIZON_MS, STEP_US, sim);
+
+    printf("%-20s %4s %4s %6s %6s %8s %8s %8s %5s\n", "task", "core", "prio", "T ms", "D ms", "C us", "R us", "sim us", "miss");
+    for(int i = 0; i < NUM_FLIGHT_TASKS; i++) {
+        const task_spec_t* t = &flight_tasks[i];
+        printf("%-20s %4d %4d %6lu %6lu %8lu %8lu %8lu %5lu%s\n", t->name, t->core, t->priority,
+               (unsigned long) t->period_ms, (unsigned long) t->deadline_ms, (unsigned long) t->wcet_us,
+               (unsigned long) analysis[i].response_us, (unsigned long) sim[i].max_response_us,
+               (unsigned long) sim[i].misses, analysis[i].schedulable ? "" : "  DEADLINE");
+    }
+
+    for(uint8_t core = 0; core < NUM_TASK_CORES; core++) {
+        printf("core %d: U = %.3f, rate monotonic bound %.3f\n", core,
+               task_core_utilization(flight_tasks, NUM_FLIGHT_TASKS, all, core),
+               task_rm_bound(task_core_count(flight_tasks, NUM_FLIGHT_TASKS, all, core)));
+    }
+
+    uint32_t stacks = task_stack_total(flight_tasks, NUM_FLIGHT_TASKS, all);
+    uint8_t stacks_fit = stacks <= TASK_STACK_ARENA_SIZE;
+    printf("stacks %lu of %d bytes%s\n", (unsigned long) stacks, TASK_STACK_ARENA_SIZE, stacks_fit ? "" : "  ARENA TOO SMALL");
+
+    printf("%s, %lu simulated misses\n", ok ? "SCHEDULABLE" : "NOT SCHEDULABLE", (unsigned long) misses);
+    return ok && misses == 0 && stacks_fit ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+/**
+ * Host throughput check of src/telemetry_batch.cpp against an in-process mock broker
+ * Records arrive at a fixed rate into a TELEMETRY_DATA_QUEUE_LENGTH queue and a simulated
+ * telemetry task batches them as telemetryTask does. A publish to the mock broker blocks
+ * for a fixed per message overhead plus the payload at the link byte rate, records that
+ * arrive while the queue is full are dropped. The broker splits every payload back into
+ * rows and checks each record arrives once and in order.
+ *
+ * Every run is made with one record per publish as before batching, with the configured
+ * MQTT_BATCH_SIZE, and adaptive, on a good WiFi link and on a congested one
+ *
+ * build and run from this directory:
+ *     g++ -I../common -I../../src mock_broker.cpp ../../src/telemetry_batch.cpp -o mock_broker && ./mock_broker
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "telemetry_batch.h"
+#include "check.h"
+
+#define QUEUE_LENGTH        10          /* TELEMETRY_DATA_QUEUE_LENGTH */
+#define BATCH_SIZE          8           /* MQTT_BATCH_SIZE */
+#define BATCH_MAX_SIZE      32          /* MQTT_BATCH_MAX_SIZE */
+#define BATCH_MAX_LATENCY   100         /* MQTT_BATCH_MAX_LATENCY */
+#define CONGESTION_TIME     50          /* MQTT_CONGESTION_TIME */
+#define FORMAT_US           50          /* telemetry_to_csv and the queue receive per record */
+#define RUN_US              20000000
+#define ARRIVAL_SLOTS       4096
+
+typedef struct {
+    const char* name;
+    uint32_t overhead_us;               /* per publish, MQTT header, TCP write and ACK wait */
+    uint32_t bytes_per_s;
+} link_model_t;
+
+static const link_model_t GOOD_LINK = { "good WiFi", 3000, 125000 };
+static const link_model_t CONGESTED_LINK = { "congested", 25000, 25000 };
+
+typedef struct {
+    uint32_t offered;
+    uint32_t delivered;
+    uint32_t dropped;
+    uint32_t publishes;
+    uint32_t out_of_order;
+    uint32_t max_latency_us;
+    uint16_t final_batch_size;
+} run_result_t;
+
+/* the mock broker, it keeps the arrival time of every record to measure its latency */
+typedef struct {
+    uint32_t arrival_us[ARRIVAL_SLOTS];
+    int64_t last_sequence;
+    run_result_t* result;
+} mock_broker_t;
+
+static void broker_receive(mock_broker_t* broker, const char* payload, size_t length, uint32_t now_us) {
+    const char* p = payload;
+    const char* end = payload + length;
+
+    broker->result->publishes++;
+
+    while(p < end) {
+        const char* newline = (const char*) memchr(p, '\n', end - p);
+        if(newline == NULL) {
+            broker->result->out_of_order++;         /* a partial row */
+            return;
+        }
+
+        long sequence = strtol(p, NULL, 10);
+        if(sequence <= broker->last_sequence) {
+            broker->result->out_of_order++;
+        }
+        broker->last_sequence = sequence;
+
+        uint32_t latency = now_us - broker->arrival_us[sequence % ARRIVAL_SLOTS];
+        if(latency > broker->result->max_latency_us) {
+            broker->result->max_latency_us = latency;
+        }
+
+        broker->result->delivered++;
+        p = newline + 1;
+    }
+}
+
+/* a row of the same length as a flight telemetry row, the sequence number first */
+static size_t make_row(char* row, uint32_t sequence) {
+    return (size_t) sprintf(row, "%u,1,3,-0.42,0.13,9.81,1.25,-0.50,12.50,-3.25,-1.292100,36.821900,1795,82123.45,24.50,1234.56,101.25\n", sequence);
+}
+
+static run_result_t run(const link_model_t* link, uint32_t rate_hz, uint16_t batch_size, uint8_t adaptive) {
+    static mock_broker_t broker;
+    static telemetry_batch_t batch;
+    run_result_t result = {};
+
+    memset(&broker, 0, sizeof(broker));
+    broker.last_sequence = -1;
+    broker.result = &result;
+
+    uint32_t queue[QUEUE_LENGTH];
+    uint32_t queue_head = 0;
+    uint32_t queue_count = 0;
+
+    uint32_t period_us = 1000000 / rate_hz;
+    uint32_t next_arrival = 0;
+    uint32_t sequence = 0;
+    uint32_t now = 0;
+
+    batch_init(&batch, batch_size, BATCH_MAX_SIZE, BATCH_MAX_LATENCY, CONGESTION_TIME, adaptive);
+
+    auto arrive = [&]() {
+        while(next_arrival <= now && next_arrival < RUN_US) {
+            broker.arrival_us[sequence % ARRIVAL_SLOTS] = next_arrival;
+            if(queue_count < QUEUE_LENGTH) {
+                queue[(queue_head + queue_count++) % QUEUE_LENGTH] = sequence;
+            } else {
+                result.dropped++;
+            }
+            result.offered++;
+            sequence++;
+            next_arrival += period_us;
+        }
+    };
+
+    auto publish = [&]() {
+        uint32_t duration = link->overhead_us + (uint32_t) ((uint64_t) batch.length * 1000000 / link->bytes_per_s);
+        now += duration;
+        broker_receive(&broker, batch.payload, batch.length, now);
+        batch_report_publish(&batch, 1, duration / 1000);
+        arrive();
+    };
+
+    while(now < RUN_US || queue_count > 0 || batch.samples > 0) {
+        arrive();
+
+        if(queue_count > 0) {
+            char row[160];
+            size_t length = make_row(row, queue[queue_head]);
+            queue_head = (queue_head + 1) % QUEUE_LENGTH;
+            queue_count--;
+            now += FORMAT_US;
+
+            if(!batch_append(&batch, row, length, now / 1000)) {
+                publish();
+                batch_append(&batch, row, length, now / 1000);
+            }
+        } else {
+            // block on the queue until the next record or the latency cap of the batch
+            uint32_t wake = next_arrival < RUN_US ? next_arrival : UINT32_MAX;
+            if(batch.samples > 0) {
+                uint32_t deadline = now + batch_time_to_deadline(&batch, now / 1000) * 1000;
+                if(deadline < wake) {
+                    wake = deadline;
+                }
+            }
+            if(wake == UINT32_MAX) {
+                break;
+            }
+            now = wake > now ? wake : now + 1;
+        }
+
+        if(batch_ready(&batch, now / 1000)) {
+            publish();
+        }
+    }
+
+    if(batch.samples > 0) {
+        publish();
+    }
+
+    result.final_batch_size = batch.batch_size;
+    return result;
+}
+
+static void print_result(const char* mode, const run_result_t* r) {
+    printf("    %-12s %6.0f samples/s delivered  %5.1f%% dropped  %5.1f publishes/s  max latency %4lu ms\n",
+           mode, r->delivered * 1e6 / RUN_US, 100.0 * r->dropped / r->offered, r->publishes * 1e6 / RUN_US,
+           (unsigned long) (r->max_latency_us / 1000));
+}
+
+static bool consistent(const run_result_t* r) {
+    return r->out_of_order == 0 && r->delivered + r->dropped == r->offered;
+}
+
+int main() {
+    const link_model_t* links[] = { &GOOD_LINK, &CONGESTED_LINK };
+    const uint32_t rates[] = { 100, 1000 };
+
+    run_result_t single[2][2];
+    run_result_t batched[2][2];
+    run_result_t adaptive[2][2];
+
+    for(int l = 0; l < 2; l++) {
+        for(int r = 0; r < 2; r++) {
+            printf("%s link, %lu us per publish and %lu B/s, records offered at %lu Hz\n", links[l]->name,
+                   (unsigned long) links[l]->overhead_us, (unsigned long) links[l]->bytes_per_s, (unsigned long) rates[r]);
+
+            single[l][r] = run(links[l], rates[r], 1, 0);
+            batched[l][r] = run(links[l], rates[r], BATCH_SIZE, 0);
+            adaptive[l][r] = run(links[l], rates[r], BATCH_SIZE, 1);
+
+            print_result("unbatched", &single[l][r]);
+            print_result("batch of 8", &batched[l][r]);
+            print_result("adaptive", &adaptive[l][r]);
+        }
+    }
+
+    printf("checks\n");
+
+    bool ok = true;
+    for(int l = 0; l < 2; l++) {
+        for(int r = 0; r < 2; r++) {
+            ok &= consistent(&single[l][r]) && consistent(&batched[l][r]) && consistent(&adaptive[l][r]);
+        }
+    }
+    check(ok, "every record delivered once and in order, or counted as dropped");
+
+    check(batched[0][0].dropped == 0 && adaptive[0][0].dropped == 0, "good link at 100 Hz, nothing dropped");
+    check(batched[0][0].max_latency_us <= (BATCH_MAX_LATENCY + 20) * 1000, "good link at 100 Hz, latency within the cap plus one publish");
+    check(single[1][0].dropped * 2 > single[1][0].offered, "congested link at 100 Hz, unbatched loses over half the records");
+    check(batched[1][0].dropped == 0 && adaptive[1][0].dropped == 0, "congested link at 100 Hz, batched loses nothing");
+    check(batched[0][1].delivered > 2.5 * single[0][1].delivered, "good link saturated, batching delivers 2.5x the records");
+    check(adaptive[1][1].delivered >= batched[1][1].delivered, "congested link saturated, adaptive at least as good as fixed");
+
+    return check_summary();
+}
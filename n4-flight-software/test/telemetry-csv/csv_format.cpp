@@ -0,0 +1,283 @@
+/**
+ * Host check of the fixed precision formatter in src/telemetry_csv.cpp against snprintf
+ * - every float bit pattern at a stride, all exact two decimal ties and every integer
+ *   float up to 2^24, compared with snprintf("%.2f")
+ * - random doubles over the whole exponent range, including the magnitudes above 2^56
+ *   that go through the snprintf fallback
+ * - integers, nan and inf, and rows that do not fit their buffer
+ * - a benchmark of telemetry_to_csv() against the sprintf call it replaced
+ *
+ * build and run from this directory:
+ *     g++ -O2 -I../sensor-fusion/shim -I../common -I../../src csv_format.cpp ../../src/telemetry_csv.cpp -o csv_format && ./csv_format
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include "telemetry_csv.h"
+#include "check.h"
+
+#define FLOAT_STRIDE        509         /* ~8.4M of the 2^32 float bit patterns */
+#define RANDOM_DOUBLES      2000000
+#define BENCH_ROWS          200000
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t random64() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/* csv_append_* output as a string, NULL if it did not fit */
+static char out[512];
+
+static const char* format_float(float value) {
+    char* p = csv_append_float(out, out + sizeof(out) - 1, value);
+    if(p == NULL) {
+        return NULL;
+    }
+    *p = '\0';
+    return out;
+}
+
+static const char* format_double(double value) {
+    char* p = csv_append_double(out, out + sizeof(out) - 1, value);
+    if(p == NULL) {
+        return NULL;
+    }
+    *p = '\0';
+    return out;
+}
+
+/* printf spells these "nan", "-nan", "inf" and "-inf" on glibc, so does the formatter */
+static uint64_t mismatches = 0;
+
+static void compare(const char* got, double value, uint64_t bits) {
+    char expected[512];
+    snprintf(expected, sizeof(expected), "%.2f", value);
+
+    if(got == NULL || strcmp(got, expected) != 0) {
+        if(mismatches < 5) {
+            printf("    bits %016llx: \"%s\" printf \"%s\"\n", (unsigned long long) bits, got ? got : "(null)", expected);
+        }
+        mismatches++;
+    }
+}
+
+static void floats() {
+    printf("float against snprintf\n");
+
+    uint64_t tested = 0;
+    mismatches = 0;
+
+    for(uint64_t bits = 0; bits <= 0xFFFFFFFFULL; bits += FLOAT_STRIDE) {
+        uint32_t b = (uint32_t) bits;
+        float value;
+        memcpy(&value, &b, sizeof(value));
+        compare(format_float(value), value, b);
+        tested++;
+    }
+    printf("    %llu bit patterns at a stride of %d\n", (unsigned long long) tested, FLOAT_STRIDE);
+    check(mismatches == 0, "strided bit patterns match");
+
+    // n/8 are the exact ties at two decimals, x.x25 and x.x75 round to the even digit
+    mismatches = 0;
+    for(int32_t n = -800000; n <= 800000; n++) {
+        float value = n / 8.0f;
+        compare(format_float(value), value, (uint32_t) n);
+    }
+    check(mismatches == 0, "exact ties n/8 round half to even");
+
+    mismatches = 0;
+    for(uint32_t n = 0; n <= (1u << 24); n++) {
+        float value = (float) n;
+        compare(format_float(value), value, n);
+    }
+    check(mismatches == 0, "every integer float up to 2^24");
+
+    // the values the flight records actually hold, cents and their neighbours
+    mismatches = 0;
+    for(int32_t n = -2000000; n <= 2000000; n++) {
+        float value = n / 100.0f;
+        compare(format_float(value), value, (uint32_t) n);
+        compare(format_float(nextafterf(value, INFINITY)), nextafterf(value, INFINITY), (uint32_t) n);
+        compare(format_float(nextafterf(value, -INFINITY)), nextafterf(value, -INFINITY), (uint32_t) n);
+    }
+    check(mismatches == 0, "cents to +-20000 and their neighbouring floats");
+}
+
+static void doubles() {
+    printf("double against snprintf\n");
+
+    mismatches = 0;
+    uint64_t fallback = 0;
+    for(uint32_t i = 0; i < RANDOM_DOUBLES; i++) {
+        uint64_t bits = random64();
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        if(fabs(value) >= 72057594037927936.0) {        /* 2^56 */
+            fallback++;
+        }
+        compare(format_double(value), value, bits);
+    }
+    printf("    %d random bit patterns, %llu through the snprintf fallback\n", RANDOM_DOUBLES, (unsigned long long) fallback);
+    check(mismatches == 0, "random bit patterns match");
+
+    // around the switch to the fallback, where the integer path runs out of bits
+    mismatches = 0;
+    for(int e = 40; e < 80; e++) {
+        double value = ldexp(1.0, e);
+        for(int k = 0; k < 1000; k++) {
+            compare(format_double(value), value, (uint64_t) e);
+            compare(format_double(-value), -value, (uint64_t) e);
+            value = nextafter(value, INFINITY);
+        }
+    }
+    check(mismatches == 0, "2^40 to 2^80 across the fallback threshold");
+
+    mismatches = 0;
+    for(int64_t n = -1000000; n <= 1000000; n++) {
+        double value = n / 1000.0;
+        compare(format_double(value), value, (uint64_t) n);
+    }
+    check(mismatches == 0, "thousandths to +-1000, the half-cent ties");
+
+    mismatches = 0;
+    const double special[] = { 0.0, -0.0, 0.004999999, 0.005, 0.015, -0.005, 4.9e-324, -4.9e-324, 1.7976931348623157e308, -1.7976931348623157e308 };
+    for(size_t i = 0; i < sizeof(special) / sizeof(special[0]); i++) {
+        compare(format_double(special[i]), special[i], i);
+    }
+    check(mismatches == 0, "zeros, subnormals and the largest double");
+
+    check(strcmp(format_double(NAN), "nan") == 0 && strcmp(format_double(INFINITY), "inf") == 0
+          && strcmp(format_double(-INFINITY), "-inf") == 0 && strcmp(format_float(-INFINITY), "-inf") == 0,
+          "nan and inf spelled like printf");
+}
+
+static void integers() {
+    printf("integers and buffer bounds\n");
+
+    char expected[32];
+    bool ok = true;
+
+    for(uint32_t i = 0; i < 1000000; i++) {
+        uint32_t u = (uint32_t) random64();
+        int32_t s = (int32_t) random64();
+
+        char* p = csv_append_uint(out, out + 31, u);
+        *p = '\0';
+        snprintf(expected, sizeof(expected), "%u", u);
+        ok &= strcmp(out, expected) == 0;
+
+        p = csv_append_int(out, out + 31, s);
+        *p = '\0';
+        snprintf(expected, sizeof(expected), "%d", s);
+        ok &= strcmp(out, expected) == 0;
+    }
+
+    char* p = csv_append_int(out, out + 31, INT32_MIN);
+    *p = '\0';
+    ok &= strcmp(out, "-2147483648") == 0;
+    check(ok, "csv_append_uint and csv_append_int match %u and %d");
+
+    // every prefix of a row that does not fit is refused, never overrun
+    telemetry_type_t packet = {};
+    packet.record_number = 123456;
+    packet.acc_data.ax = -12.345f;
+    packet.gps_data.latitude = -1.2921;
+    packet.gps_data.longitude = 36.8219;
+    packet.gps_data.gps_altitude = 1795;
+    packet.alt_data.pressure = 82123.456;
+    packet.alt_data.AGL = 1234.567;
+
+    char row[TELEMETRY_CSV_ROW_LENGTH];
+    size_t full = telemetry_to_csv(row, sizeof(row), &packet);
+
+    bool bounded = full > 0;
+    for(size_t size = 1; size <= full; size++) {
+        char small[TELEMETRY_CSV_ROW_LENGTH + 1];
+        memset(small, 'x', sizeof(small));
+        bounded &= telemetry_to_csv(small, size, &packet) == 0 && small[0] == '\0' && small[size] == 'x';
+    }
+    bounded &= telemetry_to_csv(row, full + 1, &packet) == full;
+    check(bounded, "a row one byte short of its buffer is refused without overrun");
+
+    check(strstr(row, ",1795,") != NULL, "gps_altitude written as an integer");
+}
+
+/* the sprintf the formatter replaced, with the integer GPS altitude */
+static int sprintf_row(char* buffer, const telemetry_type_t* t) {
+    return sprintf(buffer, "%u,%d,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%u,%.2f,%.2f,%.2f,%.2f\n",
+                   t->record_number, t->operation_mode, t->state,
+                   t->acc_data.ax, t->acc_data.ay, t->acc_data.az, t->acc_data.pitch, t->acc_data.roll,
+                   t->gyro_data.gx, t->gyro_data.gy, t->gps_data.latitude, t->gps_data.longitude,
+                   t->gps_data.gps_altitude, t->alt_data.pressure, t->alt_data.temperature,
+                   t->alt_data.AGL, t->alt_data.velocity);
+}
+
+static void benchmark() {
+    printf("benchmark, %d flight-like rows\n", BENCH_ROWS);
+
+    static telemetry_type_t packets[1024];
+    for(int i = 0; i < 1024; i++) {
+        telemetry_type_t* t = &packets[i];
+        t->record_number = i;
+        t->state = i % 7;
+        t->acc_data.ax = (float) ((random64() % 20000) / 100.0 - 100.0);
+        t->acc_data.ay = (float) ((random64() % 2000) / 100.0 - 10.0);
+        t->acc_data.az = (float) ((random64() % 2000) / 100.0 - 10.0);
+        t->acc_data.pitch = (float) ((random64() % 18000) / 100.0 - 90.0);
+        t->acc_data.roll = (float) ((random64() % 36000) / 100.0 - 180.0);
+        t->gyro_data.gx = (random64() % 100000) / 100.0 - 500.0;
+        t->gyro_data.gy = (random64() % 100000) / 100.0 - 500.0;
+        t->gps_data.latitude = -1.2921 + (random64() % 1000) * 1e-6;
+        t->gps_data.longitude = 36.8219 + (random64() % 1000) * 1e-6;
+        t->gps_data.gps_altitude = 1795 + random64() % 3000;
+        t->alt_data.pressure = 82000.0 + (random64() % 100000) / 100.0;
+        t->alt_data.temperature = 20.0 + (random64() % 1000) / 100.0;
+        t->alt_data.AGL = (random64() % 300000) / 100.0;
+        t->alt_data.velocity = (random64() % 60000) / 100.0 - 300.0;
+    }
+
+    char row[TELEMETRY_CSV_ROW_LENGTH];
+    char reference[TELEMETRY_CSV_ROW_LENGTH];
+    bool same = true;
+    for(int i = 0; i < 1024; i++) {
+        telemetry_to_csv(row, sizeof(row), &packets[i]);
+        sprintf_row(reference, &packets[i]);
+        same &= strcmp(row, reference) == 0;
+    }
+    check(same, "rows identical to the sprintf rows");
+
+    volatile size_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < BENCH_ROWS; i++) {
+        sink += sprintf_row(reference, &packets[i & 1023]);
+    }
+    double sprintf_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_ROWS;
+
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < BENCH_ROWS; i++) {
+        sink += telemetry_to_csv(row, sizeof(row), &packets[i & 1023]);
+    }
+    double csv_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_ROWS;
+
+    printf("    sprintf          %7.0f ns per row\n", sprintf_ns);
+    printf("    telemetry_to_csv %7.0f ns per row, %.1fx faster\n", csv_ns, sprintf_ns / csv_ns);
+    check(csv_ns < sprintf_ns, "faster than sprintf");
+}
+
+int main() {
+    floats();
+    doubles();
+    integers();
+    benchmark();
+
+    return check_summary();
+}
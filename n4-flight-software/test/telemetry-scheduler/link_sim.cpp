@@ -0,0 +1,327 @@
+/**
+ * Host check of the link aware telemetry scheduler in src/telemetry_scheduler.cpp
+ * on simulated bandwidth limited links. Sensor packets arrive at 100 Hz and a frame is
+ * built every TELEMETRY_FRAME_INTERVAL as telemetryTask does
+ * - a radio: send() copies the frame into a UART TX buffer drained at the link rate and
+ *   refuses it if it does not fit, as the XBee transport does
+ * - the radio rate drops tenfold in flight, and recovers
+ * - an MQTT link that always keeps up next to a saturated radio, once with one scheduler
+ *   per link as telemetryTask runs them and once with a single shared estimate
+ *
+ * build and run from this directory:
+ *     g++ -I../sensor-fusion/shim -I../common -I../../src link_sim.cpp ../../src/telemetry_scheduler.cpp ../../src/telemetry_csv.cpp -o link_sim && ./link_sim
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "telemetry_scheduler.h"
+#include "check.h"
+
+#define FRAME_INTERVAL      100         /* TELEMETRY_FRAME_INTERVAL */
+#define LINK_RATE           2000        /* TELEMETRY_LINK_RATE */
+#define MIN_LINK_RATE       200         /* TELEMETRY_MIN_LINK_RATE */
+#define MAX_LINK_RATE       20000       /* TELEMETRY_MAX_LINK_RATE */
+#define CONGESTION_TIME     50          /* MQTT_CONGESTION_TIME */
+#define PACKET_INTERVAL     10
+#define TX_BUFFER_SIZE      512         /* bytes of the UART TX ring the radio may hold */
+
+/*
+ * simulated links
+ */
+
+typedef struct {
+    float rate;                         /* bytes/s the link carries */
+    uint8_t blocking;                   /* 1: send waits for the link like an MQTT publish, 0: buffered like the UART */
+    float buffered;                     /* bytes waiting in the TX buffer */
+    uint32_t last_ms;
+
+    uint32_t accepted_bytes;
+    uint32_t frames;
+    uint32_t rejected;
+    uint32_t last_delivered[NUM_TELEMETRY_CHANNELS];
+    uint32_t max_gap[NUM_TELEMETRY_CHANNELS];
+    uint32_t delivered[NUM_TELEMETRY_CHANNELS];
+} sim_link_t;
+
+static void link_init(sim_link_t* link, float rate, uint8_t blocking) {
+    memset(link, 0, sizeof(sim_link_t));
+    link->rate = rate;
+    link->blocking = blocking;
+}
+
+static void link_measure_from(sim_link_t* link, uint32_t now) {
+    for(uint8_t c = 0; c < NUM_TELEMETRY_CHANNELS; c++) {
+        link->last_delivered[c] = now;
+        link->max_gap[c] = 0;
+        link->delivered[c] = 0;
+    }
+    link->accepted_bytes = 0;
+    link->frames = 0;
+    link->rejected = 0;
+}
+
+/* send a frame, feed the result back like publishTelemetryBatch() does */
+static void link_send(sim_link_t* link, telemetry_scheduler_t* s, const char* frame, size_t length, uint32_t now) {
+    link->buffered -= link->rate * (now - link->last_ms) / 1000.0f;
+    if(link->buffered < 0) {
+        link->buffered = 0;
+    }
+    link->last_ms = now;
+    link->frames++;
+
+    uint8_t sent;
+    uint32_t duration = 0;
+
+    if(link->blocking) {
+        duration = (uint32_t) (length * 1000.0f / link->rate);
+        sent = 1;
+    } else {
+        sent = link->buffered + length <= TX_BUFFER_SIZE;
+        if(sent) {
+            link->buffered += length;
+        }
+    }
+
+    scheduler_report_link(s, length, duration, sent, duration > CONGESTION_TIME);
+
+    if(!sent) {
+        link->rejected++;
+        return;
+    }
+
+    link->accepted_bytes += length;
+
+    // "F,<time>,<mask>,..."
+    const char* mask_field = strchr(strchr(frame, ',') + 1, ',') + 1;
+    uint32_t mask = strtoul(mask_field, NULL, 10);
+    for(uint8_t c = 0; c < NUM_TELEMETRY_CHANNELS; c++) {
+        if(mask & (1 << c)) {
+            uint32_t gap = now - link->last_delivered[c];
+            if(gap > link->max_gap[c]) {
+                link->max_gap[c] = gap;
+            }
+            link->last_delivered[c] = now;
+            link->delivered[c]++;
+        }
+    }
+}
+
+/*
+ * scheduler set up and fed like telemetryTask does
+ */
+
+static void scheduler_setup(telemetry_scheduler_t* s) {
+    scheduler_init(s, FRAME_INTERVAL, LINK_RATE, MIN_LINK_RATE, MAX_LINK_RATE);
+    scheduler_set_channel(s, CHANNEL_STATE,      0, 500);
+    scheduler_set_channel(s, CHANNEL_ALTITUDE,   1, 100);
+    scheduler_set_channel(s, CHANNEL_VELOCITY,   2, 100);
+    scheduler_set_channel(s, CHANNEL_GPS,        3, 1000);
+    scheduler_set_channel(s, CHANNEL_ATTITUDE,   4, 200);
+    scheduler_set_channel(s, CHANNEL_HEALTH,     5, 2000);
+}
+
+static void make_packet(telemetry_type_t* packet, uint32_t now) {
+    float t = now / 1000.0f;
+
+    memset(packet, 0, sizeof(telemetry_type_t));
+    packet->record_number = now / PACKET_INTERVAL;
+    packet->data_flags = ACCEL_DATA_FLAG | GYRO_DATA_FLAG | ALTIMETER_DATA_FLAG;
+    packet->fresh_flags = packet->data_flags;
+    packet->acc_data.ax = -12.5f + t;
+    packet->acc_data.ay = 0.25f;
+    packet->acc_data.az = 9.81f;
+    packet->acc_data.pitch = 87.5f;
+    packet->acc_data.roll = -1.25f;
+    packet->alt_data.pressure = 82123.45 - t;
+    packet->alt_data.altitude = 1795.0 + 10.0 * t;
+    packet->alt_data.AGL = 10.0 * t;
+    packet->alt_data.velocity = 10.0;
+    packet->alt_data.temperature = 24.5;
+
+    // the GPS fixes at 5 Hz
+    if(now % 200 == 0) {
+        packet->data_flags |= GPS_DATA_FLAG;
+        packet->fresh_flags |= GPS_DATA_FLAG;
+        packet->gps_data.latitude = -1.292100;
+        packet->gps_data.longitude = 36.821900;
+        packet->gps_data.gps_altitude = 1795 + (uint16_t) (10 * t);
+    }
+}
+
+/*
+ * runs
+ */
+
+/* with shared set, one frame is built from schedulers[0] and sent over every link */
+static void run(telemetry_scheduler_t** schedulers, sim_link_t** links, uint8_t n, uint8_t shared, uint32_t from, uint32_t to) {
+    telemetry_type_t packet;
+    char frame[TELEMETRY_FRAME_LENGTH];
+    uint8_t builders = shared ? 1 : n;
+
+    for(uint32_t now = from; now < to; now += PACKET_INTERVAL) {
+        make_packet(&packet, now);
+        for(uint8_t i = 0; i < builders; i++) {
+            scheduler_update(schedulers[i], &packet, now);
+        }
+
+        if(now % FRAME_INTERVAL != 0) {
+            continue;
+        }
+
+        for(uint8_t i = 0; i < builders; i++) {
+            scheduler_update_state(schedulers[i], 3, 1, now);
+            scheduler_update_health(schedulers[i], 0x3F, now);
+
+            size_t length = scheduler_build_frame(schedulers[i], frame, sizeof(frame), now);
+            if(length == 0) {
+                continue;
+            }
+
+            if(shared) {
+                for(uint8_t l = 0; l < n; l++) {
+                    link_send(links[l], schedulers[0], frame, length, now);
+                }
+            } else {
+                link_send(links[i], schedulers[i], frame, length, now);
+            }
+        }
+    }
+}
+
+/* longest gap between deliveries of a channel, "never" if it was not delivered */
+static const char* gap_text(const sim_link_t* link, uint8_t channel) {
+    static char text[4][16];
+    static uint8_t next = 0;
+    char* t = text[next++ % 4];
+
+    if(link->delivered[channel] == 0) {
+        return "never";
+    }
+    snprintf(t, 16, "%lu ms", (unsigned long) link->max_gap[channel]);
+    return t;
+}
+
+static void print_link(const char* name, const sim_link_t* link, const telemetry_scheduler_t* s, uint32_t duration_ms) {
+    printf("    %-10s carries %5.0f B/s, estimate %6.0f B/s, used %5.0f B/s, %4.1f%% of frames refused\n",
+           name, link->rate, s->link_rate, link->accepted_bytes * 1000.0f / duration_ms,
+           link->frames ? 100.0f * link->rejected / link->frames : 0.0f);
+    printf("               longest gap state %s, altitude %s, attitude %s, GPS %s\n",
+           gap_text(link, CHANNEL_STATE), gap_text(link, CHANNEL_ALTITUDE), gap_text(link, CHANNEL_ATTITUDE), gap_text(link, CHANNEL_GPS));
+}
+
+static void radio_steady() {
+    static telemetry_scheduler_t s;
+    sim_link_t radio;
+    telemetry_scheduler_t* schedulers[] = { &s };
+    sim_link_t* links[] = { &radio };
+
+    printf("radio at 800 B/s, XBee at 9600 baud less the API framing\n");
+
+    scheduler_setup(&s);
+    link_init(&radio, 800, 0);
+
+    run(schedulers, links, 1, 0, 0, 10000);
+    link_measure_from(&radio, 10000);
+    run(schedulers, links, 1, 0, 10000, 70000);
+    print_link("radio", &radio, &s, 60000);
+
+    check(radio.accepted_bytes >= 0.8f * 800 * 60, "link at least 80% used once the estimate settled");
+    check(radio.rejected * 10 < radio.frames, "under 10% of the frames refused");
+    check(radio.max_gap[CHANNEL_STATE] <= 1000, "state reaches ground at least every second");
+    check(radio.max_gap[CHANNEL_ALTITUDE] <= 500, "altitude at least every 500 ms");
+    check(radio.delivered[CHANNEL_GPS] > 0 && radio.delivered[CHANNEL_HEALTH] > 0, "GPS and health still get through");
+}
+
+static void radio_rate_drop() {
+    static telemetry_scheduler_t s;
+    sim_link_t radio;
+    telemetry_scheduler_t* schedulers[] = { &s };
+    sim_link_t* links[] = { &radio };
+
+    printf("radio drops from 4000 B/s to 400 B/s for 30 s\n");
+
+    scheduler_setup(&s);
+    link_init(&radio, 4000, 0);
+    run(schedulers, links, 1, 0, 0, 20000);
+    float before = s.link_rate;
+
+    radio.rate = 400;
+    link_measure_from(&radio, 20000);
+    run(schedulers, links, 1, 0, 20000, 25000);
+    float after_5s = s.link_rate;
+    run(schedulers, links, 1, 0, 25000, 50000);
+    print_link("degraded", &radio, &s, 30000);
+    uint32_t state_gap = radio.max_gap[CHANNEL_STATE];
+
+    radio.rate = 4000;
+    run(schedulers, links, 1, 0, 50000, 80000);
+    printf("    estimate before %.0f B/s, 5 s after the drop %.0f B/s, 30 s after recovery %.0f B/s\n", before, after_5s, s.link_rate);
+
+    check(before >= 2000, "estimate grows on the fast link");
+    check(after_5s <= 2 * 400, "estimate within 2x of the slow link 5 s after the drop");
+    check(state_gap <= 1000, "state keeps reaching ground on the slow link");
+    check(s.link_rate >= 2000, "estimate grows back after the link recovers");
+}
+
+static void two_links() {
+    static telemetry_scheduler_t mqtt_scheduler;
+    static telemetry_scheduler_t radio_scheduler;
+    static telemetry_scheduler_t shared;
+    sim_link_t mqtt;
+    sim_link_t radio;
+
+    printf("MQTT link at 20000 B/s next to a radio at 300 B/s\n");
+
+    // one scheduler per link
+    scheduler_setup(&mqtt_scheduler);
+    scheduler_setup(&radio_scheduler);
+    link_init(&mqtt, 20000, 1);
+    link_init(&radio, 300, 0);
+    telemetry_scheduler_t* separate[] = { &mqtt_scheduler, &radio_scheduler };
+    sim_link_t* links[] = { &mqtt, &radio };
+
+    run(separate, links, 2, 0, 0, 10000);
+    link_measure_from(&mqtt, 10000);
+    link_measure_from(&radio, 10000);
+    run(separate, links, 2, 0, 10000, 40000);
+    printf("  one scheduler per link\n");
+    print_link("MQTT", &mqtt, &mqtt_scheduler, 30000);
+    print_link("radio", &radio, &radio_scheduler, 30000);
+
+    float separate_mqtt_rate = mqtt_scheduler.link_rate;
+    float separate_radio_rate = radio_scheduler.link_rate;
+    uint32_t separate_mqtt_attitude = mqtt.delivered[CHANNEL_ATTITUDE];
+    uint32_t separate_radio_refused = radio.rejected;
+    uint32_t separate_radio_frames = radio.frames;
+
+    // one estimate fed by both links, the same frame sent over both
+    scheduler_setup(&shared);
+    link_init(&mqtt, 20000, 1);
+    link_init(&radio, 300, 0);
+    telemetry_scheduler_t* one[] = { &shared };
+
+    run(one, links, 2, 1, 0, 10000);
+    link_measure_from(&mqtt, 10000);
+    link_measure_from(&radio, 10000);
+    run(one, links, 2, 1, 10000, 40000);
+    printf("  one shared estimate\n");
+    print_link("MQTT", &mqtt, &shared, 30000);
+    print_link("radio", &radio, &shared, 30000);
+
+    check(separate_mqtt_rate >= 0.9f * MAX_LINK_RATE, "MQTT estimate stays at the maximum next to a saturated radio");
+    check(separate_radio_rate <= 2 * 300, "radio estimate follows the radio, not the MQTT successes");
+    check(separate_radio_refused * 10 < separate_radio_frames, "radio refuses under 10% of its own frames");
+    check(separate_mqtt_attitude > mqtt.delivered[CHANNEL_ATTITUDE], "MQTT carries more attitude data than with a shared estimate");
+    check(radio.rejected > separate_radio_refused, "a shared estimate overruns the radio more often");
+}
+
+int main() {
+    radio_steady();
+    radio_rate_drop();
+    two_links();
+
+    return check_summary();
+}
@@ -0,0 +1,29 @@
+/**
+ * Host stand-in for Arduino.h, the clock and the HardwareSerial calls the XBee transport
+ * makes. The serial port and the clock are implemented by the test
+ */
+
+#ifndef SHIM_ARDUINO_H
+#define SHIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define SERIAL_8N1 0x800001c
+
+uint32_t millis();
+uint32_t micros();
+
+class HardwareSerial {
+    public:
+        size_t setTxBufferSize(size_t size);
+        void begin(unsigned long baud, uint32_t config, int8_t rx_pin, int8_t tx_pin);
+        int available();
+        int read();
+        int availableForWrite();
+        size_t write(const uint8_t* buffer, size_t size);
+};
+
+#endif
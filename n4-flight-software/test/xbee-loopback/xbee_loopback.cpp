@@ -0,0 +1,416 @@
+/**
+ * Host loopback test of the XBee transport in src/xbee_transport.cpp
+ * The HardwareSerial stand-in in shim/ is a UART with a TX ring buffer drained at the baud
+ * rate into a simulated radio. The radio parses the API frames, sends each payload over the
+ * air to a ground station after its air time and answers with a transmit status frame on
+ * the UART RX line. The ground station checks it receives exactly the accepted messages,
+ * in order, and measures their latency. Runs:
+ * - a 1 KB batch sent to an idle radio through the small UART TX ring
+ * - throughput and latency under and over the link rate, with the telemetry task polling
+ *   the link every 20 ms
+ * - lost transmit status and failed deliveries, while frames wait in the staging buffer
+ *
+ * build and run from this directory:
+ *     g++ -Ishim -I../../include -I../common -I../../src xbee_loopback.cpp ../../src/xbee_transport.cpp ../../src/xbee_frame.cpp -o xbee_loopback && ./xbee_loopback
+ *
+ * exit status is 1 if any check fails
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "xbee_transport.h"
+#include "check.h"
+
+#define BAUD_RATE           9600        /* XBEE_BAUD_RATE */
+#define RF_BYTES_PER_S      2500        /* 900 MHz XBee-PRO at 20 kbit/s less RF framing */
+#define RF_OVERHEAD_US      4000        /* per RF packet, preamble and MAC acknowledgement */
+#define POLL_INTERVAL_US    20000       /* TELEMETRY_POLL_INTERVAL */
+#define STATUS_TIMEOUT      1000        /* XBEE_STATUS_TIMEOUT */
+
+static uint32_t rng_state = 0x2545F491;
+
+static uint32_t uniform(uint32_t range) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state % range;
+}
+
+/*
+ * the simulated clock, UART and radio
+ */
+
+static uint64_t sim_us = 0;
+
+uint32_t millis() {
+    return (uint32_t) (sim_us / 1000);
+}
+
+uint32_t micros() {
+    return (uint32_t) sim_us;
+}
+
+typedef struct {
+    uint8_t id;
+    std::vector<uint8_t> payload;
+} rf_packet_t;
+
+static struct {
+    size_t tx_size = 128;
+    std::deque<uint8_t> tx;             /* UART TX ring */
+    std::deque<uint8_t> rx;             /* radio to ESP32 */
+    uint64_t uart_us = 0;               /* time the UART has sent up to */
+
+    xbee_parser_t parser;               /* the radio's side of the UART */
+    xbee_frame_t frame;
+    std::deque<rf_packet_t> air;        /* transmit requests waiting for the air */
+    uint64_t air_free_us = 0;
+
+    uint32_t fail_percent = 0;          /* deliveries reported as failed */
+    uint32_t lose_status_percent = 0;   /* transmit status frames that never come back */
+    std::vector<uint8_t> ground;        /* bytes received by the ground station */
+    size_t max_tx_ring = 0;
+} sim;
+
+/* transmit status frame, escaped as in API mode 2 */
+static void radio_status(uint8_t id, uint8_t delivery) {
+    uint8_t data[] = { XBEE_API_TX_STATUS, id, 0xFF, 0xFE, 0, delivery, 0 };
+    uint8_t sum = 0;
+    std::vector<uint8_t> frame = { XBEE_START_DELIMITER, 0, sizeof(data) };
+
+    for(uint8_t byte : data) {
+        sum += byte;
+    }
+
+    auto put = [&](uint8_t byte) {
+        if(byte == XBEE_START_DELIMITER || byte == XBEE_ESCAPE || byte == XBEE_XON || byte == XBEE_XOFF) {
+            frame.push_back(XBEE_ESCAPE);
+            byte ^= XBEE_ESCAPE_XOR;
+        }
+        frame.push_back(byte);
+    };
+
+    for(uint8_t byte : data) {
+        put(byte);
+    }
+    put(0xFF - sum);
+
+    sim.rx.insert(sim.rx.end(), frame.begin(), frame.end());
+}
+
+static uint64_t air_time_us(const rf_packet_t* packet) {
+    return RF_OVERHEAD_US + packet->payload.size() * 1000000ULL / RF_BYTES_PER_S;
+}
+
+/* run the UART and the radio up to to_us */
+static void advance(uint64_t to_us) {
+    const uint64_t byte_us = 10 * 1000000ULL / BAUD_RATE;
+
+    while(true) {
+        uint64_t next_byte = sim.tx.empty() ? UINT64_MAX : sim.uart_us + byte_us;
+        uint64_t next_air = sim.air.empty() ? UINT64_MAX : sim.air_free_us + air_time_us(&sim.air.front());
+
+        if(std::min(next_byte, next_air) > to_us) {
+            break;
+        }
+
+        if(next_byte <= next_air) {
+            sim.uart_us = next_byte;
+            uint8_t byte = sim.tx.front();
+            sim.tx.pop_front();
+
+            if(xbee_parser_feed(&sim.parser, byte, &sim.frame) && sim.frame.api_id == XBEE_API_TX_REQUEST) {
+                rf_packet_t packet;
+                packet.id = sim.frame.data[0];
+                packet.payload.assign(sim.frame.data + XBEE_TX_REQUEST_OVERHEAD - 1, sim.frame.data + sim.frame.length);
+                if(sim.air.empty() && sim.air_free_us < sim.uart_us) {
+                    sim.air_free_us = sim.uart_us;
+                }
+                sim.air.push_back(packet);
+            }
+        } else {
+            rf_packet_t packet = sim.air.front();
+            sim.air.pop_front();
+            sim.air_free_us = next_air;
+
+            bool failed = uniform(100) < sim.fail_percent;
+            if(!failed) {
+                sim.ground.insert(sim.ground.end(), packet.payload.begin(), packet.payload.end());
+            }
+            if(uniform(100) >= sim.lose_status_percent) {
+                radio_status(packet.id, failed ? 0x21 : XBEE_DELIVERY_SUCCESS);
+            }
+        }
+    }
+
+    sim_us = to_us;
+}
+
+size_t HardwareSerial::setTxBufferSize(size_t size) {
+    sim.tx_size = size;
+    return size;
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rx_pin, int8_t tx_pin) {
+    (void) baud; (void) config; (void) rx_pin; (void) tx_pin;
+    sim.uart_us = sim_us;
+}
+
+int HardwareSerial::available() {
+    return (int) sim.rx.size();
+}
+
+int HardwareSerial::read() {
+    if(sim.rx.empty()) {
+        return -1;
+    }
+    uint8_t byte = sim.rx.front();
+    sim.rx.pop_front();
+    return byte;
+}
+
+int HardwareSerial::availableForWrite() {
+    return (int) (sim.tx_size - sim.tx.size());
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    // the driver blocks when the ring is full, the transport must never let that happen
+    if(size > sim.tx_size - sim.tx.size()) {
+        printf("    write of %lu bytes with only %lu free would block\n", (unsigned long) size, (unsigned long) (sim.tx_size - sim.tx.size()));
+        failures++;
+        size = sim.tx_size - sim.tx.size();
+    }
+
+    if(sim.tx.empty()) {
+        sim.uart_us = std::max(sim.uart_us, sim_us);
+    }
+    sim.tx.insert(sim.tx.end(), buffer, buffer + size);
+    sim.max_tx_ring = std::max(sim.max_tx_ring, sim.tx.size());
+    return size;
+}
+
+static void sim_reset() {
+    sim.tx.clear();
+    sim.rx.clear();
+    sim.air.clear();
+    sim.ground.clear();
+    sim.uart_us = sim_us;
+    sim.air_free_us = sim_us;
+    sim.fail_percent = 0;
+    sim.lose_status_percent = 0;
+    sim.max_tx_ring = 0;
+    xbee_parser_init(&sim.parser);
+}
+
+/*
+ * messages, rows of "<message>,<row>,<rows in message>,<padding>\n" like a telemetry batch
+ */
+
+typedef struct {
+    uint32_t sent_us;
+    size_t rows;
+    uint8_t accepted;
+} message_t;
+
+static size_t build_message(char* out, uint32_t number, size_t rows) {
+    size_t length = 0;
+    for(size_t r = 0; r < rows; r++) {
+        length += sprintf(out + length, "%u,%lu,%lu,-0.42,0.13,9.81,1.25,-0.50,12.50,-3.25,-1.292100,36.821900,1795,82123.45,24.50\n",
+                          number, (unsigned long) r, (unsigned long) rows);
+    }
+    return length;
+}
+
+typedef struct {
+    uint32_t accepted;
+    uint32_t refused;
+    uint32_t delivered;
+    uint32_t gaps;                      /* rows missing, lost with a failed frame */
+    uint32_t out_of_order;              /* rows repeated, going backwards or never sent */
+    uint32_t max_latency_ms;
+    uint32_t median_latency_ms;
+    double payload_rate;
+} run_result_t;
+
+/* check the ground stream row by row, a message is delivered with its last row */
+static void ground_check(std::vector<message_t>& messages, run_result_t* result, uint64_t* delivered_at) {
+    std::vector<uint32_t> latencies;
+    int64_t last_message = -1;
+    int64_t last_row = -1;
+    size_t start = 0;
+
+    for(size_t i = 0; i < sim.ground.size(); i++) {
+        if(sim.ground[i] != '\n') {
+            continue;
+        }
+
+        unsigned number;
+        unsigned long row, rows;
+        int fields = sscanf((const char*) &sim.ground[start], "%u,%lu,%lu", &number, &row, &rows);
+        start = i + 1;
+
+        if(fields != 3 || number >= messages.size()) {
+            result->out_of_order++;
+            continue;
+        }
+
+        if((int64_t) number < last_message || ((int64_t) number == last_message && (int64_t) row <= last_row)) {
+            result->out_of_order++;
+        } else if((int64_t) number == last_message ? (int64_t) row != last_row + 1 : row != 0) {
+            result->gaps++;
+        } else {
+            // a message skipped between the last one and this one must have been refused
+            for(int64_t m = last_message + 1; m < (int64_t) number; m++) {
+                if(messages[m].accepted) {
+                    result->gaps++;
+                }
+            }
+        }
+        last_message = number;
+        last_row = row;
+
+        if(row + 1 == rows) {
+            uint32_t latency = (uint32_t) ((delivered_at[number] - messages[number].sent_us) / 1000);
+            latencies.push_back(latency);
+            result->delivered++;
+        }
+    }
+
+    for(size_t m = 0; m < messages.size(); m++) {
+        if(!messages[m].accepted && delivered_at[m] != 0) {
+            result->out_of_order++;
+        }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    result->max_latency_ms = latencies.empty() ? 0 : latencies.back();
+    result->median_latency_ms = latencies.empty() ? 0 : latencies[latencies.size() / 2];
+}
+
+/* the telemetry task: a batch of rows every interval_us, the link polled every 20 ms */
+static run_result_t run(XBeeTransport* xbee, size_t rows_per_batch, uint32_t interval_us, uint32_t duration_us) {
+    static char payload[4096];
+    static uint64_t delivered_at[4096];
+    std::vector<message_t> messages;
+    run_result_t result = {};
+    uint64_t start = sim_us;
+    uint64_t next_batch = sim_us;
+    size_t ground_seen = 0;
+
+    memset(delivered_at, 0, sizeof(delivered_at));
+
+    while(sim_us < start + duration_us + 3000000ULL) {
+        if(sim_us >= next_batch && sim_us < start + duration_us) {
+            message_t m = { (uint32_t) sim_us, rows_per_batch, 0 };
+            size_t length = build_message(payload, (uint32_t) messages.size(), rows_per_batch);
+            m.accepted = xbee->send((const uint8_t*) payload, length) != TELEMETRY_REFUSED;
+            if(m.accepted) {
+                result.accepted++;
+            } else {
+                result.refused++;
+            }
+            messages.push_back(m);
+            next_batch += interval_us;
+        }
+
+        advance(sim_us + POLL_INTERVAL_US);
+        xbee->poll();
+
+        // note when the last row of each message reached the ground
+        for(; ground_seen < sim.ground.size(); ground_seen++) {
+            if(sim.ground[ground_seen] != '\n') {
+                continue;
+            }
+            size_t line_start = ground_seen;
+            while(line_start > 0 && sim.ground[line_start - 1] != '\n') {
+                line_start--;
+            }
+            unsigned number;
+            unsigned long row, rows;
+            if(sscanf((const char*) &sim.ground[line_start], "%u,%lu,%lu", &number, &row, &rows) == 3 && row + 1 == rows && number < 4096) {
+                delivered_at[number] = sim_us;
+            }
+        }
+    }
+
+    ground_check(messages, &result, delivered_at);
+    result.payload_rate = result.delivered * (double) (messages.empty() ? 0 : build_message(payload, 0, rows_per_batch)) * 1e6 / duration_us;
+    return result;
+}
+
+static void print_result(const char* name, const run_result_t* r, const XBeeTransport* xbee) {
+    printf("    %-22s %4lu accepted %4lu refused %4lu delivered, %5.0f B/s, latency median %4lu ms max %4lu ms\n",
+           name, (unsigned long) r->accepted, (unsigned long) r->refused, (unsigned long) r->delivered, r->payload_rate,
+           (unsigned long) r->median_latency_ms, (unsigned long) r->max_latency_ms);
+    printf("    %-22s frames sent %lu delivered %lu failed %lu timed out %lu, partial writes %lu, UART ring peak %lu B\n", "",
+           (unsigned long) xbee->stats.frames_sent, (unsigned long) xbee->stats.frames_delivered,
+           (unsigned long) xbee->stats.frames_failed, (unsigned long) xbee->stats.frames_timed_out,
+           (unsigned long) xbee->stats.partial_writes, (unsigned long) sim.max_tx_ring);
+}
+
+int main() {
+    HardwareSerial serial;
+
+    printf("1 KB batch through the %d byte UART ring of an idle radio\n", XBEE_UART_TX_SIZE);
+    {
+        static XBeeTransport xbee(serial, 35, 2, 0xFFFF, STATUS_TIMEOUT);
+        sim_reset();
+        xbee.begin();
+
+        run_result_t r = run(&xbee, 9, 1000000, 1000000);
+        print_result("one batch", &r, &xbee);
+        check(r.accepted == 1 && r.delivered == 1 && r.gaps == 0 && r.out_of_order == 0, "accepted and delivered whole, though larger than the ring");
+        check(sim.max_tx_ring <= XBEE_UART_TX_SIZE && xbee.stats.partial_writes > 0, "written in parts as the ring drains");
+        check(xbee.stats.frames_delivered == xbee.stats.frames_sent && xbee.stats.frames_timed_out == 0, "every frame acknowledged");
+    }
+
+    printf("throughput and latency, a batch every second for 120 s\n");
+    {
+        static XBeeTransport xbee(serial, 35, 2, 0xFFFF, STATUS_TIMEOUT);
+        sim_reset();
+        xbee.begin();
+
+        // 4 rows of ~100 B a second, about half of the 9600 baud UART
+        run_result_t r = run(&xbee, 4, 1000000, 120000000);
+        print_result("half the link", &r, &xbee);
+        check(r.refused == 0 && r.delivered == r.accepted && r.gaps == 0 && r.out_of_order == 0, "every message delivered once and in order");
+        check(r.max_latency_ms < 1000, "latency under a second");
+        check(xbee.stats.frames_timed_out == 0, "no transmit status timed out");
+    }
+    {
+        static XBeeTransport xbee(serial, 35, 2, 0xFFFF, STATUS_TIMEOUT);
+        sim_reset();
+        xbee.begin();
+
+        // 3 rows every 200 ms, more than the link carries
+        run_result_t r = run(&xbee, 3, 200000, 120000000);
+        print_result("over the link", &r, &xbee);
+        check(r.delivered == r.accepted && r.gaps == 0 && r.out_of_order == 0, "accepted messages delivered once and in order");
+        check(r.refused > 0, "messages refused once the staging buffer is full");
+        check(r.payload_rate > 0.8 * BAUD_RATE / 10, "over 80% of the UART rate carried as payload");
+        check(xbee.stats.frames_timed_out == 0, "frames waiting to be written do not time out");
+    }
+
+    printf("failed deliveries and lost transmit status\n");
+    {
+        static XBeeTransport xbee(serial, 35, 2, 0xFFFF, STATUS_TIMEOUT);
+        sim_reset();
+        xbee.begin();
+        sim.fail_percent = 10;
+        sim.lose_status_percent = 5;
+
+        run_result_t r = run(&xbee, 4, 1000000, 120000000);
+        print_result("lossy link", &r, &xbee);
+
+        uint32_t accounted = xbee.stats.frames_delivered + xbee.stats.frames_failed + xbee.stats.frames_timed_out;
+        check(accounted == xbee.stats.frames_sent, "every frame delivered, failed or timed out");
+        check(xbee.stats.frames_failed > xbee.stats.frames_sent / 20 && xbee.stats.frames_failed < xbee.stats.frames_sent / 6, "failed deliveries counted, about 10%");
+        check(xbee.stats.frames_timed_out > 0 && xbee.stats.frames_timed_out < xbee.stats.frames_sent / 10, "lost status frames time out, about 5%");
+        check(r.gaps > 0 && r.out_of_order == 0, "rows of failed frames missing, no row out of order or twice");
+    }
+
+    return check_summary();
+}